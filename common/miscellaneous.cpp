@@ -25,8 +25,6 @@
 #include <cstdint> // rand
 #include <cstdio> // popen
 #include <cstring> // strerror
-#include <event2/event.h> // libevent_global_shutdown
-#include <event2/thread.h> // evthread_use_pthreads
 #include <iostream>
 #include <libgen.h>
 #include <memory>
@@ -483,36 +481,6 @@ string git_last_commit(){
     return git_read_last_commit();
 }
 
-/*********************************************************************************************************************
- *                                                                                                                   *
- *  libevent                                                                                                         *
- *                                                                                                                   *
- *********************************************************************************************************************/
-static int g_libevent_active_clients = 0; // number of invocations libevent_init - invocations to libevent_shutdown
-static mutex g_libevent_mutex; // concurrency protection for multiple invocations to libevent_init and libevent_shutdown
-
-void libevent_init(){
-    scoped_lock<mutex> lock(g_libevent_mutex);
-    assert(g_libevent_active_clients >= 0 && "Negative counter");
-    if(g_libevent_active_clients > 0){
-        g_libevent_active_clients += 1;
-    } else {
-        int rc = evthread_use_pthreads();
-        if(rc != 0) RAISE_EXCEPTION(Exception, "[libevent_init] Cannot initialise the library");
-        assert(g_libevent_active_clients == 0 && "Multiple inits of the same library?");
-        g_libevent_active_clients = 1;
-    }
-}
-
-void libevent_shutdown(){
-    scoped_lock<mutex> lock(g_libevent_mutex);
-    assert(g_libevent_active_clients >= 0 && "Negative counter");
-    if(g_libevent_active_clients == 1){
-       libevent_global_shutdown(); // it doesn't return anything
-    }
-    g_libevent_active_clients -= 1;
-}
-
 /*********************************************************************************************************************
  *                                                                                                                   *
  *  Miscellaneous                                                                                                    *
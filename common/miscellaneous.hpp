@@ -252,16 +252,6 @@ struct timeval duration2timeval(Duration duration){
  */
 int memfd_create(const char* name, unsigned int flags);
 
-/**
- * Initialise the library libevent. If the library has been already initialised, this call is ignored.
- */
-void libevent_init();
-
-/**
- * Shutdown the library libevent. This should be invoked once for each call to libevent_init().
- */
-void libevent_shutdown();
-
 } // namespace common
 
 #endif /* COMMON_MISCELLANEOUS_HPP_ */
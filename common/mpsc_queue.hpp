@@ -0,0 +1,242 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMON_MPSC_QUEUE_HPP_
+#define COMMON_MPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cinttypes>
+#include <deque>
+#include <linux/futex.h>
+#include <mutex>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace common {
+
+/**
+ * A bounded multi-producer/single-consumer queue.
+ *
+ * Producers reserve a slot in a ring buffer with a single CAS on the tail and publish the item through the sequence number
+ * of the slot (D. Vyukov's bounded queue). The consumer fetches the items in batches, without any atomic RMW. When the
+ * ring is full, producers fall back to an overflow list protected by a mutex. Once the overflow list is not empty, all
+ * producers keep appending to it until the consumer drains it, to preserve the order of the items sent by the same producer.
+ * For the same reason, the consumer drains the overflow list only after it fetched all the cells reserved in the ring.
+ *
+ * The consumer can block on a doorbell (a futex) when the queue is empty. Producers only issue a system call to
+ * ring the doorbell when the consumer is actually sleeping.
+ *
+ * The type T must be trivially copyable.
+ */
+template<typename T>
+class MPSCQueue {
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    struct Cell {
+        std::atomic<uint64_t> m_sequence; // the position of the item in the queue, tells whether the cell is ready for the producer or the consumer
+        T m_value; // the item stored
+    };
+
+    Cell* m_cells; // the ring buffer
+    const uint64_t m_mask; // capacity -1
+    alignas(64) std::atomic<uint64_t> m_tail; // next position for the producers
+    alignas(64) uint64_t m_head; // next position for the consumer
+    alignas(64) std::atomic<uint64_t> m_overflow_size; // number of items in the overflow list
+    std::mutex m_overflow_mutex; // protect the overflow list
+    std::deque<T> m_overflow; // items appended when the ring was full
+    alignas(64) std::atomic<int> m_doorbell; // 1 if the consumer is sleeping, or it's about to sleep, 0 otherwise
+
+    // Attempt to append the item in the ring buffer. Return false if the buffer is full.
+    bool push_ring(const T& item){
+        uint64_t position = m_tail.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while(true){
+            cell = m_cells + (position & m_mask);
+            uint64_t sequence = cell->m_sequence.load(std::memory_order_acquire);
+            int64_t difference = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+            if(difference == 0){ // the cell is free
+                if(m_tail.compare_exchange_weak(position, position +1, std::memory_order_relaxed)) break;
+            } else if (difference < 0){ // full
+                return false;
+            } else { // another producer took this cell
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->m_value = item;
+        cell->m_sequence.store(position +1, std::memory_order_release);
+        return true;
+    }
+
+    // Append the item in the overflow list
+    void push_overflow(const T& item){
+        std::scoped_lock<std::mutex> lock(m_overflow_mutex);
+        m_overflow.push_back(item);
+        m_overflow_size.store(m_overflow.size(), std::memory_order_release);
+    }
+
+    // Wake up the consumer, if it's sleeping
+    void ring_doorbell(){
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in #wait_and_pop
+        if(m_doorbell.load(std::memory_order_relaxed) != 0 && m_doorbell.exchange(0) != 0){
+            syscall(SYS_futex, reinterpret_cast<int*>(&m_doorbell), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+        }
+    }
+
+public:
+    /**
+     * Create a new queue with the given capacity for the ring buffer. It must be a power of 2.
+     */
+    MPSCQueue(uint64_t capacity = 1024) : m_cells(nullptr), m_mask(capacity -1), m_tail(0), m_head(0), m_overflow_size(0), m_doorbell(0) {
+        if(capacity < 2 || (capacity & (capacity -1)) != 0) throw std::invalid_argument("[MPSCQueue] The capacity must be a power of 2");
+        m_cells = new Cell[capacity];
+        for(uint64_t i = 0; i < capacity; i++){
+            m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Destructor
+     */
+    ~MPSCQueue(){
+        delete[] m_cells; m_cells = nullptr;
+    }
+
+    /**
+     * Append an item in the queue. It can be invoked concurrently by multiple producers.
+     */
+    void push(const T& item){
+        if(m_overflow_size.load(std::memory_order_acquire) > 0 || !push_ring(item)){
+            push_overflow(item);
+        }
+        ring_doorbell();
+    }
+
+    /**
+     * Fetch up to `max_items' from the queue, without blocking. Only the consumer can invoke this method.
+     * @return the number of items copied into the buffer
+     */
+    uint64_t pop(T* buffer, uint64_t max_items){
+        assert(buffer != nullptr && "Null pointer");
+        uint64_t num_items = 0;
+
+        // fetch the items from the ring buffer
+        while(num_items < max_items){
+            Cell* cell = m_cells + (m_head & m_mask);
+            if(cell->m_sequence.load(std::memory_order_acquire) != m_head +1) break; // no more items ready
+            buffer[num_items++] = cell->m_value;
+            cell->m_sequence.store(m_head + m_mask +1, std::memory_order_release); // release the cell to the producers
+            m_head++;
+        }
+
+        // fetch the items from the overflow list, only once the ring is really empty. A producer may have reserved a
+        // cell without having published its item yet, and its following items could already be in the overflow list
+        if(num_items < max_items && m_overflow_size.load(std::memory_order_acquire) > 0 && m_head == m_tail.load(std::memory_order_acquire)){
+            std::scoped_lock<std::mutex> lock(m_overflow_mutex);
+            while(num_items < max_items && !m_overflow.empty()){
+                buffer[num_items++] = m_overflow.front();
+                m_overflow.pop_front();
+            }
+            m_overflow_size.store(m_overflow.size(), std::memory_order_release);
+        }
+
+        return num_items;
+    }
+
+    /**
+     * Fetch up to `max_items' from the queue. If the queue is empty, wait on the doorbell until at least
+     * one item is available. Only the consumer can invoke this method.
+     * @return the number of items copied into the buffer, always > 0
+     */
+    uint64_t wait_and_pop(T* buffer, uint64_t max_items){
+        assert(max_items > 0 && "The buffer must be able to contain at least one item");
+        while(true){
+            uint64_t num_items = pop(buffer, max_items);
+            if(num_items > 0) return num_items;
+
+            // announce we're going to sleep, and check again the queue to avoid a lost wake up
+            m_doorbell.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in #ring_doorbell
+            num_items = pop(buffer, max_items);
+            if(num_items > 0){
+                m_doorbell.store(0, std::memory_order_relaxed);
+                return num_items;
+            }
+
+            syscall(SYS_futex, reinterpret_cast<int*>(&m_doorbell), FUTEX_WAIT_PRIVATE, 1, nullptr, nullptr, 0); // Zzz
+            m_doorbell.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Fetch up to `max_items' from the queue. If the queue is empty, wait on the doorbell until at least one item is
+     * available or the given timeout expires. Only the consumer can invoke this method.
+     * @return the number of items copied into the buffer, 0 if the timeout expired
+     */
+    template<typename Duration>
+    uint64_t wait_and_pop(T* buffer, uint64_t max_items, Duration timeout){
+        assert(max_items > 0 && "The buffer must be able to contain at least one item");
+        using namespace std::chrono;
+        const auto deadline = steady_clock::now() + timeout;
+        while(true){
+            uint64_t num_items = pop(buffer, max_items);
+            if(num_items > 0) return num_items;
+
+            auto now = steady_clock::now();
+            if(now >= deadline) return 0;
+            uint64_t nanosecs = duration_cast<nanoseconds>(deadline - now).count();
+            struct timespec relative_timeout;
+            relative_timeout.tv_sec = nanosecs / 1000000000ull;
+            relative_timeout.tv_nsec = nanosecs % 1000000000ull;
+
+            // as #wait_and_pop(buffer, max_items)
+            m_doorbell.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            num_items = pop(buffer, max_items);
+            if(num_items > 0){
+                m_doorbell.store(0, std::memory_order_relaxed);
+                return num_items;
+            }
+
+            syscall(SYS_futex, reinterpret_cast<int*>(&m_doorbell), FUTEX_WAIT_PRIVATE, 1, &relative_timeout, nullptr, 0); // Zzz
+            m_doorbell.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Check whether the queue is empty. Only reliable when invoked by the consumer.
+     */
+    bool empty() const {
+        return m_head == m_tail.load(std::memory_order_acquire) && m_overflow_size.load(std::memory_order_acquire) == 0;
+    }
+
+    /**
+     * The capacity of the ring buffer
+     */
+    uint64_t capacity() const {
+        return m_mask +1;
+    }
+};
+
+} // namespace common
+
+#endif /* COMMON_MPSC_QUEUE_HPP_ */
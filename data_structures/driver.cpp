@@ -22,6 +22,7 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "factory.hpp"
@@ -32,6 +33,8 @@
 #include "common/errorhandling.hpp"
 #include "common/miscellaneous.hpp"
 
+#include "experiments/gate_contention.hpp"
+#include "experiments/index_routing.hpp"
 #include "experiments/interface.hpp"
 #include "experiments/parallel_idls.hpp"
 #include "experiments/parallel_insert.hpp"
@@ -47,6 +50,8 @@
 #include "rma/baseline/packed_memory_array.hpp"
 #include "rma/batch_processing/packed_memory_array.hpp"
 #include "rma/common/knobs.hpp"
+#include "rma/common/learned_index.hpp"
+#include "rma/common/segment_kernels.hpp"
 #include "rma/one_by_one/packed_memory_array.hpp"
 
 using namespace std;
@@ -138,6 +143,15 @@ void initialise() {
         return algorithm;
     });
 
+    PARAMETER(string, "apma_update_mode").hint("sync|async|ryw").set_default("async")
+            .descr("How a writer handles an update when its gate is busy: `sync' waits for the gate, `async' forwards the update to the writer already operating "
+                    "on the gate, `ryw' (read your writes) forwards the update and waits for it to be applied. Only used in the algorithm `rma_1by1'")
+            .validate_fn([](const std::string& mode){
+        if(mode != "sync" && mode != "async" && mode != "ryw")
+            RAISE_EXCEPTION(configuration::ConsoleArgumentError, "Invalid update mode: " << mode);
+        return true;
+    });
+
     REGISTER_DATA_STRUCTURE("rma_1by1", "Parallel version of APMA/int3 (with Katriel's thresholds). This version includes asynchronous writes to minimise "
             "the number of writers locked in a gate. Set the size of an extent with the option --extent_size=N", [](){
         uint64_t iB = ARGREF(uint64_t, "iB");
@@ -158,10 +172,47 @@ void initialise() {
         auto argument_rank = ARGREF(double, "apma_rank");
         if(argument_rank.is_set()){ algorithm->knobs().m_rank_threshold = argument_rank.get(); }
 
+        // Synchronous or asynchronous updates
+        string update_mode = ARGREF(string, "apma_update_mode").get();
+        LOG_VERBOSE("[rma_1by1] update mode: " << update_mode);
+        using UpdateMode = rma::one_by_one::PackedMemoryArray::UpdateMode;
+        if(update_mode == "sync"){
+            algorithm->set_update_mode(UpdateMode::SYNC);
+        } else if(update_mode == "ryw"){
+            algorithm->set_update_mode(UpdateMode::ASYNC_READ_YOUR_WRITES);
+        } else {
+            algorithm->set_update_mode(UpdateMode::ASYNC);
+        }
+
         return algorithm;
     });
 
     PARAMETER(uint64_t, "delay").descr("The minimum amount of time to delay a rebalance in apma_parallel3, in milliseconds").set_default(0);
+    PARAMETER(uint64_t, "apma_master_shards").descr("Number of coordinators in the Rebalancer, each in charge of a disjoint range of gates. It must be a power of 2. Only used in the algorithm `rma_batch'")
+            .set_default(1).validate_fn([](uint64_t value){ return value >= 1 && is_power_of_2(value); });
+    PARAMETER(bool, "delay_adaptive").descr("Tune the delay of the rebalances at runtime, for each gate, up to --delay milliseconds (default: 100 ms). Only used in the algorithm `rma_batch'");
+    PARAMETER(bool, "apma_lazy_deletes").descr("Deletions only mark the removed elements with a tombstone, physically removed by the next insertion or rebalance in the same segment. Only used in the algorithm `rma_batch'");
+    PARAMETER(double, "apma_density").hint("(0, 1)").descr("The upper density at the root of the calibrator tree, once the array grows beyond the thresholds switch. With --apma_density_tuner, its initial value. Only used in the algorithm `rma_batch'")
+            .set_default(0.75).validate_fn([](double value){ return value > 0 && value < 1; });
+    PARAMETER(bool, "apma_adaptive").descr("Sample the updates into a detector and skew the distribution of the elements in the rebalances, leaving more room to the segments hammered by sequential insertions, as in APMA. The sampling rate is set with --apma_sampling_rate. Only used in the algorithm `rma_batch'");
+    PARAMETER(bool, "apma_density_tuner").descr("Revise the upper density of the primary thresholds at each resize, according to the mix of updates & scans and the cost of the rebalances observed, within [0.6, 0.9]. Only used in the algorithm `rma_batch'");
+    PARAMETER(bool, "apma_online_resize").descr("While the array is being resized, readers keep accessing the old storage and writers defer their updates, rather than waiting for the resize to complete. Only used in the algorithm `rma_batch'");
+    PARAMETER(bool, "apma_rebalance_snapshots").descr("Copy a window before rebalancing it, the point lookups & sums arriving in the meanwhile read from the copy rather than waiting for the rebalance to complete. Only used in the algorithm `rma_batch'");
+    PARAMETER(bool, "apma_append").descr("Stage the runs of increasing keys inserted by a thread in a private buffer, appended in batches at the end of the related gates. The staged elements become visible to the other threads when the buffer is flushed. Only used in the algorithm `rma_batch'");
+    PARAMETER(uint64_t, "apma_delta_buffer").descr("Capacity of the delta buffer of each gate. The insertions are absorbed by a small sorted buffer, merged on the fly by the readers and flushed into the segments in a single spread once full or when the gate is rebalanced. 0 disables the buffers. Only used in the algorithm `rma_batch'")
+            .set_default(0);
+    PARAMETER(uint64_t, "apma_filters").descr("Number of bits per element of the Bloom filter attached to each segment. The point lookups for missing keys are answered by the filter, without scanning the segment. 0 disables the filters. Only used in the algorithm `rma_batch'")
+            .set_default(0).validate_fn([](uint64_t value){ return value <= 64; });
+    PARAMETER(uint64_t, "apma_read_cache").descr("Number of entries of the cache for the point lookups of the hot keys. The cached values are validated against the version of their gate, bumped by any writer or rebalance. 0 disables the cache. Only used in the algorithm `rma_batch'")
+            .set_default(0);
+    PARAMETER(string, "apma_search").hint("linear|simd|binary|interpolation|adaptive").set_default("binary")
+            .descr("How to search a key inside the segments and the gates: linear scan, vectorised linear scan, branch-free binary search, interpolation search with a linear fallback, or adaptive, choosing per segment according to the spread of its keys. Only used in the algorithm `rma_batch'")
+            .validate_fn([](const std::string& strategy){
+        if(strategy != "linear" && strategy != "simd" && strategy != "binary" && strategy != "interpolation" && strategy != "adaptive")
+            RAISE_EXCEPTION(configuration::ConsoleArgumentError, "Invalid search strategy: " << strategy);
+        return true;
+    });
+    PARAMETER(bool, "apma_learned_index").descr("Route the keys to the gates with a learned index, piecewise linear models over the separator keys with a bounded error, rather than a static B-Tree. Only used in the algorithm `rma_batch'");
 
     REGISTER_DATA_STRUCTURE("rma_batch", "Parallel version of APMA/int3 (with Katriel's thresholds). This version includes asynchronous writes to minimise "
             "the number of writers locked in a gate. Set the size of an extent with the option --extent_size=N", [](){
@@ -174,16 +225,57 @@ void initialise() {
         uint64_t worker_threads_rebalancer = ARGREF(uint64_t, "apma_rebalancing_threads");
         uint64_t segments_per_lock = ARGREF(uint64_t, "apma_segments_per_lock");
         auto rebal_delay = chrono::milliseconds(ARGREF(uint64_t, "delay"));
-        LOG_VERBOSE("[rma_batch] index block size (iB): " << iB << ", segment size (lB): " << lB << ", "
+        rma::batch_processing::Options options;
+        options.m_num_master_shards = ARGREF(uint64_t, "apma_master_shards");
+        ARGREF(bool, "delay_adaptive").get(options.m_adaptive_delay);
+        if(options.m_adaptive_delay && rebal_delay.count() == 0){ rebal_delay = 100ms; } // the max delay for a gate
+        ARGREF(bool, "apma_lazy_deletes").get(options.m_lazy_deletes);
+        double density = ARGREF(double, "apma_density");
+        ARGREF(bool, "apma_density_tuner").get(options.m_adaptive_densities);
+        ARGREF(bool, "apma_adaptive").get(options.m_adaptive_rebalancing);
+        ARGREF(bool, "apma_online_resize").get(options.m_online_resize);
+        ARGREF(bool, "apma_rebalance_snapshots").get(options.m_rebalance_snapshots);
+        ARGREF(bool, "apma_append").get(options.m_append_fastpath);
+        ARGREF(bool, "apma_learned_index").get(options.m_learned_index);
+        options.m_delta_buffer_capacity = ARGREF(uint64_t, "apma_delta_buffer");
+        options.m_filter_bits_per_key = ARGREF(uint64_t, "apma_filters");
+        options.m_read_cache_capacity = ARGREF(uint64_t, "apma_read_cache");
+        LOG_VERBOSE("[rma_batch] index block size (iB): " << iB << ", segment size (lB): " << lB << (rma::common::segment_kernels::is_specialised(lB) ? " (specialised kernels)" : "") << ", "
                 "extent size: " << extent_mult << " (" << get_memory_page_size() * extent_mult << " bytes), "
                         "worker threads in the rebalancer: " << worker_threads_rebalancer << ", "
-                        "segments per lock: " << segments_per_lock << ", rebalancer delay: " << rebal_delay.count());
-        auto algorithm = make_unique<rma::batch_processing::PackedMemoryArray>(iB, lB, extent_mult, worker_threads_rebalancer, segments_per_lock, rebal_delay);
+                        "segments per lock: " << segments_per_lock << ", rebalancer delay: " << rebal_delay.count() << (options.m_adaptive_delay ? " (adaptive)" : "") << ", "
+                        "master shards: " << options.m_num_master_shards << ", lazy deletes: " << (options.m_lazy_deletes ? "yes" : "no") << ", "
+                        "primary density: " << density << (options.m_adaptive_densities ? " (adaptive)" : "") << ", online resize: " << (options.m_online_resize ? "yes" : "no") << ", "
+                        "rebalance snapshots: " << (options.m_rebalance_snapshots ? "yes" : "no") << ", adaptive rebalancing: " << (options.m_adaptive_rebalancing ? "yes" : "no") << ", append fast path: " << (options.m_append_fastpath ? "yes" : "no") << ", "
+                        "learned index: " << (options.m_learned_index ? "yes" : "no") << ", delta buffers: " << options.m_delta_buffer_capacity << ", "
+                        "lookup filters: " << options.m_filter_bits_per_key << " bits/key, read cache: " << options.m_read_cache_capacity << " entries");
+        auto algorithm = make_unique<rma::batch_processing::PackedMemoryArray>(iB, lB, extent_mult, worker_threads_rebalancer, segments_per_lock, rebal_delay, options);
+        algorithm->set_primary_density(density);
 
         // Rank threshold
         auto argument_rank = ARGREF(double, "apma_rank");
         if(argument_rank.is_set()){ algorithm->knobs().m_rank_threshold = argument_rank.get(); }
 
+        // Sampling rate for the detector, only used with --apma_adaptive
+        auto argument_sampling_rate = ARGREF(double, "apma_sampling_rate");
+        if(argument_sampling_rate.is_set()){ algorithm->knobs().set_sampling_rate(argument_sampling_rate.get()); }
+
+        // Search strategy inside the segments & gates
+        string search_strategy = ARGREF(string, "apma_search").get();
+        LOG_VERBOSE("[rma_batch] search strategy: " << search_strategy);
+        using SearchStrategy = rma::common::segment_kernels::SearchStrategy;
+        if(search_strategy == "linear"){
+            algorithm->knobs().m_search_strategy = SearchStrategy::LINEAR;
+        } else if(search_strategy == "simd"){
+            algorithm->knobs().m_search_strategy = SearchStrategy::SIMD_LINEAR;
+        } else if(search_strategy == "interpolation"){
+            algorithm->knobs().m_search_strategy = SearchStrategy::INTERPOLATION;
+        } else if(search_strategy == "adaptive"){
+            algorithm->knobs().m_search_strategy = SearchStrategy::ADAPTIVE;
+        } else {
+            algorithm->knobs().m_search_strategy = SearchStrategy::BINARY;
+        }
+
         return algorithm;
     });
 
@@ -228,6 +320,37 @@ void initialise() {
         auto param_thread_scans = ARGREF(uint64_t, "thread_scans");
         return make_unique<experiments::ParallelInsert>(data_structure, param_thread_inserts, param_thread_scans);
     });
+    /**
+     * Routing with the static & learned index of the RMA
+     */
+    PARAMETER(uint64_t, "index_segments").set_default(1ull << 16).descr("Number of separator keys (segments) in the indices compared by the experiment `index_routing'");
+    PARAMETER(uint64_t, "index_error_bound").set_default(rma::common::LearnedIndex::DEFAULT_ERROR_BOUND).descr("The bound on the error of the predictions of the learned index, in number of segments, in the experiment `index_routing'");
+    REGISTER_EXPERIMENT("index_routing", "Compare the static B-Tree and the learned index of the RMA in routing the keys to the segments, for each available distribution. "
+            "Use -I to set the number of keys generated, -L the number of lookups and --index_segments the number of separator keys. The parameter --algorithm is ignored.", [](shared_ptr<Interface> data_structure){
+        uint64_t num_segments = ARGREF(uint64_t, "index_segments");
+        int64_t num_lookups = ARGREF(int64_t, "L");
+        if(num_lookups <= 0) num_lookups = 10000000;
+        uint64_t node_size = ARGREF(uint64_t, "iB");
+        uint64_t error_bound = ARGREF(uint64_t, "index_error_bound");
+        uint64_t num_threads = thread::hardware_concurrency();
+        LOG_VERBOSE("index_routing, segments: " << num_segments << ", lookups: " << num_lookups << ", static index node size: " << node_size << ", learned index error bound: " << error_bound);
+        return make_unique<experiments::IndexRouting>(num_segments, num_lookups, node_size, error_bound, num_threads);
+    });
+
+    /**
+     * False sharing among the gates of the rma_batch
+     */
+    PARAMETER(uint64_t, "gate_threads").set_default(0).descr("Number of threads in the experiment `gate_contention', each operating on its own gate. 0 uses all the hardware threads");
+    REGISTER_EXPERIMENT("gate_contention", "Measure the false sharing among adjacent gates of the rma_batch, comparing the layout with the hot fields aligned to a cache line against the previous layout with all fields back to back. "
+            "Each thread repeatedly enters and leaves its own gate as a reader. Use -L to set the number of operations per thread and --gate_threads the number of threads. The parameter --algorithm is ignored.", [](shared_ptr<Interface> data_structure){
+        uint64_t num_threads = ARGREF(uint64_t, "gate_threads");
+        if(num_threads == 0) num_threads = thread::hardware_concurrency();
+        int64_t num_operations = ARGREF(int64_t, "L");
+        if(num_operations <= 0) num_operations = 10000000;
+        LOG_VERBOSE("gate_contention, threads: " << num_threads << ", operations per thread: " << num_operations);
+        return make_unique<experiments::GateContention>(num_threads, num_operations);
+    });
+
     REGISTER_EXPERIMENT("parallel_idls", "Perform `initial_size' insertions in the data structure at the start. Afterward perform `num_insertions' operations split in groups of `idls_group_size' consecutive inserts/deletes.",
         [](shared_ptr<Interface> data_structure){
         auto N_initial_inserts = ARGREF(int64_t, "initial_size");
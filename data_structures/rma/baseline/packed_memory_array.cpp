@@ -36,6 +36,7 @@
 #include "rma/common/buffered_rewired_memory.hpp"
 #include "rma/common/move_detector_info.hpp"
 #include "rma/common/rewired_memory.hpp"
+#include "rma/common/segment_kernels.hpp"
 #include "adaptive_rebalancing.hpp"
 #include "garbage_collector.hpp"
 #include "gate.hpp"
@@ -522,43 +523,19 @@ bool PackedMemoryArray::storage_insert_unsafe(size_t segment_id, int64_t key, in
     if(segment_id % 2 == 0){ // for even segment ids (0, 2, ...), insert at the end of the segment
         size_t stop = m_storage.m_segment_capacity -1;
         size_t start = m_storage.m_segment_capacity - sz -1;
-        size_t i = start;
-
-        while(i < stop && keys[i+1] < key){
-            keys[i] = keys[i+1];
-            i++;
-        }
+        size_t i = segment_kernels::insert_even(keys, values, m_storage.m_segment_capacity, sz, key, value);
 
 //        COUT_DEBUG("(even) segment_id: " << segment_id << ", start: " << start << ", stop: " << stop << ", key: " << key << ", value: " << value << ", position: " << i);
-        keys[i] = key;
-
-        for(size_t j = start; j < i; j++){
-            values[j] = values[j+1];
-        }
-        values[i] = value;
-
         minimum = (i == start);
         bool maximum = (i == stop);
 
         // update the detector
         predecessor = minimum ? std::numeric_limits<int64_t>::min() : keys[i -1];
         successor = maximum ? std::numeric_limits<int64_t>::max() : keys[i +1];
-
     } else { // for odd segment ids (1, 3, ...), insert at the front of the segment
-        size_t i = sz;
-        while(i > 0 && keys[i-1] > key){
-            keys[i] = keys[i-1];
-            i--;
-        }
+        size_t i = segment_kernels::insert_odd(keys, values, m_storage.m_segment_capacity, sz, key, value);
 
 //        COUT_DEBUG("(odd) segment_id: " << segment_id << ", key: " << key << ", value: " << value << ", position: " << i);
-        keys[i] = key;
-
-        for(size_t j = sz; j > i; j--){
-            values[j] = values[j-1];
-        }
-        values[i] = value;
-
         minimum = (i == 0);
         bool maximum = (i == sz);
 
@@ -627,8 +604,8 @@ bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
     int64_t successor = numeric_limits<int64_t>::max(); // to forward to the detector/predictor
 
     if (segment_id % 2 == 0) { // even
-        size_t imin = m_storage.m_segment_capacity - sz, i;
-        for(i = imin; i < m_storage.m_segment_capacity; i++){ if(keys[i] == key) break; }
+        size_t imin = m_storage.m_segment_capacity - sz;
+        size_t i = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, /* even ? */ true, key);
         if(i < m_storage.m_segment_capacity){ // found ?
             // to update the predictor/detector
             if(i > imin) predecessor = keys[i-1];
@@ -636,10 +613,7 @@ bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
 
             value = values[i];
             // shift the rest of the elements by 1
-            for(size_t j = i; j > imin; j--){
-                keys[j] = keys[j -1];
-                values[j] = values[j-1];
-            }
+            segment_kernels::remove_even(keys, values, m_storage.m_segment_capacity, sz, i);
 
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
@@ -655,8 +629,7 @@ bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
         } // end if (found)
     } else { // odd
         // find the key in the segment
-        size_t i = 0;
-        for( ; i < sz; i++){ if(keys[i] == key) break; }
+        size_t i = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, /* even ? */ false, key);
         if(i < sz){ // found?
             // to update the predictor/detector
             if(i > 0) predecessor = keys[i-1];
@@ -664,10 +637,7 @@ bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
 
             value = values[i];
             // shift the rest of the elements by 1
-            for(size_t j = i; j < sz - 1; j++){
-                keys[j] = keys[j+1];
-                values[j] = values[j+1];
-            }
+            segment_kernels::remove_odd(keys, values, sz, i);
 
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
@@ -1383,22 +1353,9 @@ int64_t PackedMemoryArray::do_find(Gate* gate, int64_t key) const{
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
     size_t sz = m_storage.m_segment_sizes[segment_id];
 
-    size_t start, stop;
-    if(segment_id % 2 == 0){ // even
-        stop = m_storage.m_segment_capacity;
-        start = stop - sz;
-    } else { // odd
-        start = 0;
-        stop = sz;
-    }
-
-    for(size_t i = start; i < stop; i++){
-        if(keys[i] == key){
-            return *(m_storage.m_values + segment_id * m_storage.m_segment_capacity + i);
-        }
-    }
-
-    return -1;
+    size_t i = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, /* even ? */ segment_id % 2 == 0, key);
+    if(i == m_storage.m_segment_capacity) return -1; // not found
+    return *(m_storage.m_values + segment_id * m_storage.m_segment_capacity + i);
 }
 
 Gate* PackedMemoryArray::find_on_entry(int64_t key) const {
@@ -1417,23 +1374,13 @@ int PackedMemoryArray::find_position(size_t segment_id, int64_t key) const noexc
     sz = min<size_t>(sz, m_storage.m_segment_capacity); // avoid overflow
 
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
-    int start, stop;
-
-    if(segment_id % 2 == 0){ // for even segment ids (0, 2, ...), the keys are at the end
-        start = m_storage.m_segment_capacity - sz;
-        stop = m_storage.m_segment_capacity;
-    } else { // odd segment ids (1, 3, ...), the keys are at the start of the segment
-        start = 0;
-        stop = sz;
-    }
-
-    for(int i = start; i < stop; i++){
-        if(keys[i] == key){
-            return i -start;
-        }
-    }
+    // for even segment ids (0, 2, ...), the keys are at the end; odd segment ids (1, 3, ...), the keys are at the start of the segment
+    const bool is_even = segment_id % 2 == 0;
+    const size_t start = is_even ? m_storage.m_segment_capacity - sz : 0;
 
-    return -1; // not found
+    size_t position = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, is_even, key);
+    if(position == m_storage.m_segment_capacity) return -1; // not found
+    return static_cast<int>(position - start);
 }
 
 /*****************************************************************************
@@ -1535,7 +1482,7 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
 
             // find the starting offset
             while(min_notfound && segment_begin < window_end){
-                while(start < stop && keys[start] < next_min){ start++; }
+                start += segment_kernels::lower_bound(keys + start, stop - start, next_min, 2 * m_storage.m_segment_capacity);
 
                 min_notfound = (start == stop);
                 if(min_notfound){
@@ -1568,7 +1515,7 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
                     int64_t index = end -1;
 
                     while(max_notfound && segment_end >= segment_begin){
-                        while(index >= stop && keys[index] > max) index--;
+                        if(index >= stop) index = stop + segment_kernels::upper_bound(keys + stop, index - stop +1, max, 2 * m_storage.m_segment_capacity) -1;
                         max_notfound = (index < stop);
                         if(max_notfound){
                             segment_end -= 2;
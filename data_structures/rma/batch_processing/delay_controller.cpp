@@ -0,0 +1,83 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "delay_controller.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include "gate.hpp"
+#include "thread_context.hpp"
+
+using namespace std;
+
+namespace data_structures::rma::batch_processing {
+
+DelayController::DelayController(chrono::microseconds max_delay, uint64_t backlog_capacity) :
+        m_max_delay(max_delay), m_backlog_capacity(backlog_capacity), m_rebalance_cost(0) {
+    if(max_delay.count() <= 0) throw std::invalid_argument("[DelayController::ctor] The maximum delay must be a positive quantity");
+    if(backlog_capacity == 0) throw std::invalid_argument("[DelayController::ctor] The backlog capacity must be a positive quantity");
+}
+
+chrono::steady_clock::time_point DelayController::deadline(Gate* gate, chrono::steady_clock::time_point now){
+    assert(gate != nullptr && "Null pointer");
+    assert(gate->m_locked && "The caller should hold the lock of the gate");
+
+    // amortise the cost of the rebalance
+    int64_t target = AMORTIZATION_FACTOR * m_rebalance_cost.load(memory_order_relaxed);
+
+    // do not let the updates pile up beyond the backlog capacity
+    int64_t interval = max<int64_t>(1, chrono::duration_cast<chrono::microseconds>(now - gate->m_cold->m_time_last_rebal).count());
+    uint64_t backlog = 0;
+    if(gate->m_cold->m_async_queue != nullptr){
+        backlog = gate->m_cold->m_async_queue->insertions().size() + gate->m_cold->m_async_queue->deletions().size();
+    }
+    if(gate->m_cold->m_num_updates > 0){
+        double arrival_rate = static_cast<double>(gate->m_cold->m_num_updates) / interval; // updates per microsec
+        double time_to_fill = static_cast<double>(m_backlog_capacity - min(backlog, m_backlog_capacity)) / arrival_rate;
+        target = min<int64_t>(target, interval + time_to_fill);
+    }
+
+    // threads waiting on the gate
+    target /= (1 + static_cast<int64_t>(gate->m_cold->m_queue.size()));
+
+    // smooth the delay over the successive requests
+    int64_t delay = (gate->m_cold->m_rebalance_delay.count() + target) / 2;
+    gate->m_cold->m_rebalance_delay = chrono::microseconds{ clamp<int64_t>(delay, 0, m_max_delay.count()) };
+
+    return gate->m_cold->m_time_last_rebal + gate->m_cold->m_rebalance_delay;
+}
+
+void DelayController::record_rebalance(chrono::microseconds cost){
+    // exponential moving average, alpha = 1/8. Invoked concurrently by the shards of the master
+    int64_t previous = m_rebalance_cost.load(memory_order_relaxed);
+    int64_t value;
+    do {
+        value = (previous == 0) ? cost.count() : previous + (cost.count() - previous) / 8;
+    } while(!m_rebalance_cost.compare_exchange_weak(previous, value, memory_order_relaxed));
+}
+
+chrono::microseconds DelayController::rebalance_cost() const {
+    return chrono::microseconds{ m_rebalance_cost.load(memory_order_relaxed) };
+}
+
+chrono::microseconds DelayController::max_delay() const {
+    return m_max_delay;
+}
+
+} // namespace
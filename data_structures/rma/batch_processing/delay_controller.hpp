@@ -0,0 +1,75 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+
+namespace data_structures::rma::batch_processing {
+
+class Gate; // forward declaration
+
+/**
+ * Self-tuning controller for the delayed rebalances. Rather than a fixed delay, each gate waits for a rebalance
+ * an amount of time computed from:
+ * - the cost of a rebalance, measured by the master: the interval between two rebalances of the same gate should be
+ *   large enough to amortise it;
+ * - the arrival rate of the updates in the gate: the updates pending for the rebalance should not exceed the given
+ *   backlog capacity;
+ * - the number of clients queued on the gate and the updates already pending in its async queue: they shorten the delay.
+ * The delay of each gate is smoothed over its successive requests and capped by a maximum delay.
+ */
+class DelayController {
+    const std::chrono::microseconds m_max_delay; // upper bound for the delay of a gate
+    const uint64_t m_backlog_capacity; // the max number of updates a gate should accumulate while waiting for a rebalance
+    std::atomic<int64_t> m_rebalance_cost; // moving average of the time to rebalance a window, in microsecs
+
+    constexpr static int64_t AMORTIZATION_FACTOR = 10; // a gate should not be rebalanced more often than 10x the cost of a rebalance
+
+public:
+    /**
+     * Constructor
+     * @param max_delay the maximum delay for a gate
+     * @param backlog_capacity the max number of updates that should be accumulated in a gate while waiting for a rebalance
+     */
+    DelayController(std::chrono::microseconds max_delay, uint64_t backlog_capacity);
+
+    /**
+     * Compute the time when the given gate should be rebalanced, and update its delay.
+     * Precondition: the caller holds the lock of the gate
+     */
+    std::chrono::steady_clock::time_point deadline(Gate* gate, std::chrono::steady_clock::time_point now);
+
+    /**
+     * Record the time spent to rebalance a window. Thread safe, it can be invoked concurrently by the shards of the master.
+     */
+    void record_rebalance(std::chrono::microseconds cost);
+
+    /**
+     * Retrieve the current estimate of the cost of a rebalance
+     */
+    std::chrono::microseconds rebalance_cost() const;
+
+    /**
+     * Retrieve the maximum delay for a gate
+     */
+    std::chrono::microseconds max_delay() const;
+};
+
+} // namespace
@@ -0,0 +1,111 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "delta_buffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "rma/common/segment_kernels.hpp"
+
+using namespace std;
+
+namespace data_structures::rma::batch_processing {
+
+DeltaBuffer::DeltaBuffer(uint64_t capacity) : m_capacity(capacity), m_size(0), m_keys(nullptr), m_values(nullptr) {
+    if(capacity == 0) throw std::invalid_argument("The capacity of the buffer must be greater than 0");
+    if(capacity > numeric_limits<uint32_t>::max()) throw std::invalid_argument("The capacity of the buffer is too large");
+
+    m_keys = new int64_t[2 * capacity];
+    m_values = m_keys + capacity;
+}
+
+DeltaBuffer::~DeltaBuffer(){
+    delete[] m_keys; m_keys = m_values = nullptr;
+}
+
+uint64_t DeltaBuffer::lower_bound(int64_t key) const {
+    return common::segment_kernels::lower_bound(m_keys, m_size, key, m_capacity);
+}
+
+uint64_t DeltaBuffer::upper_bound(int64_t key) const {
+    return common::segment_kernels::upper_bound(m_keys, m_size, key, m_capacity);
+}
+
+bool DeltaBuffer::insert(int64_t key, int64_t value){
+    if(full()) return false;
+
+    uint64_t position = upper_bound(key);
+    memmove(m_keys + position +1, m_keys + position, (m_size - position) * sizeof(m_keys[0]));
+    memmove(m_values + position +1, m_values + position, (m_size - position) * sizeof(m_values[0]));
+    m_keys[position] = key;
+    m_values[position] = value;
+    m_size++;
+
+    return true;
+}
+
+bool DeltaBuffer::remove(int64_t key, int64_t* out_value){
+    uint64_t position = lower_bound(key);
+    if(position == m_size || m_keys[position] != key) return false;
+
+    if(out_value != nullptr){ *out_value = m_values[position]; }
+    memmove(m_keys + position, m_keys + position +1, (m_size - position -1) * sizeof(m_keys[0]));
+    memmove(m_values + position, m_values + position +1, (m_size - position -1) * sizeof(m_values[0]));
+    m_size--;
+
+    return true;
+}
+
+int64_t DeltaBuffer::find(int64_t key) const {
+    uint64_t position = lower_bound(key);
+    if(position == m_size || m_keys[position] != key) return -1;
+    return m_values[position];
+}
+
+void DeltaBuffer::sum(int64_t min, int64_t max, ::data_structures::Interface::SumResult* __restrict result) const {
+    assert(result != nullptr && "Null pointer");
+    uint64_t pos_start = lower_bound(min);
+    uint64_t pos_end = upper_bound(max);
+    if(pos_start >= pos_end) return; // no elements in the interval
+
+    for(uint64_t i = pos_start; i < pos_end; i++){
+        result->m_sum_keys += m_keys[i];
+        result->m_sum_values += m_values[i];
+    }
+    // the readers visit the gates in order, the last key is either in the buffer or in the segments of the same gate
+    result->m_first_key = std::min(result->m_first_key, m_keys[pos_start]);
+    if(result->m_num_elements == 0 || result->m_last_key < m_keys[pos_end -1]){ result->m_last_key = m_keys[pos_end -1]; }
+    result->m_num_elements += (pos_end - pos_start);
+}
+
+void DeltaBuffer::pop_front(uint64_t count){
+    assert(count <= m_size && "Underflow");
+    memmove(m_keys, m_keys + count, (m_size - count) * sizeof(m_keys[0]));
+    memmove(m_values, m_values + count, (m_size - count) * sizeof(m_values[0]));
+    m_size -= count;
+}
+
+uint64_t DeltaBuffer::memory_footprint() const {
+    return sizeof(DeltaBuffer) + 2 * m_capacity * sizeof(int64_t);
+}
+
+} // namespace
@@ -0,0 +1,120 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+
+#include "data_structures/interface.hpp"
+
+namespace data_structures::rma::batch_processing {
+
+/**
+ * A small sorted buffer of pending insertions, attached to a gate. With the delta buffers enabled, writers insert the
+ * new elements in the buffer of their gate rather than shifting the elements in its segments. The readers merge its
+ * content with the segments on the fly. The buffer is flushed into the segments, in a single spread of the whole gate,
+ * once it is full, or it is loaded by the RebalancingMaster when the gate is rebalanced.
+ *
+ * The buffer is protected by the gate: it can only be altered by the writer owning the gate, or by the master while
+ * the gate is being rebalanced.
+ */
+class DeltaBuffer {
+    const uint32_t m_capacity; // max number of elements in the buffer
+    uint32_t m_size; // current number of elements in the buffer
+    int64_t* m_keys; // sorted
+    int64_t* m_values;
+
+public:
+    /**
+     * Create an empty buffer, able to hold up to `capacity' elements
+     */
+    DeltaBuffer(uint64_t capacity);
+
+    /**
+     * Destructor
+     */
+    ~DeltaBuffer();
+
+    /**
+     * Insert the given element, after the elements with the same key. It returns false if the buffer is full.
+     */
+    bool insert(int64_t key, int64_t value);
+
+    /**
+     * Remove one occurrence of the given key, if present. It returns true and sets out_value if the key was found.
+     */
+    bool remove(int64_t key, int64_t* out_value);
+
+    /**
+     * Retrieve the value associated to the given key, or -1 if not present
+     */
+    int64_t find(int64_t key) const;
+
+    /**
+     * Add to the partial result the elements in the interval [min, max]
+     */
+    void sum(int64_t min, int64_t max, ::data_structures::Interface::SumResult* __restrict result) const;
+
+    /**
+     * Position of the first element not less than (lower_bound) or greater than (upper_bound) the given key
+     */
+    uint64_t lower_bound(int64_t key) const;
+    uint64_t upper_bound(int64_t key) const;
+
+    /**
+     * Remove the first `count' elements of the buffer
+     */
+    void pop_front(uint64_t count);
+
+    /**
+     * Remove all elements from the buffer
+     */
+    void clear() { m_size = 0; }
+
+    /**
+     * The sorted content of the buffer
+     */
+    const int64_t* keys() const { return m_keys; }
+    const int64_t* values() const { return m_values; }
+
+    /**
+     * Number of elements in the buffer
+     */
+    uint64_t size() const { return m_size; }
+
+    /**
+     * Max number of elements in the buffer
+     */
+    uint64_t capacity() const { return m_capacity; }
+
+    /**
+     * Check whether the buffer is empty
+     */
+    bool empty() const { return m_size == 0; }
+
+    /**
+     * Check whether the buffer is full
+     */
+    bool full() const { return m_size == m_capacity; }
+
+    /**
+     * Amount of memory used by the buffer, in bytes
+     */
+    uint64_t memory_footprint() const;
+};
+
+} // namespace
@@ -0,0 +1,121 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "density_tuner.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "thread_context.hpp"
+
+using namespace std;
+
+namespace data_structures::rma::batch_processing {
+
+/*****************************************************************************
+ *                                                                           *
+ *   DEBUG                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+extern mutex _debug_mutex; // PackedMemoryArray.cpp
+//#define DEBUG
+#define COUT_DEBUG_FORCE(msg) { scoped_lock<mutex> lock(_debug_mutex); std::cout << "[DensityTuner::" << __FUNCTION__ << "] [" << this_thread::get_id() << "] " << msg << std::endl; }
+#if defined(DEBUG)
+    #define COUT_DEBUG(msg) COUT_DEBUG_FORCE(msg)
+#else
+    #define COUT_DEBUG(msg)
+#endif
+
+/*****************************************************************************
+ *                                                                           *
+ *   DensityTuner                                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+DensityTuner::DensityTuner(uint64_t segment_capacity, double density_min, double density_max) :
+        m_segment_capacity(segment_capacity), m_density_min(density_min), m_density_max(density_max) {
+    if(segment_capacity == 0) throw std::invalid_argument("[DensityTuner::ctor] The segment capacity must be a positive quantity");
+    if(!(0 < density_min && density_min <= density_max && density_max < 1)) throw std::invalid_argument("[DensityTuner::ctor] Invalid bounds for the density, it must hold 0 < density_min <= density_max < 1");
+}
+
+DensityTuner::Counters& DensityTuner::counters(){
+    // unregistered threads have thread_id == -1, they all share the last slot
+    return m_counters[ static_cast<uint64_t>(ClientContext::thread_id()) % NUM_SHARDS ];
+}
+
+void DensityTuner::record_update(){
+    counters().m_num_updates.fetch_add(1, memory_order_relaxed);
+}
+
+void DensityTuner::record_scan(uint64_t num_elements){
+    counters().m_num_scanned.fetch_add(num_elements, memory_order_relaxed);
+}
+
+void DensityTuner::record_rebalance(uint64_t num_elements){
+    m_num_moved.fetch_add(num_elements, memory_order_relaxed);
+}
+
+double DensityTuner::tune(double density){
+    uint64_t num_updates = 0, num_scanned = 0;
+    for(uint64_t i = 0; i < NUM_SHARDS; i++){
+        num_updates += m_counters[i].m_num_updates.load(memory_order_relaxed);
+        num_scanned += m_counters[i].m_num_scanned.load(memory_order_relaxed);
+    }
+    uint64_t num_moved = m_num_moved.load(memory_order_relaxed);
+
+    // workload since the last resize
+    double updates = num_updates - m_last_updates;
+    double scanned_segments = static_cast<double>(num_scanned - m_last_scanned) / m_segment_capacity;
+    double moved = num_moved - m_last_moved;
+    m_last_updates = num_updates;
+    m_last_scanned = num_scanned;
+    m_last_moved = num_moved;
+    if(updates + scanned_segments == 0) return clamp(density, m_density_min, m_density_max); // nothing to learn from
+
+    // the mix of the workload: a visited segment and an update roughly cost the same
+    double scan_share = scanned_segments / (scanned_segments + updates);
+    double target = m_density_min + scan_share * (m_density_max - m_density_min);
+
+    // the rebalances are too expensive for the current update rate
+    double moved_per_update = (updates > 0) ? moved / updates : 0.;
+    if(moved_per_update > REBALANCE_BUDGET){
+        target -= (m_density_max - m_density_min) * min(1.0, moved_per_update / REBALANCE_BUDGET - 1.0);
+    }
+
+    // smooth over the successive resizes
+    double result = density + clamp((target - density) / 2, -MAX_STEP, MAX_STEP);
+    result = clamp(result, m_density_min, m_density_max);
+
+    COUT_DEBUG("updates: " << updates << ", scanned segments: " << scanned_segments << ", moved per update: " << moved_per_update << ", "
+            "scan share: " << scan_share << ", target: " << target << ", density: " << density << " -> " << result);
+
+    return result;
+}
+
+double DensityTuner::density_min() const {
+    return m_density_min;
+}
+
+double DensityTuner::density_max() const {
+    return m_density_max;
+}
+
+} // namespace
@@ -0,0 +1,96 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cinttypes>
+
+namespace data_structures::rma::batch_processing {
+
+/**
+ * Self-tuning controller for the primary density thresholds. It observes the workload between two resizes and, at
+ * each resize, revises the upper density at the root of the calibrator tree (theta_h):
+ * - the mix of the workload: the more time is spent in scans, rather than in updates, the denser the array should be,
+ *   as a scan visits fewer segments to retrieve the same number of elements;
+ * - the cost of the rebalances: when the elements moved by the rebalances, per update, exceed a budget, the array is
+ *   too dense for the current update rate and theta_h is lowered.
+ * The density is smoothed over the successive resizes and always kept within [density_min, density_max].
+ */
+class DensityTuner {
+    const uint64_t m_segment_capacity; // the capacity of a segment, to convert the scanned elements into visited segments
+    const double m_density_min; // lower bound for theta_h
+    const double m_density_max; // upper bound for theta_h
+
+    // the counters are sharded by the client threads, to avoid contention on a single cache line
+    struct alignas(64) Counters {
+        std::atomic<uint64_t> m_num_updates = 0; // insertions & deletions
+        std::atomic<uint64_t> m_num_scanned = 0; // elements visited by the scans
+    };
+    constexpr static uint64_t NUM_SHARDS = 64;
+    Counters m_counters[NUM_SHARDS];
+    std::atomic<uint64_t> m_num_moved = 0; // elements moved by the local & global rebalances
+
+    // snapshot of the counters at the last resize, only accessed by #tune
+    uint64_t m_last_updates = 0;
+    uint64_t m_last_scanned = 0;
+    uint64_t m_last_moved = 0;
+
+    constexpr static double MAX_STEP = 0.05; // max change of theta_h at each resize
+    constexpr static double REBALANCE_BUDGET = 32; // max number of elements moved by the rebalances for each update
+
+    // Retrieve the counters for the current thread
+    Counters& counters();
+
+public:
+    /**
+     * Constructor
+     * @param segment_capacity the capacity of a single segment in the PMA
+     * @param density_min the lower bound for theta_h
+     * @param density_max the upper bound for theta_h
+     */
+    DensityTuner(uint64_t segment_capacity, double density_min = 0.6, double density_max = 0.9);
+
+    /**
+     * Record an insertion or a deletion
+     */
+    void record_update();
+
+    /**
+     * Record the number of elements visited by a scan
+     */
+    void record_scan(uint64_t num_elements);
+
+    /**
+     * Record the number of elements moved by a rebalance
+     */
+    void record_rebalance(uint64_t num_elements);
+
+    /**
+     * Compute the new value for theta_h, given its current value, according to the workload observed since the last
+     * invocation. Only invoked at a resize, when all gates are held by the caller.
+     */
+    double tune(double density);
+
+    /**
+     * Bounds for theta_h
+     */
+    double density_min() const;
+    double density_max() const;
+};
+
+} // namespace
@@ -24,6 +24,7 @@
 #include <new>
 #include <thread> // debug only
 
+#include "delta_buffer.hpp"
 #include "thread_context.hpp"
 #include "wakelist.hpp"
 
@@ -50,26 +51,42 @@ extern mutex _debug_mutex; // PackedMemoryArray.cpp
  *   Initialisation                                                          *
  *                                                                           *
  *****************************************************************************/
-Gate::Gate(uint32_t window_start, uint32_t window_length) : m_window_start(window_start), m_window_length(window_length), m_queue(/* initial capacity */ 2) {
+Gate::Gate(uint32_t window_start, uint32_t window_length, Cold* cold) : m_window_start(window_start), m_window_length(window_length) {
     m_num_active_threads = 0;
-    m_cardinality = 0;
     m_fence_low_key = m_fence_high_key = numeric_limits<int64_t>::min();
+    m_delta_buffer = nullptr;
     m_separator_keys = nullptr; // needs to be set eventually
+    m_cold = cold;
+}
+
+Gate::Cold::Cold() : m_queue(/* initial capacity */ 2) {
+    m_version = 0;
+    m_cardinality = 0;
+    m_num_updates = 0;
     m_async_queue = nullptr;
+    m_snapshot = nullptr;
+    m_rebalance_delay = chrono::microseconds{0};
+    m_timer.m_next = m_timer.m_prev = nullptr;
+    m_timer.m_level = m_timer.m_slot = -1;
+    m_timer.m_expiry = 0;
 }
 
 Gate* Gate::allocate(uint64_t num_locks, uint64_t segments_per_lock){
     assert(num_locks > 0 && segments_per_lock > 0);
     if(num_locks == 0 || segments_per_lock == 0) return nullptr;
 
-    size_t space_per_gate = sizeof(Gate) + (segments_per_lock -1) * sizeof(int64_t);
-    Gate* __restrict array_gates = (Gate*) malloc(space_per_gate * num_locks);
-    if(array_gates == nullptr) throw std::bad_alloc();
-    int64_t* __restrict array_separator_keys = reinterpret_cast<int64_t*>(array_gates + num_locks);
+    // layout: [hot records][cold records][separator keys]
+    size_t space_required = num_locks * (sizeof(Gate) + sizeof(Cold) + (segments_per_lock -1) * sizeof(int64_t));
+    Gate* __restrict array_gates = nullptr;
+    int rc = posix_memalign((void**) &array_gates, /* alignment */ 64, /* size */ space_required);
+    if(rc != 0 || array_gates == nullptr) throw std::bad_alloc();
+    Cold* __restrict array_cold = reinterpret_cast<Cold*>(array_gates + num_locks);
+    int64_t* __restrict array_separator_keys = reinterpret_cast<int64_t*>(array_cold + num_locks);
 
     int64_t* separator_keys = array_separator_keys;
     for(uint64_t i = 0; i < num_locks; i++){
-        new( array_gates + i ) Gate{ static_cast<uint32_t>(i * segments_per_lock), static_cast<uint32_t>(segments_per_lock) };
+        new( array_cold + i ) Cold{};
+        new( array_gates + i ) Gate{ static_cast<uint32_t>(i * segments_per_lock), static_cast<uint32_t>(segments_per_lock), array_cold + i };
         array_gates[i].m_separator_keys = separator_keys;
         separator_keys += (segments_per_lock -1);
     }
@@ -87,6 +104,8 @@ Gate* Gate::allocate(uint64_t num_locks, uint64_t segments_per_lock){
 
 void Gate::deallocate(Gate* gates, uint64_t num_locks){
     for(uint64_t i = 0; i < num_locks; i++){
+        delete gates[i].m_delta_buffer; gates[i].m_delta_buffer = nullptr;
+        gates[i].m_cold->~Cold();
         gates[i].~Gate();
     }
 
@@ -130,18 +149,18 @@ void Gate::wake_next(WakeList& wake_list) {
     COUT_DEBUG("gate id: " << gate_id());
     assert(m_locked && "To invoke this method the internal lock must be acquired first");
 
-    if(m_queue.empty()) {
+    if(m_cold->m_queue.empty()) {
         return;
-    } else if(m_queue[0].m_purpose == State::WRITE){
-        wake_list.m_list_workers.push_back(m_queue[0].m_promise);
-        m_queue.pop();
+    } else if(m_cold->m_queue[0].m_purpose == State::WRITE){
+        wake_list.m_list_workers.push_back(m_cold->m_queue[0].m_promise);
+        m_cold->m_queue.pop();
     } else {
-        assert(m_queue[0].m_purpose == State::READ);
+        assert(m_cold->m_queue[0].m_purpose == State::READ);
         do {
-            std::promise<void>* producer = m_queue[0].m_promise;
+            std::promise<void>* producer = m_cold->m_queue[0].m_promise;
             producer->set_value(); // notify
-            m_queue.pop();
-        } while(!m_queue.empty() && m_queue[0].m_purpose == State::READ);
+            m_cold->m_queue.pop();
+        } while(!m_cold->m_queue.empty() && m_cold->m_queue[0].m_purpose == State::READ);
     }
 }
 
@@ -154,9 +173,9 @@ void Gate::wake_all(WakeList& wake_list){
     COUT_DEBUG("gate id: " << gate_id());
     assert((m_locked || m_state == State::REBAL) && "To invoke this method the internal lock must be acquired first");
 
-    while(!m_queue.empty()){
-        m_queue[0].m_promise->set_value(); // notify
-        m_queue.pop();
+    while(!m_cold->m_queue.empty()){
+        m_cold->m_queue[0].m_promise->set_value(); // notify
+        m_cold->m_queue.pop();
     }
 }
 
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cinttypes>
 #include <chrono>
 #include <future>
@@ -24,47 +25,83 @@
 #include "common/circular_array.hpp"
 #include "common/miscellaneous.hpp"
 #include "common/spin_lock.hpp"
+#include "rma/common/segment_kernels.hpp"
 
 namespace data_structures::rma::batch_processing {
 
 // forward declarations
 class ClientContext;
 class ClientContextQueue;
+class DeltaBuffer;
 class RebalancingTask;
 struct Storage;
 class WakeList;
+class WindowSnapshot;
 
-class Gate {
+/**
+ * The gates are the locks protecting the windows of the PMA. Their fields are split in two records, laid out in two
+ * parallel arrays. The `hot' record, the Gate itself, contains the fields accessed on each acquisition of the gate: the
+ * spin lock, the state, the number of active readers, the fence keys and the pointers to search the gate. It's aligned
+ * to a cache line, so that threads operating on adjacent gates do not contend the same lines. The `cold' record contains
+ * the fields accessed by the writers, the waiting threads, the timer manager and the rebalancer.
+ */
+class alignas(64) Gate {
 public:
-    const uint32_t m_window_start; // the first segment of this gate
-    const uint32_t m_window_length; // the number of segments controlled by this gate
     enum class State {
         FREE, // no threads are operating on this gate
         READ, // one or more readers are active on this gate
         WRITE, // one & only one writer is active on this gate
         TIMEOUT, // set by the timer manager on an occupied gate, the last reader/writer must ask to rebalance the gate
         REBAL, // this gate is closed and it's currently being rebalanced
+        RESIZE, // online resize in progress: readers still access the old storage, writers defer their updates in the async queue
     };
-    State m_state = State::FREE; // whether reader/writer/rebalancing in progress?
-    ::common::SpinLock m_spin_lock; // sync the access to the gate
-#if !defined(NDEBUG) // for debugging purposes
-    bool m_locked = false; // keep track whether the spin lock has been acquired, for debugging purposes
-    int64_t m_owned_by = -1; // if the mutex is owned, report the thread id of the last thread that acquired the lock
-#endif
-    int32_t m_num_active_threads; // how many readers are accessing this gate?
-    uint32_t m_cardinality; // the total number of elements in this gate
-    int64_t m_fence_low_key; // the minimum key that can be stored in this gate (inclusive)
-    int64_t m_fence_high_key; // the maximum key that can be stored in this gate (exclusive)
-    ClientContextQueue* m_async_queue; // queue to add/remove elements asynchronously
-    std::chrono::steady_clock::time_point m_time_last_rebal; // the last time this gate was rebalanced
 
     struct SleepingBeauty{
         State m_purpose; // either read or write
         std::promise<void>* m_promise; // the thread waiting
     };
-    ::common::CircularArray<SleepingBeauty> m_queue; // a queue with the threads being on the wait
-    int64_t* m_separator_keys; // the separator keys for the segments in this gate
 
+    // The timer for a delayed rebalance. It is embedded in the gate to avoid allocations, and it's only accessed by the TimerManager
+    struct Timer {
+        Gate* m_next; // next timer in the same slot of the wheel
+        Gate* m_prev; // previous timer in the same slot of the wheel
+        int16_t m_level; // the level of the wheel where the timer is stored, -1 if the timer is not armed
+        int16_t m_slot; // the slot, in the level of the wheel, where the timer is stored
+        uint64_t m_expiry; // the tick when the timer expires
+        std::chrono::steady_clock::time_point m_time_last_rebal; // the value of m_time_last_rebal when the timer was armed
+    };
+
+    // The fields of the gate not accessed by the readers. The first cache line is used by the writers, the second one by
+    // the timer manager and the rebalancer.
+    struct alignas(64) Cold {
+        std::atomic<uint32_t> m_version; // incremented each time the content of the gate may be altered, it validates the entries of the ReadCache
+        uint32_t m_cardinality; // the total number of elements in this gate
+        uint32_t m_num_updates; // number of updates performed in this gate since its last rebalance
+        ClientContextQueue* m_async_queue; // queue to add/remove elements asynchronously
+        ::common::CircularArray<SleepingBeauty> m_queue; // a queue with the threads being on the wait
+
+        const WindowSnapshot* m_snapshot; // while the window of this gate is being rebalanced, its content before the rebalance (or nullptr)
+        std::chrono::steady_clock::time_point m_time_last_rebal; // the last time this gate was rebalanced
+        std::chrono::microseconds m_rebalance_delay; // the current delay for the rebalances of this gate, only used by the DelayController
+        Timer m_timer;
+
+        Cold();
+    };
+
+    const uint32_t m_window_start; // the first segment of this gate
+    const uint32_t m_window_length; // the number of segments controlled by this gate
+    ::common::SpinLock m_spin_lock; // sync the access to the gate
+    State m_state = State::FREE; // whether reader/writer/rebalancing in progress?
+    int32_t m_num_active_threads; // how many readers are accessing this gate?
+    int64_t m_fence_low_key; // the minimum key that can be stored in this gate (inclusive)
+    int64_t m_fence_high_key; // the maximum key that can be stored in this gate (exclusive)
+    DeltaBuffer* m_delta_buffer; // pending insertions, not yet merged in the segments of this gate (or nullptr)
+    int64_t* m_separator_keys; // the separator keys for the segments in this gate
+    Cold* m_cold; // the rest of the fields, in the parallel array of the cold records
+#if !defined(NDEBUG) // for debugging purposes
+    bool m_locked = false; // keep track whether the spin lock has been acquired, for debugging purposes
+    int64_t m_owned_by = -1; // if the mutex is owned, report the thread id of the last thread that acquired the lock
+#endif
 
 public:
     // The result of check_fence_keys()
@@ -78,7 +115,7 @@ public:
 
 private:
     // Constructor
-    Gate(uint32_t window_start, uint32_t window_length);
+    Gate(uint32_t window_start, uint32_t window_length, Cold* cold);
 
 public:
 
@@ -106,11 +143,17 @@ public:
         m_spin_lock.unlock();
     }
 
+    // Invalidate the entries of the ReadCache recorded for this gate. Invoked, with the spin lock held, when a writer or
+    // the rebalancer acquires the gate, before its content is altered
+    void bump_version(){
+        m_cold->m_version.store(m_cold->m_version.load(std::memory_order_relaxed) +1, std::memory_order_release);
+    }
+
     /**
-     * Retrieve the segment associated to the given key.
+     * Retrieve the segment associated to the given key, searching the separator keys with the given strategy.
      * Precondition: the gate has been acquired by the thread
      */
-    uint64_t find(int64_t key) const;
+    uint64_t find(int64_t key, common::segment_kernels::SearchStrategy strategy = common::segment_kernels::SearchStrategy::BINARY) const;
 
     /**
      * The first segment in this gate
@@ -157,7 +200,7 @@ public:
     void wake_all(WakeList& wake_list);
 
     /**
-     * Allocate an array of locks
+     * Allocate an array of locks, together with the parallel array of their cold records and their separator keys
      */
     static Gate* allocate(uint64_t num_locks, uint64_t segments_per_lock);
 
@@ -169,12 +212,15 @@ public:
 
 
 inline
-uint64_t Gate::find(int64_t key) const {
+uint64_t Gate::find(int64_t key, common::segment_kernels::SearchStrategy strategy) const {
     assert(m_fence_low_key <= key && key <= m_fence_high_key && "Fence keys check: the key does not belong to this gate");
-    int i = 0, sz = m_window_length -1;
-    int64_t* __restrict keys = m_separator_keys;
-    while(i < sz && keys[i] <= key) i++;
-    return m_window_start + i;
+    const size_t sz = m_window_length -1;
+    return m_window_start + common::segment_kernels::upper_bound(m_separator_keys, sz, key, sz, strategy);
 }
 
+#if defined(NDEBUG)
+static_assert(sizeof(Gate) == 64, "The hot fields of a gate should fit a single cache line");
+#endif
+static_assert(sizeof(Gate::Cold) == 128, "The cold record of a gate should span exactly two cache lines");
+
 } // namespace
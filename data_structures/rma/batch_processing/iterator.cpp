@@ -24,12 +24,16 @@
 #include <utility>
 
 #include "rma/common/abort.hpp"
+#include "rma/common/segment_kernels.hpp"
 #include "data_structures/parallel.hpp"
+#include "delta_buffer.hpp"
+#include "density_tuner.hpp"
 #include "gate.hpp"
 #include "packed_memory_array.hpp"
 #include "rebalancing_master.hpp"
 #include "thread_context.hpp"
 
+using namespace data_structures::rma::common;
 using namespace std;
 
 namespace data_structures::rma::batch_processing {
@@ -58,12 +62,16 @@ extern mutex _debug_mutex; // PackedMemoryArray.cpp
 Iterator::Iterator(const PackedMemoryArray* pma, int64_t min, int64_t max) : m_pma(pma), m_min(min), m_max(max){
     restart();
     set_offset();
+    if(m_offset > m_stop) fetch_next_chunk();
+    skip_tombstones();
 }
 
 Iterator::~Iterator(){
     if(m_gate != nullptr)
         release_lock();
 
+    if(m_pma->m_density_tuner != nullptr){ m_pma->m_density_tuner->record_scan(m_num_visited); }
+
     m_pma->get_context()->bye();
 }
 
@@ -80,7 +88,7 @@ void Iterator::restart(){
         try {
             auto context = m_pma->get_context();
             context->hello();
-            auto gate_id = m_pma->m_locks.get(context)->find(m_min);
+            auto gate_id = m_pma->finger_find(context, m_min);
             acquire_lock(gate_id);
             done = true;
         } catch (common::Abort) { /* retry  */ };
@@ -100,6 +108,7 @@ void Iterator::acquire_lock(uint64_t gate_id){
         unique_lock<Gate> lock(gate);
         // is this the right gate ?
         if(m_pma->check_fence_keys(gate, /* in/out */ gate_id, m_min)){
+            m_pma->finger_set(context, gates, gate_id);
             switch(gate.m_state){
             case Gate::State::FREE:
                 assert(gate.m_num_active_threads == 0 && "Precondition not satisfied");
@@ -111,7 +120,7 @@ void Iterator::acquire_lock(uint64_t gate_id){
                 done = true; // done, proceed with the insertion
                 break;
             case Gate::State::READ:
-                if(gate.m_queue.empty()){ // as above
+                if(gate.m_cold->m_queue.empty()){ // as above
                     gate.m_num_active_threads++;
                     lock.unlock();
                     m_gate = gates + gate_id;
@@ -120,11 +129,20 @@ void Iterator::acquire_lock(uint64_t gate_id){
                     std::promise<void> producer;
                     std::future<void> consumer = producer.get_future();
 
-                    gate.m_queue.append({ Gate::State::READ, &producer } );
+                    gate.m_cold->m_queue.append({ Gate::State::READ, &producer } );
                     lock.unlock();
                     consumer.wait();
                 }
                 break;
+            case Gate::State::RESIZE:
+                if(!m_pma->m_resize_closing){ // the old storage is still valid, read from it
+                    gate.m_num_active_threads++;
+                    lock.unlock();
+                    m_gate = gates + gate_id;
+                    done = true;
+                    break;
+                }
+                /* fall through */
             case Gate::State::WRITE:
             case Gate::State::TIMEOUT:
             case Gate::State::REBAL:
@@ -132,7 +150,7 @@ void Iterator::acquire_lock(uint64_t gate_id){
                     std::promise<void> producer;
                     std::future<void> consumer = producer.get_future();
 
-                    gate.m_queue.append({ Gate::State::READ, &producer } );
+                    gate.m_cold->m_queue.append({ Gate::State::READ, &producer } );
                     lock.unlock();
                     consumer.wait();
                 }
@@ -164,16 +182,20 @@ void Iterator::release_lock(){
            send_message_to_rebalancer = true;
            client_exit = true;
        } break;
+       case Gate::State::RESIZE: {
+           /* nop, the old storage is still open, the master checks the active readers when it closes the gate */
+       } break;
        default:
            assert(0 && "Invalid state");
        }
     }
     m_min = m_gate->m_fence_high_key +1; // next restarting point
+    uint64_t gate_id = m_gate->lock_id();
     m_gate->unlock();
     m_gate = nullptr;
 
     if(send_message_to_rebalancer){
-        m_pma->rebalance_global(m_gate->lock_id(), client_exit);
+        m_pma->rebalance_global(gate_id, client_exit);
     } else {
         context->process_wakelist();
     }
@@ -187,8 +209,17 @@ void Iterator::release_lock(){
 void Iterator::set_offset(){
     assert(m_gate != nullptr && "Gate not acquired");
     m_last = m_max <= m_gate->m_fence_high_key;
-    auto segment_id = m_gate->find(m_min);
+    auto segment_id = m_gate->find(m_min, m_pma->m_knobs.m_search_strategy);
     set_offset(segment_id);
+
+    // the pending insertions in the delta buffer of the gate, merged with the elements in the segments
+    const DeltaBuffer* delta = m_gate->m_delta_buffer;
+    if(delta != nullptr && !delta->empty()){
+        m_delta_offset = delta->lower_bound(m_min);
+        m_delta_stop = delta->upper_bound(m_max);
+    } else {
+        m_delta_offset = m_delta_stop = 0;
+    }
 }
 
 void Iterator::set_offset(uint64_t segment_id){
@@ -201,23 +232,27 @@ void Iterator::set_offset(uint64_t segment_id){
     m_stop = stop_segment_id * m_pma->m_storage.m_segment_capacity + m_pma->m_storage.m_segment_sizes[stop_segment_id] -1; // inclusive
 
     int64_t* __restrict keys = m_pma->m_storage.m_keys;
-    while(m_offset <= m_stop && keys[m_offset] < m_min){
-        m_offset++;
+    const size_t window_capacity = 2 * m_pma->m_storage.m_segment_capacity; // the pair of segments
+    if(m_offset <= m_stop){
+        m_offset += segment_kernels::lower_bound(keys + m_offset, m_stop - m_offset +1, m_min, window_capacity);
     }
-    if(m_last){
-        while(m_offset <= m_stop && keys[m_stop] > m_max){
-            m_stop--;
-        }
+    m_next_segment_id = stop_segment_id +1;
+    if(m_last && m_offset <= m_stop){
+        int64_t stop = m_offset + segment_kernels::upper_bound(keys + m_offset, m_stop - m_offset +1, m_max, window_capacity) -1;
+        if(stop < m_stop){ m_next_segment_id = -1; } // reached the maximum of the interval
+        m_stop = stop;
     }
 }
 
 void Iterator::fetch_next_chunk(){
     assert(m_offset > m_stop && "Invalid position");
 
-    auto next_segment_id = (m_stop / m_pma->m_storage.m_segment_capacity) +1;
-    if(next_segment_id % 2 == 1) return; // it means the stop offset has been moved from its fixed position due to reaching the maximum of the interval
-    if(next_segment_id > m_pma->m_storage.m_number_segments) return; // depleted
+    if(m_next_segment_id < 0) return; // the maximum of the interval has been reached
+    uint64_t next_segment_id = m_next_segment_id;
+    if(next_segment_id >= m_pma->m_storage.m_number_segments) return; // depleted
     if(next_segment_id % m_pma->get_segments_per_lock() == 0){
+        if(m_delta_offset < m_delta_stop) return; // first consume the pending insertions of the current gate
+
         // move to the next lock
         release_lock();
 
@@ -229,22 +264,57 @@ void Iterator::fetch_next_chunk(){
     } else {
         set_offset(next_segment_id);
     }
+
+    if(m_offset > m_stop) fetch_next_chunk(); // empty chunk, move ahead
 }
 
 bool Iterator::hasNext() const {
-    return ::data_structures::global_parallel_scan_enabled && m_offset <= m_stop;
+    return ::data_structures::global_parallel_scan_enabled && (m_offset <= m_stop || m_delta_offset < m_delta_stop);
 }
 
 pair<int64_t, int64_t> Iterator::next(){
     int64_t* keys = m_pma->m_storage.m_keys;
     int64_t* values = m_pma->m_storage.m_values;
 
+    // is the next element in the delta buffer?
+    if(m_delta_offset < m_delta_stop){
+        const DeltaBuffer* delta = m_gate->m_delta_buffer;
+        if(m_offset > m_stop || delta->keys()[m_delta_offset] < keys[m_offset]){
+            pair<int64_t, int64_t> result { delta->keys()[m_delta_offset], delta->values()[m_delta_offset] };
+            m_delta_offset++;
+            m_num_visited++;
+            if(m_offset > m_stop && m_delta_offset == m_delta_stop){ // resume from the next gate
+                fetch_next_chunk();
+                skip_tombstones();
+            }
+            return result;
+        }
+    }
+
     pair<int64_t, int64_t> result { keys[m_offset], values[m_offset] };
 
     m_offset++;
+    m_num_visited++;
     if(m_offset > m_stop) fetch_next_chunk();
+    skip_tombstones();
 
     return result;
 }
 
+void Iterator::skip_tombstones(){
+    const Storage& storage = m_pma->m_storage;
+    if(!storage.tombstones_enabled()) return;
+
+    bool fetched = true;
+    while(fetched){
+        while(m_offset <= m_stop && storage.is_tombstone(m_offset)){ m_offset++; }
+        if(m_offset <= m_stop) return; // found a valid element
+
+        // the rest of the chunk only contained tombstones, move to the next chunk
+        int64_t stop = m_stop;
+        fetch_next_chunk();
+        fetched = (m_stop != stop); // otherwise the iterator has been depleted
+    }
+}
+
 } // namespace
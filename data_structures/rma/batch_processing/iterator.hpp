@@ -31,7 +31,11 @@ class Iterator : public data_structures::Iterator {
     const int64_t m_max; // the maximum key of the interval
     int64_t m_offset = 0; // the current position in the storage
     int64_t m_stop = -1; // index when the current sequence stops
+    int64_t m_next_segment_id = -1; // the first segment of the next chunk, or -1 if the interval terminates with the current chunk
+    uint64_t m_delta_offset = 0; // the current position in the delta buffer of the gate
+    uint64_t m_delta_stop = 0; // the position in the delta buffer where the interval stops (exclusive)
     bool m_last = false; // whether the iterator has been consumed
+    uint64_t m_num_visited = 0; // number of elements returned so far
 
     /**
      * Acquire the next extent
@@ -59,6 +63,11 @@ class Iterator : public data_structures::Iterator {
      */
     void fetch_next_chunk();
 
+    /**
+     * Lazy deletes, move the iterator past the elements marked as deleted
+     */
+    void skip_tombstones();
+
 public:
     /**
      * Initialise the iterator
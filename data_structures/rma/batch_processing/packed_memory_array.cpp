@@ -20,20 +20,29 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <mutex>
 #include <thread>
 
 #include "common/miscellaneous.hpp"
 #include "rma/common/bitset.hpp"
 #include "rma/common/buffered_rewired_memory.hpp"
+#include "rma/common/learned_index.hpp"
+#include "rma/common/segment_kernels.hpp"
 #include "rma/common/static_index.hpp"
+#include "delay_controller.hpp"
+#include "delta_buffer.hpp"
+#include "density_tuner.hpp"
 #include "garbage_collector.hpp"
 #include "gate.hpp"
 #include "iterator.hpp"
+#include "read_cache.hpp"
 #include "rebalancing_master.hpp"
 #include "thread_context.hpp"
 #include "timer_manager.hpp"
+#include "window_snapshot.hpp"
 
 using namespace common;
 using namespace data_structures::rma::common;
@@ -61,24 +70,47 @@ mutex _debug_mutex;
  *                                                                           *
  *****************************************************************************/
 
-PackedMemoryArray::PackedMemoryArray(size_t btree_block_size, size_t pma_segment_size, size_t pages_per_extent, size_t num_worker_threads, size_t segments_per_lock, chrono::milliseconds delay_rebalance) :
+PackedMemoryArray::PackedMemoryArray(size_t btree_block_size, size_t pma_segment_size, size_t pages_per_extent, size_t num_worker_threads, size_t segments_per_lock, chrono::milliseconds delay_rebalance, const Options& options) :
         m_storage(pma_segment_size, pages_per_extent),
-        m_index(new StaticIndex(btree_block_size)),
+        m_index(options.m_learned_index ? static_cast<common::SegmentIndex*>(new common::LearnedIndex()) : new common::StaticIndex(btree_block_size)),
+        m_index_block_size(btree_block_size),
         m_locks(Gate::allocate(1, segments_per_lock)),
+        m_detector(m_knobs, 1, 8),
         m_density_bounds1(0, 0.75, 0.75, 1), /* there is rationale for these hardwired thresholds */
-        m_rebalancer(new RebalancingMaster{ this, num_worker_threads } ),
+        m_rebalancer(new RebalancingMaster{ this, num_worker_threads, options.m_num_master_shards } ),
         m_garbage_collector( new GarbageCollector(this) ),
         m_timer_manager( new TimerManager(this) ),
+        m_delay_controller( nullptr ),
+        m_density_tuner( nullptr ),
+        m_read_cache( nullptr ),
         m_segments_per_lock(segments_per_lock),
-        m_delayed_rebalance(delay_rebalance){
+        m_delayed_rebalance(delay_rebalance),
+        m_online_resize(options.m_online_resize),
+        m_rebalance_snapshots(options.m_rebalance_snapshots),
+        m_append_fastpath(options.m_append_fastpath),
+        m_adaptive_rebalancing(options.m_adaptive_rebalancing),
+        m_delta_buffer_capacity(options.m_delta_buffer_capacity){
     if(!is_power_of_2(segments_per_lock)) throw std::invalid_argument("[PackedMemoryArray::ctor] Invalid value for the `segments_per_lock', it is not a power of 2");
     if(segments_per_lock < 2) throw std::invalid_argument("[PackedMemoryArray::ctor] Invalid value for the `segments_per_lock', it must be >= 2");
     if(segments_per_lock > 256) throw std::invalid_argument("[PackedMemoryArray::ctor] This implementation does not support more than 256 segments per lock/gate, due to the implmentation limit of std::bitset<256> in ClientContext");
     if(m_storage.get_segments_per_extent() % segments_per_lock != 0) throw std::invalid_argument("[PackedMemoryArray::ctor] The parameter `segments_per_extent' must be a multiple of `segments_per_lock'");
+    if(options.m_adaptive_delay && delay_rebalance.count() == 0) throw std::invalid_argument("[PackedMemoryArray::ctor] With an adaptive delay, the parameter `delay_rebalance' must be set to the maximum delay for a gate");
+
+    if(options.m_adaptive_delay){ // tolerate up to half of the capacity of a gate as pending updates
+        m_delay_controller = new DelayController(delay_rebalance, segments_per_lock * m_storage.m_segment_capacity / 2);
+    }
+
+    if(options.m_lazy_deletes){ m_storage.enable_tombstones(); }
+
+    if(options.m_filter_bits_per_key > 0){ m_storage.enable_filters(options.m_filter_bits_per_key); }
+
+    if(options.m_adaptive_densities){ m_density_tuner = new DensityTuner(m_storage.m_segment_capacity); }
+
+    if(options.m_read_cache_capacity > 0){ m_read_cache = new ReadCache(options.m_read_cache_capacity); }
 
 
     // set the init time for the gates
-    m_locks.get_unsafe()->m_time_last_rebal = chrono::steady_clock::now();
+    m_locks.get_unsafe()->m_cold->m_time_last_rebal = chrono::steady_clock::now();
 
     // start the garbage collector
     GC()->start();
@@ -97,12 +129,18 @@ PackedMemoryArray::PackedMemoryArray(size_t btree_block_size, size_t pma_segment
 
 
 PackedMemoryArray::~PackedMemoryArray() {
-    // stop the timer manager (impl. called by the dtor)
-    delete m_timer_manager; m_timer_manager = nullptr;
+    // stop the timer manager first, as it sends requests to the rebalancer
+    m_timer_manager->stop();
 
     // stop the rebalancer
     delete m_rebalancer; m_rebalancer = nullptr;
 
+    // remove the timer manager
+    delete m_timer_manager; m_timer_manager = nullptr;
+    delete m_delay_controller; m_delay_controller = nullptr;
+    delete m_density_tuner; m_density_tuner = nullptr;
+    delete m_read_cache; m_read_cache = nullptr;
+
     // stop the garbage collector
     delete m_garbage_collector; m_garbage_collector = nullptr;
 
@@ -113,7 +151,7 @@ PackedMemoryArray::~PackedMemoryArray() {
     const uint64_t num_locks = get_number_locks();
     for(size_t i = 0; i < num_locks; i++){
         Gate& gate = m_locks.get_unsafe()[i];
-        delete gate.m_async_queue; gate.m_async_queue = nullptr;
+        delete gate.m_cold->m_async_queue; gate.m_cold->m_async_queue = nullptr;
     }
 
     // remove the locks
@@ -148,6 +186,7 @@ void PackedMemoryArray::register_thread(uint32_t client_id){
 }
 
 void PackedMemoryArray::unregister_thread(){
+    append_sync(); // make the staged insertions visible to the other threads
     get_context()->exit();
     ClientContext::unregister_client_thread();
 }
@@ -189,6 +228,7 @@ void PackedMemoryArray::writer_loop(int64_t key){
             std::sort(begin(deletions), end(deletions));
             for(auto& key : deletions){
                 int64_t value = -1;
+                if(delta_remove(gate, key, &value)) continue; // the key was still pending in the delta buffer
                 int64_t absseg2rebal = do_remove(gate, key, /* ignored */ &value);
 
                 // keep track of which segments to rebalance at the end
@@ -208,13 +248,18 @@ void PackedMemoryArray::writer_loop(int64_t key){
         bool inserted = true;
         auto& insertions = context->queue_local()->insertions();
         ClientContext::bitset_t* segments2rebalance = (num_deletions > 0 && context->m_bitset->any()) ? context->m_bitset : nullptr;
+        if(m_append_fastpath && insertions.size() > 1){ num_insertions += do_append(gate, insertions); }
         if(insertions.size() > 0){
             do {
                 auto& pair = insertions.back();
-                inserted = do_insert(gate, pair.first, pair.second, segments2rebalance);
+                if(m_delta_buffer_capacity > 0){
+                    inserted = delta_insert(gate, pair.first, pair.second, segments2rebalance, /* in/out */ num_insertions);
+                } else {
+                    inserted = do_insert(gate, pair.first, pair.second, segments2rebalance);
+                    num_insertions += inserted;
+                }
                 COUT_DEBUG("inserted = " << inserted);
                 if(inserted) {
-                    num_insertions++;
                     insertions.pop_back();
                 }
             } while(inserted && !insertions.empty());
@@ -252,8 +297,7 @@ Gate* PackedMemoryArray::writer_on_entry(int64_t key){
 
     do {
         try {
-            StaticIndex* index = m_index.get(*context); // snapshot, current index
-            auto gate_id = index->find(key);
+            auto gate_id = finger_find(context, key);
             Gate* gates = m_locks.get(*context);
 
             do {
@@ -263,18 +307,22 @@ Gate* PackedMemoryArray::writer_on_entry(int64_t key){
 
                 // is this the right gate ?
                 if(check_fence_keys(gate, /* in/out */ gate_id, key)){
+                    finger_set(context, gates, gate_id);
+                    if(m_append_fastpath){ append_split(gate, context); } // a flushed run may span multiple gates
 
                     switch(gate.m_state){
                     case Gate::State::FREE:
                     case Gate::State::READ:
                     case Gate::State::WRITE:
-                        if(gate.m_async_queue != nullptr){ // there is an asynchronous queue installed
-                            assert(gate.m_async_queue != context->queue_local() && "Inserting in my own private queue!");
-                            assert(gate.m_async_queue != context->queue_spare() && "Inserting in my own spare queue!");
-                            gate.m_async_queue->merge(context->queue_local());
+                        // the update is pending on this gate, the new readers will wait for it: invalidate the cached entries
+                        gate.bump_version();
+                        if(gate.m_cold->m_async_queue != nullptr){ // there is an asynchronous queue installed
+                            assert(gate.m_cold->m_async_queue != context->queue_local() && "Inserting in my own private queue!");
+                            assert(gate.m_cold->m_async_queue != context->queue_spare() && "Inserting in my own spare queue!");
+                            gate.m_cold->m_async_queue->merge(context->queue_local());
                             done = true;
                         } else {
-                            gate.m_async_queue = context->queue_spare();
+                            gate.m_cold->m_async_queue = context->queue_spare();
                             if(gate.m_state == Gate::State::FREE){ // man this gate
                                 assert(gate.m_num_active_threads == 0 && "There should not be any thread active on a free gate");
                                 gate.m_state = Gate::State::WRITE;
@@ -282,7 +330,7 @@ Gate* PackedMemoryArray::writer_on_entry(int64_t key){
                                 result = &gate;
                                 done = true;
                             } else {
-                                gate.m_async_queue->merge(context->queue_local()); // move the items from the local to the global queue
+                                gate.m_cold->m_async_queue->merge(context->queue_local()); // move the items from the local to the global queue
                                 writer_wait(gate, lock);
                                 context_switch = true;
                             }
@@ -290,12 +338,21 @@ Gate* PackedMemoryArray::writer_on_entry(int64_t key){
                     case Gate::State::TIMEOUT:
                     case Gate::State::REBAL:
                         writer_wait(gate, lock);
+                        break;
+                    case Gate::State::RESIZE:
+                        if(!m_resize_closing){ // defer the update, it will be loaded once the resize is complete
+                            if(gate.m_cold->m_async_queue == nullptr){ gate.m_cold->m_async_queue = new ClientContextQueue(); } // owned by the rebalancer
+                            gate.m_cold->m_async_queue->merge(context->queue_local());
+                            done = true;
+                        } else { // the new storage is about to be installed
+                            writer_wait(gate, lock);
+                        }
                     }
 
                     // we installed the global queue, check whether it's still in
                     while(context_switch){
                         lock.lock(); // relock the gate
-                        if(gate.m_async_queue != context->queue_spare()){
+                        if(gate.m_cold->m_async_queue != context->queue_spare()){
                             // kaboom, a rebalance occurred in the meanwhile & the items in the local queues have been loaded by the rebalancer
                             context->queue_new();
                             context_switch = false; // exit the context_switch loop
@@ -305,13 +362,14 @@ Gate* PackedMemoryArray::writer_on_entry(int64_t key){
                             case Gate::State::FREE: // finally, man this gate
                                 assert(gate.m_num_active_threads == 0 && "There should not be any thread active on a free gate");
                                 gate.m_state = Gate::State::WRITE;
+                                gate.bump_version();
                                 gate.m_num_active_threads = 1;
                                 result = &gate;
 
                                 assert(!context->queue_spare()->empty() && "The global queue should at least contain the first synchronous update");
                                 assert(context->queue_local()->empty() && "The private queue should be empty as the thread was in the wait list");
                                 context->queue_swap();
-                                gate.m_async_queue = context->queue_spare(); // the previous private queue is now the public queue
+                                gate.m_cold->m_async_queue = context->queue_spare(); // the previous private queue is now the public queue
 
                                 // we're done
                                 context_switch = false;
@@ -344,45 +402,47 @@ bool PackedMemoryArray::writer_on_exit(Gate* gate, int64_t cardinality_change, b
     bool client_exit = false; // is this a rebalancing (false) or a client_exit (true) request ?
 
     gate->lock();
-    assert(static_cast<int64_t>(gate->m_cardinality) + cardinality_change >= 0);
-    gate->m_cardinality += cardinality_change;
+    assert(static_cast<int64_t>(gate->m_cold->m_cardinality) + cardinality_change >= 0);
+    gate->m_cold->m_cardinality += cardinality_change;
+    gate->m_cold->m_num_updates += std::abs(cardinality_change);
     debug_validate_cardinality_gate(gate, cardinality_change);
 
     assert(gate->m_state == Gate::State::WRITE || gate->m_state == Gate::State::TIMEOUT || gate->m_state == Gate::State::REBAL);
-    assert(gate->m_async_queue == context->queue_spare());
+    assert(gate->m_cold->m_async_queue == context->queue_spare());
     assert(gate->m_num_active_threads == 1 && "The writer should have previously updated this member");
 
     switch(gate->m_state){
     case Gate::State::WRITE:
         if(do_rebalance) {
-            gate->m_async_queue->merge(context->queue_local());
+            gate->m_cold->m_async_queue->merge(context->queue_local());
             gate->m_num_active_threads = 0;
             context->queue_new();
 
             auto now = chrono::steady_clock::now();
-            if(now < gate->m_time_last_rebal + m_delayed_rebalance){ // delay this rebalance
+            auto deadline = (m_delay_controller != nullptr) ? m_delay_controller->deadline(gate, now) : gate->m_cold->m_time_last_rebal + m_delayed_rebalance;
+            if(now < deadline){ // delay this rebalance
                 gate->m_state = Gate::State::FREE;
-                auto delay_usecs = chrono::duration_cast<chrono::microseconds>(gate->m_time_last_rebal + m_delayed_rebalance - now);
-                m_timer_manager->delay_rebalance(gate->lock_id(), gate->m_time_last_rebal, delay_usecs);
+                auto delay_usecs = chrono::duration_cast<chrono::microseconds>(deadline - now);
+                m_timer_manager->delay_rebalance(gate, gate->m_cold->m_time_last_rebal, delay_usecs);
                 gate->wake_next(context);
             } else { // rebalance immediately
                 gate->m_state = Gate::State::REBAL;
                 send_rebalance_request = true;
                 writer_do_pending_deletions(gate);
             }
-        } else if (gate->m_async_queue->empty()){ // we're done, there are no more items to asynchronously update
-            gate->m_async_queue = nullptr;
+        } else if (gate->m_cold->m_async_queue->empty()){ // we're done, there are no more items to asynchronously update
+            gate->m_cold->m_async_queue = nullptr;
             gate->m_num_active_threads = 0;
             gate->m_state = Gate::State::FREE;
             gate->wake_next(context);
-        } else if (gate->m_queue.size() > 0){ // context switch, other clients are waiting to access this queue
+        } else if (gate->m_cold->m_queue.size() > 0){ // context switch, other clients are waiting to access this queue
             gate->m_num_active_threads = 0;
             gate->m_state = Gate::State::FREE;
             gate->wake_next(context);
 
             std::promise<void> producer;
             std::future<void> consumer = producer.get_future();
-            gate->m_queue.append({ Gate::State::WRITE, &producer } );
+            gate->m_cold->m_queue.append({ Gate::State::WRITE, &producer } );
             gate->unlock();
             context->process_wakelist();
             consumer.wait();
@@ -391,21 +451,22 @@ bool PackedMemoryArray::writer_on_exit(Gate* gate, int64_t cardinality_change, b
 
             do {
                 gate->lock();
-                if(gate->m_async_queue != context->queue_spare()){ // the Rebalancer must have touched this gate, taking already care to merge the items in the global queue
+                if(gate->m_cold->m_async_queue != context->queue_spare()){ // the Rebalancer must have touched this gate, taking already care to merge the items in the global queue
                     context->queue_new();
                     context_switch = false; // done
                 } else if (gate->m_state != Gate::State::FREE){ // someone else stole our spot!
                     writer_wait(*gate); // context switch
                 } else {
                     assert(gate->m_state == Gate::State::FREE);
-                    assert(gate->m_async_queue == context->queue_spare());
+                    assert(gate->m_cold->m_async_queue == context->queue_spare());
                     assert(!context->queue_spare()->empty() && "Who cleared my global queue?");
 
                     context->queue_swap();
-                    gate->m_async_queue = context->queue_spare(); // the previous private queue is now the public queue
+                    gate->m_cold->m_async_queue = context->queue_spare(); // the previous private queue is now the public queue
 
                     gate->m_num_active_threads = 1;
                     gate->m_state = Gate::State::WRITE;
+                    gate->bump_version();
 
                     hold_this_gate = true; // we still have to man this gate
                     context_switch = false; // done
@@ -413,7 +474,7 @@ bool PackedMemoryArray::writer_on_exit(Gate* gate, int64_t cardinality_change, b
             } while(context_switch);
         } else { // there are no other clients waiting for && the global queue is not empty
             context->queue_swap();
-            gate->m_async_queue = context->queue_spare(); // the previous private queue is now the public queue
+            gate->m_cold->m_async_queue = context->queue_spare(); // the previous private queue is now the public queue
             hold_this_gate = true;
         }
         break;
@@ -425,7 +486,7 @@ bool PackedMemoryArray::writer_on_exit(Gate* gate, int64_t cardinality_change, b
         gate->m_state = Gate::State::REBAL;
         gate->m_num_active_threads = 0;
 
-        gate->m_async_queue->merge(context->queue_local());
+        gate->m_cold->m_async_queue->merge(context->queue_local());
         writer_do_pending_deletions(gate);
         context->queue_new();
 
@@ -435,7 +496,7 @@ bool PackedMemoryArray::writer_on_exit(Gate* gate, int64_t cardinality_change, b
     }
 
 
-    COUT_DEBUG("send_rebalance_request: " << send_rebalance_request << ", client_exit: " << client_exit << ",  async queue: " << gate->m_async_queue);
+    COUT_DEBUG("send_rebalance_request: " << send_rebalance_request << ", client_exit: " << client_exit << ",  async queue: " << gate->m_cold->m_async_queue);
 
     gate->unlock();
 
@@ -452,28 +513,29 @@ bool PackedMemoryArray::writer_on_exit(Gate* gate, int64_t cardinality_change, b
 void PackedMemoryArray::writer_do_pending_deletions(Gate* gate){
     assert(gate != nullptr);
     assert(gate->m_locked == true && "This method can be invoked only while helding the lock for the gate");
-    if(gate->m_async_queue == nullptr) return; // there is no queue attached to this gate
+    if(gate->m_cold->m_async_queue == nullptr) return; // there is no queue attached to this gate
 
-    auto& queue = gate->m_async_queue->deletions();
+    auto& queue = gate->m_cold->m_async_queue->deletions();
     if(queue.empty()) return;
 
     int64_t num_deletions = 0;
     std::sort(begin(queue), end(queue));
     for(int64_t key : queue){
         int64_t value = -1;
+        if(delta_remove(gate, key, &value)) continue; // the key was still pending in the delta buffer
         do_remove(gate, key, &value);
         num_deletions += (value != -1);
     }
 
-    assert(gate->m_cardinality >= num_deletions);
-    gate->m_cardinality -= num_deletions;
+    assert(gate->m_cold->m_cardinality >= num_deletions);
+    gate->m_cold->m_cardinality -= num_deletions;
 }
 
 template<typename Lock>
 void PackedMemoryArray::writer_wait(Gate& gate, Lock& lock){
     std::promise<void> producer;
     std::future<void> consumer = producer.get_future();
-    gate.m_queue.append({ Gate::State::WRITE, &producer } );
+    gate.m_cold->m_queue.append({ Gate::State::WRITE, &producer } );
     lock.unlock();
     consumer.wait();
 }
@@ -484,13 +546,12 @@ void PackedMemoryArray::writer_wait(Gate& gate, Lock& lock){
  *                                                                           *
  *****************************************************************************/
 
-Gate* PackedMemoryArray::reader_on_entry(int64_t key, int64_t start_gate_id) const {
+Gate* PackedMemoryArray::reader_on_entry(int64_t key, int64_t start_gate_id, const WindowSnapshot** out_snapshot) const {
     ClientContext* context = get_context();
     assert(context != nullptr);
     uint64_t gate_id { 0 };
     if(start_gate_id < 0){
-        StaticIndex* index = m_index.get(*context); // snapshot, current index
-        gate_id = index->find(key);
+        gate_id = finger_find(context, key);
     } else {
         gate_id = static_cast<uint64_t>(start_gate_id);
     }
@@ -505,6 +566,7 @@ Gate* PackedMemoryArray::reader_on_entry(int64_t key, int64_t start_gate_id) con
         unique_lock<Gate> lock(gate);
         // is this the right gate ?
         if(check_fence_keys(gate, /* in/out */ gate_id, key)){
+            finger_set(context, gates, gate_id);
             switch(gate.m_state){
             case Gate::State::FREE:
                 assert(gate.m_num_active_threads == 0 && "Precondition not satisfied");
@@ -516,7 +578,7 @@ Gate* PackedMemoryArray::reader_on_entry(int64_t key, int64_t start_gate_id) con
                 done = true; // done, go on
                 break;
             case Gate::State::READ:
-                if(gate.m_queue.empty()){ // as above
+                if(gate.m_cold->m_queue.empty()){ // as above
                     gate.m_num_active_threads++;
                     lock.unlock();
                     result = gates + gate_id;
@@ -525,20 +587,37 @@ Gate* PackedMemoryArray::reader_on_entry(int64_t key, int64_t start_gate_id) con
                     std::promise<void> producer;
                     std::future<void> consumer = producer.get_future();
 
-                    gate.m_queue.append({ Gate::State::READ, &producer } );
+                    gate.m_cold->m_queue.append({ Gate::State::READ, &producer } );
                     lock.unlock();
 
                     consumer.wait();
                 }
                 break;
+            case Gate::State::RESIZE:
+                if(!m_resize_closing){ // the old storage is still valid, read from it
+                    gate.m_num_active_threads++;
+                    lock.unlock();
+                    result = gates + gate_id;
+                    done = true;
+                    break;
+                }
+                /* fall through */
+            case Gate::State::REBAL:
+                if(out_snapshot != nullptr && gate.m_cold->m_snapshot != nullptr && gate.m_cold->m_snapshot->contains(key)){ // read the content before the rebalance
+                    *out_snapshot = gate.m_cold->m_snapshot;
+                    lock.unlock();
+                    result = gates + gate_id;
+                    done = true;
+                    break;
+                }
+                /* fall through */
             case Gate::State::WRITE:
             case Gate::State::TIMEOUT:
-            case Gate::State::REBAL:
                 { // add the thread in the queue
                     std::promise<void> producer;
                     std::future<void> consumer = producer.get_future();
 
-                    gate.m_queue.append({ Gate::State::READ, &producer } );
+                    gate.m_cold->m_queue.append({ Gate::State::READ, &producer } );
                     lock.unlock();
 
                     consumer.wait();
@@ -571,8 +650,12 @@ void PackedMemoryArray::reader_on_exit(Gate* gate) const {
            client_exit = (gate->m_state == Gate::State::REBAL);
            gate->m_state = Gate::State::REBAL;
 
-           // optimisation, avoid performing the deletions in the rebalancer
-           const_cast<PackedMemoryArray*>(this)->writer_do_pending_deletions(gate);
+           // optimisation, avoid performing the deletions in the rebalancer. Not in the old gates of an online resize,
+           // their pending updates are moved to the new gates by the master
+           if(!m_resize_closing){ const_cast<PackedMemoryArray*>(this)->writer_do_pending_deletions(gate); }
+       } break;
+       case Gate::State::RESIZE: {
+           /* nop, the old storage is still open, the master checks the active readers when it closes the gate */
        } break;
        default:
            assert(0 && "Invalid state");
@@ -594,51 +677,60 @@ void PackedMemoryArray::reader_on_exit(Gate* gate) const {
  *   - Only invoked by the Timer Manager                                     *
  *                                                                           *
  *****************************************************************************/
-void PackedMemoryArray::timeout(size_t gate_id, std::chrono::steady_clock::time_point time_last_rebal){
+void PackedMemoryArray::timeout(const std::vector<Gate*>& expired){
     auto context = m_thread_contexts.timer_manager();
     ScopedState scope{context};
+    vector<uint64_t> gate_ids; // the gates to rebalance
 
     try {
-        bool send_rebalance_request = false; // request a global rebalance ?
-
-        if(gate_id >= get_number_locks()) return; // it may refer a gate_id that doesn't exist anymore due to a downsize
-
-        Gate& gate = m_locks.get(context)[gate_id]; // it can throw an Abort exception
-
-        unique_lock<Gate> lock(gate);
-
-        if(gate.m_time_last_rebal == time_last_rebal){ // check that the gate hasn't been rebalanced in the meanwhile
-            switch(gate.m_state){
-            case Gate::State::FREE:
-                assert(gate.m_num_active_threads == 0 && "Great, the gate is free but there are registered threads being active on it");
-                send_rebalance_request = true;
-                gate.m_state = Gate::State::REBAL;
-                break;
-            case Gate::State::READ:
-            case Gate::State::WRITE:
-                assert(gate.m_num_active_threads > 0 && "There should be some client thread still active on this gate");
-                gate.m_state = Gate::State::TIMEOUT; // the last client thread that leaves this gate needs to invoke the global rebalancer
-                break;
-            case Gate::State::TIMEOUT:
-                // we've already requested to rebalance this segment?
-                assert(gate.m_num_active_threads > 0 && "There should be some client thread still active on this gate");
-                /* nop */
-                break;
-            case Gate::State::REBAL:
-                /* nop */
-                break;
+        Gate* gates = m_locks.get(context); // it can throw an Abort exception
+        const uint64_t num_gates = get_number_locks();
+
+        for(Gate* gate : expired){
+            // it may refer a gate that doesn't exist anymore due to a resize
+            if(gate < gates || gate >= gates + num_gates) continue;
+
+            bool send_rebalance_request = false; // request a global rebalance ?
+            unique_lock<Gate> lock(*gate);
+
+            if(gate->m_cold->m_time_last_rebal == gate->m_cold->m_timer.m_time_last_rebal){ // check that the gate hasn't been rebalanced in the meanwhile
+                switch(gate->m_state){
+                case Gate::State::FREE:
+                    assert(gate->m_num_active_threads == 0 && "Great, the gate is free but there are registered threads being active on it");
+                    send_rebalance_request = true;
+                    gate->m_state = Gate::State::REBAL;
+                    gate->bump_version();
+                    break;
+                case Gate::State::READ:
+                case Gate::State::WRITE:
+                    assert(gate->m_num_active_threads > 0 && "There should be some client thread still active on this gate");
+                    gate->m_state = Gate::State::TIMEOUT; // the last client thread that leaves this gate needs to invoke the global rebalancer
+                    gate->bump_version();
+                    break;
+                case Gate::State::TIMEOUT:
+                    // we've already requested to rebalance this segment?
+                    assert(gate->m_num_active_threads > 0 && "There should be some client thread still active on this gate");
+                    /* nop */
+                    break;
+                case Gate::State::REBAL:
+                case Gate::State::RESIZE:
+                    /* nop */
+                    break;
+                }
             }
-        }
 
-        lock.unlock();
+            lock.unlock();
 
-        if(send_rebalance_request)
-            rebalance_global(gate_id, false);
+            if(send_rebalance_request){ gate_ids.push_back(gate->lock_id()); }
+        }
 
     } catch(Abort) {
         // if we abort, then it means that the PMA has resized in the meanwhile and the request
         // to rebalance became obsolete -> nop
     }
+
+    // hand all gates to the rebalancer at once
+    if(!gate_ids.empty()){ m_rebalancer->rebalance(gate_ids); }
 }
 
 
@@ -649,13 +741,17 @@ void PackedMemoryArray::timeout(size_t gate_id, std::chrono::steady_clock::time_
  *****************************************************************************/
 
 bool PackedMemoryArray::empty() const noexcept{
+    return size() == 0;
+}
+
+bool PackedMemoryArray::storage_empty() const noexcept{
     assert(m_cardinality >= 0 && "Negative cardinality ?");
     return m_cardinality == 0;
 }
 
 size_t PackedMemoryArray::size() const noexcept {
     assert(m_cardinality >= 0 && "Negative cardinality ?");
-    return m_cardinality;
+    return m_cardinality + m_delta_cardinality;
 }
 
 const CachedDensityBounds& PackedMemoryArray::get_thresholds() const {
@@ -666,6 +762,10 @@ const CachedDensityBounds& PackedMemoryArray::get_thresholds() const {
     }
 }
 
+const ReadCache* PackedMemoryArray::read_cache() const {
+    return m_read_cache;
+}
+
 std::pair<double, double> PackedMemoryArray::get_thresholds(int height) const {
     assert(height >= 1 && height <= m_storage.hyperheight());
     return get_thresholds().thresholds(height);
@@ -682,11 +782,31 @@ void PackedMemoryArray::set_thresholds(int height_calibrator_tree){
 
 void PackedMemoryArray::set_thresholds(const RebalancePlan& action){
     if(action.m_operation == RebalanceOperation::RESIZE || action.m_operation == RebalanceOperation::RESIZE_REBALANCE){
+        // all gates are held by the caller, revise the primary densities according to the workload observed
+        if(m_density_tuner != nullptr){
+            double theta_h = m_density_tuner->tune(get_primary_density());
+            if(theta_h != get_primary_density()){ m_density_bounds1 = CachedDensityBounds(0, theta_h, theta_h, 1); }
+        }
+
         m_primary_densities = action.m_window_length > balanced_thresholds_cutoff();
         set_thresholds(ceil(log2(action.m_window_length)) +1);
+    } else if(m_density_tuner != nullptr){
+        m_density_tuner->record_rebalance(action.get_cardinality_after());
     }
 }
 
+void PackedMemoryArray::set_primary_density(double theta_h){
+    if(!(0 < theta_h && theta_h < 1)) throw std::invalid_argument("[PackedMemoryArray::set_primary_density] Invalid density, it must be in (0, 1)");
+    if(m_density_tuner != nullptr && (theta_h < m_density_tuner->density_min() || theta_h > m_density_tuner->density_max()))
+        throw std::invalid_argument("[PackedMemoryArray::set_primary_density] The density is out of the bounds of the tuner");
+    m_density_bounds1 = CachedDensityBounds(0, theta_h, theta_h, 1);
+    set_thresholds(m_storage.hyperheight());
+}
+
+double PackedMemoryArray::get_primary_density() const {
+    return m_density_bounds1.get_upper_threshold_root();
+}
+
 size_t PackedMemoryArray::balanced_thresholds_cutoff() const {
     return m_knobs.get_thresholds_switch() * m_storage.get_segments_per_extent();
 }
@@ -699,6 +819,19 @@ Knobs& PackedMemoryArray::knobs(){
     return m_knobs;
 }
 
+Detector& PackedMemoryArray::detector(){
+    return m_detector;
+}
+
+bool PackedMemoryArray::detector_sample() const {
+    if(!m_adaptive_rebalancing) return false;
+    static thread_local uint32_t counter = 0;
+    int32_t sampling_percentage = m_knobs.get_sampling_percentage();
+    if(sampling_percentage >= 100) return true;
+    counter = (counter +1) % 100;
+    return static_cast<int32_t>(counter) < sampling_percentage;
+}
+
 size_t PackedMemoryArray::get_segment_capacity() const noexcept {
     return m_storage.m_segment_capacity;
 }
@@ -711,16 +844,27 @@ size_t PackedMemoryArray::get_number_locks() const noexcept {
     return max<size_t>(1ull, m_storage.m_number_segments / get_segments_per_lock());
 }
 
+uint64_t PackedMemoryArray::get_number_skewed_rebalances() const noexcept {
+    return m_num_skewed_rebalances.load(memory_order_relaxed);
+}
+
 void PackedMemoryArray::build() {
     on_complete();
 }
 
 size_t PackedMemoryArray::memory_footprint() const {
     size_t space_index = m_index.get_unsafe()->memory_footprint();
-    size_t space_locks = get_segments_per_lock() * (sizeof(Gate) + /* separator keys */ (m_index.get_unsafe()->node_size() -1) * sizeof(int64_t));
+    size_t space_locks = get_segments_per_lock() * (sizeof(Gate) + sizeof(Gate::Cold) + /* separator keys */ (m_index_block_size -1) * sizeof(int64_t));
     size_t space_storage = m_storage.memory_footprint();
+    size_t space_detector = m_detector.capacity() * m_detector.sizeof_entry() * sizeof(uint64_t);
+    size_t space_delta_buffers = 0;
+    for(uint64_t i = 0, num_locks = get_number_locks(); i < num_locks; i++){
+        const DeltaBuffer* delta = m_locks.get_unsafe()[i].m_delta_buffer;
+        if(delta != nullptr){ space_delta_buffers += delta->memory_footprint(); }
+    }
 
-    return sizeof(decltype(*this)) + space_index + space_locks + space_storage;
+    size_t space_read_cache = m_read_cache != nullptr ? m_read_cache->memory_footprint() : 0;
+    return sizeof(decltype(*this)) + space_index + space_locks + space_storage + space_detector + space_delta_buffers + space_read_cache;
 }
 
 void PackedMemoryArray::rebalance_global(uint64_t gate_id, bool client_exit) const{
@@ -753,6 +897,47 @@ bool PackedMemoryArray::check_fence_keys(Gate& gate, uint64_t& gate_id, int64_t
     return false;
 }
 
+uint64_t PackedMemoryArray::finger_find(ClientContext* context, int64_t key) const {
+    const auto& finger = context->m_finger;
+    const Gate* gates = m_locks.get(*context);
+    barrier();
+    if(finger.m_gates == gates && finger.m_timestamp == m_locks.timestamp()){ // same array of gates
+        if(key < finger.m_fence_low_key){ // try with the gate on the left, its fence keys are only a hint without its lock
+            if(finger.m_gate_id > 0){
+                const Gate& gate = gates[finger.m_gate_id -1];
+                if(gate.m_fence_low_key <= key && key <= gate.m_fence_high_key) return finger.m_gate_id -1;
+            }
+        } else if(key > finger.m_fence_high_key){ // try with the gate on the right. The last gate always has the max fence key
+            const Gate& gate = gates[finger.m_gate_id +1];
+            if(gate.m_fence_low_key <= key && key <= gate.m_fence_high_key) return finger.m_gate_id +1;
+        } else {
+            return finger.m_gate_id;
+        }
+    }
+
+    return m_index.get(*context)->find(key);
+}
+
+void PackedMemoryArray::finger_set(ClientContext* context, const Gate* gates, uint64_t gate_id) const {
+    assert(gates[gate_id].m_locked && "The lock of the gate must be held by the caller");
+    auto& finger = context->m_finger;
+
+    // the timestamp is reset to max while the master installs a new array, read it before & after the pointer to the array
+    uint64_t timestamp = m_locks.timestamp();
+    barrier();
+    bool valid = (m_locks.get_unsafe() == gates);
+    barrier();
+    if(!valid || timestamp == numeric_limits<uint64_t>::max() || timestamp != m_locks.timestamp()){
+        finger.m_gates = nullptr; // a resize is in progress
+    } else {
+        finger.m_gates = gates;
+        finger.m_timestamp = timestamp;
+        finger.m_gate_id = gate_id;
+        finger.m_fence_low_key = gates[gate_id].m_fence_low_key;
+        finger.m_fence_high_key = gates[gate_id].m_fence_high_key;
+    }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Index                                                                   *
@@ -797,6 +982,9 @@ void PackedMemoryArray::insert(int64_t key, int64_t value){
     assert(context->queue_local()->empty());
     assert(context->queue_spare()->empty());
 
+    if(m_density_tuner != nullptr){ m_density_tuner->record_update(); }
+    if(m_append_fastpath && append_enqueue(context, key, value)){ return; } // staged
+
     // Add the element to process in the local queue
     context->queue_local()->insertions().emplace_back(key, value);
 
@@ -816,7 +1004,7 @@ bool PackedMemoryArray::do_insert(Gate* gate, int64_t key, int64_t value, Client
         insert_empty(key, value);
         return true;
     } else {
-        size_t segment = gate->find(key);
+        size_t segment = gate->find(key, m_knobs.m_search_strategy);
         return insert_common(segment, key, value, bitset);
     }
 }
@@ -826,9 +1014,11 @@ void PackedMemoryArray::insert_empty(int64_t key, int64_t value){
     COUT_DEBUG("key: " << key << ", value: " << value);
 
     m_storage.m_segment_sizes[0] = 1;
+    m_storage.clear_tombstones(0); // the segment may still contain some deleted elements
     size_t pos = m_storage.m_segment_capacity -1;
     m_storage.m_keys[pos] = key;
     m_storage.m_values[pos] = value;
+    m_storage.rebuild_filters(0, 1); // discard the keys previously removed from the segment
     m_cardinality = 1;
 }
 
@@ -837,6 +1027,9 @@ bool PackedMemoryArray::insert_common(size_t segment_id, int64_t key, int64_t va
     assert(segment_id < m_storage.m_number_segments && "Overflow: attempting to access an invalid segment in the PMA");
 //    COUT_DEBUG("segment_id: " << segment_id << ", element: <" << key << ", " << value << ">");
 
+    // lazy deletes, remove the tombstones before shifting the elements in the segment
+    m_storage.compact_tombstones(segment_id, segment_id +1);
+
     // is this bucket full ?
     auto bucket_cardinality = m_storage.m_segment_sizes[segment_id];
     if(bucket_cardinality == m_storage.m_segment_capacity){
@@ -860,44 +1053,35 @@ bool PackedMemoryArray::storage_insert_unsafe(size_t segment_id, int64_t key, in
     bool minimum = false; // the inserted key is the new minimum ?
     size_t sz = m_storage.m_segment_sizes[segment_id];
     assert(sz < m_storage.m_segment_capacity && "Segment overfilled");
+    int64_t predecessor, successor; // to update the detector
 
     if(segment_id % 2 == 0){ // for even segment ids (0, 2, ...), insert at the end of the segment
         size_t stop = m_storage.m_segment_capacity -1;
         size_t start = m_storage.m_segment_capacity - sz -1;
-        size_t i = start;
-
-        while(i < stop && keys[i+1] < key){
-            keys[i] = keys[i+1];
-            i++;
-        }
-
-//        COUT_DEBUG("(even) segment_id: " << segment_id << ", start: " << start << ", stop: " << stop << ", key: " << key << ", value: " << value << ", pos   ition: " << i);
-        keys[i] = key;
-
-        for(size_t j = start; j < i; j++){
-            values[j] = values[j+1];
-        }
-        values[i] = value;
+        size_t i = segment_kernels::insert_even(keys, values, m_storage.m_segment_capacity, sz, key, value, m_knobs.m_search_strategy);
 
+//        COUT_DEBUG("(even) segment_id: " << segment_id << ", start: " << start << ", stop: " << stop << ", key: " << key << ", value: " << value << ", position: " << i);
         minimum = (i == start);
+        bool maximum = (i == stop);
+
+        // update the detector
+        predecessor = minimum ? std::numeric_limits<int64_t>::min() : keys[i -1];
+        successor = maximum ? std::numeric_limits<int64_t>::max() : keys[i +1];
     } else { // for odd segment ids (1, 3, ...), insert at the front of the segment
-        size_t i = sz;
-        while(i > 0 && keys[i-1] > key){
-            keys[i] = keys[i-1];
-            i--;
-        }
+        size_t i = segment_kernels::insert_odd(keys, values, m_storage.m_segment_capacity, sz, key, value, m_knobs.m_search_strategy);
 
 //        COUT_DEBUG("(odd) segment_id: " << segment_id << ", key: " << key << ", value: " << value << ", position: " << i);
-        keys[i] = key;
-
-        for(size_t j = sz; j > i; j--){
-            values[j] = values[j-1];
-        }
-        values[i] = value;
-
         minimum = (i == 0);
+        bool maximum = (i == sz);
+
+        // update the detector
+        predecessor = minimum ? std::numeric_limits<int64_t>::min() : keys[i -1];
+        successor = maximum ? std::numeric_limits<int64_t>::max() : keys[i +1];
     }
 
+    if(detector_sample()){ m_detector.insert(segment_id, predecessor, successor); }
+    m_storage.filter_insert(segment_id, key);
+
     // update the cardinality
     m_storage.m_segment_sizes[segment_id]++;
     m_cardinality++;
@@ -905,6 +1089,226 @@ bool PackedMemoryArray::storage_insert_unsafe(size_t segment_id, int64_t key, in
     return minimum;
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   Append                                                                  *
+ *                                                                           *
+ *****************************************************************************/
+bool PackedMemoryArray::append_enqueue(ClientContext* context, int64_t key, int64_t value){
+    assert(m_append_fastpath && "Append fast path not enabled");
+
+    context->m_append_streak = (key > context->m_append_last_key) ? context->m_append_streak +1 : 0;
+    context->m_append_last_key = key;
+
+    if(context->m_append_streak < APPEND_STREAK_MIN){ // not a run, yet
+        append_flush(context); // the previous insertions of this thread must precede this one
+        return false;
+    }
+
+    context->m_appends.emplace_back(key, value);
+    if(context->m_appends.size() >= APPEND_BUFFER_CAPACITY){
+        append_flush(context);
+    }
+
+    return true;
+}
+
+void PackedMemoryArray::append_flush(ClientContext* context){
+    assert(context->epoch() < numeric_limits<uint64_t>::max() && "Epoch not set");
+    assert(context->queue_local()->empty() && context->queue_spare()->empty());
+    auto& appends = context->m_appends;
+
+    while(!appends.empty()){
+        COUT_DEBUG("run: [" << appends.front().first << ", " << appends.back().first << "], size: " << appends.size());
+
+        // the writer loop processes the insertions from the back of the queue, reverse the run so that its smallest keys come first.
+        // Fetch the local queue at each iteration, the writer loop may have swapped it with the spare queue
+        auto& insertions = context->queue_local()->insertions();
+        insertions.assign(appends.rbegin(), appends.rend());
+        appends.clear();
+
+        // on entry, the elements in the queue that belong to the next gates are moved back in the buffer
+        writer_loop(insertions.back().first);
+    }
+
+    assert(context->queue_local()->empty() && context->queue_spare()->empty());
+}
+
+void PackedMemoryArray::append_sync() const {
+    if(!m_append_fastpath) return;
+    ClientContext* context = get_context();
+    if(context->m_appends.empty()) return;
+
+    ScopedState scope { context };
+    const_cast<PackedMemoryArray*>(this)->append_flush(context); // the buffer is private to the current thread
+}
+
+void PackedMemoryArray::append_split(const Gate& gate, ClientContext* context){
+    assert(gate.m_locked && "The gate must be locked by the current thread");
+    auto& insertions = context->queue_local()->insertions();
+    if(insertions.empty() || insertions.front().first <= gate.m_fence_high_key) return; // fast path, this is not a run spanning multiple gates
+
+    // the run is sorted in decreasing order, the elements beyond the gate are at the front of the queue. They precede the
+    // elements already moved back in the buffer, in case the gate has been resized while the thread was waiting on it
+    auto it = find_if(begin(insertions), end(insertions), [&gate](auto& p){ return p.first <= gate.m_fence_high_key; });
+    context->m_appends.insert(begin(context->m_appends), make_reverse_iterator(it), insertions.rend());
+    insertions.erase(begin(insertions), it);
+}
+
+uint64_t PackedMemoryArray::do_append(Gate* gate, vector<ClientContextQueue::insertion_t>& insertions){
+    assert(!insertions.empty());
+    uint64_t num_appended = 0;
+    if(UNLIKELY( empty() )){
+        insert_empty(insertions.back().first, insertions.back().second);
+        insertions.pop_back();
+        num_appended++;
+    }
+
+    // find the last element in the gate
+    const int64_t capacity = m_storage.m_segment_capacity;
+    const int64_t window_end = min<int64_t>(gate->window_start() + gate->window_length(), m_storage.m_number_segments); // the first gate may be larger than the storage
+    int64_t segment_id = window_end -1;
+    while(segment_id >= gate->window_start()){
+        m_storage.compact_tombstones(segment_id, segment_id +1);
+        if(m_storage.m_segment_sizes[segment_id] > 0) break;
+        segment_id--;
+    }
+    if(segment_id < gate->window_start()) return num_appended; // the gate is empty, use the standard procedure
+    int64_t max_key = (segment_id % 2 == 0) ? m_storage.m_keys[(segment_id +1) * capacity -1] : m_storage.m_keys[segment_id * capacity + m_storage.m_segment_sizes[segment_id] -1];
+
+    // whether the key can be stored in the segment, according to the separator keys of the gate
+    auto fits = [gate, window_end](int64_t segment_id, int64_t key){
+        return (segment_id +1 == window_end) ? key <= gate->m_fence_high_key : key < gate->get_separator_key(segment_id +1);
+    };
+
+    int64_t* __restrict keys = m_storage.m_keys;
+    int64_t* __restrict values = m_storage.m_values;
+    while(!insertions.empty() && insertions.back().first > max_key){
+        const int64_t key = insertions.back().first;
+        int64_t sz = m_storage.m_segment_sizes[segment_id];
+        if(sz == capacity || !fits(segment_id, key)){ // move to the next segment, all segments after the current one are empty
+            if(segment_id +1 == window_end) break; // the gate is full
+            segment_id = max<int64_t>(segment_id +1, gate->find(key, m_knobs.m_search_strategy));
+            m_storage.clear_tombstones(segment_id);
+            gate->set_separator_key(segment_id, key);
+            sz = 0;
+        }
+
+        // length of the run that fits in the segment
+        int64_t length = 0;
+        int64_t run_max = max_key;
+        for(int64_t i = insertions.size() -1; i >= 0 && length < capacity - sz && insertions[i].first > run_max && fits(segment_id, insertions[i].first); i--){
+            run_max = insertions[i].first;
+            length++;
+        }
+        assert(length > 0 && "The first key of the run should always fit in the segment");
+
+        int64_t pos_start = segment_id * capacity; // position of the first appended element
+        if(segment_id % 2 == 0){ // even segment, shift the existing elements towards the start
+            pos_start += capacity - length;
+            memmove(keys + pos_start - sz, keys + pos_start - sz + length, sz * sizeof(keys[0]));
+            memmove(values + pos_start - sz, values + pos_start - sz + length, sz * sizeof(values[0]));
+        } else { // odd segment, the free space is at the end
+            pos_start += sz;
+        }
+        for(int64_t i = 0; i < length; i++){
+            auto& p = insertions[insertions.size() -1 -i];
+            keys[pos_start + i] = p.first;
+            values[pos_start + i] = p.second;
+            m_storage.filter_insert(segment_id, p.first);
+
+            // update the detector, as in #storage_insert_unsafe, the sequence drives the adaptive rebalances
+            if(detector_sample()){ m_detector.insert(segment_id, (i == 0) ? max_key : keys[pos_start + i -1], numeric_limits<int64_t>::max()); }
+        }
+        insertions.resize(insertions.size() - length);
+
+        m_storage.m_segment_sizes[segment_id] += length;
+        m_cardinality += length;
+        num_appended += length;
+        max_key = run_max;
+    }
+
+    COUT_DEBUG("gate: " << gate->lock_id() << ", appended: " << num_appended << ", remaining: " << insertions.size());
+    return num_appended;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Delta buffers                                                           *
+ *                                                                           *
+ *****************************************************************************/
+bool PackedMemoryArray::delta_insert(Gate* gate, int64_t key, int64_t value, ClientContext::bitset_t* bitset, int64_t& num_insertions){
+    assert(gate != nullptr && "Null pointer");
+    assert(m_delta_buffer_capacity > 0 && "Delta buffers not enabled");
+
+    if(UNLIKELY( empty() )){ // the first element goes straight into the storage
+        insert_empty(key, value);
+        num_insertions++;
+        return true;
+    }
+
+    if(gate->m_delta_buffer == nullptr){ gate->m_delta_buffer = new DeltaBuffer(m_delta_buffer_capacity); }
+    if(gate->m_delta_buffer->full() && !delta_flush(gate, bitset, num_insertions)){ return false; }
+
+    COUT_DEBUG("gate: " << gate->lock_id() << ", key: " << key << ", value: " << value << ", buffer size: " << gate->m_delta_buffer->size());
+    gate->m_delta_buffer->insert(key, value);
+    m_delta_cardinality++;
+
+    return true;
+}
+
+bool PackedMemoryArray::delta_flush(Gate* gate, ClientContext::bitset_t* bitset, int64_t& num_insertions){
+    assert(gate != nullptr && gate->m_delta_buffer != nullptr && "Null pointer");
+    DeltaBuffer* delta = gate->m_delta_buffer;
+    const int64_t window_start = gate->m_window_start;
+    const int64_t window_length = gate->m_window_length;
+    bool result = true;
+
+    if(window_start + window_length <= m_storage.m_number_segments){ // merge the buffer in a single spread of the whole gate
+        m_storage.compact_tombstones(window_start, window_start + window_length);
+
+        int64_t cardinality_before = 0;
+        for(int64_t segment_id = window_start; segment_id < window_start + window_length; segment_id++){
+            cardinality_before += m_storage.m_segment_sizes[segment_id];
+        }
+        int64_t cardinality_after = cardinality_before + delta->size();
+        double theta = get_thresholds(static_cast<int>(log2(window_length)) +1).second;
+
+        if(cardinality_after <= theta * window_length * m_storage.m_segment_capacity){
+            auto plan = rebalance_plan(window_start, window_length, cardinality_before, cardinality_after, /* resize ? */ false);
+            set_thresholds(plan);
+            spread_local(plan, /* insertion */ nullptr, delta);
+            if(bitset != nullptr){ bitset->reset(0, window_length); } // all segments of the gate have been rebalanced
+
+            num_insertions += delta->size();
+            m_delta_cardinality -= delta->size();
+            delta->clear();
+        } else { // the gate is too dense, the buffer will be loaded by the global rebalance
+            result = false;
+        }
+    } else { // the storage is smaller than a gate, insert the elements one at the time, possibly resizing the storage
+        uint64_t num_flushed = 0;
+        while(result && num_flushed < delta->size()){
+            result = do_insert(gate, delta->keys()[num_flushed], delta->values()[num_flushed], bitset);
+            num_flushed += result;
+        }
+
+        delta->pop_front(num_flushed);
+        num_insertions += num_flushed;
+        m_delta_cardinality -= num_flushed;
+    }
+
+    COUT_DEBUG("gate: " << gate->lock_id() << ", result: " << result << ", elements left in the buffer: " << delta->size());
+    return result;
+}
+
+bool PackedMemoryArray::delta_remove(Gate* gate, int64_t key, int64_t* out_value){
+    assert(gate != nullptr && "Null pointer");
+    if(gate->m_delta_buffer == nullptr || !gate->m_delta_buffer->remove(key, out_value)) return false;
+    m_delta_cardinality--;
+    return true;
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Remove                                                                  *
@@ -918,8 +1322,11 @@ int64_t PackedMemoryArray::remove(int64_t key){
     assert(context->queue_local()->empty());
     assert(context->queue_spare()->empty());
 
+    if(m_append_fastpath){ append_flush(context); } // the key may still be staged
+
     // Add the element to process in the local queue
     context->queue_local()->deletions().push_back(key);
+    if(m_density_tuner != nullptr){ m_density_tuner->record_update(); }
 
     // Process the deletion from the local queue
     writer_loop(key);
@@ -938,13 +1345,14 @@ int64_t PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value
     assert(gate != nullptr && "Null pointer");
 
     *out_value = -1;
-    if(empty()) return false;
+    if(storage_empty()) return false;
 //    bool request_global_rebalance = false;
 
-    int64_t segment_id = gate->find(key);
+    int64_t segment_id = gate->find(key, m_knobs.m_search_strategy);
 //    COUT_DEBUG("Gate: " << gate->gate_id() << ", segment: " << segment_id << ", key: " << key);
     size_t sz = m_storage.m_segment_sizes[segment_id];
     if(sz == 0) return segment_id; // this segment is empty, and anyway should be rebalanced
+    if(m_storage.tombstones_enabled()) return do_remove_lazy(segment_id, key, out_value);
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
     int64_t* __restrict values = m_storage.m_values + segment_id * m_storage.m_segment_capacity;
 
@@ -953,8 +1361,8 @@ int64_t PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value
     int64_t successor = numeric_limits<int64_t>::max(); // to forward to the detector/predictor
 
     if (segment_id % 2 == 0) { // even
-        size_t imin = m_storage.m_segment_capacity - sz, i;
-        for(i = imin; i < m_storage.m_segment_capacity; i++){ if(keys[i] == key) break; }
+        size_t imin = m_storage.m_segment_capacity - sz;
+        size_t i = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, /* even ? */ true, key, m_knobs.m_search_strategy);
         if(i < m_storage.m_segment_capacity){ // found ?
             // to update the predictor/detector
             if(i > imin) predecessor = keys[i-1];
@@ -962,10 +1370,7 @@ int64_t PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value
 
             value = values[i];
             // shift the rest of the elements by 1
-            for(size_t j = i; j > imin; j--){
-                keys[j] = keys[j -1];
-                values[j] = values[j-1];
-            }
+            segment_kernels::remove_even(keys, values, m_storage.m_segment_capacity, sz, i);
 
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
@@ -981,8 +1386,7 @@ int64_t PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value
         } // end if (found)
     } else { // odd
         // find the key in the segment
-        size_t i = 0;
-        for( ; i < sz; i++){ if(keys[i] == key) break; }
+        size_t i = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, /* even ? */ false, key, m_knobs.m_search_strategy);
         if(i < sz){ // found?
             // to update the predictor/detector
             if(i > 0) predecessor = keys[i-1];
@@ -990,10 +1394,7 @@ int64_t PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value
 
             value = values[i];
             // shift the rest of the elements by 1
-            for(size_t j = i; j < sz - 1; j++){
-                keys[j] = keys[j+1];
-                values[j] = values[j+1];
-            }
+            segment_kernels::remove_odd(keys, values, sz, i);
 
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
@@ -1009,6 +1410,7 @@ int64_t PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value
     // shall we rebalance ?
     int64_t rebalance_segment = -1;
     if(value != -1){
+        if(detector_sample()){ m_detector.remove(segment_id, predecessor, successor); }
 
 //        if(m_storage.m_number_segments >= 2 * balanced_thresholds_cutoff() && static_cast<double>(m_cardinality) < 0.5 * m_storage.capacity()){
 //            assert(m_storage.get_number_extents() > 1);
@@ -1028,6 +1430,40 @@ int64_t PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value
     return rebalance_segment;
 }
 
+int64_t PackedMemoryArray::do_remove_lazy(int64_t segment_id, int64_t key, int64_t* out_value){
+    const size_t sz = m_storage.m_segment_sizes[segment_id];
+    assert(sz > 0 && "Empty segment");
+    const size_t segment_start = segment_id * m_storage.m_segment_capacity;
+    const size_t start = (segment_id % 2 == 0) ? segment_start + m_storage.m_segment_capacity - sz : segment_start;
+    const size_t end = start + sz;
+    int64_t* __restrict keys = m_storage.m_keys;
+
+    // find the key in the segment, ignoring the elements already deleted
+    size_t i = start + segment_kernels::lower_bound(keys + start, sz, key, m_storage.m_segment_capacity, m_knobs.m_search_strategy);
+    while(i < end && keys[i] == key && m_storage.is_tombstone(i)) i++;
+    if(i < end && keys[i] != key) i = end;
+    if(i == end) return -1; // not found
+
+    *out_value = m_storage.m_values[i];
+    m_storage.set_tombstone(i);
+    m_cardinality--;
+    // the separator key does not need to be altered, it's still a lower bound for the elements in the segment
+
+    if(detector_sample()){
+        int64_t predecessor = (i > start) ? keys[i -1] : numeric_limits<int64_t>::min();
+        int64_t successor = (i < end -1) ? keys[i +1] : numeric_limits<int64_t>::max();
+        m_detector.remove(segment_id, predecessor, successor);
+    }
+
+    // shall we rebalance ?
+    if(m_storage.m_number_segments > 1) {
+        const size_t minimum_size = max<size_t>(get_thresholds(1).first * m_storage.m_segment_capacity, 1); // at least one element per segment
+        if(sz - m_storage.count_tombstones(start, end) < minimum_size){ return segment_id; }
+    }
+
+    return -1;
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Local rebalance                                                         *
@@ -1038,6 +1474,12 @@ bool PackedMemoryArray::rebalance_local(size_t segment_id, InsertionT* insertion
     const bool is_insert = (insertion != nullptr);
     COUT_DEBUG("segment_id: " << segment_id << ", is_insert: " << is_insert);
 
+    // lazy deletes, a local rebalance cannot go beyond the current gate: physically remove all tombstones in the gate
+    if(m_storage.tombstones_enabled()){
+        const size_t gate_start = (segment_id / get_segments_per_lock()) * get_segments_per_lock();
+        m_storage.compact_tombstones(gate_start, min<size_t>(gate_start + get_segments_per_lock(), m_storage.m_number_segments));
+    }
+
     int64_t window_start {0}, window_length {0}, cardinality_after {0};
     bool do_resize { false };
     bool is_local_rebalance = rebalance_find_window(segment_id, is_insert, &window_start, &window_length, &cardinality_after, &do_resize);
@@ -1194,7 +1636,7 @@ void PackedMemoryArray::rebalance_plan(RebalancePlan* plan) const {
             plan->m_window_length = num_extents * segments_per_extent;
         }
 
-        if(m_storage.m_number_segments >= m_storage.get_segments_per_extent()){ // use rewiring
+        if(m_storage.m_number_segments >= m_storage.get_segments_per_extent() && !m_online_resize){ // use rewiring, the old storage is altered in place
             plan->m_operation = RebalanceOperation::RESIZE_REBALANCE;
         } else {
             plan->m_operation = RebalanceOperation::RESIZE;
@@ -1333,7 +1775,11 @@ void PackedMemoryArray::resize_local(const RebalancePlan& action, InsertionT* in
     }
 
     // update the PMA properties
+    m_storage.resize_tombstones(m_storage.m_number_segments, num_segments); // the tombstones were already removed by #rebalance_local
+    m_storage.resize_filters(m_storage.m_number_segments, num_segments);
     m_storage.m_number_segments = num_segments;
+    m_storage.rebuild_filters(0, num_segments);
+    m_detector.resize(num_segments);
 }
 
 /*****************************************************************************
@@ -1342,7 +1788,7 @@ void PackedMemoryArray::resize_local(const RebalancePlan& action, InsertionT* in
  *                                                                           *
  *****************************************************************************/
 
-void PackedMemoryArray::spread_local(const RebalancePlan& action, InsertionT* insertion){
+void PackedMemoryArray::spread_local(const RebalancePlan& action, InsertionT* insertion, const DeltaBuffer* delta){
     COUT_DEBUG("start: " << action.m_window_start << ", length: " << action.m_window_length);
     assert(action.m_window_length <= get_segments_per_lock() && "This operation should have been performed by the RebalancingMaster");
 
@@ -1356,7 +1802,11 @@ void PackedMemoryArray::spread_local(const RebalancePlan& action, InsertionT* in
 
     // 1) first copy all elements in input keys
     int64_t insert_position = -1;
-    spread_load(action, input_keys, input_values, insertion, &insert_position);
+    if(delta != nullptr){
+        spread_load(action, input_keys, input_values, delta);
+    } else {
+        spread_load(action, input_keys, input_values, insertion, &insert_position);
+    }
 
 //    // debug only
 //#if defined(DEBUG)
@@ -1396,17 +1846,16 @@ void PackedMemoryArray::spread_local(const RebalancePlan& action, InsertionT* in
         segment_id += 2;
     }
 
+    m_storage.rebuild_filters(action.m_window_start, action.m_window_start + action.m_window_length);
+
     COUT_DEBUG("Done");
 }
 
 
 size_t PackedMemoryArray::spread_insert_unsafe(int64_t* __restrict keys_from, int64_t* __restrict values_from, int64_t* __restrict keys_to, int64_t* __restrict values_to, size_t num_elements, int64_t new_key, int64_t new_value){
-    size_t i = 0;
-    while(i < num_elements && keys_from[i] < new_key){
-        keys_to[i] = keys_from[i];
-        values_to[i] = values_from[i];
-        i++;
-    }
+    size_t i = (num_elements > 0) ? segment_kernels::lower_bound(keys_from, num_elements, new_key, num_elements) : 0;
+    memcpy(keys_to, keys_from, i * sizeof(keys_to[0]));
+    memcpy(values_to, values_from, i * sizeof(values_to[0]));
     keys_to[i] = new_key;
     values_to[i] = new_value;
 
@@ -1459,6 +1908,45 @@ void PackedMemoryArray::spread_load(const RebalancePlan& action, int64_t* __rest
     }
 }
 
+void PackedMemoryArray::spread_load(const RebalancePlan& action, int64_t* keys_to, int64_t* values_to, const DeltaBuffer* delta){
+    assert(delta != nullptr && "Null pointer");
+    assert(action.get_cardinality_after() == action.m_cardinality_before + static_cast<int64_t>(delta->size()) && "The plan should cover the elements in the buffer");
+    const int64_t num_pending = delta->size();
+    const int64_t num_elements = action.get_cardinality_after();
+
+    // copy the elements of the window after the first num_pending slots of the output
+    int64_t* keys_from = keys_to + num_pending;
+    int64_t* values_from = values_to + num_pending;
+    for(int64_t i = 1; i < action.m_window_length; i+=2){
+        int64_t segment_id = action.m_window_start + i;
+        size_t length = m_storage.m_segment_sizes[segment_id -1] + m_storage.m_segment_sizes[segment_id];
+        size_t offset = m_storage.m_segment_capacity * segment_id - m_storage.m_segment_sizes[segment_id -1];
+        memcpy(keys_from, m_storage.m_keys + offset, sizeof(keys_from[0]) * length);
+        memcpy(values_from, m_storage.m_values + offset, sizeof(values_from[0]) * length);
+        keys_from += length; values_from += length;
+    }
+
+    // merge with the elements in the buffer, from the front, the output never overtakes the input
+    const int64_t* __restrict delta_keys = delta->keys();
+    const int64_t* __restrict delta_values = delta->values();
+    int64_t i = num_pending, j = 0, k = 0;
+    while(j < num_pending){
+        if(i < num_elements && keys_to[i] <= delta_keys[j]){
+            keys_to[k] = keys_to[i];
+            values_to[k] = values_to[i];
+            i++;
+        } else {
+            keys_to[k] = delta_keys[j];
+            values_to[k] = delta_values[j];
+            j++;
+        }
+        k++;
+    }
+    // the remaining elements of the window are already in place
+
+    m_cardinality += num_pending;
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Find                                                                    *
@@ -1467,16 +1955,29 @@ void PackedMemoryArray::spread_load(const RebalancePlan& action, int64_t* __rest
 
 int64_t PackedMemoryArray::find(int64_t key) const {
 //    COUT_DEBUG("key: " << key);
-    if(empty()) return -1;
+    append_sync();
+    if(size() == 0) return -1;
 
     int64_t value = -1;
     bool done = false;
     do{
         try {
             ScopedState scope{ this };
-            Gate* gate = find_on_entry(key);
-            value = do_find(gate, key);
-            find_on_exit(gate);
+            if(m_read_cache != nullptr && m_read_cache->find(key, &value)){ // hot key
+                done = true;
+                break;
+            }
+            uint64_t cache_generation = m_read_cache != nullptr ? m_read_cache->generation() : 0; // before accessing the gates
+
+            const WindowSnapshot* snapshot = nullptr; // protected by the epoch of the scope
+            Gate* gate = find_on_entry(key, &snapshot);
+            if(snapshot != nullptr){ // the gate is being rebalanced
+                value = snapshot->find(key);
+            } else {
+                value = do_find(gate, key);
+                if(m_read_cache != nullptr && value != -1){ find_cache_fill(gate, key, value, cache_generation); }
+                find_on_exit(gate);
+            }
             done = true;
         } catch (Abort) { /* retry */ }
     } while (!done);
@@ -1485,32 +1986,46 @@ int64_t PackedMemoryArray::find(int64_t key) const {
 }
 
 int64_t PackedMemoryArray::do_find(Gate* gate, int64_t key) const{
-    auto segment_id = gate->find(key);
-    COUT_DEBUG("gate: " << gate->lock_id() << ", key: " << key << ", segment_id: " << segment_id);
-
-    int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
-    size_t sz = m_storage.m_segment_sizes[segment_id];
-
-    size_t start, stop;
-    if(segment_id % 2 == 0){ // even
-        stop = m_storage.m_segment_capacity;
-        start = stop - sz;
-    } else { // odd
-        start = 0;
-        stop = sz;
+    if(gate->m_delta_buffer != nullptr){ // first check the pending insertions
+        int64_t value = gate->m_delta_buffer->find(key);
+        if(value != -1) return value;
     }
 
-    for(size_t i = start; i < stop; i++){
-        if(keys[i] == key){
-            return *(m_storage.m_values + segment_id * m_storage.m_segment_capacity + i);
+    auto segment_id = gate->find(key, m_knobs.m_search_strategy);
+    COUT_DEBUG("gate: " << gate->lock_id() << ", key: " << key << ", segment_id: " << segment_id);
+    if(!m_storage.filter_contains(segment_id, key)) return -1; // the key is certainly not in the segment
+
+    const size_t segment_capacity = m_storage.m_segment_capacity;
+    const int64_t* __restrict keys = m_storage.m_keys + segment_id * segment_capacity;
+    const size_t sz = m_storage.m_segment_sizes[segment_id];
+    const bool is_even = segment_id % 2 == 0;
+    const size_t stop = is_even ? segment_capacity : sz;
+
+    // skip the tombstones among the occurrences of the same key
+    size_t i = segment_kernels::find(keys, segment_capacity, sz, is_even, key, m_knobs.m_search_strategy);
+    while(i < stop && keys[i] == key){
+        if(!m_storage.is_tombstone(segment_id * segment_capacity + i)){
+            return *(m_storage.m_values + segment_id * segment_capacity + i);
         }
+        i++;
     }
 
     return -1;
 }
 
-Gate* PackedMemoryArray::find_on_entry(int64_t key) const {
-    return reader_on_entry(key);
+void PackedMemoryArray::find_cache_fill(Gate* gate, int64_t key, int64_t value, uint64_t cache_generation) const {
+    assert(m_read_cache != nullptr && "Read cache not enabled");
+    gate->lock();
+    // otherwise a writer or the rebalancer has already claimed the gate, and it's waiting for the readers to leave
+    bool is_valid = gate->m_state == Gate::State::READ;
+    uint32_t version = gate->m_cold->m_version.load(memory_order_relaxed);
+    gate->unlock();
+
+    if(is_valid){ m_read_cache->insert(key, value, gate, version, cache_generation); }
+}
+
+Gate* PackedMemoryArray::find_on_entry(int64_t key, const WindowSnapshot** out_snapshot) const {
+    return reader_on_entry(key, -1, m_rebalance_snapshots ? out_snapshot : nullptr);
 }
 
 void PackedMemoryArray::find_on_exit(Gate* gate) const {
@@ -1525,23 +2040,13 @@ int PackedMemoryArray::find_position(size_t segment_id, int64_t key) const noexc
     sz = min<size_t>(sz, m_storage.m_segment_capacity); // avoid overflow
 
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
-    int start, stop;
-
-    if(segment_id % 2 == 0){ // for even segment ids (0, 2, ...), the keys are at the end
-        start = m_storage.m_segment_capacity - sz;
-        stop = m_storage.m_segment_capacity;
-    } else { // odd segment ids (1, 3, ...), the keys are at the start of the segment
-        start = 0;
-        stop = sz;
-    }
+    // for even segment ids (0, 2, ...), the keys are at the end; odd segment ids (1, 3, ...), the keys are at the start of the segment
+    const bool is_even = segment_id % 2 == 0;
+    const size_t start = is_even ? m_storage.m_segment_capacity - sz : 0;
 
-    for(int i = start; i < stop; i++){
-        if(keys[i] == key){
-            return i -start;
-        }
-    }
-
-    return -1; // not found
+    size_t position = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, is_even, key, m_knobs.m_search_strategy);
+    if(position == m_storage.m_segment_capacity) return -1; // not found
+    return static_cast<int>(position - start);
 }
 
 /*****************************************************************************
@@ -1551,6 +2056,7 @@ int PackedMemoryArray::find_position(size_t segment_id, int64_t key) const noexc
  *****************************************************************************/
 
 unique_ptr<::data_structures::Iterator> PackedMemoryArray::find(int64_t min, int64_t max) const {
+    append_sync();
     return make_unique<Iterator>( this, min, max );
 }
 
@@ -1565,7 +2071,8 @@ unique_ptr<::data_structures::Iterator> PackedMemoryArray::iterator() const {
  *****************************************************************************/
 ::data_structures::Interface::SumResult PackedMemoryArray::sum(int64_t min, int64_t max) const {
     using SumResult = ::data_structures::Interface::SumResult;
-    if(/* empty ? */m_cardinality == 0 ||
+    append_sync();
+    if(/* empty ? */size() == 0 ||
        /* invalid min, max */ max < min ||
        /* scans disabled */ !::data_structures::global_parallel_scan_enabled){ return SumResult{}; }
 
@@ -1576,12 +2083,13 @@ unique_ptr<::data_structures::Iterator> PackedMemoryArray::iterator() const {
     do {
         try {
             ScopedState scope { this };
-            auto gate_id = m_index.get(get_context())->find(min);
+            auto gate_id = finger_find(get_context(), min);
             do_sum(gate_id, /* in/out */ min, /* in */ max, /* in/out */ &result);
             done = true;
         } catch (Abort){ /* retry */ }
     } while (!done);
 
+    if(m_density_tuner != nullptr){ m_density_tuner->record_scan(result.m_num_elements); }
 
     if(result.m_num_elements == 0)
         result.m_first_key = 0;
@@ -1600,10 +2108,30 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
 
     do {
         bool read_all { false };
-        Gate* gate = sum_on_entry(gate_id, next_min, max, &read_all);
+        const WindowSnapshot* snapshot { nullptr };
+        Gate* gate = sum_on_entry(gate_id, next_min, max, &read_all, &snapshot);
+
+        if(snapshot != nullptr){ // the window is being rebalanced, read its content before the rebalance
+            snapshot->sum(next_min, max, sum);
+            next_min = snapshot->m_fence_high_key;
+            if(next_min == numeric_limits<int64_t>::max() || (next_min +1) > max || !(::data_structures::global_parallel_scan_enabled)){
+                sum_done = true;
+            } else {
+                next_min++;
+                gate_id = snapshot->m_gate_end; // next gate after the window
+            }
+            continue; // the gate was not acquired
+        }
 //        COUT_DEBUG("READER ENTRY gate_id: " << gate->gate_id() << ", readall: " << read_all << ", min: " << next_min << ", max: " << max);
 
-        if(read_all){ // read the whole content protected by this gate
+        if(read_all && m_storage.tombstones_enabled()){ // read the whole content protected by this gate, skipping the deleted elements
+            uint16_t* __restrict cardinalities = m_storage.m_segment_sizes + gate->m_window_start;
+            for(int64_t segment_id = 0, last_segment_id = gate->m_window_length; segment_id < last_segment_id; segment_id+= 2){
+                int64_t start = (gate->m_window_start + segment_id +1) * m_storage.m_segment_capacity - cardinalities[segment_id];
+                int64_t end = start + cardinalities[segment_id] + cardinalities[segment_id +1];
+                do_sum_tombstones(start, end, sum);
+            }
+        } else if(read_all){ // read the whole content protected by this gate
             int64_t* __restrict keys = m_storage.m_keys + gate->m_window_start * m_storage.m_segment_capacity;
             int64_t* __restrict values = m_storage.m_values + gate->m_window_start * m_storage.m_segment_capacity;
             uint16_t* __restrict cardinalities = m_storage.m_segment_sizes + gate->m_window_start;
@@ -1629,7 +2157,7 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
             uint16_t* __restrict cardinalities = m_storage.m_segment_sizes;
 
             bool min_notfound = true;
-            int64_t segment_begin = gate->find(next_min), start = 0;
+            int64_t segment_begin = gate->find(next_min, m_knobs.m_search_strategy), start = 0;
             if(segment_begin % 2 == 0){
                 start = ( segment_begin +1 )* m_storage.m_segment_capacity - cardinalities[segment_begin];
             } else {
@@ -1643,7 +2171,7 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
 
             // find the starting offset
             while(min_notfound && segment_begin < window_end){
-                while(start < stop && keys[start] < next_min){ start++; }
+                start += segment_kernels::lower_bound(keys + start, stop - start, next_min, 2 * m_storage.m_segment_capacity);
 
                 min_notfound = (start == stop);
                 if(min_notfound){
@@ -1666,7 +2194,7 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
                 end = segment_end * m_storage.m_segment_capacity + cardinalities[segment_end];
                 max_notfound = false;
             } else {
-                segment_end = gate->find(max);
+                segment_end = gate->find(max, m_knobs.m_search_strategy);
                 if(segment_end >= window_end -1) segment_end = window_end -1; // inclusive
                 // make it odd: 0 => 1, 1 => 1, 2 => 3, 3 => 3, ...
                 segment_end = (segment_end / 2) * 2 +1;
@@ -1676,7 +2204,7 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
                     int64_t index = end -1;
 
                     while(max_notfound && segment_end >= segment_begin){
-                        while(index >= stop && keys[index] > max) index--;
+                        if(index >= stop) index = stop + segment_kernels::upper_bound(keys + stop, index - stop +1, max, 2 * m_storage.m_segment_capacity) -1;
                         max_notfound = (index < stop);
                         if(max_notfound){
                             segment_end -= 2;
@@ -1700,18 +2228,24 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
                 stop = std::min(stop, end);
 
                 int64_t* __restrict values = m_storage.m_values;
-                sum->m_first_key = std::min(sum->m_first_key, keys[offset]);
+                const bool skip_tombstones = m_storage.tombstones_enabled();
+                if(!skip_tombstones){ sum->m_first_key = std::min(sum->m_first_key, keys[offset]); }
 
                 while(offset < stop){
-                    sum->m_num_elements += (stop - offset);
-                    while(offset < stop){
-                        sum->m_sum_keys += keys[offset];
-                        sum->m_sum_values += values[offset];
+                    if(skip_tombstones){
+                        do_sum_tombstones(offset, stop, sum);
+                        offset = stop;
+                    } else {
+                        sum->m_num_elements += (stop - offset);
+                        while(offset < stop){
+                            sum->m_sum_keys += keys[offset];
+                            sum->m_sum_values += values[offset];
 #if !defined(NDEBUG)
-                        assert(keys[offset] >= key_previous && "Sorted order not respected");
-                        key_previous = keys[offset];
+                            assert(keys[offset] >= key_previous && "Sorted order not respected");
+                            key_previous = keys[offset];
 #endif
-                        offset++;
+                            offset++;
+                        }
                     }
 
                     segment_id += 2; // next even segment
@@ -1724,12 +2258,15 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
                         stop = std::min(end, offset + size_lhs + size_rhs);
                     }
                 }
-                sum->m_last_key = keys[end -1];
+                if(!skip_tombstones){ sum->m_last_key = keys[end -1]; }
                 sum_done = end < (window_end -1) * m_storage.m_segment_capacity + m_storage.m_segment_sizes[window_end -1];
             }
 
         } // end if (read partially this chunk)
 
+        // merge the pending insertions in the delta buffer of the gate
+        if(gate->m_delta_buffer != nullptr){ gate->m_delta_buffer->sum(next_min, max, sum); }
+
         next_min = gate->m_fence_high_key;
         if(!sum_done && (next_min == numeric_limits<int64_t>::max() || (next_min +1) > max || !(::data_structures::global_parallel_scan_enabled))){
             sum_done = true;
@@ -1745,9 +2282,44 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
 }
 
 
-Gate* PackedMemoryArray::sum_on_entry(uint64_t gate_id, int64_t min, int64_t max, bool* out_readall) const{
-    Gate* gate = reader_on_entry(min, gate_id);
-    if(out_readall != nullptr){
+void PackedMemoryArray::do_sum_tombstones(int64_t position_start, int64_t position_end, ::data_structures::Interface::SumResult* __restrict sum) const {
+    const int64_t* __restrict keys = m_storage.m_keys;
+    const int64_t* __restrict values = m_storage.m_values;
+    const uint64_t* __restrict tombstones = m_storage.m_tombstones;
+    assert(tombstones != nullptr && "Lazy deletes not enabled");
+
+    // proceed by chunks of 64 positions, one word of the bitmap at the time
+    int64_t offset = position_start;
+    while(offset < position_end){
+        int64_t chunk_end = std::min<int64_t>(position_end, (offset / 64 +1) * 64);
+        uint64_t bitmask = tombstones[offset / 64] >> (offset % 64);
+
+        if(bitmask == 0){ // fast path, there are no tombstones in this chunk
+            for(int64_t i = offset; i < chunk_end; i++){
+                sum->m_sum_keys += keys[i];
+                sum->m_sum_values += values[i];
+            }
+            sum->m_first_key = std::min(sum->m_first_key, keys[offset]);
+            sum->m_last_key = keys[chunk_end -1];
+            sum->m_num_elements += (chunk_end - offset);
+        } else {
+            for(int64_t i = offset; i < chunk_end; i++, bitmask >>= 1){
+                if(bitmask & 1) continue; // deleted
+                sum->m_sum_keys += keys[i];
+                sum->m_sum_values += values[i];
+                sum->m_first_key = std::min(sum->m_first_key, keys[i]);
+                sum->m_last_key = keys[i];
+                sum->m_num_elements++;
+            }
+        }
+
+        offset = chunk_end;
+    }
+}
+
+Gate* PackedMemoryArray::sum_on_entry(uint64_t gate_id, int64_t min, int64_t max, bool* out_readall, const WindowSnapshot** out_snapshot) const{
+    Gate* gate = reader_on_entry(min, gate_id, m_rebalance_snapshots ? out_snapshot : nullptr);
+    if(out_readall != nullptr && (out_snapshot == nullptr || *out_snapshot == nullptr)){
         *out_readall = min <= gate->m_fence_low_key && gate->m_fence_high_key <= max && m_storage.m_number_segments >= gate->m_window_length;
     }
     return gate;
@@ -1790,6 +2362,9 @@ void PackedMemoryArray::dump(std::ostream& out) const {
             m_density_bounds1.densities().rho_h << ", " <<
             m_density_bounds1.densities().theta_h << ", " <<
             m_density_bounds1.densities().theta_0 << "\n";
+    if(m_read_cache != nullptr){
+        out << "Read cache, capacity: " << m_read_cache->capacity() << ", hits: " << m_read_cache->num_hits() << ", misses: " << m_read_cache->num_misses() << "\n";
+    }
 
     assert(integrity_check && "Integrity check failed!");
 }
@@ -1808,11 +2383,13 @@ void PackedMemoryArray::dump_locks(std::ostream& out, bool* integrity_check) con
         case Gate::State::WRITE: out << "write"; break;
         case Gate::State::TIMEOUT: out << "timeout"; break;
         case Gate::State::REBAL: out << "rebal"; break;
+        case Gate::State::RESIZE: out << "resize"; break;
         default: out << "?"; break;
         }
         out << ", active threads: " << gate.m_num_active_threads;
-        out << ", queue: " << gate.m_queue.size();
-        out << ", cardinality: " << gate.m_cardinality;
+        out << ", queue: " << gate.m_cold->m_queue.size();
+        out << ", cardinality: " << gate.m_cold->m_cardinality;
+        if(gate.m_delta_buffer != nullptr){ out << ", delta buffer: " << gate.m_delta_buffer->size(); }
         out << ", fence keys: " << gate.m_fence_low_key << ", " << gate.m_fence_high_key;
 
         if(i * get_segments_per_lock() != gate.m_window_start){
@@ -1850,7 +2427,7 @@ void PackedMemoryArray::dump_storage(std::ostream& out, bool* integrity_check) c
             ", segments per lock: " << get_segments_per_lock() <<
             ", # segments for balanced thresholds: " << balanced_thresholds_cutoff() << endl;
 
-    if(empty()){ // edge case
+    if(storage_empty()){ // edge case
         out << "-- empty --" << endl;
         return;
     }
@@ -1865,7 +2442,7 @@ void PackedMemoryArray::dump_storage(std::ostream& out, bool* integrity_check) c
     for(size_t i = 0; i < m_storage.m_number_segments; i++){
         out << "[" << i << "] ";
 
-        tot_count += sizes[i];
+        tot_count += sizes[i] - m_storage.count_tombstones(i);
         bool even = i % 2 == 0;
         size_t start = even ? m_storage.m_segment_capacity - sizes[i] : 0;
         size_t end = even ? m_storage.m_segment_capacity : sizes[i];
@@ -1873,6 +2450,7 @@ void PackedMemoryArray::dump_storage(std::ostream& out, bool* integrity_check) c
         for(size_t j = start, sz = end; j < sz; j++){
             if(j > start) out << ", ";
             out << "<" << keys[j] << ", " << values[j] << ">";
+            if(m_storage.is_tombstone(i * m_storage.m_segment_capacity + j)) out << " (deleted)";
 
 //            // only for the unit tests
 //            if(keys[j] <= 0){
@@ -1899,7 +2477,8 @@ void PackedMemoryArray::dump_storage(std::ostream& out, bool* integrity_check) c
         } else { // check the content in the extent
             int64_t offset = i % get_segments_per_lock() -1;
             int64_t  indexed_key = m_locks.get_unsafe()[gate_id].m_separator_keys[offset];
-            if(keys[start] != indexed_key){
+            // with the lazy deletes, the separator key can be lower than the actual minimum of the segment
+            if(m_storage.tombstones_enabled() ? keys[start] < indexed_key : keys[start] != indexed_key){
                 out << " (ERROR: invalid key in the extent, minimum: " << keys[start] << ", indexed key: " << indexed_key << ", gate: " << gate_id  << ")" << end;
                 if(integrity_check) *integrity_check = false;
             }
@@ -1929,13 +2508,13 @@ void PackedMemoryArray::debug_validate_cardinality_gate(Gate* gate, int64_t card
     int64_t segments_cardinality = 0;
     int64_t window_end = std::min<int64_t>(gate->m_window_start + gate->m_window_length, m_storage.m_number_segments);
     for(int64_t segment_id = gate->m_window_start; segment_id < window_end; segment_id ++){
-        segments_cardinality += m_storage.m_segment_sizes[segment_id];
+        segments_cardinality += m_storage.m_segment_sizes[segment_id] - m_storage.count_tombstones(segment_id);
     }
-    if(segments_cardinality != gate->m_cardinality){
+    if(segments_cardinality != gate->m_cold->m_cardinality){
         for(int64_t segment_id = gate->m_window_start; segment_id < window_end; segment_id ++){
             COUT_DEBUG_FORCE("segment[" << segment_id << "]: " <<  m_storage.m_segment_sizes[segment_id]);
         }
-        COUT_DEBUG_FORCE("cardinality mismatch, gate " << gate->lock_id() << " cardinality: " << gate->m_cardinality << ", cardinality_change: " << cardinality_change << ", segments cardinality: " << segments_cardinality);
+        COUT_DEBUG_FORCE("cardinality mismatch, gate " << gate->lock_id() << " cardinality: " << gate->m_cold->m_cardinality << ", cardinality_change: " << cardinality_change << ", segments cardinality: " << segments_cardinality);
         assert(0 && "cardinality mismatch");
     }
 #endif
@@ -27,9 +27,10 @@
 #include "data_structures/iterator.hpp"
 #include "data_structures/parallel.hpp"
 #include "rma/common/density_bounds.hpp"
+#include "rma/common/detector.hpp"
 #include "rma/common/knobs.hpp"
 #include "rma/common/memory_pool.hpp"
-#include "rma/common/static_index.hpp"
+#include "rma/common/segment_index.hpp"
 #include "pointer.hpp"
 #include "rebalance_plan.hpp"
 #include "storage.hpp"
@@ -38,15 +39,73 @@
 namespace data_structures::rma::batch_processing {
 
 // forward declarations
+class DelayController;
+class DeltaBuffer;
+class DensityTuner;
 class Gate;
 class GarbageCollector;
 class Iterator;
+class ReadCache;
 class RebalancingMaster;
 class RebalancingTask;
 class RebalancingWorker;
 class SpreadWithRewiring; // forward decl.
 class TimerManager;
 class Weights;
+class WindowSnapshot;
+
+/**
+ * The optional features of the PackedMemoryArray, fixed at construction time. By default, all features are disabled.
+ */
+struct Options {
+    // the number of coordinators in the rebalancer, each in charge of a disjoint range of gates. It must be a power of 2.
+    size_t m_num_master_shards = 1;
+
+    // if true, the delay of the rebalances is tuned at runtime for each gate, up to the `delay_rebalance' of the ctor
+    bool m_adaptive_delay = false;
+
+    // if true, the updates are sampled into a detector and the rebalances skew the distribution of the elements, leaving
+    // more room to the segments hammered by sequential insertions (APMA). The sampling rate is set in the knobs.
+    bool m_adaptive_rebalancing = false;
+
+    // if true, deletions only mark the removed slots with a tombstone, which is physically removed by the next operation
+    // restructuring the segment (insertion, local or global rebalance)
+    bool m_lazy_deletes = false;
+
+    // if true, the upper density of the primary thresholds is revised at each resize, according to the mix of updates &
+    // scans and the cost of the rebalances observed
+    bool m_adaptive_densities = false;
+
+    // if true, the resizes always build a new storage and, while the workers are filling it, readers keep accessing the
+    // old one and writers defer their updates, applied by the rebalancer once the resize is complete
+    bool m_online_resize = false;
+
+    // if true, the workers copy the elements of a window before rebalancing it, and the point lookups & sums arriving in
+    // the meanwhile read from the copy, rather than waiting for the rebalance to complete
+    bool m_rebalance_snapshots = false;
+
+    // if true, the threads inserting runs of increasing keys stage them in a private buffer, and append them in batches at
+    // the end of the related gates. The staged elements become visible to the other threads when the buffer is flushed:
+    // once it is full, at the next operation of the same thread or when it is unregistered.
+    bool m_append_fastpath = false;
+
+    // if true, the keys are routed to the gates with a learned index (piecewise linear models over the separator keys of
+    // the gates), rather than the static B-Tree
+    bool m_learned_index = false;
+
+    // if greater than 0, each gate absorbs up to this number of insertions in a sorted buffer, merged on the fly by the
+    // readers, rather than shifting the elements in its segments. The buffer is flushed in a single spread of the gate
+    // once full, or loaded by the rebalancer when the gate is rebalanced.
+    size_t m_delta_buffer_capacity = 0;
+
+    // if greater than 0, each segment is paired with a Bloom filter of this number of bits per element, which lets the
+    // point lookups for missing keys return without scanning the segment
+    size_t m_filter_bits_per_key = 0;
+
+    // if greater than 0, the point lookups are served by a set-associative cache with this number of entries, validated
+    // against the version of the gates, before going through the index and the gates
+    size_t m_read_cache_capacity = 0;
+};
 
 class PackedMemoryArray : public InterfaceRQ, public ParallelCallbacks {
 friend class GarbageCollector;
@@ -62,14 +121,15 @@ friend class Weights;
 using CachedDensityBounds = common::CachedDensityBounds;
 using CachedMemoryPool = common::CachedMemoryPool;
 using Knobs = common::Knobs;
-using StaticIndex = common::StaticIndex;
 
 protected:
     std::atomic<int64_t> m_cardinality = 0; // the number of elements contained in the data structure
     Storage m_storage; // actual content. There is no need to further protect its access, workers/rebalancers need to hold a lock to the related extent to alter it
-    Pointer<common::StaticIndex> m_index; // the static index
+    Pointer<common::SegmentIndex> m_index; // route the keys to the gates, either a static or a learned index
+    const uint64_t m_index_block_size; // the node size of the static index (iB)
     Pointer<Gate> m_locks; // array of locks, to protect access to the single chunks of the PMA
     Knobs m_knobs; // General settings
+    common::Detector m_detector; // Record updates
     CachedDensityBounds m_density_bounds0; // user thresholds (for num_segments<=balanced_thresholds_cutoff())
     CachedDensityBounds m_density_bounds1; // primary thresholds (for num_segmnets>balanced_thresholds_cutoff())
     bool m_primary_densities = false; // use the primary thresholds?
@@ -77,13 +137,34 @@ protected:
     RebalancingMaster* m_rebalancer;
     GarbageCollector* m_garbage_collector; // garbage collector
     TimerManager* m_timer_manager; // delayed rebalances
+    DelayController* m_delay_controller; // adaptive delays for the rebalances, nullptr if the delay is fixed
+    DensityTuner* m_density_tuner; // adaptive primary thresholds, nullptr if they are fixed
+    ReadCache* m_read_cache; // cache for the point lookups of the hot keys, nullptr if disabled
     ThreadContextList m_thread_contexts; // the list of thread contexts, to keep track of the thread epochs
     const uint64_t m_segments_per_lock; // number of contiguous segments per lock\gate
     const std::chrono::milliseconds m_delayed_rebalance; // minimum amount of time that must pass before a gate can be rebalanced by the master
+    const bool m_online_resize; // whether clients can still access the old storage while it's being resized
+    std::atomic<bool> m_resize_closing = false; // set by the master at the end of an online resize, the old gates stop admitting clients
+    const bool m_rebalance_snapshots; // whether the workers copy a window before rebalancing it, to serve the readers in the meanwhile
+    const bool m_append_fastpath; // whether the runs of increasing keys are staged by the client threads and appended in batches
+    const bool m_adaptive_rebalancing; // whether the updates are recorded in the detector, to skew the distribution of the elements in the rebalances
+    std::atomic<uint64_t> m_num_skewed_rebalances = 0; // number of rebalances where the detector altered the distribution of the elements
+    const uint64_t m_delta_buffer_capacity; // capacity of the delta buffer of each gate, 0 if the delta buffers are disabled
+    std::atomic<int64_t> m_delta_cardinality = 0; // number of elements pending in the delta buffers, not counted in m_cardinality
+
+    constexpr static uint64_t APPEND_STREAK_MIN = 8; // number of consecutive increasing keys, by the same thread, before staging its insertions
+    constexpr static uint64_t APPEND_BUFFER_CAPACITY = 1024; // max number of insertions staged by a thread before flushing them
 
     // Check this is the correct lock
     bool check_fence_keys(Gate& gate, uint64_t& gate_id, int64_t key) const;
 
+    // Retrieve the gate for the given key, from the finger of the current thread when it still points to the same
+    // array of gates, otherwise from the static index. The result is only a hint, to be validated with #check_fence_keys
+    uint64_t finger_find(ClientContext* context, int64_t key) const;
+
+    // Set the finger of the current thread to the given gate, whose lock must be held by the caller
+    void finger_set(ClientContext* context, const Gate* gates, uint64_t gate_id) const;
+
     // Common procedures for concurrency
     Gate* writer_on_entry(int64_t key); // retrieve the Gate where to perform the insertions/deletion (or nullptr if the item will be updated asynchronously)
     void writer_loop(int64_t key); // process the items in the local queues
@@ -93,7 +174,7 @@ protected:
     template<typename Lock> void writer_wait(Gate& gate, Lock& lock); // context switch on this gate & release the lock
     void writer_wait(Gate& gate){ writer_wait(gate, gate); } // as above
     void writer_do_pending_deletions(Gate* gate); // report the number of deletions executed
-    Gate* reader_on_entry(int64_t key, int64_t gate_id = -1) const;
+    Gate* reader_on_entry(int64_t key, int64_t gate_id = -1, const WindowSnapshot** out_snapshot = nullptr) const; // with a snapshot, the gate is not acquired
     void reader_on_exit(Gate* gate) const;
 
     /**
@@ -111,20 +192,60 @@ protected:
     /**
      * State machine to find an element in the data structure
      */
-    Gate* find_on_entry(int64_t key) const;
+    Gate* find_on_entry(int64_t key, const WindowSnapshot** out_snapshot = nullptr) const;
     int64_t do_find(Gate* gate, int64_t key) const;
     void find_on_exit(Gate* gate) const;
 
+    // Record the result of a point lookup in the read cache, if the gate, acquired by the reader, can still be read
+    void find_cache_fill(Gate* gate, int64_t key, int64_t value, uint64_t cache_generation) const;
+
     /**
      * State machine for the method #sum
      */
-    Gate* sum_on_entry(uint64_t gate_id, int64_t min, int64_t max, bool* out_readall) const;
+    Gate* sum_on_entry(uint64_t gate_id, int64_t min, int64_t max, bool* out_readall, const WindowSnapshot** out_snapshot = nullptr) const;
     void do_sum(uint64_t start_gate, int64_t& next_min, int64_t max, ::data_structures::Interface::SumResult* __restrict result) const;
+    void do_sum_tombstones(int64_t position_start, int64_t position_end, ::data_structures::Interface::SumResult* __restrict result) const; // sum the positions [start, end), skipping the tombstones
     void sum_on_exit(Gate* gate) const;
 
+    // Lazy deletes, mark the key as removed with a tombstone, rather than shifting the elements in the segment
+    int64_t do_remove_lazy(int64_t segment_id, int64_t key, int64_t* out_value);
+
+    // Append fast path. Stage the insertion in the buffer of the current thread, if it belongs to a run of increasing
+    // keys, otherwise flush the buffer. It returns true if the insertion has been staged, false if it still needs to be performed.
+    bool append_enqueue(ClientContext* context, int64_t key, int64_t value);
+
+    // Insert the staged elements of the current thread. The thread must have already set its epoch.
+    void append_flush(ClientContext* context);
+
+    // Flush the staged elements of the current thread, before it accesses the data structure with any other operation
+    void append_sync() const;
+
+    // Move the staged elements of the local queue that fall beyond the given gate back into the buffer of the thread
+    void append_split(const Gate& gate, ClientContext* context);
+
+    // Append, without shifting, the elements at the back of the queue that are greater than all keys in the gate. It
+    // stops at the first element not following the run or once the last segment of the gate is full.
+    // It returns the number of elements inserted.
+    uint64_t do_append(Gate* gate, std::vector<ClientContextQueue::insertion_t>& insertions);
+
+    // Delta buffers. Insert the element in the buffer of the gate, flushing the buffer first if it is full. It returns
+    // false if a global rebalance is required, in this case the element has not been inserted. The number of elements
+    // moved into the segments of the gate is added to num_insertions.
+    bool delta_insert(Gate* gate, int64_t key, int64_t value, ClientContext::bitset_t* bitset, int64_t& num_insertions);
+
+    // Merge the content of the delta buffer into the segments of the gate, in a single spread. It returns false if a
+    // global rebalance is required, the elements still in the buffer are loaded by the RebalancingMaster.
+    bool delta_flush(Gate* gate, ClientContext::bitset_t* bitset, int64_t& num_insertions);
+
+    // Remove the key from the delta buffer of the gate. It returns true if the key was found, setting out_value.
+    bool delta_remove(Gate* gate, int64_t key, int64_t* out_value);
+
     // Insert the first element in the (empty) container
     void insert_empty(int64_t key, int64_t value);
 
+    // Whether the storage is empty, there may still be elements pending in the delta buffers
+    bool storage_empty() const noexcept;
+
     // Insert an element in the PMA at the given segment_id
     bool insert_common(size_t segment_id, int64_t key, int64_t value, ClientContext::bitset_t* bitset);
 
@@ -178,9 +299,11 @@ protected:
     // Rebuild the underlying storage to hold m_elements
     void resize_local(const RebalancePlan& action, InsertionT* insertion);
 
-    // Spread (without rewiring) the elements in the given window
-    void spread_local(const RebalancePlan& action, InsertionT* insertion);
+    // Spread (without rewiring) the elements in the given window, together with the given insertion or the elements of
+    // the given delta buffer
+    void spread_local(const RebalancePlan& action, InsertionT* insertion, const DeltaBuffer* delta = nullptr);
     void spread_load(const RebalancePlan& action, int64_t* __restrict keys_to, int64_t* __restrict values_to, InsertionT* insertion, int64_t* out_insert_position = nullptr);
+    void spread_load(const RebalancePlan& action, int64_t* keys_to, int64_t* values_to, const DeltaBuffer* delta);
     size_t spread_insert_unsafe(int64_t* __restrict keys_from, int64_t* __restrict values_from, int64_t* __restrict keys_to, int64_t* __restrict values_to, size_t num_elements, int64_t new_key, int64_t new_value);
 
     // Retrieve the number of segments after that the primary thresholds are used
@@ -200,11 +323,17 @@ protected:
     // Helper for the class Weights. This method is not thread safe.
     int find_position(size_t segment_id, int64_t key) const noexcept;
 
-    // Invoked by the Timer, when a gate is ready for rebalance
-    void timeout(size_t gate_id, std::chrono::steady_clock::time_point time_last_rebal);
+    // Invoked by the Timer, when the timers of the given gates expired
+    void timeout(const std::vector<Gate*>& gates);
 
 public:
-    PackedMemoryArray(size_t index_B, size_t pma_segment_size, size_t pages_per_extent, size_t num_worker_threads, size_t segments_per_lock, std::chrono::milliseconds delay_rebalance = std::chrono::milliseconds(0));
+    /**
+     * Constructor
+     * @param delay_rebalance the delay to wait before rebalancing a gate, after a writer requested it. With the option
+     *        m_adaptive_delay, the maximum delay for a gate.
+     * @param options the optional features to enable, see the struct Options
+     */
+    PackedMemoryArray(size_t index_B, size_t pma_segment_size, size_t pages_per_extent, size_t num_worker_threads, size_t segments_per_lock, std::chrono::milliseconds delay_rebalance = std::chrono::milliseconds(0), const Options& options = Options{});
 
     /**
      * Destructor
@@ -262,11 +391,39 @@ public:
      */
     Knobs& knobs();
 
+    /**
+     * Accessor to the underlying predictor/detector
+     */
+    common::Detector& detector();
+
+    /**
+     * Whether the current update should be forwarded to the detector, according to the sampling rate in the knobs.
+     * Always false when the adaptive rebalancing is disabled.
+     */
+    bool detector_sample() const;
+
     /**
      * Retrieve the densities currently in use
      */
     const CachedDensityBounds& get_thresholds() const;
 
+    /**
+     * Retrieve the cache for the point lookups of the hot keys, or nullptr if it is not enabled
+     */
+    const ReadCache* read_cache() const;
+
+    /**
+     * Set the upper density at the root of the calibrator tree for the primary thresholds, used once the array grows
+     * beyond balanced_thresholds_cutoff() segments (default: 0.75). With the adaptive densities, this is the initial value
+     * for the tuner. This method is not thread safe, it should be invoked before the data structure is populated.
+     */
+    void set_primary_density(double theta_h);
+
+    /**
+     * Retrieve the upper density at the root of the calibrator tree for the primary thresholds
+     */
+    double get_primary_density() const;
+
     /**
      * Retrieve the maximum capacity (in terms of number of elements) of a segment
      */
@@ -292,6 +449,11 @@ public:
      */
     size_t get_number_locks() const noexcept;
 
+    /**
+     * Retrieve the number of rebalances where the adaptive rebalancing assigned a different density to the segments of the window
+     */
+    uint64_t get_number_skewed_rebalances() const noexcept;
+
     /**
      * Set the maximum number of worker threads
      */
@@ -0,0 +1,205 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "read_cache.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "common/miscellaneous.hpp"
+#include "gate.hpp"
+#include "thread_context.hpp"
+
+using namespace std;
+
+namespace data_structures::rma::batch_processing {
+
+/*****************************************************************************
+ *                                                                           *
+ *   DEBUG                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+extern mutex _debug_mutex; // PackedMemoryArray.cpp
+//#define DEBUG
+#define COUT_DEBUG_FORCE(msg) { scoped_lock<mutex> lock(_debug_mutex); std::cout << "[ReadCache::" << __FUNCTION__ << "] [" << this_thread::get_id() << "] " << msg << std::endl; }
+#if defined(DEBUG)
+    #define COUT_DEBUG(msg) COUT_DEBUG_FORCE(msg)
+#else
+    #define COUT_DEBUG(msg)
+#endif
+
+/*****************************************************************************
+ *                                                                           *
+ *   Initialisation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+ReadCache::ReadCache(uint64_t capacity) :
+        m_num_sets(::common::hyperceil(max<uint64_t>(capacity, NUM_WAYS)) / NUM_WAYS), m_hash_shift(64 - __builtin_ctzll(m_num_sets)), m_sets(nullptr) {
+    if(capacity == 0) throw std::invalid_argument("[ReadCache::ctor] The capacity must be a positive quantity");
+    m_sets = new Set[m_num_sets](); // zero initialised: all entries are empty
+}
+
+ReadCache::~ReadCache(){
+    delete[] m_sets; m_sets = nullptr;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Lookups                                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+ReadCache::Set& ReadCache::get_set(int64_t key) const {
+    // Fibonacci hashing, the top bits of the product select the set
+    uint64_t hash = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+    return m_sets[ m_num_sets == 1 ? 0 : (hash >> m_hash_shift) ];
+}
+
+bool ReadCache::find(int64_t key, int64_t* out_value){
+    assert(out_value != nullptr && "Null pointer");
+    Set& set = get_set(key);
+
+    bool found = false;
+    int64_t value = -1;
+    const Gate* gate = nullptr;
+    uint32_t version = 0;
+
+    uint32_t sequence = set.m_sequence.load(memory_order_acquire);
+    if(sequence % 2 == 0){ // otherwise a fill is in progress
+        for(uint64_t i = 0; i < NUM_WAYS && !found; i++){
+            if(set.m_keys[i].load(memory_order_relaxed) == key){
+                value = set.m_values[i].load(memory_order_relaxed);
+                gate = set.m_gates[i].load(memory_order_relaxed);
+                version = set.m_versions[i].load(memory_order_relaxed);
+                found = gate != nullptr;
+            }
+        }
+        atomic_thread_fence(memory_order_acquire);
+        found = found && set.m_sequence.load(memory_order_relaxed) == sequence; // the entry has not been overwritten in the meanwhile
+    }
+
+    // the gate has not been altered since the entry was filled
+    found = found && gate->m_cold->m_version.load(memory_order_acquire) == version;
+
+    if(found){
+        counters().m_num_hits.fetch_add(1, memory_order_relaxed);
+        *out_value = value;
+    } else {
+        counters().m_num_misses.fetch_add(1, memory_order_relaxed);
+    }
+
+    return found;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Updates                                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+void ReadCache::insert(int64_t key, int64_t value, const Gate* gate, uint32_t version, uint64_t generation){
+    assert(gate != nullptr && "Null pointer");
+    Set& set = get_set(key);
+
+    uint32_t sequence = set.m_sequence.load(memory_order_relaxed);
+    if(sequence % 2 == 1 || !set.m_sequence.compare_exchange_strong(sequence, sequence +1, memory_order_acquire)) return; // another thread is filling this set
+    atomic_thread_fence(memory_order_release);
+
+    if(m_generation.load(memory_order_acquire) == generation){ // otherwise the gate may belong to an old array
+        // replace the same key, an empty entry or the next victim, in this order
+        uint64_t way = NUM_WAYS;
+        for(uint64_t i = 0; i < NUM_WAYS && way == NUM_WAYS; i++){
+            if(set.m_keys[i].load(memory_order_relaxed) == key) way = i;
+        }
+        for(uint64_t i = 0; i < NUM_WAYS && way == NUM_WAYS; i++){
+            if(set.m_gates[i].load(memory_order_relaxed) == nullptr) way = i;
+        }
+        if(way == NUM_WAYS){
+            way = set.m_victim.load(memory_order_relaxed) % NUM_WAYS;
+            set.m_victim.store(way +1, memory_order_relaxed);
+        }
+
+        COUT_DEBUG("key: " << key << ", value: " << value << ", gate: " << gate->lock_id() << ", version: " << version << ", way: " << way);
+        set.m_keys[way].store(key, memory_order_relaxed);
+        set.m_values[way].store(value, memory_order_relaxed);
+        set.m_gates[way].store(gate, memory_order_relaxed);
+        set.m_versions[way].store(version, memory_order_relaxed);
+    }
+
+    set.m_sequence.store(sequence +2, memory_order_release);
+}
+
+uint64_t ReadCache::generation() const {
+    return m_generation.load(memory_order_acquire);
+}
+
+void ReadCache::clear(){
+    COUT_DEBUG("generation: " << m_generation);
+    m_generation.fetch_add(1, memory_order_acq_rel); // first discard the fills in progress
+
+    for(uint64_t i = 0; i < m_num_sets; i++){
+        Set& set = m_sets[i];
+
+        // wait for the fill in progress to complete
+        uint32_t sequence = set.m_sequence.load(memory_order_relaxed);
+        while(sequence % 2 == 1 || !set.m_sequence.compare_exchange_weak(sequence, sequence +1, memory_order_acquire)){
+            sequence = set.m_sequence.load(memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_release);
+
+        for(uint64_t j = 0; j < NUM_WAYS; j++){ set.m_gates[j].store(nullptr, memory_order_relaxed); }
+
+        set.m_sequence.store(sequence +2, memory_order_release);
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Statistics                                                              *
+ *                                                                           *
+ *****************************************************************************/
+
+ReadCache::Counters& ReadCache::counters(){
+    // unregistered threads have thread_id == -1, they all share the last slot
+    return m_counters[ static_cast<uint64_t>(ClientContext::thread_id()) % NUM_SHARDS ];
+}
+
+uint64_t ReadCache::capacity() const {
+    return m_num_sets * NUM_WAYS;
+}
+
+uint64_t ReadCache::num_hits() const {
+    uint64_t result = 0;
+    for(uint64_t i = 0; i < NUM_SHARDS; i++){ result += m_counters[i].m_num_hits.load(memory_order_relaxed); }
+    return result;
+}
+
+uint64_t ReadCache::num_misses() const {
+    uint64_t result = 0;
+    for(uint64_t i = 0; i < NUM_SHARDS; i++){ result += m_counters[i].m_num_misses.load(memory_order_relaxed); }
+    return result;
+}
+
+size_t ReadCache::memory_footprint() const {
+    return sizeof(ReadCache) + m_num_sets * sizeof(Set);
+}
+
+} // namespace
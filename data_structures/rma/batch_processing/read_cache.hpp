@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+
+namespace data_structures::rma::batch_processing {
+
+class Gate; // forward decl.
+
+/**
+ * A small set-associative cache in front of the point lookups, to serve the hot keys of skewed workloads without going
+ * through the index, the gate and the segment. Each set fits a single cache line and holds a couple of entries
+ * <key, value, gate, version>. An entry is valid as long as the version of its gate has not changed: writers and the
+ * rebalancer bump the version of a gate before altering its content, implicitly invalidating all the entries recorded
+ * for that gate.
+ *
+ * The entries refer to the gates by address, the cache is cleared each time a new array of gates is installed by a
+ * resize. Each set is protected by a sequence lock: the lookups never block, while a fill is dropped if another thread is
+ * already filling the same set.
+ */
+class ReadCache {
+    constexpr static uint64_t NUM_WAYS = 2; // number of entries in each set
+
+    struct alignas(64) Set {
+        std::atomic<uint32_t> m_sequence; // sequence lock, odd while an entry of the set is being written
+        std::atomic<uint32_t> m_victim; // the next entry to evict, round robin
+        std::atomic<uint32_t> m_versions[NUM_WAYS]; // the version of the gate when the entry was filled
+        std::atomic<int64_t> m_keys[NUM_WAYS];
+        std::atomic<int64_t> m_values[NUM_WAYS];
+        std::atomic<const Gate*> m_gates[NUM_WAYS]; // the gate storing the key, nullptr if the entry is empty
+    };
+    static_assert(sizeof(Set) == 64, "A set should fit a single cache line");
+
+    const uint64_t m_num_sets; // the number of sets, a power of 2
+    const int m_hash_shift; // the number of bits to discard from the hash of a key, to select its set
+    Set* m_sets; // the actual cache
+    std::atomic<uint64_t> m_generation = 0; // incremented each time the cache is cleared, to discard the fills that started before
+
+    // the counters are sharded by the client threads, to avoid contention on a single cache line
+    struct alignas(64) Counters {
+        std::atomic<uint64_t> m_num_hits = 0;
+        std::atomic<uint64_t> m_num_misses = 0;
+    };
+    constexpr static uint64_t NUM_SHARDS = 64;
+    Counters m_counters[NUM_SHARDS];
+
+    // Retrieve the set for the given key
+    Set& get_set(int64_t key) const;
+
+    // Retrieve the counters for the current thread
+    Counters& counters();
+
+public:
+    /**
+     * Constructor
+     * @param capacity the number of entries in the cache, rounded up to a power of 2
+     */
+    ReadCache(uint64_t capacity);
+
+    /**
+     * Destructor
+     */
+    ~ReadCache();
+
+    /**
+     * Look up the given key. Return true, and set `out_value', if the key is in the cache and its entry is still valid.
+     * Precondition: the calling thread is inside an epoch, as the gates of the entries may be concurrently released by a resize.
+     */
+    bool find(int64_t key, int64_t* out_value);
+
+    /**
+     * Record the value for the given key, read from `gate' at the given `version'. The fill is dropped if the cache has
+     * been cleared since `generation' was retrieved, or if another thread is concurrently filling the same set.
+     */
+    void insert(int64_t key, int64_t value, const Gate* gate, uint32_t version, uint64_t generation);
+
+    /**
+     * The current generation of the cache, to be retrieved before accessing the gates of an entry to fill
+     */
+    uint64_t generation() const;
+
+    /**
+     * Remove all entries from the cache. Invoked by the RebalancingMaster when a new array of gates is installed.
+     */
+    void clear();
+
+    /**
+     * Number of entries in the cache
+     */
+    uint64_t capacity() const;
+
+    /**
+     * The number of lookups served by the cache
+     */
+    uint64_t num_hits() const;
+
+    /**
+     * The number of lookups not served by the cache, either because the key was absent or its entry invalid
+     */
+    uint64_t num_misses() const;
+
+    /**
+     * Retrieve the space used by the cache, in bytes
+     */
+    size_t memory_footprint() const;
+};
+
+} // namespace
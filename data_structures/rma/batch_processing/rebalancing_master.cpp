@@ -17,23 +17,33 @@
 
 #include "rebalancing_master.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdlib> // abs, debug only
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "common/configuration.hpp" // LOG_VERBOSE
 #include "common/errorhandling.hpp"
 #include "common/miscellaneous.hpp"
-#include "rma/common/static_index.hpp"
+#include "rma/common/segment_index.hpp"
+#include "delay_controller.hpp"
+#include "delta_buffer.hpp"
 #include "garbage_collector.hpp"
 #include "gate.hpp"
 #include "packed_memory_array.hpp"
+#include "read_cache.hpp"
 #include "rebalancing_task.hpp"
 #include "rebalancing_worker.hpp"
+#include "task_scheduler.hpp"
+#include "timer_manager.hpp"
 #include "wakelist.hpp"
+#include "window_snapshot.hpp"
 
 using namespace common;
 using namespace std;
@@ -60,7 +70,20 @@ extern mutex _debug_mutex; // PackedMemoryArray.cpp
  *                                                                           *
  *****************************************************************************/
 
-RebalancingMaster::RebalancingMaster(PackedMemoryArray* pma, uint64_t num_workers) : m_instance(pma), m_thread_pool(num_workers){ }
+RebalancingMaster::Shard::Shard(int shard_id, State state) : m_shard_id(shard_id), m_state(state) { }
+
+RebalancingMaster::RebalancingMaster(PackedMemoryArray* pma, uint64_t num_workers, uint64_t num_shards) : m_instance(pma), m_coordinator(nullptr), m_gates_per_shard(1), m_thread_pool(num_workers){
+    if(num_shards == 0 || !is_power_of_2(num_shards)) throw std::invalid_argument("[RebalancingMaster::ctor] Invalid value for the number of shards, it must be a power of 2");
+
+    if(num_shards == 1){ // a single coordinator in charge of all gates
+        m_coordinator = new Shard(-1, Shard::State::GLOBAL);
+    } else {
+        m_coordinator = new Shard(-1, Shard::State::SHARDED);
+        for(uint64_t i = 0; i < num_shards; i++){
+            m_shards.push_back(new Shard(i, Shard::State::ACTIVE));
+        }
+    }
+}
 
 RebalancingMaster::~RebalancingMaster() {
     stop();
@@ -68,289 +91,620 @@ RebalancingMaster::~RebalancingMaster() {
 #if defined(PROFILING)
     LOG_VERBOSE("[RebalancingMaster::dtor] Computing the rebalancing statistics....");
     auto t0 = chrono::steady_clock::now();
-    auto stats = get_rebalancing_stastistics(m_stats_completed_tasks);
+    std::vector<RebalancingStatistics> stats_completed_tasks = m_coordinator->m_stats_completed_tasks;
+    for(auto shard : m_shards){
+        stats_completed_tasks.insert(end(stats_completed_tasks), begin(shard->m_stats_completed_tasks), end(shard->m_stats_completed_tasks));
+    }
+    auto stats = get_rebalancing_stastistics(stats_completed_tasks);
     auto t1 = chrono::steady_clock::now();
     cout << "Statistics computed in " << chrono::duration_cast<chrono::seconds>(t1 - t0).count() << " seconds\n";
     cout << stats << endl;;
 #endif
+
+    for(auto shard : m_shards){ delete shard; }
+    m_shards.clear();
+    delete m_coordinator; m_coordinator = nullptr;
 }
 
 void RebalancingMaster::start(){
     COUT_DEBUG("Starting the master...");
 
-    scoped_lock<mutex> lock(m_mutex);
-    if(m_handle.joinable()){ RAISE_EXCEPTION(Exception, "Main thread already started") };
-    m_queue.clear();
-    m_handle = thread(&RebalancingMaster::main_thread, this);
+    if(m_coordinator->m_handle.joinable()){ RAISE_EXCEPTION(Exception, "Main thread already started") };
+    update_gates_per_shard();
+    m_thread_pool.start();
+
+    auto start_thread = [this](Shard* shard){
+        InternalTask discard[64];
+        while(shard->m_queue.pop(discard, 64) > 0){ /* remove the leftovers of a previous run */ }
+        shard->m_handle = thread(&RebalancingMaster::main_thread, this, shard);
+    };
+    start_thread(m_coordinator);
+    for(auto shard : m_shards){ start_thread(shard); }
 }
 
 void RebalancingMaster::stop(){
     COUT_DEBUG("Stopping the master...");
-    { // restrict the scope
-        scoped_lock<mutex> lock(m_mutex);
-        if(!m_handle.joinable()) return; // already stopped
-        m_queue.append(InternalTask{InternalTask::Type::Stop, 0});
-        m_condvar.notify_one();
+    if(!m_coordinator->m_handle.joinable()) return; // already stopped
+
+    for(auto shard : m_shards){
+        send(shard, InternalTask{InternalTask::Type::Stop, 0});
+        shard->m_handle.join();
     }
-    m_handle.join();
+    send(m_coordinator, InternalTask{InternalTask::Type::Stop, 0});
+    m_coordinator->m_handle.join();
+
+    m_thread_pool.stop();
 }
 
 RebalancingPool& RebalancingMaster::thread_pool(){
     return m_thread_pool;
 }
 
+uint64_t RebalancingMaster::num_shards() const noexcept {
+    return max<uint64_t>(1, m_shards.size());
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Interface                                                               *
  *                                                                           *
  *****************************************************************************/
 void RebalancingMaster::rebalance(uint64_t gate_id){
-    {
-        scoped_lock<mutex> lock(m_mutex);
-        m_queue.append(InternalTask{InternalTask::Type::Rebalance, gate_id });
+    send(get_shard_for(gate_id), InternalTask{InternalTask::Type::Rebalance, gate_id });
+}
+
+void RebalancingMaster::rebalance(const std::vector<uint64_t>& gate_ids){
+    if(gate_ids.empty()) return;
+    if(gate_ids.size() == 1){ rebalance(gate_ids[0]); return; }
+
+    // a single message for each shard involved
+    if(m_shards.empty()){
+        send(m_coordinator, InternalTask{InternalTask::Type::RebalanceBatch, reinterpret_cast<uint64_t>(new vector<uint64_t>(gate_ids)) });
+    } else {
+        vector<vector<uint64_t>*> batches(m_shards.size(), nullptr);
+        for(uint64_t gate_id : gate_ids){
+            auto& batch = batches[get_shard_for(gate_id)->m_shard_id];
+            if(batch == nullptr){ batch = new vector<uint64_t>(); }
+            batch->push_back(gate_id);
+        }
+        for(size_t i = 0; i < batches.size(); i++){
+            if(batches[i] != nullptr){
+                send(m_shards[i], InternalTask{InternalTask::Type::RebalanceBatch, reinterpret_cast<uint64_t>(batches[i]) });
+            }
+        }
     }
-    m_condvar.notify_one();
 }
 
 void RebalancingMaster::exit(uint64_t gate_id){
-    {
-        scoped_lock<mutex> lock(m_mutex);
-        m_queue.append(InternalTask{InternalTask::Type::ClientExit, gate_id });
-    }
-    m_condvar.notify_one();
+    send(get_shard_for(gate_id), InternalTask{InternalTask::Type::ClientExit, gate_id });
 }
 
 void RebalancingMaster::task_done(RebalancingTask* task){
     assert(task != nullptr && "Null pointer");
-    {
-        scoped_lock<mutex> lock(m_mutex);
-        m_queue.append(InternalTask{InternalTask::Type::TaskDone, reinterpret_cast<uint64_t>(task) });
+    // fetch the owner before sending the message, as afterwards the task can be deallocated at any time
+    Shard* owner = task->m_shard_id < 0 ? m_coordinator : m_shards[task->m_shard_id];
+    send(owner, InternalTask{InternalTask::Type::TaskDone, reinterpret_cast<uint64_t>(task) });
+
+    // a worker has been released to the pool, resume the coordinators that could not acquire one
+    for(auto shard : m_shards){
+        if(shard != owner && shard->m_starved.exchange(false)){
+            send(shard, InternalTask{InternalTask::Type::ProcessTodo, 0});
+        }
+    }
+    if(m_coordinator != owner && m_coordinator->m_starved.exchange(false)){
+        send(m_coordinator, InternalTask{InternalTask::Type::ProcessTodo, 0});
     }
-    m_condvar.notify_one();
 }
 
-
 void RebalancingMaster::complete(){
-    std::promise<void> producer;
-    std::future<void> consumer = producer.get_future();
     COUT_DEBUG("Waiting for the rebalancer to become idle... ");
-    {
-        scoped_lock<mutex> lock(m_mutex);
-        m_queue.append(InternalTask{InternalTask::Type::Wait2Complete, reinterpret_cast<uint64_t>(&producer)});
-    }
-    m_condvar.notify_one();
 
-    consumer.wait(); // Zzz
+    auto wait = [this](Shard* shard){
+        std::promise<void> producer;
+        std::future<void> consumer = producer.get_future();
+        send(shard, InternalTask{InternalTask::Type::Wait2Complete, reinterpret_cast<uint64_t>(&producer)});
+        consumer.wait(); // Zzz
+    };
+
+    if(m_shards.empty()){
+        wait(m_coordinator);
+    } else {
+        // a shard frozen or handed over forwards the request to the coordinator
+        for(auto shard : m_shards){ wait(shard); }
+    }
 
     COUT_DEBUG("Done");
 }
 
+void RebalancingMaster::send(Shard* shard, InternalTask message){
+    assert(shard != nullptr && "Null pointer");
+    shard->m_queue.push(message);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Shards                                                                  *
+ *                                                                           *
+ *****************************************************************************/
+
+RebalancingMaster::Shard* RebalancingMaster::get_shard_for(uint64_t gate_id) const {
+    if(m_shards.empty()) return m_coordinator;
+    uint64_t shard_id = std::min<uint64_t>(gate_id / m_gates_per_shard, m_shards.size() -1);
+    return m_shards[shard_id];
+}
+
+std::pair<int64_t, int64_t> RebalancingMaster::get_gate_range(const Shard& shard) const {
+    const int64_t num_locks = m_instance->get_number_locks();
+    if(is_global(shard)) return std::pair<int64_t, int64_t>{ 0, num_locks };
+
+    const int64_t gates_per_shard = m_gates_per_shard;
+    int64_t start = std::min<int64_t>(shard.m_shard_id * gates_per_shard, num_locks);
+    int64_t end = (shard.m_shard_id == static_cast<int64_t>(m_shards.size()) -1) ? num_locks : std::min<int64_t>(start + gates_per_shard, num_locks);
+    return std::pair<int64_t, int64_t>{ start, end };
+}
+
+bool RebalancingMaster::is_global(const Shard& shard) const {
+    return shard.m_shard_id < 0;
+}
+
+void RebalancingMaster::update_gates_per_shard(){
+    // Each shard, except the last one, covers a power of 2 of gates, multiple of an extent. In this way, the windows of the
+    // calibrator tree are naturally aligned to the shards and to the extents for rewiring.
+    const uint64_t gates_per_extent = max<uint64_t>(1, m_instance->m_storage.get_segments_per_extent() / m_instance->get_segments_per_lock());
+    m_gates_per_shard = max<uint64_t>(gates_per_extent, hyperfloor(max<uint64_t>(1, m_instance->get_number_locks() / num_shards())));
+    COUT_DEBUG("gates per shard: " << m_gates_per_shard);
+}
+
+void RebalancingMaster::escalate(Shard& shard){
+    assert(!is_global(shard) && "Only the shards can escalate their tasks");
+    if(shard.m_state != Shard::State::ACTIVE) return; // the coordinator is already taking over
+    COUT_DEBUG("shard: " << shard.m_shard_id);
+    shard.m_state = Shard::State::FROZEN;
+    send(m_coordinator, InternalTask{InternalTask::Type::Escalate, static_cast<uint64_t>(shard.m_shard_id)});
+}
+
+void RebalancingMaster::handover(Shard& shard){
+    assert(shard.m_state == Shard::State::FROZEN && "The shard must be frozen");
+    assert(shard.m_executing.empty() && "There should be no tasks in execution");
+    COUT_DEBUG("shard: " << shard.m_shard_id << ", pending tasks: " << shard.m_todo.size());
+
+    Handover* handover = new Handover();
+    while(!shard.m_todo.empty()){
+        if(shard.m_todo[0] != nullptr) handover->m_tasks.push_back(shard.m_todo[0]);
+        shard.m_todo.pop();
+    }
+    handover->m_wait2complete = std::move(shard.m_wait2complete);
+    shard.m_wait2complete.clear();
+
+    shard.m_state = Shard::State::HANDED_OVER;
+    send(m_coordinator, InternalTask{InternalTask::Type::Handover, reinterpret_cast<uint64_t>(handover)});
+}
+
+void RebalancingMaster::thaw(){
+    Shard& coordinator = *m_coordinator;
+    assert(coordinator.m_state == Shard::State::GLOBAL && !busy(coordinator));
+    COUT_DEBUG("Returning the control to the shards...");
+
+    for(auto p : coordinator.m_wait2complete){ p->set_value(); }
+    coordinator.m_wait2complete.clear();
+
+    update_gates_per_shard(); // the array may have been resized in the meanwhile
+    coordinator.m_state = Shard::State::SHARDED;
+    for(auto shard : m_shards){
+        send(shard, InternalTask{InternalTask::Type::Thaw, 0});
+    }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Controller thread                                                       *
  *                                                                           *
  *****************************************************************************/
-void RebalancingMaster::main_thread(){
-    COUT_DEBUG("Master node started");
-    set_thread_name("RB Master");
+void RebalancingMaster::main_thread(Shard* shard){
+    assert(shard != nullptr && "Null pointer");
+    COUT_DEBUG("Master node started, shard: " << shard->m_shard_id);
+    set_thread_name(is_global(*shard) ? string("RB Master") : string("RB Master ") + to_string(shard->m_shard_id));
 
     // we promised in the paper that all threads are pinned to the first socket
 #if defined(HAVE_LIBNUMA)
     pin_thread_to_numa_node(0);
 #endif
 
+    constexpr uint64_t batch_capacity = 64;
+    InternalTask batch[batch_capacity];
     bool stop_loop = false;
-    m_thread_pool.start();
 
     do {
-        InternalTask task;
+        // Fetch the next batch of tasks from the queue, sleep only if there is nothing to do
+        uint64_t batch_size = shard->m_queue.wait_and_pop(batch, batch_capacity);
+        assert(batch_size > 0 && "Precondition not satified: there should be at least one item in the queue at this point");
+
+        for(uint64_t i = 0; i < batch_size && !stop_loop; i++){
+            InternalTask& task = batch[i];
+            COUT_DEBUG("[shard: " << shard->m_shard_id << "] Task received: " << task.to_string());
 
-        { // Fetch the next task from the queue
-            unique_lock<mutex> lock(m_mutex);
-            if(m_queue.empty()){ m_condvar.wait(lock, [this](){ return !m_queue.empty(); }); }
-            assert(!m_queue.empty() && "Precondition not satified: there should be at least one item in the queue at this point");
-            task = m_queue[0];
-            m_queue.pop();
+            if(is_global(*shard)){
+                stop_loop = handle_coordinator(*shard, task);
+            } else {
+                stop_loop = handle_shard(*shard, task);
+            }
         }
+    } while(!stop_loop);
 
-        COUT_DEBUG("Task received: " << task.to_string());
+    COUT_DEBUG("Master node stopped, shard: " << shard->m_shard_id);
+}
 
-        switch(task.m_type){
-        case InternalTask::Type::Rebalance: {
-            uint64_t gate_id = task.m_payload;
-            assert(gate_id < m_instance->get_number_locks() && "Invalid gate ID");
-            if(!m_resizing && !ignore_lock(gate_id)){
-                RebalancingTask* task = rebal_init(gate_id);
-                if(task != nullptr){ // task == nullptr => ignore this request
-                    rebal_resume(task);
+bool RebalancingMaster::handle_shard(Shard& shard, InternalTask message){
+    assert(!is_global(shard));
+
+    switch(message.m_type){
+    case InternalTask::Type::Rebalance: {
+        uint64_t gate_id = message.m_payload;
+        auto range = get_gate_range(shard);
+        if(shard.m_state != Shard::State::ACTIVE){ // the coordinator is taking over
+            send(m_coordinator, message);
+        } else if(static_cast<int64_t>(gate_id) < range.first || static_cast<int64_t>(gate_id) >= range.second){
+            send(get_shard_for(gate_id), message); // the request was routed before the shards were redistributed
+        } else {
+            on_rebalance(shard, gate_id);
+        }
+    } break;
+    case InternalTask::Type::RebalanceBatch: {
+        unique_ptr<vector<uint64_t>> batch { reinterpret_cast<vector<uint64_t>*>(message.m_payload) };
+        for(uint64_t gate_id : *batch){ handle_shard(shard, InternalTask{InternalTask::Type::Rebalance, gate_id}); }
+    } break;
+    case InternalTask::Type::TaskDone: {
+        assert(shard.m_state != Shard::State::HANDED_OVER && "All tasks in execution should have been completed before handing over");
+        on_task_done(shard, reinterpret_cast<RebalancingTask*>(message.m_payload));
+    } break;
+    case InternalTask::Type::ClientExit: {
+        if(shard.m_state == Shard::State::HANDED_OVER){
+            send(m_coordinator, message); // the task is now owned by the coordinator
+        } else {
+            on_client_exit(shard, message.m_payload);
+        }
+    } break;
+    case InternalTask::Type::Wait2Complete: {
+        if(shard.m_state == Shard::State::HANDED_OVER){
+            send(m_coordinator, message);
+        } else {
+            on_wait2complete(shard, reinterpret_cast<std::promise<void>*>(message.m_payload));
+        }
+    } break;
+    case InternalTask::Type::ProcessTodo: {
+        if(shard.m_state == Shard::State::ACTIVE){ process_todo_list(shard); }
+    } break;
+    case InternalTask::Type::Freeze: {
+        // if the shard escalated a task by itself, it may have already handed over its tasks
+        if(shard.m_state == Shard::State::ACTIVE){ shard.m_state = Shard::State::FROZEN; }
+    } break;
+    case InternalTask::Type::Thaw: {
+        assert(shard.m_state == Shard::State::HANDED_OVER && "The shard was not frozen");
+        assert(!busy(shard) && "All tasks should have been handed over to the coordinator");
+        shard.m_state = Shard::State::ACTIVE;
+    } break;
+    case InternalTask::Type::Stop: {
+        assert(shard.m_executing.size() == 0 && "There should be no jobs on execution");
+        return true;
+    } break; // done
+    default:
+        assert(0 && "Invalid task");
+    }
 
-                    // append the task in the list of tasks to execute
-                    m_todo.append(task);
+    // once all tasks in execution terminated, a frozen shard can hand over the pending tasks to the coordinator
+    if(shard.m_state == Shard::State::FROZEN && shard.m_executing.empty()){
+        handover(shard);
+    }
 
-                    // process the list of tasks
-                    process_todo_list();
-                }
-            } // otherwise this gate is already going to be rebalanced
-        } break;
-        case InternalTask::Type::TaskDone: {
-            // a task has been performed by a rebal worker
-            RebalancingTask* rebal_task = reinterpret_cast<RebalancingTask*>(task.m_payload);
-            IF_PROFILING( auto task_done_t0 = chrono::steady_clock::now() );
-
-            // remove the task from the execution list
-            auto it = std::find_if(begin(m_executing), end(m_executing), [rebal_task](const RebalancingTask* task){ return rebal_task == task; });
-            assert(it != end(m_executing) && "Task not found ?");
-            m_executing.erase(it);
-
-
-            switch(rebal_task->m_plan.m_operation){
-            case RebalanceOperation::REBALANCE:
-            {
-                // 1) update the todo list with the rebalances that cannot proceed
-                for(size_t i = 0, sz = m_todo.size(); i < sz; i++){
-                    if(m_todo[i] != nullptr && m_todo[i]->m_blocked_on_lock == rebal_task->get_lock_start()){
-                        m_todo[i]->m_blocked_on_lock = -1;
-                    }
-                }
-                // 2) unlock the client threads associated to the gates rebalanced
-                WakeList worker_list;
-                auto now = chrono::steady_clock::now();
-                for(size_t i = rebal_task->get_lock_start(), end = rebal_task->get_lock_end(); i < end; i++){
-                    release_lock(i, /* workspace */ worker_list, /* time of the last rebalance */ now);
-                }
-                // 3) go through the todo list
-                process_todo_list();
-            } break;
-            case RebalanceOperation::RESIZE:
-            case RebalanceOperation::RESIZE_REBALANCE:
-            {
-                while(!m_todo.empty() && m_todo[0] == nullptr) m_todo.pop(); // remove the nullptrs from the todo list
-                assert(m_todo.empty() && "All gates should have been locked");
-                m_resizing = false;
-
-                // 1) Invalidate the old storage
-                if(rebal_task->m_plan.m_operation == RebalanceOperation::RESIZE){
-                    COUT_DEBUG("[Storage OLD] keys: " << m_instance->m_storage.m_keys << ", values: " << m_instance->m_storage.m_values << ", cardinalities: " << m_instance->m_storage.m_segment_sizes
-                            << ", rw keys: " << m_instance->m_storage.m_memory_keys << ", rw values:" << m_instance->m_storage.m_memory_values << ", rw cardinalities: " << m_instance->m_storage.m_memory_sizes);
-                    COUT_DEBUG("[Storage NEW] keys: " << rebal_task->m_ptr_storage->m_keys << ", values: " << rebal_task->m_ptr_storage->m_values << ", cardinalities: " << rebal_task->m_ptr_storage->m_segment_sizes
-                            << ", rw keys: " << rebal_task->m_ptr_storage->m_memory_keys << ", rw values:" << rebal_task->m_ptr_storage->m_memory_values << ", rw cardinalities: " << rebal_task->m_ptr_storage->m_memory_sizes);
-
-                    m_instance->m_storage = std::move(*(rebal_task->m_ptr_storage));
-                    delete rebal_task->m_ptr_storage; rebal_task->m_ptr_storage = nullptr;
-                }
+    return false;
+}
 
-                // 2) Set the time when the storage was created
-                auto now = chrono::steady_clock::now();
-                Gate* locks_new = rebal_task->m_ptr_locks;
-                for(size_t i = 0, sz = rebal_task->get_lock_length(); i < sz; i++){
-                    locks_new[i].m_time_last_rebal = now;
-                }
+bool RebalancingMaster::handle_coordinator(Shard& coordinator, InternalTask message){
+    assert(is_global(coordinator));
+
+    switch(message.m_type){
+    case InternalTask::Type::Rebalance:
+    case InternalTask::Type::ClientExit:
+    case InternalTask::Type::Wait2Complete: {
+        if(coordinator.m_state == Shard::State::FREEZING){
+            // some shards are still in control of their gates, wait for all of them to hand over their tasks
+            coordinator.m_postponed.push_back(message);
+        } else if (coordinator.m_state == Shard::State::SHARDED){
+            // a request forwarded before the shards took the control back
+            if(message.m_type == InternalTask::Type::Wait2Complete){
+                reinterpret_cast<std::promise<void>*>(message.m_payload)->set_value(); // nothing pending in the coordinator
+            } else {
+                send(get_shard_for(message.m_payload), message);
+            }
+        } else if (message.m_type == InternalTask::Type::Rebalance){
+            on_rebalance(coordinator, message.m_payload);
+        } else if (message.m_type == InternalTask::Type::ClientExit){
+            on_client_exit(coordinator, message.m_payload);
+        } else {
+            on_wait2complete(coordinator, reinterpret_cast<std::promise<void>*>(message.m_payload));
+        }
+    } break;
+    case InternalTask::Type::RebalanceBatch: {
+        unique_ptr<vector<uint64_t>> batch { reinterpret_cast<vector<uint64_t>*>(message.m_payload) };
+        for(uint64_t gate_id : *batch){ handle_coordinator(coordinator, InternalTask{InternalTask::Type::Rebalance, gate_id}); }
+    } break;
+    case InternalTask::Type::TaskDone: {
+        assert(coordinator.m_state == Shard::State::GLOBAL && "Only in global mode the coordinator executes tasks");
+        on_task_done(coordinator, reinterpret_cast<RebalancingTask*>(message.m_payload));
+    } break;
+    case InternalTask::Type::ProcessTodo: {
+        if(coordinator.m_state == Shard::State::GLOBAL){ process_todo_list(coordinator); }
+    } break;
+    case InternalTask::Type::Escalate: {
+        if(coordinator.m_state == Shard::State::SHARDED){
+            COUT_DEBUG("Escalation requested by shard " << message.m_payload << ", freezing all shards...");
+            coordinator.m_state = Shard::State::FREEZING;
+            coordinator.m_num_handovers = 0;
+            for(auto shard : m_shards){
+                send(shard, InternalTask{InternalTask::Type::Freeze, 0});
+            }
+        } // else, the shards are already being frozen
+    } break;
+    case InternalTask::Type::Handover: {
+        assert(coordinator.m_state == Shard::State::FREEZING && "Unexpected handover");
+        unique_ptr<Handover> handover { reinterpret_cast<Handover*>(message.m_payload) };
+        for(auto task : handover->m_tasks){
+            task->m_blocked_on_lock = -1; // the tasks in execution in the shard are all completed
+            coordinator.m_todo.append(task);
+        }
+        for(auto producer : handover->m_wait2complete){
+            coordinator.m_wait2complete.push_back(producer);
+        }
+        coordinator.m_num_handovers++;
 
-                // 3) Install the new index & the group of locks
-                size_t num_locks_old = rebal_task->m_num_locks;
-                Gate* locks_old = m_instance->m_locks.get_unsafe();
-                /* Gate* lock_new = ... // already initialised */
-                assert(locks_old != locks_new);
-                common::StaticIndex* index_old = m_instance->m_index.get_unsafe();
-                common::StaticIndex* index_new = rebal_task->m_ptr_index;
-                assert(index_old != index_new);
-
-                m_instance->m_locks.timestamp() = m_instance->m_index.timestamp() = numeric_limits<uint64_t>::max();
-                barrier();
-                m_instance->m_locks.set(locks_new);
-                m_instance->m_index.set(index_new);
-                barrier();
-                m_instance->m_locks.timestamp() = m_instance->m_index.timestamp() = rdtscp();
-
-                // 4) Invalidate the old locks and unblock the threads
-                WakeList worker_list;
-                for(size_t i = 0; i < num_locks_old; i++){
-                    cleanup_lock(locks_old[i],  /* workspace */ worker_list);
-                }
+        if(coordinator.m_num_handovers == m_shards.size()){ // all shards have been frozen
+            COUT_DEBUG("All shards frozen, pending tasks: " << coordinator.m_todo.size());
+            coordinator.m_state = Shard::State::GLOBAL;
+            process_todo_list(coordinator);
 
-                // 5) Mark the old data structures for garbage collection
-                m_instance->GC()->mark(locks_old, [num_locks_old](Gate* ptr){ Gate::deallocate(ptr, num_locks_old); });
-                m_instance->GC()->mark(index_old);
-            } break;
-            default:
-                assert(0 && "Invalid task type");
-            }
+            // serve the requests received in the meanwhile
+            auto postponed = std::move(coordinator.m_postponed);
+            coordinator.m_postponed.clear();
+            for(auto& request : postponed){ handle_coordinator(coordinator, request); }
+        }
+    } break;
+    case InternalTask::Type::Stop: {
+        assert(!m_thread_pool.active() && "Wrong termination order: all client threads must have terminated before invoking this method!");
+        assert(coordinator.m_executing.size() == 0 && "There should be no jobs on execution");
+        return true;
+    } break; // done
+    default:
+        assert(0 && "Invalid task");
+    }
 
-            IF_PROFILING(auto task_done_t1 = chrono::steady_clock::now());
-            IF_PROFILING(rebal_task->m_statistics.m_master_release_time = chrono::duration_cast<chrono::microseconds>(task_done_t1 - task_done_t0).count());
-            IF_PROFILING(rebal_task->m_statistics.m_master_wallclock_time = chrono::duration_cast<chrono::microseconds>(task_done_t1 - rebal_task->m_statistics.m_time_init).count());
-            IF_PROFILING(m_stats_completed_tasks.push_back(rebal_task->m_statistics));
+    // return the control to the shards
+    if(!m_shards.empty() && coordinator.m_state == Shard::State::GLOBAL && !busy(coordinator)){
+        thaw();
+    }
+
+    return false;
+}
 
-            // release the memory for the task
-            delete rebal_task; rebal_task = nullptr;
+void RebalancingMaster::on_rebalance(Shard& shard, uint64_t gate_id){
+    assert(gate_id < m_instance->get_number_locks() && "Invalid gate ID");
+    if(!shard.m_resizing && !ignore_lock(shard, gate_id)){
+        RebalancingTask* task = rebal_init(gate_id);
+        if(task != nullptr){ // task == nullptr => ignore this request
+            rebal_resume(shard, task);
 
-            // are there still threads waiting for the rebalancer to become idle?
-            if(!busy()){
-                for(auto p : m_wait2complete){ p->set_value(); }
-                m_wait2complete.clear();
-            }
-        } break;
-        case InternalTask::Type::ClientExit: {
-            // a client thread has just released a gate/lock
-            uint64_t lock_id = task.m_payload;
-            COUT_DEBUG("ClientExit lock_id: " << lock_id);
-            RebalancingTask* task = get_todo_task_for(lock_id);
-            assert(task != nullptr && "Task associated to the given lock not found");
-            wait_to_complete_remove(task, lock_id);
-            if(task->ready_for_execution()){ process_todo_list(); }
-        } break;
-        case InternalTask::Type::Wait2Complete: {
-            auto producer = reinterpret_cast<std::promise<void>*>(task.m_payload);
-            if(!busy()){
-                assert(m_wait2complete.empty() && "If the rebalancer is not busy, there should no other promises in the list ");
-                producer->set_value();
-            } else {
-                m_wait2complete.push_back(producer);
+            // append the task in the list of tasks to execute
+            shard.m_todo.append(task);
+
+            // process the list of tasks
+            process_todo_list(shard);
+        }
+    } // otherwise this gate is already going to be rebalanced
+}
+
+void RebalancingMaster::on_task_done(Shard& shard, RebalancingTask* rebal_task){
+    // a task has been performed by a rebal worker
+    IF_PROFILING( auto task_done_t0 = chrono::steady_clock::now() );
+
+    // remove the task from the execution list
+    auto it = std::find_if(begin(shard.m_executing), end(shard.m_executing), [rebal_task](const RebalancingTask* task){ return rebal_task == task; });
+    assert(it != end(shard.m_executing) && "Task not found ?");
+    shard.m_executing.erase(it);
+
+
+    switch(rebal_task->m_plan.m_operation){
+    case RebalanceOperation::REBALANCE:
+    {
+        // 1) update the todo list with the rebalances that cannot proceed
+        for(size_t i = 0, sz = shard.m_todo.size(); i < sz; i++){
+            if(shard.m_todo[i] != nullptr && shard.m_todo[i]->m_blocked_on_lock == rebal_task->get_lock_start()){
+                shard.m_todo[i]->m_blocked_on_lock = -1;
             }
-        } break;
-        case InternalTask::Type::Stop: {
-            assert(!m_thread_pool.active() && "Wrong termination order: all client threads must have terminated before invoking this method!");
-            assert(m_executing.size() == 0 && "There should be no jobs on execution");
-            m_thread_pool.stop();
-            stop_loop = true;
-        } break; // done
-        default:
-            assert(0 && "Invalid task");
+        }
+        // 2) unlock the client threads associated to the gates rebalanced
+        WakeList worker_list;
+        auto now = chrono::steady_clock::now();
+        if(m_instance->m_delay_controller != nullptr){
+            m_instance->m_delay_controller->record_rebalance(chrono::duration_cast<chrono::microseconds>(now - rebal_task->m_time_launched));
+        }
+        for(size_t i = rebal_task->get_lock_start(), end = rebal_task->get_lock_end(); i < end; i++){
+            release_lock(i, /* workspace */ worker_list, /* time of the last rebalance */ now);
+        }
+        if(rebal_task->m_snapshot != nullptr){ // readers may still be accessing the snapshot
+            m_instance->GC()->mark(rebal_task->m_snapshot);
+            rebal_task->m_snapshot = nullptr;
+        }
+        // 3) go through the todo list
+        process_todo_list(shard);
+    } break;
+    case RebalanceOperation::RESIZE:
+    case RebalanceOperation::RESIZE_REBALANCE:
+    {
+        assert(is_global(shard) && "Only the coordinator can resize the array");
+        while(!shard.m_todo.empty() && shard.m_todo[0] == nullptr) shard.m_todo.pop(); // remove the nullptrs from the todo list
+        assert(shard.m_todo.empty() && "All gates should have been locked");
+
+        // Online resize, the readers may still be accessing the old storage
+        const bool is_online_resize = rebal_task->m_plan.m_operation == RebalanceOperation::RESIZE && m_instance->m_online_resize;
+        if(is_online_resize && !resize_online_close(rebal_task)){
+            shard.m_resize_drain = rebal_task; // resumed by #on_client_exit, once the last reader left the old gates
+            return;
         }
 
-    } while(!stop_loop);
+        resize_install(shard, rebal_task);
+    } break;
+    default:
+        assert(0 && "Invalid task type");
+    }
 
-    m_thread_pool.stop();
+    IF_PROFILING(auto task_done_t1 = chrono::steady_clock::now());
+    IF_PROFILING(rebal_task->m_statistics.m_master_release_time = chrono::duration_cast<chrono::microseconds>(task_done_t1 - task_done_t0).count());
+    IF_PROFILING(rebal_task->m_statistics.m_master_wallclock_time = chrono::duration_cast<chrono::microseconds>(task_done_t1 - rebal_task->m_statistics.m_time_init).count());
+
+    task_release(shard, rebal_task);
+}
+
+void RebalancingMaster::task_release(Shard& shard, RebalancingTask* task){
+    IF_PROFILING(shard.m_stats_completed_tasks.push_back(task->m_statistics));
+
+    // release the memory for the task
+    delete task; task = nullptr;
+
+    // are there still threads waiting for the rebalancer to become idle?
+    if(!busy(shard)){
+        for(auto p : shard.m_wait2complete){ p->set_value(); }
+        shard.m_wait2complete.clear();
+    }
+}
+
+void RebalancingMaster::resize_install(Shard& shard, RebalancingTask* rebal_task){
+    assert(is_global(shard) && "Only the coordinator can resize the array");
+    shard.m_resizing = false;
+
+    // 0) Online resize, all readers left the old storage
+    const bool is_online_resize = rebal_task->m_plan.m_operation == RebalanceOperation::RESIZE && m_instance->m_online_resize;
+    if(is_online_resize){
+        assert(rebal_task->m_wait_to_complete.empty() && "There are still readers operating on the old gates");
+        m_instance->m_resize_closing = false; // all old gates have been closed
+    }
+
+    // 1) Invalidate the old storage
+    if(rebal_task->m_plan.m_operation == RebalanceOperation::RESIZE){
+        COUT_DEBUG("[Storage OLD] keys: " << m_instance->m_storage.m_keys << ", values: " << m_instance->m_storage.m_values << ", cardinalities: " << m_instance->m_storage.m_segment_sizes
+                << ", rw keys: " << m_instance->m_storage.m_memory_keys << ", rw values:" << m_instance->m_storage.m_memory_values << ", rw cardinalities: " << m_instance->m_storage.m_memory_sizes);
+        COUT_DEBUG("[Storage NEW] keys: " << rebal_task->m_ptr_storage->m_keys << ", values: " << rebal_task->m_ptr_storage->m_values << ", cardinalities: " << rebal_task->m_ptr_storage->m_segment_sizes
+                << ", rw keys: " << rebal_task->m_ptr_storage->m_memory_keys << ", rw values:" << rebal_task->m_ptr_storage->m_memory_values << ", rw cardinalities: " << rebal_task->m_ptr_storage->m_memory_sizes);
+
+        m_instance->m_storage = std::move(*(rebal_task->m_ptr_storage));
+        delete rebal_task->m_ptr_storage; rebal_task->m_ptr_storage = nullptr;
+    }
+
+    rebal_task->m_ptr_index->train(m_thread_pool.size()); // all separator keys have been set, refresh the index (learned models)
+
+    // 2) Set the time when the storage was created
+    auto now = chrono::steady_clock::now();
+    Gate* locks_new = rebal_task->m_ptr_locks;
+    for(size_t i = 0, sz = rebal_task->get_lock_length(); i < sz; i++){
+        locks_new[i].m_cold->m_time_last_rebal = now;
+    }
 
-    COUT_DEBUG("Master node stopped");
+    // 3) Install the new index & the group of locks
+    size_t num_locks_old = rebal_task->m_num_locks;
+    Gate* locks_old = m_instance->m_locks.get_unsafe();
+    vector<uint64_t> gates_deferred_updates; // online resize, the new gates with the updates deferred by the writers
+    if(is_online_resize){
+        gates_deferred_updates = resize_online_reroute(locks_old, num_locks_old, rebal_task);
+    }
+    /* Gate* lock_new = ... // already initialised */
+    assert(locks_old != locks_new);
+    common::SegmentIndex* index_old = m_instance->m_index.get_unsafe();
+    common::SegmentIndex* index_new = rebal_task->m_ptr_index;
+    assert(index_old != index_new);
+
+    m_instance->m_locks.timestamp() = m_instance->m_index.timestamp() = numeric_limits<uint64_t>::max();
+    barrier();
+    m_instance->m_locks.set(locks_new);
+    m_instance->m_index.set(index_new);
+    barrier();
+    m_instance->m_locks.timestamp() = m_instance->m_index.timestamp() = rdtscp();
+    if(m_instance->m_read_cache != nullptr){ m_instance->m_read_cache->clear(); } // its entries refer to the old gates
+
+    // 4) Invalidate the old locks and unblock the threads
+    WakeList worker_list;
+    for(size_t i = 0; i < num_locks_old; i++){
+        cleanup_lock(locks_old[i],  /* workspace */ worker_list);
+    }
+
+    // 5) Remove the pending timers of the old locks & mark the old data structures for garbage collection
+    m_instance->m_timer_manager->discard(locks_old, num_locks_old);
+    m_instance->GC()->mark(locks_old, [num_locks_old](Gate* ptr){ Gate::deallocate(ptr, num_locks_old); });
+    m_instance->GC()->mark(index_old);
+
+    // 6) Load the updates deferred during an online resize
+    for(auto gate_id : gates_deferred_updates){
+        on_rebalance(shard, gate_id);
+    }
 }
 
-bool RebalancingMaster::ignore_lock(uint64_t lock_id) const {
-    if(get_todo_task_for(lock_id) != nullptr){
+void RebalancingMaster::on_client_exit(Shard& shard, uint64_t lock_id){
+    // a client thread has just released a gate/lock
+    COUT_DEBUG("ClientExit lock_id: " << lock_id);
+    if(shard.m_resize_drain != nullptr){ // the last reader left one of the old gates of an online resize
+        RebalancingTask* task = shard.m_resize_drain;
+        auto it_wtc = std::find_if(begin(task->m_wait_to_complete), end(task->m_wait_to_complete), [lock_id](const RebalancingTask::WaitToComplete wtc){
+           return wtc.m_lock_id == lock_id;
+        });
+        assert(it_wtc != end(task->m_wait_to_complete) && "The given lock was not registered");
+        task->m_wait_to_complete.erase(it_wtc);
+
+        if(task->m_wait_to_complete.empty()){
+            shard.m_resize_drain = nullptr;
+            resize_install(shard, task);
+            task_release(shard, task);
+        }
+        return;
+    }
+
+    RebalancingTask* task = get_todo_task_for(shard, lock_id);
+    assert(task != nullptr && "Task associated to the given lock not found");
+    wait_to_complete_remove(task, lock_id);
+    if(task->ready_for_execution()){ process_todo_list(shard); }
+}
+
+void RebalancingMaster::on_wait2complete(Shard& shard, std::promise<void>* producer){
+    if(!busy(shard)){
+        assert(shard.m_wait2complete.empty() && "If the rebalancer is not busy, there should no other promises in the list ");
+        producer->set_value();
+    } else {
+        shard.m_wait2complete.push_back(producer);
+    }
+}
+
+bool RebalancingMaster::ignore_lock(const Shard& shard, uint64_t lock_id) const {
+    if(get_todo_task_for(shard, lock_id) != nullptr){
         return true;
     }
 
-    for(size_t i = 0, sz = m_executing.size(); i < sz; i++){
-        if(m_executing[i]->is_superset_of(lock_id, 1))
+    for(size_t i = 0, sz = shard.m_executing.size(); i < sz; i++){
+        if(shard.m_executing[i]->is_superset_of(lock_id, 1))
             return true;
     }
 
     return false;
 }
 
-const RebalancingTask* RebalancingMaster::find_child_on_execution(uint64_t lock_start, uint64_t lock_length) const {
-    for(size_t i = 0, sz = m_executing.size(); i < sz; i++){
-        if(m_executing[i]->overlaps(lock_start, lock_length))
-            return m_executing[i];
+const RebalancingTask* RebalancingMaster::find_child_on_execution(const Shard& shard, uint64_t lock_start, uint64_t lock_length) const {
+    for(size_t i = 0, sz = shard.m_executing.size(); i < sz; i++){
+        if(shard.m_executing[i]->overlaps(lock_start, lock_length))
+            return shard.m_executing[i];
     }
 
     return nullptr;
 }
 
-RebalancingTask* RebalancingMaster::get_todo_task_for(size_t lock_id) const {
-    for(size_t i = 0, sz = m_todo.size(); i < sz; i++){
-        if(m_todo[i] != nullptr && m_todo[i]->is_superset_of(lock_id, 1))
-            return m_todo[i];
+RebalancingTask* RebalancingMaster::get_todo_task_for(const Shard& shard, size_t lock_id) const {
+    for(size_t i = 0, sz = shard.m_todo.size(); i < sz; i++){
+        if(shard.m_todo[i] != nullptr && shard.m_todo[i]->is_superset_of(lock_id, 1))
+            return shard.m_todo[i];
     }
 
     return nullptr;
@@ -371,7 +725,7 @@ void RebalancingMaster::wait_to_complete_remove(RebalancingTask* task, uint64_t
     int64_t cardinality_old = it_wtc->m_cardinality;
     // no need to lock the gate, it should be already in the REBAL state
     assert(gate.m_state == Gate::State::REBAL);
-    int64_t cardinality_new = gate.m_cardinality;
+    int64_t cardinality_new = gate.m_cold->m_cardinality;
     COUT_DEBUG("gate: " << gate.lock_id() << ", cardinality_old: " << cardinality_old << ", cardinality_new: " << cardinality_new << ", difference: " << (cardinality_new - cardinality_old) << ", task cardinality (before): " << task->m_plan.m_cardinality_before);
     task->m_plan.m_cardinality_before += (cardinality_new - cardinality_old);
     task->m_plan.m_cardinality_change += bulk_loading_init(task, &gate);
@@ -406,14 +760,19 @@ RebalancingTask* RebalancingMaster::rebal_init(uint64_t lock_id){
 }
 
 
-void RebalancingMaster::rebal_resume(RebalancingTask* task){
-    COUT_DEBUG("task: " << task << ", # pma locks: " << m_instance->get_number_locks());
+void RebalancingMaster::rebal_resume(Shard& shard, RebalancingTask* task){
+    COUT_DEBUG("task: " << task << ", # pma locks: " << m_instance->get_number_locks() << ", shard: " << shard.m_shard_id);
     assert(task != nullptr);
     IF_PROFILING( RebalancingTimer timer { task->m_statistics.m_master_search_time } );
     IF_PROFILING( task->m_statistics.m_master_num_resumes++ );
+    task->m_escalate = false;
 
     const int64_t segments_per_lock = m_instance->get_segments_per_lock();
-    const int64_t num_locks = m_instance->get_number_locks();
+    // the window cannot grow beyond the gates handled by this shard
+    const auto gate_range = get_gate_range(shard);
+    const int64_t scope_start = gate_range.first;
+    const int64_t scope_end = gate_range.second;
+    const int64_t num_locks = scope_end - scope_start;
     const int64_t capacity_per_lock = segments_per_lock * m_instance->m_storage.m_segment_capacity;
     const int64_t window_id = task->m_window_id;
     int64_t lock_start = task->get_lock_start();
@@ -431,20 +790,22 @@ void RebalancingMaster::rebal_resume(RebalancingTask* task){
 
     // siblings
     std::vector<RebalancingTask*> siblings;
-    siblings.reserve(m_todo.size());
-    lock_length = next_window_length(lock_length);
+    siblings.reserve(shard.m_todo.size());
+    lock_length = next_window_length(shard, lock_length);
 
     while(/*can_process &&*/ !do_rebalance && lock_length <= num_locks){
         height = log2(lock_length) +1.;
 
         int64_t lock_start_new = (window_id / static_cast<int64_t>(pow(2, (height -1)))) * lock_length;
-        if(lock_start_new + lock_length >= num_locks){
-            lock_start_new = num_locks - lock_length;
+        if(lock_start_new + lock_length >= scope_end){
+            lock_start_new = scope_end - lock_length;
         } else if (lock_start_new > lock_start){ // when merging with other tasks, the window in the calibrator tree might be unaligned
             lock_start_new = lock_start;
         } else if (lock_start_new + lock_length < task->get_lock_end()){ // as above, due to merging, windows might get unaligned
             lock_start_new = task->get_lock_end() - lock_length;
         }
+        // the last shard can be longer than the others, keep the window inside the gates of the shard
+        lock_start_new = std::clamp<int64_t>(lock_start_new, std::max<int64_t>(scope_start, task->get_lock_end() - lock_length), std::min<int64_t>(lock_start, scope_end - lock_length));
 
         COUT_DEBUG("(begin iteration) height: " << height << ", previous start position: " << lock_start << ", new start position: " << lock_start_new << ", window: [" << lock_start_new << ", " << lock_start_new + lock_length << ")");
         assert(lock_start_new <= lock_start);
@@ -453,7 +814,7 @@ void RebalancingMaster::rebal_resume(RebalancingTask* task){
         int64_t lock_end = lock_start + lock_length;
 
         // can we execute this window?
-        const RebalancingTask* execution_task = find_child_on_execution(lock_start, lock_length);
+        const RebalancingTask* execution_task = find_child_on_execution(shard, lock_start, lock_length);
         if(execution_task != nullptr){
             // we cannot process this window now because a rebalance is currently on execution with a child of this window
             task->m_blocked_on_lock = execution_task->get_lock_start();
@@ -463,20 +824,21 @@ void RebalancingMaster::rebal_resume(RebalancingTask* task){
         }
 
         // corner case: can we merge tasks ?
-        for(size_t i = 0, sz = m_todo.size(); i < sz; i++){
-            if(m_todo[i] != nullptr && m_todo[i]->overlaps(lock_start, lock_length)){
-                siblings.push_back(m_todo[i]);
+        for(size_t i = 0, sz = shard.m_todo.size(); i < sz; i++){
+            if(shard.m_todo[i] != nullptr && shard.m_todo[i]->overlaps(lock_start, lock_length)){
+                siblings.push_back(shard.m_todo[i]);
                 // adjust the current window
-                COUT_DEBUG("merge with task: " << m_todo[i]);
-                if(m_todo[i]->get_lock_start() < lock_start){
-                    lock_length += (lock_start - m_todo[i]->get_lock_start());
-                    lock_start = m_todo[i]->get_lock_start();
+                COUT_DEBUG("merge with task: " << shard.m_todo[i]);
+                if(shard.m_todo[i]->get_lock_start() < lock_start){
+                    lock_length += (lock_start - shard.m_todo[i]->get_lock_start());
+                    lock_start = shard.m_todo[i]->get_lock_start();
                 }
-                if(m_todo[i]->get_lock_end() > lock_start + lock_length){
-                    lock_length = m_todo[i]->get_lock_end() - lock_start;
+                if(shard.m_todo[i]->get_lock_end() > lock_start + lock_length){
+                    lock_length = shard.m_todo[i]->get_lock_end() - lock_start;
                 }
+                task->m_time_created = std::min(task->m_time_created, shard.m_todo[i]->m_time_created); // inherit the age
 
-                m_todo[i] = nullptr;
+                shard.m_todo[i] = nullptr;
             }
         }
         lock_end = lock_start + lock_length; // update the end of the interval
@@ -500,6 +862,7 @@ void RebalancingMaster::rebal_resume(RebalancingTask* task){
                 cardinality_before += last_sibling->m_plan.get_cardinality_before();
                 cardinality_after += last_sibling->m_plan.get_cardinality_after();
                 for(auto queue: last_sibling->m_blkld_elts){ task->m_blkld_elts.push_back(queue); }
+                task->m_snapshot_pending.insert(end(task->m_snapshot_pending), begin(last_sibling->m_snapshot_pending), end(last_sibling->m_snapshot_pending));
                 index = last_sibling->get_lock_start() -1;
                 delete last_sibling; last_sibling = nullptr;
                 if(!siblings.empty()) { last_sibling = siblings.back(); siblings.pop_back(); }
@@ -522,6 +885,7 @@ void RebalancingMaster::rebal_resume(RebalancingTask* task){
                 cardinality_before += last_sibling->m_plan.get_cardinality_before();
                 cardinality_after += last_sibling->m_plan.get_cardinality_after();
                 for(auto queue: last_sibling->m_blkld_elts){ task->m_blkld_elts.push_back(queue); }
+                task->m_snapshot_pending.insert(end(task->m_snapshot_pending), begin(last_sibling->m_snapshot_pending), end(last_sibling->m_snapshot_pending));
                 index = last_sibling->get_lock_start() -1;
                 delete last_sibling; last_sibling = nullptr;
                 if(!siblings.empty()) { last_sibling = siblings.back(); siblings.pop_back(); }
@@ -557,13 +921,18 @@ void RebalancingMaster::rebal_resume(RebalancingTask* task){
             do_rebalance = true;
         } else {
             if(lock_length == num_locks) break;
-            lock_length = next_window_length(lock_length);
+            lock_length = next_window_length(shard, lock_length);
             assert(lock_length <= num_locks);
         }
     } // while loop
 
     if(can_process){
-        if(!do_rebalance){
+        if(!do_rebalance && !is_global(shard)){
+            // the window would exceed the gates of this shard, let the coordinator resume the task
+            COUT_DEBUG("escalate, task: " << task);
+            task->m_escalate = true;
+            escalate(shard);
+        } else if(!do_rebalance){
             assert(height >= m_instance->m_storage.height());
             task->m_plan.m_operation = RebalanceOperation::RESIZE; // it might actually become RESIZE_REBALANCE
         } else {
@@ -575,13 +944,16 @@ void RebalancingMaster::rebal_resume(RebalancingTask* task){
 }
 
 
-void RebalancingMaster::launch_task(RebalancingWorker* worker, RebalancingTask* task){
+void RebalancingMaster::launch_task(Shard& shard, RebalancingWorker* worker, RebalancingTask* task){
     assert(worker != nullptr && "Null pointer");
     debug_validate_launch_task_cardinality(task);
     IF_PROFILING( RebalancingTimer timer { task->m_statistics.m_master_launch_time } );
 
     // at this point, the task can either be RESIZE or REBALANCE (but not RESIZE_REBALANCE)
-    if(task->m_plan.m_operation == RebalanceOperation::RESIZE) m_resizing = true;
+    if(task->m_plan.m_operation == RebalanceOperation::RESIZE){
+        assert(is_global(shard) && "Only the coordinator can resize the array");
+        shard.m_resizing = true;
+    }
 
     COUT_DEBUG("density: " << static_cast<double>(task->m_plan.get_cardinality_after()) / task->m_ptr_storage->capacity() << ", threshold: " << m_instance->get_thresholds().densities().theta_h);
 
@@ -591,15 +963,17 @@ void RebalancingMaster::launch_task(RebalancingWorker* worker, RebalancingTask*
 
     auto operation = task->m_plan.m_operation;
     if(operation == RebalanceOperation::RESIZE || operation == RebalanceOperation::RESIZE_REBALANCE){
-        assert(m_executing.empty() && "There should be no other tasks in execution while resizing");
+        assert(shard.m_executing.empty() && "There should be no other tasks in execution while resizing");
 
         // update the index & the number of gates
-        task->m_ptr_index = new common::StaticIndex(m_instance->m_index.get_unsafe()->node_size(), task->get_lock_length());
+        task->m_ptr_index = m_instance->m_index.get_unsafe()->create(task->get_lock_length());
         task->m_ptr_locks = Gate::allocate(task->get_lock_length(), m_instance->get_segments_per_lock());
 
         // update the storage
         if(operation == RebalanceOperation::RESIZE){
             task->m_ptr_storage = new Storage(m_instance->m_storage.m_segment_capacity, m_instance->m_storage.m_pages_per_extent, task->get_window_length());
+            if(m_instance->m_storage.tombstones_enabled()){ task->m_ptr_storage->enable_tombstones(); }
+            if(m_instance->m_storage.filters_enabled()){ task->m_ptr_storage->enable_filters(m_instance->m_storage.m_filter_bits_per_key); }
         } else { // RebalanceOperation::RESIZE_REBALANCE
             assert(task->m_plan.m_window_length >= m_instance->m_storage.m_number_segments);
             task->m_ptr_storage->extend(task->m_plan.m_window_length - m_instance->m_storage.m_number_segments);
@@ -634,31 +1008,43 @@ void RebalancingMaster::launch_task(RebalancingWorker* worker, RebalancingTask*
 
     IF_PROFILING(task->m_statistics.m_window_length = task->m_plan.m_window_length);
 
-    m_executing.push_back(task);
+    task->m_shard_id = shard.m_shard_id;
+    task->m_time_launched = chrono::steady_clock::now();
+    IF_PROFILING(task->m_statistics.m_master_queue_time = chrono::duration_cast<chrono::microseconds>(task->m_time_launched - task->m_time_created).count());
+    shard.m_executing.push_back(task);
     worker->execute(task);
 }
 
 
-void RebalancingMaster::process_todo_list(){
+void RebalancingMaster::process_todo_list(Shard& shard){
     bool workers_available = true;
 
+    // frozen shards cannot launch new tasks
+    auto can_launch = [&shard](){ return shard.m_state == Shard::State::ACTIVE || shard.m_state == Shard::State::GLOBAL; };
+
+    // process the tasks by priority, rather than in FIFO order
+    schedule_todo_list(shard);
+
     // go through the whole list of tasks to be processed
-    for(size_t i = 0, sz = m_todo.size(); i < sz; i++){
+    for(size_t i = 0, sz = shard.m_todo.size(); i < sz; i++){
         bool task_in_execution = false;
 
-        RebalancingTask* task = m_todo[0];
-        m_todo.pop();
+        RebalancingTask* task = shard.m_todo[0];
+        shard.m_todo.pop();
         if(task == nullptr) continue; // ignore
 
-        if(workers_available && task->m_blocked_on_lock == -1){
-            if(!task->is_rebalancing_window_computed()){ rebal_resume(task); }
+        if(workers_available && task->m_blocked_on_lock == -1 && can_launch()){
+            if(task->m_escalate || !task->is_rebalancing_window_computed()){ rebal_resume(shard, task); }
 
-            if(task->ready_for_execution()){
+            if(task->ready_for_execution() && !task->m_escalate && can_launch() && !TaskScheduler::is_rate_limited(task, shard.m_executing)){
+                // set the flag before acquiring a worker, to avoid missing the notification of a worker released in the meanwhile
+                shard.m_starved = true;
                 RebalancingWorker* worker = m_thread_pool.acquire();
                 if(worker == nullptr){ // there are no threads available at the moment to execute this task
                     workers_available = false;
                 } else {
-                    launch_task(worker, task);
+                    shard.m_starved = false;
+                    launch_task(shard, worker, task);
                     task_in_execution = true;
                 }
             }
@@ -666,11 +1052,27 @@ void RebalancingMaster::process_todo_list(){
 
         // add the task back at the end of the queue
         if(!task_in_execution){
-            m_todo.append(task);
+            shard.m_todo.append(task);
         }
     }
 }
 
+void RebalancingMaster::schedule_todo_list(Shard& shard){
+    if(shard.m_todo.size() <= 1) return; // nothing to sort
+
+    vector<RebalancingTask*> tasks;
+    tasks.reserve(shard.m_todo.size());
+    while(!shard.m_todo.empty()){
+        RebalancingTask* task = shard.m_todo[0];
+        shard.m_todo.pop();
+        if(task == nullptr) continue; // merged with another task
+        tasks.push_back(task);
+    }
+
+    TaskScheduler::sort(tasks, m_instance->m_locks.get_unsafe(), m_instance->get_number_locks());
+    for(auto task : tasks){ shard.m_todo.append(task); }
+}
+
 std::pair<uint64_t, uint64_t> RebalancingMaster::acquire_lock(RebalancingTask* task, uint64_t lock_id){
     assert(task != nullptr && "Null pointer");
     assert(lock_id < m_instance->get_number_locks() && "Invalid gate/lock ID");
@@ -683,13 +1085,14 @@ std::pair<uint64_t, uint64_t> RebalancingMaster::acquire_lock(RebalancingTask* t
     // update the state of this gate
     auto previous_state = gate->m_state;
     gate->m_state = Gate::State::REBAL;
+    gate->bump_version();
 
     // mark this task on wait
     switch(previous_state){
     case Gate::State::READ: // read the cardinality again because readers can indeed perform pending deletions
     case Gate::State::WRITE:
     case Gate::State::TIMEOUT: // the last reader or writer will now invoke #exit(gate_id) because gate->m_state == REBAL
-        task->m_wait_to_complete.push_back({ lock_id, gate->m_cardinality });
+        task->m_wait_to_complete.push_back({ lock_id, gate->m_cold->m_cardinality });
         break;
     default:
         assert(gate->m_num_active_threads == 0 && "There are still workers operating on this gate");
@@ -699,7 +1102,7 @@ std::pair<uint64_t, uint64_t> RebalancingMaster::acquire_lock(RebalancingTask* t
     }
 
     // read the cardinality of the gate
-    uint64_t cardinality = gate->m_cardinality;
+    uint64_t cardinality = gate->m_cold->m_cardinality;
 
 //    COUT_DEBUG("lock_id: " << lock_id << ", cardinality: " << cardinality);
 
@@ -717,10 +1120,12 @@ void RebalancingMaster::release_lock(uint64_t lock_id, WakeList& worker_list, ch
     gate->lock();
     assert(gate->m_state == Gate::State::REBAL && "This gate was supposed to be acquired previously");
     assert(gate->m_num_active_threads == 0 && "This gate should be closed for rebalancing");
-    assert(gate->m_async_queue == nullptr && "We should have already cleared the asynchronous queue");
+    assert(gate->m_cold->m_async_queue == nullptr && "We should have already cleared the asynchronous queue");
 
     gate->m_state = Gate::State::FREE;
-    gate->m_time_last_rebal = time_last_rebal;
+    gate->m_cold->m_time_last_rebal = time_last_rebal;
+    gate->m_cold->m_num_updates = 0;
+    gate->m_cold->m_snapshot = nullptr; // the readers go back to the storage
 
     // Use #wake_all rather than #wake_next! Potentially the fence keys have been changed, to threads
     // upon wake up might move to other gates. If other threads are in the wait list, they
@@ -735,7 +1140,7 @@ void RebalancingMaster::release_lock(uint64_t lock_id, WakeList& worker_list, ch
 
 void RebalancingMaster::cleanup_lock(Gate& gate, WakeList& worker_list){
     gate.lock();
-    assert(gate.m_async_queue == nullptr && "We should have reset this field already in #bulk_loading_init");
+    assert(gate.m_cold->m_async_queue == nullptr && "We should have reset this field already in #bulk_loading_init");
 
     gate.m_fence_low_key = gate.m_fence_high_key = numeric_limits<int64_t>::min();
     gate.wake_all(/* out */ worker_list);
@@ -745,14 +1150,79 @@ void RebalancingMaster::cleanup_lock(Gate& gate, WakeList& worker_list){
     worker_list();
 }
 
-int64_t RebalancingMaster::next_window_length(int64_t current_window_length) const {
+bool RebalancingMaster::resize_online_close(RebalancingTask* task){
+    assert(m_instance->m_online_resize && "Online resizes are not enabled");
+    assert(task->m_wait_to_complete.empty() && "The resize should have already acquired all gates");
+    Gate* gates = m_instance->m_locks.get_unsafe();
+    m_instance->m_resize_closing = true; // the old gates stop admitting new clients
+
+    for(uint64_t i = 0, num_gates = task->m_num_locks; i < num_gates; i++){
+        Gate& gate = gates[i];
+        gate.lock();
+        assert(gate.m_state == Gate::State::RESIZE && "The gate should have been opened by the worker");
+        gate.m_state = Gate::State::REBAL; // as in an ordinary resize, the last reader will invoke #exit(gate_id)
+        if(gate.m_num_active_threads > 0){
+            task->m_wait_to_complete.push_back({ i, gate.m_cold->m_cardinality });
+        }
+        gate.unlock();
+    }
+
+    return task->m_wait_to_complete.empty();
+}
+
+vector<uint64_t> RebalancingMaster::resize_online_reroute(Gate* gates_old, uint64_t num_gates_old, RebalancingTask* task){
+    Gate* gates_new = task->m_ptr_locks;
+    common::SegmentIndex* index_new = task->m_ptr_index;
+    const uint64_t num_gates_new = task->get_lock_length();
+    vector<ClientContextQueue*> queues(num_gates_new, nullptr);
+    auto queue = [&](int64_t key){
+        uint64_t gate_id = index_new->find(key);
+        assert(gate_id < num_gates_new && "Invalid gate ID");
+        if(queues[gate_id] == nullptr){ queues[gate_id] = new ClientContextQueue(); }
+        return queues[gate_id];
+    };
+
+    for(uint64_t i = 0; i < num_gates_old; i++){
+        Gate& gate = gates_old[i];
+        gate.lock();
+        ClientContextQueue* deferred = gate.m_cold->m_async_queue;
+        gate.m_cold->m_async_queue = nullptr;
+        gate.unlock();
+        if(deferred == nullptr) continue;
+
+        // the fence keys of the new gates differ from the old ones
+        for(auto& insertion : deferred->insertions()){
+            queue(insertion.first)->enqueue_insertion(insertion.first, insertion.second);
+        }
+        for(auto key : deferred->deletions()){
+            queue(key)->enqueue_deletion(key);
+        }
+        delete deferred; deferred = nullptr;
+    }
+
+    // the new gates are not published yet, there is no need to acquire their locks
+    vector<uint64_t> result;
+    for(uint64_t gate_id = 0; gate_id < num_gates_new; gate_id++){
+        if(queues[gate_id] == nullptr) continue;
+        gates_new[gate_id].m_cold->m_async_queue = queues[gate_id];
+        gates_new[gate_id].m_state = Gate::State::REBAL; // it will be picked by #rebal_init
+        result.push_back(gate_id);
+    }
+
+    COUT_DEBUG("gates with deferred updates: " << result.size() << "/" << num_gates_new);
+    return result;
+}
+
+int64_t RebalancingMaster::next_window_length(const Shard& shard, int64_t current_window_length) const {
     int64_t next_length = hyperceil(current_window_length);
     if(next_length == current_window_length){
         next_length *= 2;
     }
 
-    if(next_length > m_instance->get_number_locks())
-        next_length = m_instance->get_number_locks();
+    auto gate_range = get_gate_range(shard);
+    const int64_t num_locks = gate_range.second - gate_range.first;
+    if(next_length > num_locks)
+        next_length = num_locks;
 
     return next_length;
 
@@ -763,10 +1233,12 @@ uint64_t RebalancingMaster::bulk_loading_init(RebalancingTask* task, Gate* gate)
     assert(gate->m_num_active_threads == 0 && "There should be no client threads active on this gate");
     assert(gate->m_state == Gate::State::REBAL && "The state of the gate should have been switched to REBAL");
 
-    // is there an asynchronous queue associated to this gate?
-    ClientContextQueue* async_queue = gate->m_async_queue;
-    if(async_queue == nullptr) return 0;
-    gate->m_async_queue = nullptr; // reset the value of the async queue
+    // is there an asynchronous queue or a delta buffer associated to this gate?
+    ClientContextQueue* async_queue = gate->m_cold->m_async_queue;
+    DeltaBuffer* delta = gate->m_delta_buffer;
+    if(async_queue == nullptr && (delta == nullptr || delta->empty())) return 0;
+    if(async_queue == nullptr) async_queue = new ClientContextQueue();
+    gate->m_cold->m_async_queue = nullptr; // reset the value of the async queue
 
     // Perform the remaining deletions
     auto& deletions = async_queue->deletions();
@@ -775,21 +1247,37 @@ uint64_t RebalancingMaster::bulk_loading_init(RebalancingTask* task, Gate* gate)
         int64_t num_deletions = 0;
         for(auto& key : deletions){
             int64_t value = -1;
+            if(m_instance->delta_remove(gate, key, &value)) continue; // the key was still pending in the delta buffer
             // ignore the return value, we are already rebalancing
             m_instance->do_remove(gate, key, /* output */ &value);
             num_deletions += (value != -1);
         }
         deletions.clear();
 
-        assert(static_cast<int64_t>(gate->m_cardinality) - num_deletions >= 0 && "Negative cardinality");
+        assert(static_cast<int64_t>(gate->m_cold->m_cardinality) - num_deletions >= 0 && "Negative cardinality");
         if(num_deletions > 0){
 //            COUT_DEBUG("lock: " << gate->lock_id() << ", deletions: " << num_deletions);
-            gate->m_cardinality -= num_deletions;
+            gate->m_cold->m_cardinality -= num_deletions;
             task->m_plan.m_cardinality_before -= num_deletions;
             // m_instance->m_cardinality -= num_deletions; // BUG: do_remove already updates the global cardinality of the pma
         }
     }
 
+    // bulk load the pending insertions of the delta buffer together with those of the queue
+    if(delta != nullptr && !delta->empty()){
+        auto& insertions = async_queue->insertions();
+        for(uint64_t i = 0, sz = delta->size(); i < sz; i++){
+            insertions.emplace_back(delta->keys()[i], delta->values()[i]);
+        }
+        if(m_instance->m_rebalance_snapshots){ // the readers can already observe these elements
+            for(uint64_t i = 0, sz = delta->size(); i < sz; i++){
+                task->m_snapshot_pending.emplace_back(delta->keys()[i], delta->values()[i]);
+            }
+        }
+        m_instance->m_delta_cardinality -= delta->size();
+        delta->clear();
+    }
+
     auto num_insertions = async_queue->insertions().size();
     if(num_insertions == 0){ // done
         delete async_queue; async_queue = nullptr;
@@ -800,8 +1288,8 @@ uint64_t RebalancingMaster::bulk_loading_init(RebalancingTask* task, Gate* gate)
     return num_insertions;
 }
 
-bool RebalancingMaster::busy() const {
-    return !m_todo.empty() || !m_executing.empty();
+bool RebalancingMaster::busy(const Shard& shard) const {
+    return !shard.m_todo.empty() || !shard.m_executing.empty() || shard.m_resize_drain != nullptr;
 }
 
 void RebalancingMaster::debug_validate_launch_task_cardinality(RebalancingTask* task) const{
@@ -818,14 +1306,14 @@ void RebalancingMaster::debug_validate_launch_task_cardinality(RebalancingTask*
     int64_t cardinality_locks = 0;
     for(int64_t lock_id = task->get_lock_start(); lock_id < task->get_lock_end(); lock_id++){
         assert(task->m_ptr_locks[lock_id].m_num_active_threads == 0 && "This gate should be fully closed");
-        cardinality_locks += task->m_ptr_locks[lock_id].m_cardinality;
+        cardinality_locks += task->m_ptr_locks[lock_id].m_cold->m_cardinality;
     }
 
     // segments cardinality
     int64_t cardinality_segments = 0;
     const int64_t segment_max_capacity = m_instance->m_storage.m_segment_capacity;
     for(int64_t segment_id = task->get_window_start(); segment_id < task->get_window_end(); segment_id++){
-        int64_t cardinality_segment = m_instance->m_storage.m_segment_sizes[segment_id];
+        int64_t cardinality_segment = m_instance->m_storage.m_segment_sizes[segment_id] - m_instance->m_storage.count_tombstones(segment_id);
         assert(cardinality_segment <= segment_max_capacity && "The segment cardinality is greater than its maximum capacity");
         cardinality_segments += cardinality_segment;
     }
@@ -833,7 +1321,7 @@ void RebalancingMaster::debug_validate_launch_task_cardinality(RebalancingTask*
     if(cardinality_locks != cardinality_segments || cardinality_locks != task->m_plan.get_cardinality_before()){
 #if defined(DEBUG)
         for(size_t i = task->get_lock_start(); i < task->get_lock_end(); i++){
-            COUT_DEBUG("cardinality gate[" << i << "]: " << task->m_ptr_locks[i].m_cardinality);
+            COUT_DEBUG("cardinality gate[" << i << "]: " << task->m_ptr_locks[i].m_cold->m_cardinality);
         }
 #endif
 
@@ -875,6 +1363,8 @@ string RebalancingMaster::InternalTask::to_string() const {
         stream << "invalid"; break;
     case Type::Rebalance:
         stream << "rebalance gate: " << m_payload; break;
+    case Type::RebalanceBatch:
+        stream << "rebalance gates: " << reinterpret_cast<vector<uint64_t>*>(m_payload)->size(); break;
     case Type::TaskDone: {
         stream << "task completed: " << reinterpret_cast<RebalancingTask*>(m_payload); break;
     } break;
@@ -884,6 +1374,16 @@ string RebalancingMaster::InternalTask::to_string() const {
         stream << "terminate"; break;
     case Type::Wait2Complete:
         stream << "wait2complete"; break;
+    case Type::ProcessTodo:
+        stream << "process todo list"; break;
+    case Type::Escalate:
+        stream << "escalate shard: " << m_payload; break;
+    case Type::Freeze:
+        stream << "freeze"; break;
+    case Type::Handover:
+        stream << "handover: " << reinterpret_cast<void*>(m_payload); break;
+    case Type::Thaw:
+        stream << "thaw"; break;
     default:
         stream << "???";
     }
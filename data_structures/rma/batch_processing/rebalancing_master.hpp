@@ -17,14 +17,14 @@
 
 #pragma once
 
-#include <condition_variable>
+#include <atomic>
 #include <future>
-#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include "common/circular_array.hpp"
+#include "common/mpsc_queue.hpp"
 #include "rebalancing_pool.hpp"
 #include "rebalancing_statistics.hpp"
 
@@ -40,30 +40,80 @@ class RebalancingMaster {
 private:
     PackedMemoryArray* m_instance; // the pma instance
 
-    ::common::CircularArray<RebalancingTask*> m_todo; // tasks postponed for execution
-    std::vector<const RebalancingTask*> m_executing; // tasks currently in execution
-
     // Internal tasks
     struct InternalTask {
-        enum class Type { Invalid, Rebalance, TaskDone, ClientExit, Stop, Wait2Complete };
+        enum class Type { Invalid, Rebalance, RebalanceBatch, TaskDone, ClientExit, Stop, Wait2Complete, ProcessTodo, Escalate, Freeze, Handover, Thaw };
         Type m_type;
         uint64_t m_payload;
         std::string to_string() const; // for debug purposes only
     };
-    // Concurrent queue
-    mutable std::mutex m_mutex;
-    ::common::CircularArray<InternalTask> m_queue;
-    std::condition_variable m_condvar;
-    std::thread m_handle; // Handle to the controller thread
-    bool m_resizing = false; // Whether the whole PMA is currently being resized
+
+    /**
+     * A coordinator, that is a thread with its own message queue responsible to schedule the rebalances for a contiguous
+     * range of gates. With a single shard, the coordinator handles all gates, as the classic master. With multiple shards,
+     * each shard handles the range [m_shard_id * gates_per_shard, (m_shard_id +1) * gates_per_shard), while an additional
+     * coordinator takes over all pending tasks, when a window outgrows the range of its shard or the array needs to be resized.
+     */
+    struct Shard {
+        enum class State {
+            ACTIVE, // [shard] schedule the rebalances in the range of gates of this shard
+            FROZEN, // [shard] waiting for the tasks in execution to terminate, before handing over the pending tasks to the coordinator
+            HANDED_OVER, // [shard] all pending tasks have been moved to the coordinator, forward any request to it
+            SHARDED, // [coordinator] idle, the rebalances are scheduled by the shards
+            FREEZING, // [coordinator] waiting for all shards to hand over their pending tasks
+            GLOBAL, // [coordinator] schedule the rebalances for the whole array
+        };
+
+        const int m_shard_id; // -1 for the coordinator
+        State m_state;
+        ::common::CircularArray<RebalancingTask*> m_todo; // tasks postponed for execution
+        std::vector<const RebalancingTask*> m_executing; // tasks currently in execution
+        bool m_resizing = false; // Whether the whole PMA is currently being resized
+        RebalancingTask* m_resize_drain = nullptr; // [coordinator] online resize completed, waiting for the readers to leave the old gates
+        std::vector<std::promise<void>*> m_wait2complete; // array of cond. vars to be notified when the master does not have jobs pending
+        std::vector<InternalTask> m_postponed; // [coordinator] requests received while waiting for the shards to hand over their tasks
+        uint64_t m_num_handovers = 0; // [coordinator] number of shards that already handed over their tasks
+        std::atomic<bool> m_starved = false; // whether a task could not be launched because no workers were available
+        IF_PROFILING( std::vector<RebalancingStatistics> m_stats_completed_tasks );
+
+        // Concurrent queue
+        ::common::MPSCQueue<InternalTask> m_queue; // messages for this shard, consumed in batches by the controller thread
+        std::thread m_handle; // Handle to the controller thread
+
+        Shard(int shard_id, State state);
+    };
+
+    // The list of pending tasks & promises handed over by a shard to the coordinator
+    struct Handover {
+        int m_shard_id;
+        std::vector<RebalancingTask*> m_tasks;
+        std::vector<std::promise<void>*> m_wait2complete;
+    };
+
+    std::vector<Shard*> m_shards; // the coordinators for each range of gates
+    Shard* m_coordinator; // the coordinator in charge of the whole array
+    std::atomic<uint64_t> m_gates_per_shard; // the number of gates handled by each shard
     RebalancingPool m_thread_pool; // Thread pool
-    IF_PROFILING( std::vector<RebalancingStatistics> m_stats_completed_tasks );
-    std::vector<std::promise<void>*> m_wait2complete; // array of cond. vars to be notified when the master does not have jobs pending
+
+    // Append a message in the queue of the given shard
+    void send(Shard* shard, InternalTask message);
+
+    // Retrieve the shard in charge of the given gate
+    Shard* get_shard_for(uint64_t gate_id) const;
+
+    // Retrieve the interval [start, end) of the gates handled by the given shard
+    std::pair<int64_t, int64_t> get_gate_range(const Shard& shard) const;
+
+    // Whether the given shard is in charge of the whole array
+    bool is_global(const Shard& shard) const;
+
+    // Recompute the number of gates handled by each shard, after a resize
+    void update_gates_per_shard();
 
     // Check if a rebalancing window is already on execution or in the to-do list for the given gate id
-    bool ignore_lock(uint64_t lock_id) const;
+    bool ignore_lock(const Shard& shard, uint64_t lock_id) const;
 
-    const RebalancingTask* find_child_on_execution(uint64_t lock_start, uint64_t lock_length) const;
+    const RebalancingTask* find_child_on_execution(const Shard& shard, uint64_t lock_start, uint64_t lock_length) const;
 
     // Lock a single gate && read its cardinality before/after
     std::pair<uint64_t, uint64_t> acquire_lock(RebalancingTask* task, uint64_t lock_id);
@@ -75,40 +125,81 @@ private:
     void cleanup_lock(Gate& gate, WakeList& worker_list);
 
     // Process the list of tasks in the to-do list
-    void process_todo_list();
+    void process_todo_list(Shard& shard);
+
+    // Sort the to-do list by the virtual deadline of its tasks, see TaskScheduler
+    void schedule_todo_list(Shard& shard);
 
     // Find the task created to process the given lock id
-    RebalancingTask* get_todo_task_for(size_t lock_id) const;
+    RebalancingTask* get_todo_task_for(const Shard& shard, size_t lock_id) const;
 
     // Remove the lock in the wait_to_complete list
     void wait_to_complete_remove(RebalancingTask* task, uint64_t lock_id);
 
     // Increase the size of the window
-    int64_t next_window_length(int64_t current_window_length) const;
+    int64_t next_window_length(const Shard& shard, int64_t current_window_length) const;
 
     // Add a BlkEntry instance in the task for the insertions, and perform all remaining deletions in gate's writer queue
     uint64_t bulk_loading_init(RebalancingTask* task, Gate* gate);
 
+    // Online resize, close the old gates. Return false if some readers are still operating on the old storage, the
+    // related gates are recorded in the wait list of the task and the last reader leaving each gate notifies the master
+    bool resize_online_close(RebalancingTask* task);
+
+    // Install the new storage, index and gates of a completed resize
+    void resize_install(Shard& shard, RebalancingTask* task);
+
+    // Release a completed task and notify the threads waiting for the master to become idle
+    void task_release(Shard& shard, RebalancingTask* task);
+
+    // Online resize, move the updates deferred in the old gates to the new gates of the task. Return the new gates with pending updates
+    std::vector<uint64_t> resize_online_reroute(Gate* gates_old, uint64_t num_gates_old, RebalancingTask* task);
+
     // Check whether there tasks pending or in execution
-    bool busy() const;
+    bool busy(const Shard& shard) const;
 
     // Validate the cardinalities of the locks and segments before launching a task
     void debug_validate_launch_task_cardinality(RebalancingTask* task) const;
 
+    // Handlers, shared by both the shards and the coordinator
+    void on_rebalance(Shard& shard, uint64_t gate_id);
+    void on_task_done(Shard& shard, RebalancingTask* task);
+    void on_client_exit(Shard& shard, uint64_t gate_id);
+    void on_wait2complete(Shard& shard, std::promise<void>* producer);
+
+    // Dispatch a message received by a shard
+    bool handle_shard(Shard& shard, InternalTask message);
+
+    // Dispatch a message received by the coordinator
+    bool handle_coordinator(Shard& coordinator, InternalTask message);
+
+    // A task in the given shard cannot be completed inside its range of gates, request the coordinator to take over
+    void escalate(Shard& shard);
+
+    // Move all pending tasks of a frozen shard to the coordinator
+    void handover(Shard& shard);
+
+    // Return the control to the shards, once the coordinator has no more pending jobs
+    void thaw();
+
 protected:
-    void main_thread(); // Controller
+    void main_thread(Shard* shard); // Controller
 
     // Start rebalancing from a given gate
     RebalancingTask* rebal_init(uint64_t lock_id);
 
     // Find the window to rebalance for the given task
-    void rebal_resume(RebalancingTask* task);
+    void rebal_resume(Shard& shard, RebalancingTask* task);
 
     // Execute the given task
-    void launch_task(RebalancingWorker* worker, RebalancingTask* task);
+    void launch_task(Shard& shard, RebalancingWorker* worker, RebalancingTask* task);
 
 public:
-    RebalancingMaster(PackedMemoryArray* pma, uint64_t num_workers);
+    /**
+     * Create a new master to coordinate the rebalances of the given pma, with `num_workers' threads in the pool and
+     * `num_shards' coordinators, each in charge of a disjoint range of gates. The number of shards must be a power of 2.
+     */
+    RebalancingMaster(PackedMemoryArray* pma, uint64_t num_workers, uint64_t num_shards = 1);
 
     ~RebalancingMaster();
 
@@ -125,11 +216,21 @@ public:
      */
     RebalancingPool& thread_pool();
 
+    /**
+     * Number of coordinators partitioning the gates
+     */
+    uint64_t num_shards() const noexcept;
+
     /**
      * Request the rebalancing of the given gate
      */
     void rebalance(uint64_t gate_id);
 
+    /**
+     * Request the rebalancing of multiple gates at once, e.g. the gates whose timers expired at the same time
+     */
+    void rebalance(const std::vector<uint64_t>& gate_ids);
+
     /**
      * Signal the exit of a client from a given gate
      */
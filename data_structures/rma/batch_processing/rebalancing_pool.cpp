@@ -101,4 +101,9 @@ bool RebalancingPool::active() const {
     return m_num_workers_active > 0;
 }
 
+uint64_t RebalancingPool::size() const {
+    scoped_lock<mutex> lock(m_mutex);
+    return m_workers_idle.size() + m_num_workers_active;
+}
+
 } // namespace
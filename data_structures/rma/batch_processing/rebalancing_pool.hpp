@@ -53,6 +53,9 @@ public:
     void release(RebalancingWorker* worker);
 
     bool active() const;
+
+    // Total number of workers in the pool, either idle or active
+    uint64_t size() const;
 };
 
 } // namespace
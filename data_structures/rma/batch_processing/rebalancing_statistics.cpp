@@ -112,6 +112,7 @@ RebalancingCompleteStatistics get_rebalancing_stastistics(std::vector<Rebalancin
 
                 // global stats
                 add_stat(result.m_master_wallclock_time, profiles[index_end].m_master_wallclock_time);
+                add_stat(result.m_master_queue_time, profiles[index_end].m_master_queue_time);
                 add_stat(result.m_master_search_time, profiles[index_end].m_master_search_time);
                 add_stat(result.m_master_num_resumes, profiles[index_end].m_master_num_resumes);
                 add_stat(result.m_master_num_tasks_merged, profiles[index_end].m_master_num_tasks_merged);
@@ -120,6 +121,7 @@ RebalancingCompleteStatistics get_rebalancing_stastistics(std::vector<Rebalancin
 
                 // window stats
                 add_stat(window.m_master_wallclock_time, profiles[index_end].m_master_wallclock_time);
+                add_stat(window.m_master_queue_time, profiles[index_end].m_master_queue_time);
                 add_stat(window.m_master_search_time, profiles[index_end].m_master_search_time);
                 add_stat(window.m_master_num_resumes, profiles[index_end].m_master_num_resumes);
                 add_stat(window.m_master_num_tasks_merged, profiles[index_end].m_master_num_tasks_merged);
@@ -162,6 +164,7 @@ RebalancingCompleteStatistics get_rebalancing_stastistics(std::vector<Rebalancin
             }
 
             finalize_stat(m_master_wallclock_time);
+            finalize_stat(m_master_queue_time);
             finalize_stat(m_master_search_time);
             finalize_stat(m_master_num_resumes);
             finalize_stat(m_master_num_tasks_merged);
@@ -192,6 +195,7 @@ RebalancingCompleteStatistics get_rebalancing_stastistics(std::vector<Rebalancin
 
     // global stats
     compute_avg_stddev(result.m_master_wallclock_time);
+    compute_avg_stddev(result.m_master_queue_time);
     compute_avg_stddev(result.m_master_search_time);
     compute_avg_stddev(result.m_master_num_resumes);
     compute_avg_stddev(result.m_master_num_tasks_merged);
@@ -225,6 +229,7 @@ ostream& operator<<(ostream& out, const RebalancingFieldStatistics& field) {
 ostream& operator<<(ostream& out, const RebalancingWindowStatistics& window){
     out << window.m_type << " [" << window.m_window_length << "], count: " << window.m_count << "\n";
     out << "    (master) wall clock time: " << window.m_master_wallclock_time << " microsecs\n";
+    out << "    (master) queueing time in the to-do list: " << window.m_master_queue_time << " microsecs\n";
     out << "    (master) search time: " << window.m_master_search_time << " microsecs\n";
     out << "    (master) invocations to rebal_resume(): " << window.m_master_num_resumes << "\n";
     out << "    (master) tasks merged in rebal_resume(): " << window.m_master_num_tasks_merged << "\n";
@@ -247,6 +252,7 @@ ostream& operator<<(ostream& out, const RebalancingWindowStatistics& window){
 ostream& operator<<(ostream& out, const RebalancingCompleteStatistics& stats){
     out << "--- Rebalancing statistics ---\n";
     out << "-> Total wall clock time of completed tasks: " << stats.m_master_wallclock_time << " microsecs\n";
+    out << "-> Master, cumulative queueing time in the to-do list: " << stats.m_master_queue_time << " microsecs\n";
     out << "-> Master, cumulative search time: " << stats.m_master_search_time << " microsecs\n";
     out << "-> Master, cumulative number of invocations to rebal_resume(): " << stats.m_master_num_resumes << "\n";
     out << "-> Master, cumulative number of merged tasks: " << stats.m_master_num_tasks_merged << "\n";
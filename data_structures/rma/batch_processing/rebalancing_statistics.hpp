@@ -43,6 +43,7 @@ struct RebalancingStatistics {
     int64_t m_window_length = 0; // the total number of segments rebalanced or, in case of resize, of the new sparse array
 
     int64_t m_master_wallclock_time = 0; // in microsecs, the wall clock time to execute the complete task
+    int64_t m_master_queue_time = 0; // in microsecs, the time the task waited in the to-do list, from its creation to its launch
     int64_t m_master_search_time = 0; // in microsecs, the amount of time spent in the Master to compute the window to rebalance
     int64_t m_master_num_resumes = 0; // number of invocations to rebal_resume() for this task
     int64_t m_master_num_tasks_merged = 0; // the number of tasks merged in the search phase
@@ -104,6 +105,7 @@ struct RebalancingWindowStatistics{
     int64_t m_count = 0; // the number of entries associated to this window
 
     RebalancingFieldStatistics m_master_wallclock_time; // in microsecs, the wall clock time to execute the complete task
+    RebalancingFieldStatistics m_master_queue_time; // in microsecs, the time the task waited in the to-do list, from its creation to its launch
     RebalancingFieldStatistics m_master_search_time; // in microsecs, the amount of time spent in the Master to compute the window to rebalance
     RebalancingFieldStatistics m_master_num_resumes; // number of invocations to rebal_resume() for this task
     RebalancingFieldStatistics m_master_num_tasks_merged; // the number of tasks merged in the search phase
@@ -131,6 +133,7 @@ struct RebalancingWindowStatistics{
 struct RebalancingCompleteStatistics {
     // total amount of search time, resumes, launch time, release time
     RebalancingFieldStatistics m_master_wallclock_time; // in microsecs, total time for the tasks completed
+    RebalancingFieldStatistics m_master_queue_time; // in microsecs, the time the tasks waited in the to-do list, from their creation to their launch
     RebalancingFieldStatistics m_master_search_time; // in microsecs, the amount of time spent in the Master to compute the window to rebalance
     RebalancingFieldStatistics m_master_num_resumes; // number of invocations to rebal_resume() for this task
     RebalancingFieldStatistics m_master_num_tasks_merged; // the number of tasks merged in the search phase
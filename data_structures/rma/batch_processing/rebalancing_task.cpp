@@ -17,9 +17,11 @@
 
 #include "rebalancing_task.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <mutex>
+#include <numeric>
 #include <thread>
 
 #include "rma/common/static_index.hpp"
@@ -41,8 +43,8 @@ extern mutex _debug_mutex; // PackedMemoryArray.cpp
     #define COUT_DEBUG(msg)
 #endif
 
-RebalancingTask::RebalancingTask(PackedMemoryArray* pma, RebalancingMaster* master, Gate* gate) : m_pma(pma), m_master(master), m_plan(){
-    m_plan.m_cardinality_before = gate->m_cardinality;
+RebalancingTask::RebalancingTask(PackedMemoryArray* pma, RebalancingMaster* master, Gate* gate) : m_pma(pma), m_master(master), m_plan(), m_apma_partitions(vector_of_partitions(pma->memory_pool())){
+    m_plan.m_cardinality_before = gate->m_cold->m_cardinality;
     m_plan.m_window_start = gate->m_window_start;
     m_plan.m_window_length = gate->m_window_length;
     m_window_id = gate->lock_id();
@@ -134,6 +136,85 @@ bool RebalancingTask::is_rebalancing_window_computed() const noexcept {
     ;
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   Parallel sort of the bulk loading queues                                *
+ *                                                                           *
+ *****************************************************************************/
+vector<RebalancingTask::BlkLoadSortJob> RebalancingTask::BlkLoadSortJob::split(vector<insertion_t>& vect, size_t num_runs){
+    assert(num_runs > 0);
+    vector<BlkLoadSortJob> jobs;
+    const size_t length = std::max<size_t>(1, (vect.size() + num_runs -1) / num_runs);
+    for(size_t start = 0; start < vect.size(); start += length){
+        const size_t end = std::min(start + length, vect.size());
+        jobs.push_back(BlkLoadSortJob{ vect.data() + start, static_cast<int64_t>(end - start), {} });
+    }
+    return jobs;
+}
+
+vector<RebalancingTask::BlkLoadSortJob> RebalancingTask::BlkLoadSortJob::merge(const vector<run_t>& runs, insertion_t* output){
+    const size_t num_runs = runs.size();
+    vector<insertion_t> samples;
+    for(auto& run : runs){
+        const size_t run_sz = run.second - run.first;
+        for(size_t j = 1; j < num_runs; j++){ samples.push_back(run.first[j * run_sz / num_runs]); }
+    }
+    std::sort(begin(samples), end(samples));
+
+    vector<BlkLoadSortJob> jobs;
+    insertion_t* position = output;
+    vector<const insertion_t*> lower_bounds;
+    for(auto& run : runs){ lower_bounds.push_back(run.first); }
+    for(size_t j = 1; j <= num_runs; j++){
+        BlkLoadSortJob job { position, 0, {} };
+        for(size_t r = 0; r < num_runs; r++){
+            const auto& run = runs[r];
+            const insertion_t* upper_bound = (j < num_runs) ? std::lower_bound(run.first, run.second, samples[j * (num_runs -1) -1]) : run.second;
+            if(lower_bounds[r] < upper_bound){
+                job.m_runs.emplace_back(lower_bounds[r], upper_bound);
+                job.m_length += upper_bound - lower_bounds[r];
+            }
+            lower_bounds[r] = upper_bound;
+        }
+        if(job.m_length > 0){
+            position += job.m_length;
+            jobs.push_back(move(job));
+        }
+    }
+    assert(position - output == accumulate(begin(runs), end(runs), int64_t{0}, [](int64_t sum, const run_t& run){ return sum + (run.second - run.first); }));
+
+    return jobs;
+}
+
+void RebalancingTask::BlkLoadSortJob::execute() const {
+    if(m_runs.empty()){ // sort in place
+        std::sort(m_output, m_output + m_length);
+    } else if(m_runs.size() == 1){ // nothing to merge
+        std::copy(m_runs[0].first, m_runs[0].second, m_output);
+    } else { // k-way merge, through a min heap on the head of each run
+        auto cmp = [](const run_t& r1, const run_t& r2){ return *(r2.first) < *(r1.first); };
+        vector<run_t> heap { begin(m_runs), end(m_runs) };
+        std::make_heap(begin(heap), end(heap), cmp);
+        insertion_t* __restrict output = m_output;
+        while(!heap.empty()){
+            std::pop_heap(begin(heap), end(heap), cmp);
+            run_t& run = heap.back();
+            *(output++) = *(run.first++);
+            if(run.first < run.second){
+                std::push_heap(begin(heap), end(heap), cmp);
+            } else {
+                heap.pop_back();
+            }
+        }
+        assert(output == m_output + m_length);
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Debug                                                                   *
+ *                                                                           *
+ *****************************************************************************/
 std::ostream& operator<<(std::ostream& out, const RebalancingTask* task){
     if(task == nullptr){
         out << "{TASK: nullptr}";
@@ -165,6 +246,7 @@ std::ostream& operator<<(std::ostream& out, const RebalancingTask::SubTask& subt
             ", input_extent_start: " << subtask.m_input_extent_start << ", input_extent_end: " << subtask.m_input_extent_end <<
             ", output_extent_start: " << subtask.m_output_extent_start << ", output_extent_end: " << subtask.m_output_extent_end <<
             ", bulk loading start: " << subtask.m_blkload_start << ", bulk loading end: " << subtask.m_blkload_end <<
+            ", apma partition start: " << subtask.m_partition_start_id << ":" << subtask.m_partition_start_offset <<
             ", cardinality (input + blkld): " << subtask.m_cardinality << "}";
     return out;
 }
@@ -18,16 +18,18 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <cinttypes>
 #include <condition_variable>
 #include <mutex>
 #include <ostream>
 #include <vector>
 
+#include "partition.hpp"
 #include "rebalance_plan.hpp"
 #include "rebalancing_statistics.hpp"
 
-namespace data_structures::rma::common { class StaticIndex; } // forward decl.
+namespace data_structures::rma::common { class SegmentIndex; } // forward decl.
 
 namespace data_structures::rma::batch_processing {
 
@@ -37,13 +39,14 @@ class Gate;
 class PackedMemoryArray;
 class RebalancingMaster;
 struct Storage;
+class WindowSnapshot;
 
 class RebalancingTask {
 public:
     PackedMemoryArray * const m_pma;
     RebalancingMaster* m_master;
     Gate* m_ptr_locks;
-    common::StaticIndex* m_ptr_index;
+    common::SegmentIndex* m_ptr_index;
     Storage* m_ptr_storage;
 
     RebalancePlan m_plan; // the window & the operation to perform
@@ -56,10 +59,42 @@ public:
     int64_t m_blocked_on_lock = -1; // only used by the Master to keep track which extent need to be processed before this task can be executed
     size_t m_num_locks = 0; // keep track of the previous number of gates, before a resize
     bool m_forced_resize; // true if |cardinality| < capacity /2
+    int m_shard_id = -1; // only used by the Master, the shard that launched this task, -1 for the coordinator
+    bool m_escalate = false; // only used by the Master, the window outgrew the gates of its shard and it needs to be resumed by the coordinator
+    std::chrono::steady_clock::time_point m_time_created = std::chrono::steady_clock::now(); // only used by the Master, to age the task in the to-do list
+    std::chrono::steady_clock::time_point m_time_launched; // only used by the Master, when the task has been dispatched to the workers
+    WindowSnapshot* m_snapshot = nullptr; // the content of the window before the rebalance, created by the workers & released by the master
 
     // Bulk Loading
     using insertion_t = std::pair<int64_t, int64_t>;
     std::vector<ClientContextQueue*> m_blkld_elts; // writer queues with the elements to insert, possibly unsorted
+    std::vector<insertion_t> m_snapshot_pending; // the elements moved from the delta buffers to the bulk loading queues, still visible to the readers through the snapshot
+
+    // Parallel sort of the bulk loading queues, only used by the workers
+    struct BlkLoadSortJob {
+        using run_t = std::pair<const insertion_t*, const insertion_t*>; // [begin, end)
+        insertion_t* m_output; // either the run to sort in place or the destination of the merged elements
+        int64_t m_length; // number of elements in the output
+        std::vector<run_t> m_runs; // sorted runs to merge, empty => sort the output in place
+
+        // Split the vector in `num_runs' runs of similar length, one job to sort each run in place
+        static std::vector<BlkLoadSortJob> split(std::vector<insertion_t>& vect, size_t num_runs);
+
+        // Partition the merge of the sorted runs into `output' with the splitters picked by regular sampling from all runs,
+        // so that each job merges a disjoint key range into its own slice of the output
+        static std::vector<BlkLoadSortJob> merge(const std::vector<run_t>& runs, insertion_t* output);
+
+        // Sort the run in place, or merge the runs into the output
+        void execute() const;
+    };
+    std::vector<BlkLoadSortJob> m_blkld_sort_jobs; // jobs not fetched yet
+    int64_t m_blkld_sort_pending = 0; // jobs not completed yet
+    int64_t m_blkld_sort_helpers = 0; // number of helper workers still attached to the sort
+    bool m_blkld_sort_phase = false; // true until all helpers have been detached from the sort
+    bool m_blkld_sort_done = false; // no more jobs will be added, the helpers can detach
+
+    // APMA
+    VectorOfPartitions m_apma_partitions; // the cardinalities of all segments in the output window, as determined by the APMA algorithm
 
     // Only used by the workers
     struct SubTask {
@@ -67,6 +102,7 @@ public:
         int64_t m_input_extent_start, m_input_extent_end;
         int64_t m_output_extent_start, m_output_extent_end;
         int64_t m_blkload_start, m_blkload_end;
+        int64_t m_partition_start_id, m_partition_start_offset; // first apma partition of the output window (inclusive)
         int64_t m_cardinality; // total cardinality (input + bulk loading)
     };
     std::vector<SubTask> m_subtasks;
@@ -17,6 +17,7 @@
 
 #include "rebalancing_worker.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono> // debug only
 #include <condition_variable>
@@ -28,13 +29,21 @@
 #include "common/errorhandling.hpp"
 #include "common/miscellaneous.hpp"
 #include "rma/common/buffered_rewired_memory.hpp"
+#include "rma/common/copy_kernels.hpp"
+#include "rma/common/detector.hpp"
+#include "rma/common/move_detector_info.hpp"
 #include "rma/common/rewired_memory.hpp"
+#include "rma/common/segment_kernels.hpp"
+#include "adaptive_rebalancing.hpp"
 #include "gate.hpp"
 #include "packed_memory_array.hpp"
 #include "rebalancing_master.hpp"
 #include "rebalancing_pool.hpp"
 #include "storage.hpp"
 #include "thread_context.hpp"
+#include "wakelist.hpp"
+#include "weights.hpp"
+#include "window_snapshot.hpp"
 
 using namespace common;
 using namespace data_structures::rma::common;
@@ -168,8 +177,12 @@ void RebalancingWorker::do_execute() {
     if(m_worker_id == 0){
         IF_PROFILING( RebalancingTimer timer_worker_total { m_task->m_statistics.m_worker_total_time } );
 
+        compact_tombstones();
+        resize_online_open();
+        snapshot_install();
         sort_blkload_elts();
         debug_content_before();
+        rebalance_run_apma();
 
         // a lock/gate can be smaller than an extent. For instance a gate is 4 segments, while an extent up to 16.
         // In this case just use a single worker to rebalance/resize the involved gate(s).
@@ -194,11 +207,14 @@ void RebalancingWorker::do_execute() {
 
         // Finish by setting the segment cardinalities of the window just rebalanced
         update_segment_cardinalities();
+        rebuild_filters();
 
         debug_content_after();
 
         // Remove all elts from the bulk loading queues
         clear_blkload_queues();
+    } else if(m_task->m_blkld_sort_phase){ // worker_id > 0, helping worker #0 to sort the bulk loading queues
+        sort_blkload_jobs();
     } else { // worker_id > 0
         do_execute_queue();
     }
@@ -225,13 +241,14 @@ void RebalancingWorker::do_execute_single(){
         auto* input_storage = &(m_task->m_pma->m_storage);
         auto* output_storage = m_task->m_ptr_storage;
         BulkLoadingIterator loader { m_task };
+        PartitionIterator apma_partitions { m_task->m_apma_partitions };
 
         resize(/* input storage: */ input_storage, /* output storage: */ output_storage,
                /* input start position: */ input_storage->m_segment_capacity - input_storage->m_segment_sizes[0],
                /* input end position (just for boundary check): */ input_storage->m_number_segments * input_storage->m_segment_capacity,
                /* bulk loading loader */ loader,
                /* output segment id: */ 0, /* output number of segments: */ m_task->m_plan.m_window_length,
-               /* total cardinality: */ m_task->m_plan.get_cardinality_after()
+               /* segment cardinalities: */ apma_partitions
         );
     } break;
     default:
@@ -256,7 +273,7 @@ void RebalancingWorker::make_subtasks(){
     InputIterator position { storage_input, m_task->get_window_start(), window_end_before };
     const int64_t num_subtasks = max<int64_t>(m_task->get_extent_length() / EXTENTS_PER_SUBTASK, 1); // at least one subtask
     BulkLoadingIterator loader { m_task };
-
+    PartitionIterator apma_partitions { m_task->m_apma_partitions };
 
     if(num_subtasks == 1){
         RebalancingTask::SubTask subtask;
@@ -268,6 +285,8 @@ void RebalancingWorker::make_subtasks(){
         subtask.m_output_extent_end = m_task->get_extent_start() + m_task->get_extent_length();
         subtask.m_blkload_start = loader.get_absolute_position_start();
         subtask.m_blkload_end = loader.get_absolute_position_end();
+        subtask.m_partition_start_id = 0;
+        subtask.m_partition_start_offset = 0;
         subtask.m_cardinality = m_task->m_plan.get_cardinality_after();
         COUT_DEBUG("Single subtask: " << subtask);
         m_task->m_subtasks.push_back(subtask);
@@ -285,10 +304,6 @@ void RebalancingWorker::make_subtasks(){
         int64_t extents_per_subtask = m_task->get_extent_length() / num_subtasks;
         int64_t num_odd_subtasks = m_task->get_extent_length() % num_subtasks;
 
-        // cardinality per extent
-        int64_t cardinality_per_segment = m_task->m_plan.get_cardinality_after() / m_task->get_window_length();
-        int64_t num_odd_segments = m_task->m_plan.get_cardinality_after() % m_task->get_window_length();
-
         for(int64_t subtask_id = 0; subtask_id < num_subtasks; subtask_id++){
             RebalancingTask::SubTask subtask;
             // output window
@@ -298,10 +313,13 @@ void RebalancingWorker::make_subtasks(){
             subtask.m_output_extent_end = subtask.m_output_extent_start + subtask_num_extents;
 
             // cardinality
-            int64_t subtask_num_segments = subtask_num_extents * segments_per_extent;
-            const int64_t subtask_cardinality_leftover = min(num_odd_segments, subtask_num_segments);
-            num_odd_segments -= subtask_cardinality_leftover;
-            subtask.m_cardinality = cardinality_per_segment * subtask_num_segments + subtask_cardinality_leftover;
+            subtask.m_partition_start_id = apma_partitions.partition_id();
+            subtask.m_partition_start_offset = apma_partitions.partition_offset();
+            subtask.m_cardinality = 0;
+            for(int64_t i = 0, subtask_num_segments = subtask_num_extents * segments_per_extent; i < subtask_num_segments; i++){
+                subtask.m_cardinality += apma_partitions.cardinality_current();
+                apma_partitions.move(1);
+            }
 
             // input
             position.fetch_next_chunk();
@@ -315,10 +333,20 @@ void RebalancingWorker::make_subtasks(){
             subtask.m_blkload_start = loader.get_absolute_position_current();
             position--; // move one step back
             COUT_DEBUG("subtask_id: " << subtask_id << ", before blk loading: " << position);
-            while(position.get_key() > loader.get().first){
-                COUT_DEBUG("subtask_id: " << subtask_id << ", move back: " << position << ", key input: " << position.get_key() << ", key blk: " << loader.get().first);
-                position--;
-                loader++;
+            { // merge path: find the least number of elements `j' to take from the loader, such that the input element
+              // `j' positions back is not greater than the j-th element in the loader. Binary search on the diagonal.
+                int64_t j_min = 0;
+                int64_t j_max = min<int64_t>(subtask.m_cardinality, loader.get_absolute_position_end() - loader.get_absolute_position_current());
+                while(j_min < j_max){
+                    int64_t j = (j_min + j_max) / 2;
+                    InputIterator probe_input = position; probe_input -= j;
+                    BulkLoadingIterator probe_loader = loader; probe_loader += j;
+                    if(probe_input.get_key() <= probe_loader.get().first){ j_max = j; } else { j_min = j +1; }
+                }
+                if(j_min > 0){
+                    position -= j_min;
+                    loader += j_min;
+                }
             }
             COUT_DEBUG("subtask_id: " << subtask_id << ", after blk loading: " << position << ", key input: " << position.get_key() << ", key blk: " << loader.get().first);
             position++; // move one step forward again
@@ -465,6 +493,7 @@ void RebalancingWorker::do_execute_queue(){
 
 void RebalancingWorker::do_execute_subtask(RebalancingTask::SubTask& subtask, int64_t input_extent_watermark) {
     BulkLoadingIterator loader { m_task, (size_t) subtask.m_blkload_start, (size_t) subtask.m_blkload_end };
+    PartitionIterator apma_partitions { m_task->m_apma_partitions, subtask.m_partition_start_id, subtask.m_partition_start_offset };
 
     switch(m_task->m_plan.m_operation){
     case RebalanceOperation::REBALANCE:
@@ -474,14 +503,14 @@ void RebalancingWorker::do_execute_subtask(RebalancingTask::SubTask& subtask, in
                 /* bulk loader */ loader,
                 /* output extent start */ subtask.m_output_extent_start,
                 /* output extent length */ subtask.m_output_extent_end - subtask.m_output_extent_start,
-                /* final cardinality (input + bulk loader) */ subtask.m_cardinality);
+                /* segment cardinalities (input + bulk loader) */ apma_partitions);
     } break;
     case RebalanceOperation::RESIZE: {
         resize(&(m_task->m_pma->m_storage), m_task->m_ptr_storage, subtask.m_input_position_start, subtask.m_input_position_end,
                 /* bulk loader */ loader,
                 /* output window start */ subtask.m_output_extent_start * m_task->m_ptr_storage->get_segments_per_extent(),
                 /* output window length */ (subtask.m_output_extent_end - subtask.m_output_extent_start) * m_task->m_ptr_storage->get_segments_per_extent(),
-                /* final cardinality */ subtask.m_cardinality);
+                /* segment cardinalities */ apma_partitions);
     } break;
     default:
         assert(0 && "Invalid case");
@@ -518,8 +547,13 @@ void RebalancingWorker::spread_local(){
         int64_t input_sz_rhs = input_cardinalities[input_segment_id +1];
         int64_t input_sz = input_sz_lhs + input_sz_rhs;
         int64_t input_displacement = (input_segment_id +1) * segment_capacity - input_sz_lhs;
-        memcpy(workspace_keys + workspace_index, keys + input_displacement, input_sz * sizeof(keys[0]));
-        memcpy(workspace_values + workspace_index, values + input_displacement, input_sz * sizeof(values[0]));
+        if(input_segment_id +2 < end){ // prefetch the next pair of segments
+            int64_t next_displacement = (input_segment_id +3) * segment_capacity - input_cardinalities[input_segment_id +2];
+            copy_kernels::prefetch(keys + next_displacement);
+            copy_kernels::prefetch(values + next_displacement);
+        }
+        copy_kernels::copy(workspace_keys + workspace_index, keys + input_displacement, input_sz);
+        copy_kernels::copy(workspace_values + workspace_index, values + input_displacement, input_sz);
         workspace_index += input_sz;
     }
     const int64_t workspace_end = workspace_index;
@@ -528,32 +562,35 @@ void RebalancingWorker::spread_local(){
     std::pair<int64_t, int64_t> loader_elt = loader.get();
     assert((plan.get_cardinality_after() == loader.cardinality() + plan.get_cardinality_before()) && "Cardinality mismatch");
 
-    const size_t num_elts_per_segment = plan.get_cardinality_after() / plan.m_window_length;
-    const size_t num_odd_segments = plan.get_cardinality_after() % plan.m_window_length;
-    size_t i = 0; // iteration index
+    PartitionIterator apma_partitions { m_task->m_apma_partitions };
 
     // copy all elements from the workspace to their final positions in the storage
     workspace_index = 0;
     for(int64_t output_segment_id = plan.m_window_start, end = plan.m_window_start + plan.m_window_length; output_segment_id < end; output_segment_id += 2){
-        int64_t output_sz_lhs = num_elts_per_segment + (i < num_odd_segments);
-        int64_t output_sz_rhs = num_elts_per_segment + ((i+1) < num_odd_segments);
+        int64_t output_sz_lhs = apma_partitions.cardinality_current();
+        int64_t output_sz_rhs = apma_partitions.cardinality_next();
         int64_t output_sz = output_sz_lhs + output_sz_rhs;
         int64_t output_displacement = (output_segment_id +1) * segment_capacity - output_sz_lhs;
         if(/*input_sz = */ (plan.get_cardinality_before() - workspace_index) >= output_sz && loader_elt.first >= workspace_keys[workspace_index + output_sz -1]){
-            memcpy(keys + output_displacement, workspace_keys + workspace_index, output_sz * sizeof(keys[0]));
-            memcpy(values + output_displacement, workspace_values + workspace_index, output_sz * sizeof(values[0]));
+            copy_kernels::copy(keys + output_displacement, workspace_keys + workspace_index, output_sz);
+            copy_kernels::copy(values + output_displacement, workspace_values + workspace_index, output_sz);
             workspace_index += output_sz;;
         } else { // merge
-            for(int64_t k = 0; k < output_sz; k++){
-                if(workspace_index < workspace_end && workspace_keys[workspace_index] <= loader_elt.first){
-                    keys[output_displacement +k] = workspace_keys[workspace_index];
-                    values[output_displacement +k] = workspace_values[workspace_index];
-                    workspace_index++;
+            for(int64_t k = 0; k < output_sz; ){
+                // the run of elements from the workspace that precede the next element from the loader
+                int64_t run_sz = min(output_sz - k, workspace_end - workspace_index);
+                run_sz = segment_kernels::upper_bound(workspace_keys + workspace_index, run_sz, loader_elt.first, run_sz);
+                if(run_sz > 0){ // copy the run in bulk
+                    copy_kernels::copy(keys + output_displacement +k, workspace_keys + workspace_index, run_sz);
+                    copy_kernels::copy(values + output_displacement +k, workspace_values + workspace_index, run_sz);
+                    workspace_index += run_sz;
+                    k += run_sz;
                 } else {
                     keys[output_displacement +k] = loader_elt.first;
                     values[output_displacement +k] = loader_elt.second;
                     loader++;
                     loader_elt = loader.get();
+                    k++;
                 }
             }
 
@@ -562,7 +599,7 @@ void RebalancingWorker::spread_local(){
         set_separator_key(output_segment_id, keys[output_displacement]);
         set_separator_key(output_segment_id +1, keys[output_displacement + output_sz_lhs]);
 
-        i+=2; // i = 0, 2, 4, ...
+        apma_partitions.move(+2); // move ahead
     }
 }
 
@@ -571,20 +608,14 @@ void RebalancingWorker::spread_local(){
  *  Spread with rewiring                                                     *
  *                                                                           *
  *****************************************************************************/
-void RebalancingWorker::rebalance_rewire(Storage* storage, int64_t input_extent_watermark, int64_t input_position_start, int64_t input_position_end, BulkLoadingIterator& loader, int64_t output_extent_start, int64_t output_extent_length, size_t cardinality) {
+void RebalancingWorker::rebalance_rewire(Storage* storage, int64_t input_extent_watermark, int64_t input_position_start, int64_t input_position_end, BulkLoadingIterator& loader, int64_t output_extent_start, int64_t output_extent_length, PartitionIterator& apma_partitions) {
     const int64_t segment_capacity = storage->m_segment_capacity;
     const int64_t segments_per_extent = storage->get_segments_per_extent();
-    const int64_t cardinality_per_segment = cardinality / (output_extent_length * segments_per_extent);
-    int64_t num_odd_segments = cardinality % (output_extent_length * segments_per_extent);
 
     for(int64_t i = 0; i < output_extent_length; i++){
         int64_t extent_id = output_extent_start + i;
         const bool use_rewiring = (extent_id >= input_extent_watermark);
 
-        int64_t cardinality_leftover = min(num_odd_segments, segments_per_extent);
-        num_odd_segments -= cardinality_leftover;
-        const size_t extent_cardinality = (cardinality_per_segment * segments_per_extent) + cardinality_leftover;
-
         if(!use_rewiring){
             COUT_DEBUG("extent: " << extent_id << ", spread without rewiring, watermark=" << input_extent_watermark);
             int64_t offset = extent_id * segments_per_extent * segment_capacity;
@@ -594,7 +625,7 @@ void RebalancingWorker::rebalance_rewire(Storage* storage, int64_t input_extent_
                     /* bulk loading loader */ loader,
                     /* destination */ storage->m_keys + offset, storage->m_values + offset,
                     /* extent id */ extent_id,
-                    /* cardinality */ extent_cardinality);
+                    /* segment cardinalities */ apma_partitions);
         } else {
             COUT_DEBUG("extent: " << extent_id << ", spread with rewiring, watermark=" << input_extent_watermark);
 
@@ -612,12 +643,12 @@ void RebalancingWorker::rebalance_rewire(Storage* storage, int64_t input_extent_
                     /* bulk loading loader */ loader,
                     /* destination */ buffer_keys, buffer_values,
                     /* extent id */ extent_id,
-                    /* cardinality */ extent_cardinality);
+                    /* segment cardinalities */ apma_partitions);
         }
     }
 }
 
-void RebalancingWorker::spread_rewire(Storage* storage, int64_t& input_position_start, const int64_t input_position_end, BulkLoadingIterator& loader, int64_t* __restrict destination_keys, int64_t* __restrict destination_values, size_t extent_id, size_t cardinality){
+void RebalancingWorker::spread_rewire(Storage* storage, int64_t& input_position_start, const int64_t input_position_end, BulkLoadingIterator& loader, int64_t* __restrict destination_keys, int64_t* __restrict destination_values, size_t extent_id, PartitionIterator& apma_partitions){
 //    COUT_DEBUG("[destination] keys: " << destination_keys << ", values: " << destination_values << ", extent_id: " << extent_id << ", position: " << input_position_start);
     constexpr int64_t INT64_T_MAX = std::numeric_limits<int64_t>::max();
     decltype(storage->m_segment_sizes) __restrict segment_sizes = storage->m_segment_sizes;
@@ -648,16 +679,13 @@ void RebalancingWorker::spread_rewire(Storage* storage, int64_t& input_position_
 //    COUT_DEBUG("initial_displacement: " << input_initial_displacement << ", first key: " << input_keys[0]);
 
     COUT_DEBUG("extent: " << extent_id << ", initial segment: " << input_segment_id << ", run sz: " << input_run_sz << ", displacement: " << input_initial_displacement);
-    const size_t cardinality_per_segment = cardinality / segments_per_extent;
-    const size_t num_odd_segments = cardinality % segments_per_extent;
-
     // the loader should already be ready
     auto blkelt = loader.get();
 
     // left to right
     for(size_t output_segment_id = 0; output_segment_id < segments_per_extent; output_segment_id+=2){
-        const size_t output_run_sz_lhs = cardinality_per_segment + (output_segment_id < num_odd_segments);
-        const size_t output_run_sz_rhs = cardinality_per_segment + (output_segment_id+1 < num_odd_segments);
+        const size_t output_run_sz_lhs = apma_partitions.cardinality_current();
+        const size_t output_run_sz_rhs = apma_partitions.cardinality_next();
         const size_t output_run_sz = output_run_sz_lhs + output_run_sz_rhs;
         assert(output_run_sz >= 0 && output_run_sz <= 2 * segment_capacity);
         const size_t output_displacement = output_segment_id * segment_capacity + (segment_capacity - output_run_sz_lhs);
@@ -670,32 +698,36 @@ void RebalancingWorker::spread_rewire(Storage* storage, int64_t& input_position_
 
         // merge the elts from the loader and the input
         while(k < output_run_sz && input_idx < input_run_sz && blkelt.first < INT64_T_MAX){
-            if(input_keys[input_idx] < blkelt.first){ // merge from the input
-                output_keys[k] = input_keys[input_idx];
-                output_values[k] = input_values[input_idx];
-                input_idx++;
-
-                // fetch the next input sequence
-                if(input_idx >= input_run_sz){
-                    input_run_sz = 0;
-                    do {
-                        input_segment_id += 2; // move to the next even segment
-                        if(/* current position */ input_segment_id * segment_capacity >= input_position_end) break; // okay, all input segments are empty
-                        size_t input_displacement = (input_segment_id +1) * segment_capacity - segment_sizes[input_segment_id];
-                        input_keys = storage->m_keys + input_displacement;
-                        input_values = storage->m_values + input_displacement;
-                        input_run_sz = segment_sizes[input_segment_id] + segment_sizes[input_segment_id +1];
-                    } while(input_run_sz == 0);
-                    input_idx = 0;
-                }
-            } else { // merge from the bulk loader
-                output_keys[k] = blkelt.first;
-                output_values[k] = blkelt.second;
-                loader++;
+            int64_t run_sz = min<int64_t>(output_run_sz - k, input_run_sz - input_idx);
+            if(run_sz >= MERGE_RUN_MIN && input_keys[input_idx + MERGE_RUN_MIN -1] < blkelt.first){ // a long run of input elements, copy it in bulk
+                run_sz = segment_kernels::lower_bound(input_keys + input_idx, run_sz, blkelt.first, run_sz);
+                copy_kernels::stream(output_keys + k, input_keys + input_idx, run_sz);
+                copy_kernels::stream(output_values + k, input_values + input_idx, run_sz);
+                input_idx += run_sz;
+                k += run_sz;
+            } else { // interleaved elements, branch-free merge of a block
+                auto blkrun = loader.span();
+                int64_t blkrun_index = 0;
+                copy_kernels::merge(output_keys, output_values, /* in/out */ k, min<int64_t>(output_run_sz, k + MERGE_BLOCK_SIZE),
+                        input_keys, input_values, /* in/out */ input_idx, input_run_sz,
+                        blkrun.first, /* in/out */ blkrun_index, blkrun.second);
+                loader += blkrun_index;
                 blkelt = loader.get();
             }
 
-            k++;
+            // fetch the next input sequence
+            if(input_idx >= input_run_sz){
+                input_run_sz = 0;
+                do {
+                    input_segment_id += 2; // move to the next even segment
+                    if(/* current position */ input_segment_id * segment_capacity >= input_position_end) break; // okay, all input segments are empty
+                    size_t input_displacement = (input_segment_id +1) * segment_capacity - segment_sizes[input_segment_id];
+                    input_keys = storage->m_keys + input_displacement;
+                    input_values = storage->m_values + input_displacement;
+                    input_run_sz = segment_sizes[input_segment_id] + segment_sizes[input_segment_id +1];
+                } while(input_run_sz == 0);
+                input_idx = 0;
+            }
         }
 
         // loader depleted, only merge from the input
@@ -704,8 +736,8 @@ void RebalancingWorker::spread_rewire(Storage* storage, int64_t& input_position_
             int64_t input_slots = input_run_sz - input_idx;
             int64_t cpy1 = min(input_slots, output_slots);
 
-            memcpy(output_keys + k, input_keys + input_idx, cpy1 * sizeof(output_keys[0]));
-            memcpy(output_values + k, input_values + input_idx, cpy1 * sizeof(output_keys[0]));
+            copy_kernels::stream(output_keys + k, input_keys + input_idx, cpy1);
+            copy_kernels::stream(output_values + k, input_values + input_idx, cpy1);
 
             input_idx += cpy1;
             k += cpy1;
@@ -738,8 +770,12 @@ void RebalancingWorker::spread_rewire(Storage* storage, int64_t& input_position_
         assert(k == output_run_sz && "Still elements to copy?");
         set_separator_key(segment_base + output_segment_id, output_keys[0]);
         set_separator_key(segment_base + output_segment_id + 1, output_keys[output_run_sz_lhs]);
+
+        apma_partitions.move(+2); // move ahead
     }
 
+    copy_kernels::fence(); // flush the non-temporal stores
+
     // update the final position
     input_position_start = /* all inputs ahead are empty ? */ input_run_sz == 0 ?
             /* eof */ input_position_end :
@@ -754,13 +790,12 @@ void RebalancingWorker::spread_rewire(Storage* storage, int64_t& input_position_
  *                                                                           *
  *****************************************************************************/
 // left 2 right
-void RebalancingWorker::resize(const Storage* input, Storage* output, int64_t input_position_start, int64_t input_position_end, BulkLoadingIterator& loader, int64_t output_window_start, int64_t output_window_length, size_t cardinality) {
+void RebalancingWorker::resize(const Storage* input, Storage* output, int64_t input_position_start, int64_t input_position_end, BulkLoadingIterator& loader, int64_t output_window_start, int64_t output_window_length, PartitionIterator& apma_partitions) {
     assert(input != nullptr && output != nullptr);
     assert(input->m_segment_capacity == output->m_segment_capacity && "Incompatible storages");
     assert(output_window_start % 2 == 0 && "Expected an even entry point");
     assert((output_window_length % 2 == 0 || (output_window_start == 0 && output_window_length == 1)) && "Expected an even number of segments");
-    if(cardinality == 0){ // bloody corner case
-        assert(m_task->m_plan.get_cardinality_after() == 0 && "Corner case: expected to be completely empty");
+    if(m_task->m_plan.get_cardinality_after() == 0){ // bloody corner case
         assert(loader.cardinality() == 0 && "Corner case: expected empty, otherwise m_task->m_plan.get_cardinality_after() > 0");
         assert(output->m_number_segments == 1 && "Corner case: expected only one segment available, the PMA is completely empty");
         assert(m_task->m_subtasks.size() <= 1ull && "Corner case: did we really create more than 1 sub task here?");
@@ -797,13 +832,9 @@ void RebalancingWorker::resize(const Storage* input, Storage* output, int64_t in
     int64_t* __restrict output_base_keys = output->m_keys + output_window_start * output->m_segment_capacity;
     int64_t* __restrict output_base_values = output->m_values + output_window_start * output->m_segment_capacity;
 
-    // cardinality per segment
-    const int64_t cardinality_per_segment = cardinality / output_window_length;
-    const int64_t num_odd_segments = cardinality % output_window_length;
-
     for(int64_t segment_id = 0; segment_id < output_window_length; segment_id+=2){
-        const int64_t output_run_sz_lhs = cardinality_per_segment + (segment_id < num_odd_segments);
-        const int64_t output_run_sz_rhs = output_window_length == 1 ? 0 : cardinality_per_segment + ((segment_id+1) < num_odd_segments);
+        const int64_t output_run_sz_lhs = apma_partitions.cardinality_current();
+        const int64_t output_run_sz_rhs = output_window_length == 1 ? 0 : apma_partitions.cardinality_next();
         int64_t output_run_sz = output_run_sz_lhs + output_run_sz_rhs;
         assert(output_run_sz >= 0 && output_run_sz <= 2 * segment_capacity);
         size_t output_displacement = segment_id * segment_capacity + (segment_capacity - output_run_sz_lhs);
@@ -813,32 +844,36 @@ void RebalancingWorker::resize(const Storage* input, Storage* output, int64_t in
 
         // merge the elts from the loader and the input
         while(k < output_run_sz && input_idx < input_run_sz && blkelt.first < INT64_T_MAX){
-            if(input_keys[input_idx] < blkelt.first){ // merge from the input
-                output_keys[k] = input_keys[input_idx];
-                output_values[k] = input_values[input_idx];
-                input_idx++;
-
-                // fetch the next input sequence
-                if(input_idx >= input_run_sz){
-                    input_run_sz = 0; // reset
-                    do {
-                        input_segment_id += 2; // move to the next even segment
-                        if(/* current position */ input_segment_id * segment_capacity >= input_position_end) break; // okay, all input segments are empty
-                        size_t input_displacement = (input_segment_id +1) * segment_capacity - input_sizes[input_segment_id];
-                        input_keys = input->m_keys + input_displacement;
-                        input_values = input->m_values + input_displacement;
-                        input_run_sz = input_sizes[input_segment_id] + input_sizes[input_segment_id +1];
-                    } while(input_run_sz == 0);
-                    input_idx = 0;
-                }
-            } else { // merge from the bulk loader
-                output_keys[k] = blkelt.first;
-                output_values[k] = blkelt.second;
-                loader++;
+            int64_t run_sz = min<int64_t>(output_run_sz - k, input_run_sz - input_idx);
+            if(run_sz >= MERGE_RUN_MIN && input_keys[input_idx + MERGE_RUN_MIN -1] < blkelt.first){ // a long run of input elements, copy it in bulk
+                run_sz = segment_kernels::lower_bound(input_keys + input_idx, run_sz, blkelt.first, run_sz);
+                copy_kernels::stream(output_keys + k, input_keys + input_idx, run_sz);
+                copy_kernels::stream(output_values + k, input_values + input_idx, run_sz);
+                input_idx += run_sz;
+                k += run_sz;
+            } else { // interleaved elements, branch-free merge of a block
+                auto blkrun = loader.span();
+                int64_t blkrun_index = 0;
+                copy_kernels::merge(output_keys, output_values, /* in/out */ k, min<int64_t>(output_run_sz, k + MERGE_BLOCK_SIZE),
+                        input_keys, input_values, /* in/out */ input_idx, input_run_sz,
+                        blkrun.first, /* in/out */ blkrun_index, blkrun.second);
+                loader += blkrun_index;
                 blkelt = loader.get();
             }
 
-            k++;
+            // fetch the next input sequence
+            if(input_idx >= input_run_sz){
+                input_run_sz = 0; // reset
+                do {
+                    input_segment_id += 2; // move to the next even segment
+                    if(/* current position */ input_segment_id * segment_capacity >= input_position_end) break; // okay, all input segments are empty
+                    size_t input_displacement = (input_segment_id +1) * segment_capacity - input_sizes[input_segment_id];
+                    input_keys = input->m_keys + input_displacement;
+                    input_values = input->m_values + input_displacement;
+                    input_run_sz = input_sizes[input_segment_id] + input_sizes[input_segment_id +1];
+                } while(input_run_sz == 0);
+                input_idx = 0;
+            }
         }
 
         // loader depleted, only merge from the input
@@ -846,8 +881,8 @@ void RebalancingWorker::resize(const Storage* input, Storage* output, int64_t in
             int64_t output_slots = output_run_sz - k;
             int64_t input_slots = input_run_sz - input_idx;
             int64_t cpy1 = min(input_slots, output_slots);
-            memcpy(output_keys + k, input_keys + input_idx, cpy1 * sizeof(output_keys[0]));
-            memcpy(output_values + k, input_values + input_idx, cpy1 * sizeof(output_keys[0]));
+            copy_kernels::stream(output_keys + k, input_keys + input_idx, cpy1);
+            copy_kernels::stream(output_values + k, input_values + input_idx, cpy1);
 
             input_idx += cpy1;
             k += cpy1;
@@ -882,11 +917,115 @@ void RebalancingWorker::resize(const Storage* input, Storage* output, int64_t in
         set_separator_key(output_window_start + segment_id, output_keys[0]);
         if(output_window_length > 1) // it covers the case of a downsize with only 1 segment at the end
             set_separator_key(output_window_start + segment_id + 1, output_keys[output_run_sz_lhs]);
+
+        apma_partitions.move(+2); // move ahead
     }
 
+    copy_kernels::fence(); // flush the non-temporal stores
+
     COUT_DEBUG("final position: " << (input_keys - input->m_keys + input_idx));
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   APMA                                                                    *
+ *                                                                           *
+ *****************************************************************************/
+void RebalancingWorker::rebalance_run_apma(){
+    PackedMemoryArray* pma = m_task->m_pma;
+    const RebalancePlan& plan = m_task->m_plan;
+    auto& partitions = m_task->m_apma_partitions;
+    partitions.clear();
+
+    // the detector is disabled, spread the elements evenly
+    if(!pma->m_adaptive_rebalancing || pma->knobs().get_sampling_rate() == 0 || plan.get_cardinality_after() == 0){
+        partitions.emplace_back(plan.get_cardinality_after(), plan.m_window_length);
+        return;
+    }
+
+    // the input window, in a resize the storage may have already been extended by the master
+    const Storage& storage = pma->m_storage;
+    const int64_t window_start = plan.m_window_start;
+    const int64_t window_length = plan.m_operation == RebalanceOperation::REBALANCE ? plan.m_window_length :
+            min<int64_t>(m_task->m_num_locks * pma->get_segments_per_lock(), storage.m_number_segments);
+    assert(window_start + window_length <= (int64_t) pma->detector().capacity() && "The detector is smaller than the input window");
+    const uint16_t* __restrict sizes = storage.m_segment_sizes + window_start;
+    const int64_t segment_capacity = storage.m_segment_capacity;
+    auto segment_keys = [&](int64_t segment_id){ // relative to the window
+        int64_t offset = (window_start + segment_id) * segment_capacity;
+        if(segment_id % 2 == 0){ offset += segment_capacity - sizes[segment_id]; } // even segments store the keys at the end
+        return storage.m_keys + offset;
+    };
+    auto next_non_empty_segment = [&](int64_t segment_id){
+        do { segment_id++; } while(segment_id < window_length && sizes[segment_id] == 0);
+        return segment_id;
+    };
+
+    // the cardinality of each input segment, once the elements from the bulk loader have been routed to their segments
+    auto& memory_pool = pma->memory_pool();
+    auto fn_deallocate = [&memory_pool](void* ptr){ memory_pool.deallocate(ptr); };
+    unique_ptr<uint32_t, decltype(fn_deallocate)> ptr_cardinalities { memory_pool.allocate<uint32_t>(window_length), fn_deallocate };
+    uint32_t* __restrict cardinalities = ptr_cardinalities.get();
+    for(int64_t i = 0; i < window_length; i++){ cardinalities[i] = sizes[i]; }
+
+    // record the elements from the bulk loader in the detector, as they had been inserted one by one in sorted order
+    BulkLoadingIterator loader { m_task };
+    auto blkelt = loader.get();
+    int64_t segment_id = 0;
+    int64_t next_segment_id = next_non_empty_segment(0);
+    int64_t predecessor = numeric_limits<int64_t>::min(); // last key inserted in the current segment
+    while(blkelt.first < numeric_limits<int64_t>::max()){
+        const int64_t key = blkelt.first;
+        while(next_segment_id < window_length && segment_keys(next_segment_id)[0] <= key){
+            segment_id = next_segment_id;
+            next_segment_id = next_non_empty_segment(segment_id);
+            predecessor = numeric_limits<int64_t>::min();
+        }
+
+        const int64_t* keys = segment_keys(segment_id);
+        const int64_t* position = std::upper_bound(keys, keys + sizes[segment_id], key);
+        int64_t successor = (position == keys + sizes[segment_id]) ? numeric_limits<int64_t>::max() : *position;
+        if(position > keys) predecessor = max(predecessor, *(position -1));
+
+        if(pma->detector_sample()){ pma->detector().insert(window_start + segment_id, predecessor, successor); }
+        cardinalities[segment_id]++;
+
+        predecessor = key;
+        loader++;
+        blkelt = loader.get();
+    }
+
+    // detect the hammered intervals
+    Weights weights_builder { *pma, (size_t) window_start, (size_t) window_length, cardinalities };
+    auto weights = weights_builder.release();
+    int wbalance = weights_builder.balance(); // = amount of hammer insertions minus amount of hammer deletions
+
+    { // restrict the scope, the info is moved inside the detector when `mdi' is destroyed
+        MoveDetectorInfo mdi { *pma, (size_t) window_start }, *ptr_mdi = nullptr;
+        if(plan.m_operation == RebalanceOperation::REBALANCE){
+            mdi.resize(2 * weights.size()); // it can move up to 2 *|weights| info
+            ptr_mdi = &mdi;
+        }
+
+        AdaptiveRebalancing ar { *pma, move(weights), wbalance, (size_t) plan.m_window_length, (size_t) plan.get_cardinality_after(), ptr_mdi, /* fill segments ? */ false };
+        partitions = ar.release();
+    }
+
+    // whether the segments of the window have been assigned a different density
+    int64_t density_min = numeric_limits<int64_t>::max(), density_max = 0;
+    for(auto& partition : partitions){
+        if(partition.m_segments == 0) continue;
+        density_min = min<int64_t>(density_min, partition.m_cardinality / partition.m_segments);
+        density_max = max<int64_t>(density_max, (partition.m_cardinality + partition.m_segments -1) / partition.m_segments);
+    }
+    if(density_max - density_min > 1){ pma->m_num_skewed_rebalances++; }
+
+    // in a resize, the detector has to match the new number of segments
+    if(plan.m_operation == RebalanceOperation::RESIZE || plan.m_operation == RebalanceOperation::RESIZE_REBALANCE){
+        pma->detector().resize(plan.m_window_length);
+    }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Index                                                                   *
@@ -925,17 +1064,118 @@ void RebalancingWorker::set_separator_key(uint64_t segment_id, int64_t key){
  *****************************************************************************/
 void RebalancingWorker::sort_blkload_elts(){
     IF_PROFILING( RebalancingTimer timer { m_task->m_statistics.m_worker_sort_time } );
+    using insertion_t = RebalancingTask::insertion_t;
+    using BlkLoadSortJob = RebalancingTask::BlkLoadSortJob;
+    constexpr size_t PARALLEL_SORT_THRESHOLD = (1ull << 15); // min number of elts to sort, before asking other workers to help
+    constexpr size_t RUN_LENGTH_MIN = (1ull << 13); // min number of elts in a single run
 
-    // sort the list of vectors
+    // sort the list of vectors. Each vector comes from a different gate, therefore their key ranges are disjoint
     std::sort(begin(m_task->m_blkld_elts), end(m_task->m_blkld_elts), [](auto v1, auto v2){
        assert(! v1->empty() && ! v2->empty() );
        return v1->insertions()[0] < v2->insertions()[0]; // just compare the first elt
     });
 
-    // sort the single vectors
-    for(size_t i = 0; i < m_task->m_blkld_elts.size(); i++){
-        auto& vect = m_task->m_blkld_elts[i]->insertions();
-        std::sort(std::begin(vect), std::end(vect));
+    size_t num_elts = 0;
+    for(auto queue : m_task->m_blkld_elts){ num_elts += queue->insertions().size(); }
+
+    // attempt to acquire more workers from the thread pool
+    vector<RebalancingWorker*> helpers;
+    if(num_elts >= PARALLEL_SORT_THRESHOLD){
+        helpers = m_task->m_master->thread_pool().acquire(num_elts / RUN_LENGTH_MIN -1);
+    }
+
+    if(helpers.empty()){ // sort the single vectors
+        for(size_t i = 0; i < m_task->m_blkld_elts.size(); i++){
+            auto& vect = m_task->m_blkld_elts[i]->insertions();
+            std::sort(std::begin(vect), std::end(vect));
+        }
+        return;
+    }
+
+    // split the vectors in runs of similar length, so that the load is evenly distributed among the workers
+    const size_t num_workers = helpers.size() +1;
+    const size_t run_length = std::max(RUN_LENGTH_MIN, (num_elts + num_workers -1) / num_workers);
+    vector<BlkLoadSortJob> sort_jobs;
+    struct MergeInput { vector<insertion_t>* m_queue; vector<insertion_t> m_buffer; vector<BlkLoadSortJob::run_t> m_runs; };
+    vector<MergeInput> merge_inputs; // vectors split in multiple runs
+    for(auto queue : m_task->m_blkld_elts){
+        auto& vect = queue->insertions();
+        const size_t num_runs = (vect.size() + run_length -1) / run_length;
+        if(num_runs <= 1){
+            sort_jobs.push_back(BlkLoadSortJob{ vect.data(), static_cast<int64_t>(vect.size()), {} });
+        } else {
+            merge_inputs.emplace_back();
+            merge_inputs.back().m_queue = &vect;
+            for(auto& job : BlkLoadSortJob::split(vect, num_runs)){
+                merge_inputs.back().m_runs.emplace_back(job.m_output, job.m_output + job.m_length);
+                sort_jobs.push_back(move(job));
+            }
+        }
+    }
+
+    // 1st phase, sort all runs
+    { // restrict the scope
+        scoped_lock<mutex> lock(m_task->m_workers_mutex);
+        m_task->m_blkld_sort_jobs = move(sort_jobs);
+        m_task->m_blkld_sort_pending = m_task->m_blkld_sort_jobs.size();
+        m_task->m_blkld_sort_helpers = helpers.size();
+        m_task->m_blkld_sort_phase = true;
+        m_task->m_blkld_sort_done = false;
+    }
+    for(size_t i = 0; i < helpers.size(); i++){
+        helpers[i]->execute0(m_task, i +1);
+    }
+    sort_blkload_jobs();
+
+    // 2nd phase, merge the runs of the same vector, each job on a disjoint key range
+    vector<BlkLoadSortJob> merge_jobs;
+    for(auto& input : merge_inputs){
+        input.m_buffer.resize(input.m_queue->size());
+        for(auto& job : BlkLoadSortJob::merge(input.m_runs, input.m_buffer.data())){ merge_jobs.push_back(move(job)); }
+    }
+    { // restrict the scope
+        scoped_lock<mutex> lock(m_task->m_workers_mutex);
+        m_task->m_blkld_sort_jobs = move(merge_jobs);
+        m_task->m_blkld_sort_pending = m_task->m_blkld_sort_jobs.size();
+    }
+    m_task->m_workers_condvar.notify_all();
+    sort_blkload_jobs();
+
+    // release the helpers
+    { // restrict the scope
+        unique_lock<mutex> lock(m_task->m_workers_mutex);
+        m_task->m_blkld_sort_done = true;
+        m_task->m_workers_condvar.notify_all();
+        // a helper may not have even started yet, it still needs to read the flag m_blkld_sort_phase in #do_execute
+        while(m_task->m_blkld_sort_helpers > 0){ m_task->m_workers_condvar.wait(lock); }
+        m_task->m_blkld_sort_phase = false;
+    }
+
+    // the merged buffers become the content of the vectors, without copying them back
+    for(auto& input : merge_inputs){ input.m_queue->swap(input.m_buffer); }
+}
+
+void RebalancingWorker::sort_blkload_jobs(){
+    unique_lock<mutex> lock(m_task->m_workers_mutex);
+    while(true){
+        if(!m_task->m_blkld_sort_jobs.empty()){
+            RebalancingTask::BlkLoadSortJob job = move(m_task->m_blkld_sort_jobs.back());
+            m_task->m_blkld_sort_jobs.pop_back();
+            lock.unlock();
+            job.execute();
+            lock.lock();
+            m_task->m_blkld_sort_pending--;
+            if(m_task->m_blkld_sort_pending == 0){ m_task->m_workers_condvar.notify_all(); }
+        } else if(m_worker_id == 0 ? m_task->m_blkld_sort_pending == 0 : m_task->m_blkld_sort_done){
+            break;
+        } else {
+            m_task->m_workers_condvar.wait(lock);
+        }
+    }
+
+    if(m_worker_id > 0){
+        m_task->m_blkld_sort_helpers--;
+        m_task->m_workers_condvar.notify_all(); // still holding the lock, worker #0 cannot release the task yet
     }
 }
 
@@ -975,6 +1215,69 @@ void RebalancingWorker::reclaim_past_extents(int64_t input_extent_watermark){
     } while (!m_extents_to_rewire.empty() && m_extents_to_rewire.front().m_extent_id < input_extent_watermark);
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   Tombstones                                                              *
+ *                                                                           *
+ *****************************************************************************/
+void RebalancingWorker::compact_tombstones(){
+    Storage& storage = m_task->m_pma->m_storage;
+    if(!storage.tombstones_enabled()) return; // lazy deletes not enabled
+
+    // the input window, in a resize the storage may have already been extended by the master
+    const RebalancePlan& plan = m_task->m_plan;
+    const int64_t window_start = plan.m_window_start;
+    const int64_t window_length = plan.m_operation == RebalanceOperation::REBALANCE ? plan.m_window_length :
+            min<int64_t>(m_task->m_num_locks * m_task->m_pma->get_segments_per_lock(), storage.m_number_segments);
+
+    storage.compact_tombstones(window_start, window_start + window_length);
+}
+
+void RebalancingWorker::resize_online_open(){
+    PackedMemoryArray* pma = m_task->m_pma;
+    if(!pma->m_online_resize || m_task->m_plan.m_operation != RebalanceOperation::RESIZE) return;
+
+    // the old storage is not altered anymore, only read, to fill the new storage
+    Gate* gates = pma->m_locks.get_unsafe();
+    WakeList wake_list;
+    for(size_t i = 0; i < m_task->m_num_locks; i++){
+        Gate& gate = gates[i];
+        gate.lock();
+        assert(gate.m_state == Gate::State::REBAL && gate.m_num_active_threads == 0 && "All gates should have been acquired by the master");
+        gate.m_state = Gate::State::RESIZE;
+        gate.wake_all(wake_list);
+        gate.unlock();
+    }
+    wake_list();
+}
+
+void RebalancingWorker::snapshot_install(){
+    PackedMemoryArray* pma = m_task->m_pma;
+    if(!pma->m_rebalance_snapshots || m_task->m_plan.m_operation != RebalanceOperation::REBALANCE) return;
+    if(m_task->get_window_length() < 2) return; // the array is composed by a single segment
+
+    Gate* gates = m_task->m_ptr_locks;
+    const int64_t lock_start = m_task->get_lock_start();
+    const int64_t lock_end = m_task->get_lock_end();
+    auto& pending = m_task->m_snapshot_pending; // elements from the delta buffers of the gates, not in the storage
+    sort(begin(pending), end(pending)); // the tasks merged by the master may have appended them out of order
+    WindowSnapshot* snapshot = new WindowSnapshot(pma->m_storage, m_task->get_window_start(), m_task->get_window_end(),
+            gates[lock_start].m_fence_low_key, gates[lock_end -1].m_fence_high_key, lock_end, pending);
+    pending.clear();
+    m_task->m_snapshot = snapshot;
+
+    WakeList wake_list;
+    for(int64_t lock_id = lock_start; lock_id < lock_end; lock_id++){
+        Gate& gate = gates[lock_id];
+        gate.lock();
+        assert(gate.m_state == Gate::State::REBAL && "The gate should have been acquired by the master");
+        gate.m_cold->m_snapshot = snapshot;
+        gate.wake_all(wake_list); // the readers can proceed with the snapshot, the writers will wait again
+        gate.unlock();
+    }
+    wake_list();
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Segment cardinalities                                                   *
@@ -985,8 +1288,7 @@ void RebalancingWorker::update_segment_cardinalities() {
     uint16_t* __restrict cardinalities_shifted = m_task->m_ptr_storage->m_segment_sizes + m_task->get_window_start();
     Gate* __restrict locks = m_task->m_ptr_locks;
 
-    int64_t cardinality_per_segment = m_task->m_plan.get_cardinality_after() / m_task->get_window_length();
-    int64_t num_odd_segments = m_task->m_plan.get_cardinality_after() % m_task->get_window_length();
+    PartitionIterator apma_partitions { m_task->m_apma_partitions };
     auto lock_start = m_task->get_lock_start();
     auto num_segments_per_lock = std::min<int64_t>(m_task->m_ptr_storage->m_number_segments, m_task->m_pma->get_segments_per_lock());
 
@@ -996,13 +1298,14 @@ void RebalancingWorker::update_segment_cardinalities() {
         int64_t lock_cardinality = 0;
 
         for(int64_t j = 0; j < num_segments_per_lock; j++){
-            int64_t tpma_card = cardinality_per_segment + (segment_id < num_odd_segments);
-            lock_cardinality += tpma_card;
-            cardinalities_shifted[segment_id] = (uint16_t) tpma_card;
+            int64_t apma_card = apma_partitions.cardinality_current();
+            lock_cardinality += apma_card;
+            cardinalities_shifted[segment_id] = (uint16_t) apma_card;
+            apma_partitions.move(1);
             segment_id++;
         }
 
-        locks[lock_id].m_cardinality = lock_cardinality;
+        locks[lock_id].m_cold->m_cardinality = lock_cardinality;
     }
 
     // assume all elements from the bulk loader have been inserted..
@@ -1011,6 +1314,21 @@ void RebalancingWorker::update_segment_cardinalities() {
 }
 
 
+/*****************************************************************************
+ *                                                                           *
+ *   Lookup filters                                                          *
+ *                                                                           *
+ *****************************************************************************/
+void RebalancingWorker::rebuild_filters(){
+    Storage* storage = m_task->m_ptr_storage;
+    if(!storage->filters_enabled()) return; // lookup filters not enabled
+
+    const int64_t window_start = m_task->get_window_start();
+    const int64_t window_end = min<int64_t>(m_task->get_window_end(), storage->m_number_segments);
+    storage->rebuild_filters(window_start, window_end);
+}
+
+
 /*****************************************************************************
  *                                                                           *
  *   InputIterator                                                           *
@@ -1337,6 +1655,13 @@ std::pair<int64_t, int64_t> RebalancingWorker::BulkLoadingIterator::get() const
     // current elt to fetch
     return m_vectors[m_vect_pos]->insertions().operator[](m_position);
 }
+std::pair<const std::pair<int64_t, int64_t>*, int64_t> RebalancingWorker::BulkLoadingIterator::span() const {
+    if(is_ahead() || is_behind()) return make_pair(nullptr, 0);
+
+    const auto& insertions = m_vectors[m_vect_pos]->insertions();
+    int64_t end = (m_vect_pos == m_vect_last) ? m_pos_end : insertions.size();
+    return make_pair(insertions.data() + m_position, end - m_position);
+}
 size_t RebalancingWorker::BulkLoadingIterator::cardinality() const { return m_cardinality; }
 bool RebalancingWorker::BulkLoadingIterator::empty() const { return m_vect_start == m_vect_last && m_pos_start == m_pos_end; }
 bool RebalancingWorker::BulkLoadingIterator::is_ahead() const { return empty() || m_vect_pos > m_vect_last || (m_vect_pos == m_vect_last && m_position >= m_pos_end); }
@@ -1359,6 +1684,25 @@ void RebalancingWorker::BulkLoadingIterator::operator++(int){
         }
     }
 }
+void RebalancingWorker::BulkLoadingIterator::operator+=(int64_t shift){
+    assert(shift >= 0 && "Can only move forwards");
+    if(shift > 0 && is_behind()){ (*this)++; shift--; }
+
+    while(shift > 0 && !is_ahead()){
+        int64_t run_length = span().second;
+        if(shift < run_length){
+            m_position += shift;
+            shift = 0;
+        } else {
+            shift -= run_length;
+            m_position += run_length;
+            if(m_position >= m_vectors[m_vect_pos]->insertions().size()){
+                m_vect_pos++;
+                m_position = 0;
+            }
+        }
+    }
+}
 void RebalancingWorker::BulkLoadingIterator::operator--(int){
     if(is_behind() || empty()){ return; /* nop */ };
 
@@ -1377,6 +1721,106 @@ void RebalancingWorker::BulkLoadingIterator::operator--(int){
     }
 }
 
+/*****************************************************************************
+ *                                                                           *
+ *   PartitionIterator                                                       *
+ *                                                                           *
+ *****************************************************************************/
+RebalancingWorker::PartitionIterator::PartitionIterator(const VectorOfPartitions& partitions) : PartitionIterator(partitions, 0, 0){ }
+
+RebalancingWorker::PartitionIterator::PartitionIterator(const VectorOfPartitions& partitions, int64_t partition_id, int64_t partition_offset) :
+    m_partitions(partitions), m_partition_id(partition_id), m_partition_offset(partition_offset){
+}
+
+size_t RebalancingWorker::PartitionIterator::cardinality() const {
+    return cardinality_current();
+}
+
+size_t RebalancingWorker::PartitionIterator::cardinality_current() const {
+    if(m_partition_id >= m_partitions.size()){
+        return 0;
+    } else {
+        auto partition = m_partitions[m_partition_id];
+        size_t card_per_segment = partition.m_cardinality / partition.m_segments;
+        size_t odd_segments = partition.m_cardinality % partition.m_segments;
+        return card_per_segment + (m_partition_offset < odd_segments);
+    }
+}
+
+size_t RebalancingWorker::PartitionIterator::cardinality_next() const {
+    size_t partition_id = m_partition_id;
+    size_t partition_offset = m_partition_offset + 1;
+
+    if(partition_id >= m_partitions.size()) return 0;
+    if(partition_offset >= m_partitions[partition_id].m_segments){
+        partition_id++;
+        partition_offset = 0;
+
+        if(partition_id >= m_partitions.size()) return 0;
+    }
+
+    auto partition = m_partitions[partition_id];
+    size_t card_per_segment = partition.m_cardinality / partition.m_segments;
+    size_t odd_segments = partition.m_cardinality % partition.m_segments;
+    return card_per_segment + (partition_offset < odd_segments);
+}
+
+void RebalancingWorker::PartitionIterator::move_fwd(size_t N){
+    while(N > 0){
+        if(m_partition_id >= m_partitions.size()) return; // overflow
+
+        size_t max_step = m_partitions[m_partition_id].m_segments - m_partition_offset;
+        size_t step = min(max_step, N);
+        N -= step;
+
+        if(step == max_step){ // next set of partitions
+            m_partition_id++;
+            m_partition_offset = 0;
+        } else {
+            m_partition_offset += step;
+        }
+    }
+}
+
+void RebalancingWorker::PartitionIterator::move_bwd(size_t N){
+    while(N > 0){
+        if(m_partition_id == 0 && m_partition_offset == 0) return; // underflow
+
+        size_t step = min(N, m_partition_offset +1);
+        N -= step;
+        if(step > m_partition_offset){
+            if(m_partition_id > 0){
+                m_partition_id--;
+                m_partition_offset = m_partitions[m_partition_id].m_segments -1;
+            } else {
+                m_partition_offset = 0;
+            }
+        } else {
+            m_partition_offset -= step;
+        }
+    }
+}
+
+void RebalancingWorker::PartitionIterator::move(int64_t N){
+    if(N >= 0){ // move forwards
+        move_fwd(N);
+    } else { // move backwards
+        move_bwd(-N);
+    }
+}
+
+bool RebalancingWorker::PartitionIterator::end() const {
+    return m_partition_id >= m_partitions.size();
+}
+
+size_t RebalancingWorker::PartitionIterator::partition_id() const{
+    return m_partition_id;
+}
+
+size_t RebalancingWorker::PartitionIterator::partition_offset() const{
+    return m_partition_offset;
+}
+
 #undef COUT_DEBUG_FORCE
 #define COUT_DEBUG_FORCE(msg) { scoped_lock<mutex> lock(_debug_mutex); std::cout << "[RebalancingWorker::" << __FUNCTION__ << "] [" << get_thread_id() << "] " << msg << std::endl; }
 
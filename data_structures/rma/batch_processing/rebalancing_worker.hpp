@@ -106,10 +106,15 @@ class RebalancingWorker {
 
         void operator++(int);
         void operator--(int);
+        void operator+=(int64_t shift); // move ahead by `shift' elements
 
         // the next element from the queue, or <+inf, +inf> if the iterator has been depleted
         std::pair<int64_t, int64_t> get() const;
 
+        // the contiguous run of elements from the current position to the end of the current vector, or <nullptr, 0> if
+        // the iterator is not inside its range
+        std::pair<const std::pair<int64_t, int64_t>*, int64_t> span() const;
+
         int64_t get_absolute_position_start() const;
         int64_t get_absolute_position_current() const;
         int64_t get_absolute_position_end() const;
@@ -121,7 +126,52 @@ class RebalancingWorker {
         bool is_ahead() const;
     };
 
+    // Iterate over the cardinalities of the output segments, as computed by the APMA algorithm
+    class PartitionIterator{
+        const VectorOfPartitions& m_partitions;
+        size_t m_partition_id; //=0, current partition
+        size_t m_partition_offset; //=0, current offset in the partition
+
+        void move_fwd(size_t N); // move ahead
+        void move_bwd(size_t N); // move back
+    public:
+        PartitionIterator(const VectorOfPartitions& partitions);
+
+        PartitionIterator(const VectorOfPartitions& partitions, int64_t partition_id, int64_t partition_offset);
+
+        /**
+         * Get the cardinality of the current partition
+         */
+        size_t cardinality_current() const;
+        size_t cardinality() const; // alias for #cardinality_current
+
+        /**
+         * Get the cardinality of the next partition
+         */
+        size_t cardinality_next() const;
+
+        /**
+         * Move the current partition by N
+         */
+        void move(int64_t N); // move ahead if N > 0, else move back
+
+        /**
+         * Return true if we reached the last partition
+         */
+        bool end() const;
+
+        // Current position
+        size_t partition_id() const;
+        size_t partition_offset() const;
+    };
+
 private:
+    // When merging the input window with the elements to bulk load, a run of at least MERGE_RUN_MIN input elements that
+    // precede the next element to load is copied in bulk, otherwise the two sources are merged, branch-free, in blocks
+    // of MERGE_BLOCK_SIZE elements.
+    constexpr static int64_t MERGE_RUN_MIN = 8;
+    constexpr static int64_t MERGE_BLOCK_SIZE = 64;
+
     void main_thread();
 
     void do_execute();
@@ -131,6 +181,10 @@ private:
 
     void make_subtasks();
 
+    // Compute the cardinalities of the output segments through the APMA algorithm. It routes the elements to bulk load to
+    // the input segments, to account for them in the detector, before running the algorithm.
+    void rebalance_run_apma();
+
     // Check the content of the window considered before & after the rebalancing
     void debug_content_before();
     void debug_content_after();
@@ -139,11 +193,11 @@ private:
 
     void do_execute(const RebalancingTask::SubTask& subtask);
 
-    void rebalance_rewire(Storage* storage, int64_t input_extent_watermark, int64_t input_position_start, int64_t input_position_end, BulkLoadingIterator& loader, int64_t output_extent_start, int64_t output_extent_length, size_t cardinality);
+    void rebalance_rewire(Storage* storage, int64_t input_extent_watermark, int64_t input_position_start, int64_t input_position_end, BulkLoadingIterator& loader, int64_t output_extent_start, int64_t output_extent_length, PartitionIterator& apma_partitions);
 
-    void resize(const Storage* input, Storage* output, int64_t input_pos_start, int64_t input_pos_end, BulkLoadingIterator& loader, int64_t output_window_start, int64_t output_window_length, size_t output_cardinality);
+    void resize(const Storage* input, Storage* output, int64_t input_pos_start, int64_t input_pos_end, BulkLoadingIterator& loader, int64_t output_window_start, int64_t output_window_length, PartitionIterator& apma_partitions);
 
-    void spread_rewire(Storage* storage, int64_t& input_position_start, const int64_t input_position_end, BulkLoadingIterator& loader, int64_t* __restrict destination_keys, int64_t* __restrict destination_values, size_t extent_id, size_t cardinality);
+    void spread_rewire(Storage* storage, int64_t& input_position_start, const int64_t input_position_end, BulkLoadingIterator& loader, int64_t* __restrict destination_keys, int64_t* __restrict destination_values, size_t extent_id, PartitionIterator& apma_partitions);
 
     void spread_local();
 
@@ -153,9 +207,24 @@ private:
 
     void update_segment_cardinalities();
 
+    // lookup filters, reload the filters of the output window from the segments just written
+    void rebuild_filters();
+
+    // lazy deletes, physically remove the tombstones from the input window, before its elements are copied
+    void compact_tombstones();
+
+    // online resize, let the readers access again the old storage while the new one is being built
+    void resize_online_open();
+
+    // copy the window before rebalancing it, and let the readers of its gates access the copy in the meanwhile
+    void snapshot_install();
+
     // sort the vectors to load in the task
     void sort_blkload_elts();
 
+    // fetch & execute the jobs of the parallel sort, until the current phase completes (worker #0) or the sort ends (helpers)
+    void sort_blkload_jobs();
+
     // remove all elts from the writers' queues (clean up)
     void clear_blkload_queues();
 
@@ -22,6 +22,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <mutex> // debug
+#include <new> // bad_alloc
 #include <numeric>
 #include <stdexcept>
 #include <thread> // debug
@@ -72,6 +73,8 @@ Storage::Storage(uint64_t segment_size, uint64_t pages_per_extent, uint64_t num_
 
 Storage::~Storage(){
     dealloc_workspace(&m_keys, &m_values, &m_segment_sizes, &m_memory_keys, &m_memory_values, &m_memory_sizes);
+    free(m_tombstones); m_tombstones = nullptr;
+    free(m_filters); m_filters = nullptr;
 }
 
 Storage& Storage::operator=(Storage&& storage){
@@ -86,6 +89,11 @@ Storage& Storage::operator=(Storage&& storage){
     m_memory_keys = storage.m_memory_keys; storage.m_memory_keys = nullptr;
     m_memory_values = storage.m_memory_values; storage.m_memory_values = nullptr;
     m_memory_sizes = storage.m_memory_sizes; storage.m_memory_sizes = nullptr;
+    free(m_tombstones); m_tombstones = storage.m_tombstones; storage.m_tombstones = nullptr;
+    free(m_filters); m_filters = storage.m_filters; storage.m_filters = nullptr;
+    m_filter_words = storage.m_filter_words;
+    m_filter_bits_per_key = storage.m_filter_bits_per_key;
+    m_filter_hashes = storage.m_filter_hashes;
 
     return *this;
 }
@@ -196,6 +204,8 @@ void Storage::extend(size_t num_segments_to_add){
     m_keys = (int64_t*) m_memory_keys->get_start_address();
     m_values = (int64_t*) m_memory_values->get_start_address();
     m_segment_sizes = (uint16_t*) m_memory_sizes->get_start_address();
+    resize_tombstones(num_segments_before, num_segments_after);
+    resize_filters(num_segments_before, num_segments_after);
 
     // update the properties
     m_number_segments = num_segments_after;
@@ -223,6 +233,163 @@ void Storage::dealloc_workspace(int64_t** keys, int64_t** values, decltype(m_seg
 }
 
 
+/*****************************************************************************
+ *                                                                           *
+ *   Tombstones                                                              *
+ *                                                                           *
+ *****************************************************************************/
+// number of words required by the bitmap of the tombstones. Always reserve space for two segments, as in alloc_workspace
+static size_t tombstones_num_words(size_t num_segments, size_t segment_capacity){
+    return (max<size_t>(2, num_segments) * segment_capacity + 63) / 64;
+}
+
+void Storage::enable_tombstones(){
+    if(m_tombstones != nullptr) return; // already enabled
+    m_tombstones = (uint64_t*) calloc(tombstones_num_words(m_number_segments, m_segment_capacity), sizeof(uint64_t));
+    if(m_tombstones == nullptr) throw std::bad_alloc();
+}
+
+void Storage::resize_tombstones(size_t num_segments_before, size_t num_segments_after){
+    if(m_tombstones == nullptr) return; // lazy deletes not enabled
+    size_t num_words_before = tombstones_num_words(num_segments_before, m_segment_capacity);
+    size_t num_words_after = tombstones_num_words(num_segments_after, m_segment_capacity);
+    if(num_words_before == num_words_after) return;
+
+    uint64_t* tombstones = (uint64_t*) realloc(m_tombstones, num_words_after * sizeof(uint64_t));
+    if(tombstones == nullptr) throw std::bad_alloc();
+    m_tombstones = tombstones;
+    if(num_words_after > num_words_before){
+        memset(m_tombstones + num_words_before, 0, (num_words_after - num_words_before) * sizeof(uint64_t));
+    }
+}
+
+size_t Storage::count_tombstones(size_t position_start, size_t position_end) const noexcept {
+    if(m_tombstones == nullptr || position_start >= position_end) return 0;
+
+    size_t result = 0;
+    const size_t word_first = position_start / 64;
+    const size_t word_last = (position_end -1) / 64; // inclusive
+    for(size_t i = word_first; i <= word_last; i++){
+        uint64_t word = m_tombstones[i];
+        if(i == word_first){ word &= (numeric_limits<uint64_t>::max() << (position_start % 64)); }
+        if(i == word_last && position_end % 64 != 0){ word &= (1ull << (position_end % 64)) -1; }
+        result += __builtin_popcountll(word);
+    }
+    return result;
+}
+
+size_t Storage::count_tombstones(size_t segment_id) const noexcept {
+    const size_t sz = m_segment_sizes[segment_id];
+    if(segment_id % 2 == 0){ // even segment, the elements are at the end
+        return count_tombstones((segment_id +1) * m_segment_capacity - sz, (segment_id +1) * m_segment_capacity);
+    } else { // odd segment, the elements are at the start
+        return count_tombstones(segment_id * m_segment_capacity, segment_id * m_segment_capacity + sz);
+    }
+}
+
+size_t Storage::compact_tombstones(size_t segment_start, size_t segment_end) noexcept {
+    if(m_tombstones == nullptr) return 0;
+    assert(segment_end <= m_number_segments && "Invalid segment");
+    size_t num_tombstones = 0;
+
+    for(size_t segment_id = segment_start; segment_id < segment_end; segment_id++){
+        const size_t count = count_tombstones(segment_id);
+        if(count == 0) continue; // nop
+
+        const size_t sz = m_segment_sizes[segment_id];
+        int64_t* __restrict keys = m_keys;
+        int64_t* __restrict values = m_values;
+        if(segment_id % 2 == 0){ // even segment, shift the surviving elements towards the end
+            size_t start = (segment_id +1) * m_segment_capacity - sz;
+            size_t write = (segment_id +1) * m_segment_capacity;
+            for(size_t read = write; read-- > start; ){
+                if(!is_tombstone(read)){
+                    write--;
+                    keys[write] = keys[read];
+                    values[write] = values[read];
+                }
+            }
+        } else { // odd segment, shift the surviving elements towards the start
+            size_t write = segment_id * m_segment_capacity;
+            for(size_t read = write, end = write + sz; read < end; read++){
+                if(!is_tombstone(read)){
+                    keys[write] = keys[read];
+                    values[write] = values[read];
+                    write++;
+                }
+            }
+        }
+
+        COUT_DEBUG("segment: " << segment_id << ", cardinality: " << sz << " -> " << sz - count);
+        m_segment_sizes[segment_id] = sz - count;
+        clear_tombstones(segment_id);
+        num_tombstones += count;
+    }
+
+    return num_tombstones;
+}
+
+void Storage::clear_tombstones(size_t segment_id) noexcept {
+    if(m_tombstones == nullptr) return;
+    const size_t position_start = segment_id * m_segment_capacity;
+    if(m_segment_capacity >= 64){ // the segment spans whole words
+        memset(m_tombstones + position_start / 64, 0, m_segment_capacity / 64 * sizeof(uint64_t));
+    } else { // the segment is a portion of a single word
+        uint64_t mask = ((1ull << m_segment_capacity) -1) << (position_start % 64);
+        m_tombstones[position_start / 64] &= ~mask;
+    }
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Lookup filters                                                          *
+ *                                                                           *
+ *****************************************************************************/
+// number of words required by the filters. As the tombstones, always reserve space for two segments
+static size_t filters_num_words(size_t num_segments, size_t words_per_segment){
+    return max<size_t>(2, num_segments) * words_per_segment;
+}
+
+void Storage::enable_filters(size_t bits_per_key){
+    if(m_filters != nullptr) return; // already enabled
+    if(bits_per_key == 0 || bits_per_key > 64) throw std::invalid_argument("the bits per key of the filters must be in [1, 64]");
+
+    // round the size of the filter to a power of 2, to map the hashes with a mask
+    m_filter_bits_per_key = bits_per_key;
+    m_filter_words = max<size_t>(1, hyperceil(m_segment_capacity * bits_per_key) / 64);
+    m_filter_hashes = min<size_t>(8, max<size_t>(1, round(bits_per_key * log(2.0)))); // the optimal number of hash functions is ln(2) * bits per key
+    m_filters = (uint64_t*) calloc(filters_num_words(m_number_segments, m_filter_words), sizeof(uint64_t));
+    if(m_filters == nullptr) throw std::bad_alloc();
+}
+
+void Storage::resize_filters(size_t num_segments_before, size_t num_segments_after){
+    if(m_filters == nullptr) return; // filters not enabled
+    size_t num_words_before = filters_num_words(num_segments_before, m_filter_words);
+    size_t num_words_after = filters_num_words(num_segments_after, m_filter_words);
+    if(num_words_before == num_words_after) return;
+
+    uint64_t* filters = (uint64_t*) realloc(m_filters, num_words_after * sizeof(uint64_t));
+    if(filters == nullptr) throw std::bad_alloc();
+    m_filters = filters;
+    if(num_words_after > num_words_before){
+        memset(m_filters + num_words_before, 0, (num_words_after - num_words_before) * sizeof(uint64_t));
+    }
+}
+
+void Storage::rebuild_filters(size_t segment_start, size_t segment_end) noexcept {
+    if(m_filters == nullptr) return;
+    COUT_DEBUG("segments: [" << segment_start << ", " << segment_end << ")");
+
+    memset(m_filters + segment_start * m_filter_words, 0, (segment_end - segment_start) * m_filter_words * sizeof(uint64_t));
+    for(size_t segment_id = segment_start; segment_id < segment_end; segment_id++){
+        const size_t sz = m_segment_sizes[segment_id];
+        const size_t start = (segment_id % 2 == 0) ? (segment_id +1) * m_segment_capacity - sz : segment_id * m_segment_capacity;
+        for(size_t i = start, end = start + sz; i < end; i++){
+            filter_insert(segment_id, m_keys[i]);
+        }
+    }
+}
+
 /*****************************************************************************
  *                                                                           *
  *   Properties                                                              *
@@ -269,7 +436,9 @@ size_t Storage::memory_footprint() const noexcept {
     size_t memory_keys = m_memory_keys != nullptr ? m_memory_keys->get_allocated_memory_size() : capacity() * sizeof(m_keys[0]);
     size_t memory_values = m_memory_values != nullptr ? m_memory_values->get_allocated_memory_size() : capacity() * sizeof(m_values[0]);
     size_t memory_sizes = m_memory_sizes != nullptr ? m_memory_sizes->get_allocated_memory_size() : capacity() * sizeof(m_segment_sizes[0]);
-    return memory_keys + memory_values + memory_sizes;
+    size_t memory_tombstones = m_tombstones != nullptr ? tombstones_num_words(m_number_segments, m_segment_capacity) * sizeof(uint64_t) : 0;
+    size_t memory_filters = m_filters != nullptr ? filters_num_words(m_number_segments, m_filter_words) * sizeof(uint64_t) : 0;
+    return memory_keys + memory_values + memory_sizes + memory_tombstones + memory_filters;
 }
 
 } // namespace
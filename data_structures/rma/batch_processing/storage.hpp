@@ -46,6 +46,11 @@ struct Storage {
     common::BufferedRewiredMemory* m_memory_keys = nullptr; // memory space used for the keys
     common::BufferedRewiredMemory* m_memory_values = nullptr; // memory space used for the values
     common::RewiredMemory* m_memory_sizes = nullptr; // memory space used for the segment cardinalities
+    uint64_t* m_tombstones = nullptr; // bitmap of the deleted slots, one bit per position in m_keys. Only present with the lazy deletes
+    uint64_t* m_filters = nullptr; // approximate membership filters, a Bloom filter of m_filter_words words for each segment. Only present with the lookup filters
+    uint32_t m_filter_words = 0; // number of words in the filter of a single segment
+    uint16_t m_filter_bits_per_key = 0; // number of bits per element requested for the filters
+    uint16_t m_filter_hashes = 0; // number of bits set in the filter for each key
     mutable ::common::SpinLock m_mutex; // used to protect rewiring by usage of multiple workers
 
 public:
@@ -81,6 +86,88 @@ public:
      */
     void extend(size_t num_segments);
 
+    /**
+     * Allocate the bitmap for the tombstones, enabling the lazy deletes
+     */
+    void enable_tombstones();
+
+    /**
+     * Whether the lazy deletes are enabled
+     */
+    bool tombstones_enabled() const noexcept { return m_tombstones != nullptr; }
+
+    /**
+     * Check whether the given position in m_keys/m_values has been marked as deleted
+     */
+    bool is_tombstone(size_t position) const noexcept;
+
+    /**
+     * Mark the given position in m_keys/m_values as deleted
+     */
+    void set_tombstone(size_t position) noexcept;
+
+    /**
+     * Count the number of tombstones in the interval of positions [position_start, position_end)
+     */
+    size_t count_tombstones(size_t position_start, size_t position_end) const noexcept;
+
+    /**
+     * Count the number of tombstones in the given segment
+     */
+    size_t count_tombstones(size_t segment_id) const noexcept;
+
+    /**
+     * Physically remove the tombstones from the segments in [segment_start, segment_end), shifting the surviving elements
+     * and updating the segment cardinalities. Segments without tombstones are left untouched.
+     * @return the number of tombstones removed
+     */
+    size_t compact_tombstones(size_t segment_start, size_t segment_end) noexcept;
+
+    /**
+     * Reset all tombstones in the given segment, without altering its content
+     */
+    void clear_tombstones(size_t segment_id) noexcept;
+
+    /**
+     * Reallocate the bitmap of the tombstones, from `num_segments_before' to `num_segments_after' segments. The bits of the
+     * new segments are all unset. Nop if the lazy deletes are not enabled.
+     */
+    void resize_tombstones(size_t num_segments_before, size_t num_segments_after);
+
+    /**
+     * Allocate an empty Bloom filter for each segment, sized for `bits_per_key' bits per element at full capacity. The
+     * filters need to be rebuilt, with #rebuild_filters, if the segments already contain some elements.
+     */
+    void enable_filters(size_t bits_per_key);
+
+    /**
+     * Whether the lookup filters are enabled
+     */
+    bool filters_enabled() const noexcept { return m_filters != nullptr; }
+
+    /**
+     * Check whether the given key may be stored in the segment. False positives are possible, false negatives are not.
+     * Always true when the filters are not enabled.
+     */
+    bool filter_contains(size_t segment_id, int64_t key) const noexcept;
+
+    /**
+     * Record the insertion of the given key in the filter of the segment. Nop if the filters are not enabled.
+     */
+    void filter_insert(size_t segment_id, int64_t key) noexcept;
+
+    /**
+     * Rebuild the filters of the segments in [segment_start, segment_end) from their current content. This also discards
+     * the keys that have been removed since the last rebuild. Nop if the filters are not enabled.
+     */
+    void rebuild_filters(size_t segment_start, size_t segment_end) noexcept;
+
+    /**
+     * Reallocate the filters, from `num_segments_before' to `num_segments_after' segments. The filters of the new segments
+     * are empty. Nop if the filters are not enabled.
+     */
+    void resize_filters(size_t num_segments_before, size_t num_segments_after);
+
     /**
      * Retrieve the number of segments per extent
      */
@@ -117,4 +204,60 @@ public:
     size_t memory_footprint() const noexcept;
 };
 
+/*****************************************************************************
+ *                                                                           *
+ *   Tombstones                                                              *
+ *                                                                           *
+ *****************************************************************************/
+inline bool Storage::is_tombstone(size_t position) const noexcept {
+    return m_tombstones != nullptr && (m_tombstones[position / 64] & (1ull << (position % 64))) != 0;
+}
+
+inline void Storage::set_tombstone(size_t position) noexcept {
+    m_tombstones[position / 64] |= (1ull << (position % 64));
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Lookup filters                                                          *
+ *                                                                           *
+ *****************************************************************************/
+namespace storage_details {
+// the finalizer of MurmurHash3, the bits of the key are spread over the whole word
+inline uint64_t filter_hash(int64_t key) noexcept {
+    uint64_t h = static_cast<uint64_t>(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+} // namespace storage_details
+
+inline bool Storage::filter_contains(size_t segment_id, int64_t key) const noexcept {
+    if(m_filters == nullptr) return true;
+    const uint64_t* __restrict filter = m_filters + segment_id * m_filter_words;
+    const uint64_t mask = static_cast<uint64_t>(m_filter_words) * 64 -1;
+    const uint64_t hash = storage_details::filter_hash(key);
+    const uint64_t h1 = hash & 0xFFFFFFFF, h2 = (hash >> 32) | 1; // double hashing
+    for(uint64_t i = 0; i < m_filter_hashes; i++){
+        uint64_t bit = (h1 + i * h2) & mask;
+        if((filter[bit / 64] & (1ull << (bit % 64))) == 0) return false;
+    }
+    return true;
+}
+
+inline void Storage::filter_insert(size_t segment_id, int64_t key) noexcept {
+    if(m_filters == nullptr) return;
+    uint64_t* __restrict filter = m_filters + segment_id * m_filter_words;
+    const uint64_t mask = static_cast<uint64_t>(m_filter_words) * 64 -1;
+    const uint64_t hash = storage_details::filter_hash(key);
+    const uint64_t h1 = hash & 0xFFFFFFFF, h2 = (hash >> 32) | 1;
+    for(uint64_t i = 0; i < m_filter_hashes; i++){
+        uint64_t bit = (h1 + i * h2) & mask;
+        filter[bit / 64] |= (1ull << (bit % 64));
+    }
+}
+
 } // namespace
@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "gate.hpp"
+#include "rebalancing_task.hpp"
+
+using namespace std;
+
+namespace data_structures::rma::batch_processing {
+
+chrono::steady_clock::time_point TaskScheduler::deadline(const RebalancingTask* task, Gate* gates, int64_t num_gates){
+    const bool is_resize = task->m_plan.m_operation != RebalanceOperation::REBALANCE;
+    const int64_t lock_length = is_resize ? num_gates : task->get_lock_length();
+    auto deadline = task->m_time_created + SLICE * static_cast<int64_t>(ceil(log2(lock_length)));
+
+    // deadline boost, many clients are waiting for this window
+    if(!is_resize && lock_length <= LARGE_WINDOW){
+        uint64_t num_waiters = 0;
+        for(int64_t lock_id = task->get_lock_start(), end = task->get_lock_end(); lock_id < end; lock_id++){
+            gates[lock_id].lock();
+            num_waiters += gates[lock_id].m_cold->m_queue.size();
+            gates[lock_id].unlock();
+        }
+        if(num_waiters >= WAITERS){ deadline -= BOOST; }
+    }
+
+    return deadline;
+}
+
+void TaskScheduler::sort(vector<RebalancingTask*>& tasks, Gate* gates, int64_t num_gates){
+    vector<pair<chrono::steady_clock::time_point, RebalancingTask*>> schedule;
+    schedule.reserve(tasks.size());
+    for(RebalancingTask* task : tasks){
+        schedule.emplace_back(deadline(task, gates, num_gates), task);
+    }
+
+    std::stable_sort(begin(schedule), end(schedule), [](const auto& t1, const auto& t2){ return t1.first < t2.first; });
+    for(size_t i = 0; i < schedule.size(); i++){ tasks[i] = schedule[i].second; }
+}
+
+bool TaskScheduler::is_rate_limited(const RebalancingTask* task, const vector<const RebalancingTask*>& executing){
+    if(task->m_plan.m_operation != RebalanceOperation::REBALANCE || task->get_lock_length() <= LARGE_WINDOW) return false;
+
+    uint64_t num_large_tasks = 0;
+    for(const RebalancingTask* execution_task : executing){
+        num_large_tasks += (execution_task->get_lock_length() > LARGE_WINDOW);
+    }
+
+    return num_large_tasks >= MAX_LARGE_TASKS;
+}
+
+} // namespace
@@ -0,0 +1,64 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <vector>
+
+namespace data_structures::rma::batch_processing {
+
+// forward declarations
+class Gate;
+class RebalancingTask;
+
+/**
+ * Order of execution for the tasks in the to-do list of the RebalancingMaster. Each task is given a virtual deadline:
+ * its creation time plus a slack of SLICE for each doubling of its window, so that the short windows go first while
+ * the long ones age. The deadline of a short window (up to LARGE_WINDOW gates) is anticipated by BOOST when at least
+ * WAITERS client threads are waiting on its gates. At most MAX_LARGE_TASKS longer windows can be executed concurrently
+ * by the same shard.
+ */
+class TaskScheduler {
+public:
+    constexpr static std::chrono::microseconds SLICE { 500 };
+    constexpr static std::chrono::microseconds BOOST { 2000 };
+    constexpr static uint64_t WAITERS = 4;
+    constexpr static int64_t LARGE_WINDOW = 64;
+    constexpr static uint64_t MAX_LARGE_TASKS = 1;
+
+    /**
+     * Compute the virtual deadline of a task. A resize spans all `num_gates' of the array, while the window of a
+     * rebalance is still accounted with its current length when it has not been computed yet, as it can only grow.
+     * The caller must not hold the locks of the gates.
+     */
+    static std::chrono::steady_clock::time_point deadline(const RebalancingTask* task, Gate* gates, int64_t num_gates);
+
+    /**
+     * Sort the tasks by their virtual deadline. The order of the tasks with the same deadline is preserved.
+     */
+    static void sort(std::vector<RebalancingTask*>& tasks, Gate* gates, int64_t num_gates);
+
+    /**
+     * Check whether the given task needs to be postponed, as too many long windows are already in execution
+     */
+    static bool is_rate_limited(const RebalancingTask* task, const std::vector<const RebalancingTask*>& executing);
+};
+
+} // namespace
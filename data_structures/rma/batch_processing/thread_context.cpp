@@ -146,7 +146,7 @@ uint64_t ThreadContext::epoch() const noexcept {
 
 thread_local int ClientContext::m_thread_id = -1;
 
-ClientContext::ClientContext() : m_hosted(false), m_local(nullptr), m_spare(nullptr) {
+ClientContext::ClientContext() : m_hosted(false), m_local(nullptr), m_spare(nullptr), m_append_last_key(numeric_limits<int64_t>::min()), m_append_streak(0) {
 
 }
 
@@ -162,11 +162,15 @@ void ClientContext::enter(){
     m_hosted = true;
     m_local = new ClientContextQueue();
     m_spare = new ClientContextQueue();
+    m_append_last_key = numeric_limits<int64_t>::min();
+    m_append_streak = 0;
+    m_finger = Finger{};
 }
 
 void ClientContext::exit(){
     COUT_DEBUG("Exit [thread_id: " << m_thread_id << "]");
     if(!m_hosted) RAISE_EXCEPTION(Exception, "Already unregistered");
+    assert(m_appends.empty() && "The staged appends should have been flushed first");
     m_hosted = false;
     delete m_local; m_local = nullptr;
     delete m_spare; m_spare = nullptr;
@@ -35,6 +35,7 @@ namespace data_structures::rma::batch_processing {
 // Forward declarations
 class ClientContext;
 class ClientContextQueue;
+class Gate;
 class PackedMemoryArray;
 class RebalancingMaster;
 class ThreadContext;
@@ -97,6 +98,20 @@ public:
     using bitset_t = common::Bitset;
     bitset_t* m_bitset = nullptr; // bitset to keep track of which segments to rebalance in the writer loop
 
+    // Append fast path, see PackedMemoryArray::append_enqueue
+    std::vector<std::pair<int64_t, int64_t>> m_appends; // staged insertions, sorted by key, not yet visible to the other threads
+    int64_t m_append_last_key; // the last key inserted by this thread
+    uint64_t m_append_streak; // number of consecutive insertions with increasing keys
+
+    // Finger, the last gate accessed by this thread, see PackedMemoryArray::finger_find
+    struct Finger {
+        const Gate* m_gates = nullptr; // the array of gates where the finger is valid
+        uint64_t m_timestamp = 0; // when the array of gates has been installed, to detect a new array allocated at the same address
+        uint64_t m_gate_id = 0; // the last gate accessed
+        int64_t m_fence_low_key = 0; // fence keys of the gate, when last accessed
+        int64_t m_fence_high_key = 0;
+    } m_finger;
+
 public:
     ClientContext();
 
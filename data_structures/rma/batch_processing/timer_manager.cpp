@@ -17,11 +17,13 @@
 
 #include "timer_manager.hpp"
 
-#include <event2/event.h>
-#include <mutex>
+#include <algorithm>
+#include <cassert>
+#include <iostream>
 
 #include "common/errorhandling.hpp"
 #include "common/miscellaneous.hpp"
+#include "gate.hpp"
 #include "packed_memory_array.hpp"
 
 using namespace common;
@@ -31,13 +33,6 @@ namespace data_structures::rma::batch_processing {
 
 #define ERROR(msg) RAISE_EXCEPTION(Exception, msg)
 
-// Callback to retrieve all pending events stored in the libevent's queue
-static int collect_events(const struct event_base*, const struct event* event,  void*  /* std::vector<struct event*>* */vector_events); // forward decl
-
-// synchronisation to start/stop the background thread
-static std::mutex g_mutex;
-static std::condition_variable g_condvar;
-
 /*****************************************************************************
  *                                                                           *
  *   DEBUG                                                                   *
@@ -58,59 +53,42 @@ extern mutex _debug_mutex; // PackedMemoryArray.cpp
  *                                                                           *
  *****************************************************************************/
 
-TimerManager::TimerManager(PackedMemoryArray* instance) : m_instance(instance), m_queue(nullptr), m_eventloop_exec(false) {
-    libevent_init();
-    m_queue = event_base_new();
-    if(m_queue == nullptr) ERROR("Cannot initialise the libevent queue");
-
+TimerManager::TimerManager(PackedMemoryArray* instance) : m_instance(instance), m_time_origin(chrono::steady_clock::now()), m_current_tick(0), m_num_timers(0) {
+    for(int level = 0; level < WHEEL_NUM_LEVELS; level++){
+        for(int slot = 0; slot < WHEEL_NUM_SLOTS; slot++){
+            m_wheel[level][slot] = nullptr;
+        }
+    }
 }
 
 TimerManager::~TimerManager(){
     stop();
-    event_base_free(m_queue); m_queue = nullptr;
-    libevent_shutdown();
 }
 
 void TimerManager::start(){
     COUT_DEBUG("Starting...");
-    unique_lock<mutex> lock(g_mutex);
+    scoped_lock<mutex> lock(m_mutex);
     if(m_background_thread.joinable()) ERROR("Invalid state. The background thread is already running");
 
-    auto timer = duration2timeval(0s); // fire the event immediately
-    int rc = event_base_once(m_queue, /* fd, ignored */ -1, EV_TIMEOUT, &TimerManager::callback_start, /* argument */ this, &timer);
-    if(rc != 0) ERROR("Cannot initialise the event loop");
+    // remove the leftovers of a previous run
+    Command discard[64];
+    while(m_queue.pop(discard, 64) > 0){ /* nop */ }
 
+    m_current_tick = time2tick(chrono::steady_clock::now());
     m_background_thread = thread(&TimerManager::main_thread, this);
-
-    g_condvar.wait(lock, [this](){ return m_eventloop_exec; });
     COUT_DEBUG("Started");
 }
 
-void TimerManager::callback_start(int fd, short flags, void* event_argument){
-    COUT_DEBUG("Event loop started");
-
-    TimerManager* instance = reinterpret_cast<TimerManager*>(event_argument);
-    instance->m_eventloop_exec = true;
-    g_condvar.notify_all();
-}
-
 void TimerManager::stop(){
     COUT_DEBUG("Stopping...");
-    scoped_lock<mutex> lock(g_mutex);
+    scoped_lock<mutex> lock(m_mutex);
     if(!m_background_thread.joinable()) return;
-    int rc = event_base_loopbreak(m_queue);
-    if(rc != 0) ERROR("event_base_loopbreak");
+    m_queue.push(Command{ Command::Type::Stop, nullptr, 0, chrono::steady_clock::time_point{}, nullptr });
     m_background_thread.join();
 
-    // remove all enqueued events still in the queue
-    std::vector<struct event*> pending_events;
-    rc = event_base_foreach_event(m_queue, collect_events, &pending_events);
-    if(rc != 0) ERROR("event_base_foreach_event");
-    COUT_DEBUG("Pending events to remove: " << pending_events.size());
-    for(auto e : pending_events){
-        free(event_get_callback_arg(e));
-        event_free(e);
-    }
+    // remove all timers still pending
+    COUT_DEBUG("Pending timers to remove: " << m_num_timers);
+    wheel_clear(/* fire ? */ false);
 
     COUT_DEBUG("Stopped");
 }
@@ -124,135 +102,251 @@ void TimerManager::main_thread(){
     COUT_DEBUG("Service thread started");
     set_thread_name("Timer Manager");
 
-    // delegate libevent to run the loop
-    int rc = event_base_loop(m_queue, EVLOOP_NO_EXIT_ON_EMPTY);
-    if(rc != 0){ cerr << "[TimerManager::main_thread] event_base_loop rc: " << rc << endl; }
+    constexpr uint64_t batch_capacity = 64;
+    Command batch[batch_capacity];
+    bool stop_loop = false;
+
+    do {
+        // Fetch the next batch of commands. Sleep until the next timer expires, or indefinitely if there are no timers armed
+        uint64_t batch_size = 0;
+        if(m_num_timers == 0){
+            batch_size = m_queue.wait_and_pop(batch, batch_capacity);
+        } else {
+            auto now = chrono::steady_clock::now();
+            auto wakeup = tick2time(wheel_next_tick());
+            if(wakeup <= now){
+                batch_size = m_queue.pop(batch, batch_capacity);
+            } else {
+                batch_size = m_queue.wait_and_pop(batch, batch_capacity, wakeup - now);
+            }
+        }
+
+        for(uint64_t i = 0; i < batch_size && !stop_loop; i++){
+            Command& command = batch[i];
+            switch(command.m_type){
+            case Command::Type::Arm: {
+                Gate* gate = command.m_gate;
+                COUT_DEBUG("gate: " << gate->lock_id() << ", arm the timer at tick " << command.m_payload);
+                if(gate->m_cold->m_timer.m_level >= 0){ wheel_remove(gate); } // re-arm
+                if(m_num_timers == 0){ // the wheel is empty, skip the ticks elapsed while sleeping
+                    m_current_tick = std::max(m_current_tick, time2tick(chrono::steady_clock::now()));
+                }
+                gate->m_cold->m_timer.m_expiry = command.m_payload;
+                gate->m_cold->m_timer.m_time_last_rebal = command.m_time_last_rebal;
+                wheel_insert(gate);
+            } break;
+            case Command::Type::Flush: {
+                COUT_DEBUG("Flush, pending timers: " << m_num_timers);
+                wheel_clear(/* fire ? */ true);
+                fire();
+                command.m_producer->set_value();
+            } break;
+            case Command::Type::Discard: {
+                COUT_DEBUG("Discard the timers of the gates in [" << command.m_gate << ", " << (command.m_gate + command.m_payload) << ")");
+                wheel_discard(command.m_gate, command.m_payload);
+                command.m_producer->set_value();
+            } break;
+            case Command::Type::Stop: {
+                stop_loop = true;
+            } break;
+            }
+        }
+
+        if(!stop_loop){
+            wheel_advance(time2tick(chrono::steady_clock::now()));
+            fire(); // notify all expired timers at once
+        }
+    } while (!stop_loop);
 
     COUT_DEBUG("Service thread stopped");
 }
 
-/*****************************************************************************
- *                                                                           *
- *   Worker API                                                              *
- *                                                                           *
- *****************************************************************************/
-void TimerManager::delay_rebalance(uint64_t gate_id, chrono::steady_clock::time_point time_last_rebal, std::chrono::microseconds when_to_rebalance){
-    COUT_DEBUG("gate: " << gate_id << ", delay the rebalance of " << when_to_rebalance.count() << " microseconds");
-
-    assert(m_background_thread.joinable() && "The service is not running");
-    TimeoutEvent* event_payload = (TimeoutEvent*) malloc(sizeof(TimeoutEvent));
-    assert(event_payload != nullptr && "cannot allocate the timer event");
-    if(event_payload == nullptr) throw std::bad_alloc{};
-
-    struct event* event = event_new(m_queue, /* fd, ignored */ -1, EV_TIMEOUT, callback_invoke, event_payload);
-    if(event == nullptr) throw std::bad_alloc{};
-
-    // the payload to associate to the event
-    event_payload->m_event = event;
-    event_payload->m_instance = m_instance;
-    event_payload->m_gate_id = gate_id;
-    event_payload->m_time_last_rebal = time_last_rebal;
-
-    // time when the event should be invoked
-    struct timeval timer = duration2timeval(when_to_rebalance);
-    int rc = event_add(event, &timer);
-    if(rc != 0) {
-        COUT_DEBUG_FORCE("FATAL: delay_rebalance, event_add failed");
-        std::abort(); // not sure what we can do here
-    }
+void TimerManager::fire(){
+    if(m_expired.empty()) return;
+    COUT_DEBUG("timeout, number of gates: " << m_expired.size());
+    m_instance->timeout(m_expired);
+    m_expired.clear();
 }
 
-// static method, trampoline to PMA::timeout(gate_id, time_last_rebal)
-void TimerManager::callback_invoke(evutil_socket_t /* fd == -1 */, short /* flags */, void* argument){
-    assert(argument != nullptr && "Invalid pointer");
-
-    TimeoutEvent* event = reinterpret_cast<TimeoutEvent*>(argument);
-    PackedMemoryArray* instance = event->m_instance;
-    uint64_t gate_id = event->m_gate_id;
-    auto time_last_rebal = event->m_time_last_rebal;
-
-    // Release the memory associated to the event
-    event_free(event->m_event); event->m_event = nullptr;
-    free(event); event = nullptr;
+uint64_t TimerManager::time2tick(chrono::steady_clock::time_point time) const {
+    if(time <= m_time_origin) return 0;
+    return (time - m_time_origin) / TICK_DURATION; // round down
+}
 
-    // Jump to the implementation of the timeout
-    COUT_DEBUG("timeout, gate_id: " << gate_id);
-    instance->timeout(gate_id, time_last_rebal);
+chrono::steady_clock::time_point TimerManager::tick2time(uint64_t tick) const {
+    return m_time_origin + tick * TICK_DURATION;
 }
 
 /*****************************************************************************
  *                                                                           *
- *   Flush                                                                   *
+ *   Timing wheel                                                            *
  *                                                                           *
  *****************************************************************************/
-
-static int collect_events(const struct event_base*, const struct event* event,  void*  /* std::vector<struct event*>* */ argument){
-    // event_get_events: bad naming, it retrieves the flags associated to an event.
-    // The guard should protect against
-    if(event_get_events(event) == EV_TIMEOUT){
-        auto vector_elements = reinterpret_cast<std::vector<struct event*>*>(argument);
-        vector_elements->push_back(const_cast<struct event*>(event));
+void TimerManager::wheel_insert(Gate* gate){
+    assert(gate != nullptr && "Null pointer");
+    Gate::Timer& timer = gate->m_cold->m_timer;
+    assert(timer.m_level == -1 && "The timer is already armed");
+
+    // find the level of the wheel for the given expiry
+    uint64_t expiry = std::max(timer.m_expiry, m_current_tick);
+    uint64_t delta = expiry - m_current_tick;
+    int level = 0;
+    while(level < WHEEL_NUM_LEVELS -1 && delta >= (1ull << (WHEEL_LEVEL_BITS * (level +1)))){ level++; }
+    if(delta >= (1ull << (WHEEL_LEVEL_BITS * WHEEL_NUM_LEVELS))){ // beyond the span of the wheel, it will be re-inserted once reached
+        expiry = m_current_tick + (1ull << (WHEEL_LEVEL_BITS * WHEEL_NUM_LEVELS)) -1;
     }
-    return 0;
+    int slot = (expiry >> (WHEEL_LEVEL_BITS * level)) & (WHEEL_NUM_SLOTS -1);
+
+    // push front
+    Gate*& head = m_wheel[level][slot];
+    timer.m_prev = nullptr;
+    timer.m_next = head;
+    if(head != nullptr){ head->m_cold->m_timer.m_prev = gate; }
+    head = gate;
+    timer.m_level = level;
+    timer.m_slot = slot;
+    m_num_timers++;
 }
 
-void TimerManager::callback_flush(int fd, short flags, void* /* FlushEvent */ argument_untyped){
-    FlushEvent* flush_event = reinterpret_cast<FlushEvent*>(argument_untyped);
-    vector<struct event*> pending_events;
+void TimerManager::wheel_remove(Gate* gate){
+    assert(gate != nullptr && "Null pointer");
+    Gate::Timer& timer = gate->m_cold->m_timer;
+    assert(timer.m_level >= 0 && "The timer is not armed");
 
-    int rc = event_base_foreach_event(flush_event->m_queue, collect_events, &pending_events);
-    if(rc != 0) {
-        COUT_DEBUG_FORCE("FATAL: delay_rebalance, event_add failed");
-        std::abort(); // not sure what we can do here
+    if(timer.m_prev != nullptr){
+        timer.m_prev->m_cold->m_timer.m_next = timer.m_next;
+    } else {
+        assert(m_wheel[timer.m_level][timer.m_slot] == gate);
+        m_wheel[timer.m_level][timer.m_slot] = timer.m_next;
     }
+    if(timer.m_next != nullptr){ timer.m_next->m_cold->m_timer.m_prev = timer.m_prev; }
 
-    COUT_DEBUG("Pending events: " << pending_events.size());
+    timer.m_next = timer.m_prev = nullptr;
+    timer.m_level = timer.m_slot = -1;
+    assert(m_num_timers > 0);
+    m_num_timers--;
+}
 
-    for(auto e : pending_events){
-        event_del(e); // make the event non pending, it will be freed by the callback
-        auto cb = event_get_callback(e);
-        auto arg = event_get_callback_arg(e);
-        cb(-1, EV_TIMEOUT, arg);
+void TimerManager::wheel_cascade(int level, int slot){
+    Gate* gate = m_wheel[level][slot];
+    m_wheel[level][slot] = nullptr;
+
+    while(gate != nullptr){
+        Gate* next = gate->m_cold->m_timer.m_next;
+        gate->m_cold->m_timer.m_next = gate->m_cold->m_timer.m_prev = nullptr;
+        gate->m_cold->m_timer.m_level = gate->m_cold->m_timer.m_slot = -1;
+        m_num_timers--;
+        wheel_insert(gate);
+        gate = next;
     }
+}
 
-    // notify the invoking thread
-   flush_event->m_producer->set_value();
+void TimerManager::wheel_advance(uint64_t tick){
+    while(m_current_tick <= tick && m_num_timers > 0){
+        const uint64_t t = m_current_tick;
+
+        // move the timers of the upper levels to the lower levels, once a level completed a round
+        for(int level = 1; level < WHEEL_NUM_LEVELS; level++){
+            if(((t >> (WHEEL_LEVEL_BITS * (level -1))) & (WHEEL_NUM_SLOTS -1)) != 0) break;
+            wheel_cascade(level, (t >> (WHEEL_LEVEL_BITS * level)) & (WHEEL_NUM_SLOTS -1));
+        }
+
+        // expire the timers of the current tick
+        const int slot = t & (WHEEL_NUM_SLOTS -1);
+        Gate* gate = m_wheel[0][slot];
+        m_wheel[0][slot] = nullptr;
+        while(gate != nullptr){
+            Gate* next = gate->m_cold->m_timer.m_next;
+            gate->m_cold->m_timer.m_next = gate->m_cold->m_timer.m_prev = nullptr;
+            gate->m_cold->m_timer.m_level = gate->m_cold->m_timer.m_slot = -1;
+            m_num_timers--;
+            if(gate->m_cold->m_timer.m_expiry <= t){
+                m_expired.push_back(gate);
+            } else { // the timer was beyond the span of the wheel
+                wheel_insert(gate);
+            }
+            gate = next;
+        }
+
+        m_current_tick++;
+    }
 
-   // release the memory associated to the event
-   event_free(flush_event->m_event);
-   free(flush_event);
-   flush_event = nullptr;
+    if(m_num_timers == 0){ m_current_tick = std::max(m_current_tick, tick +1); }
 }
 
-void TimerManager::flush(){
-    COUT_DEBUG("Flushing the queue of events");
-    assert(m_background_thread.joinable() && "The service is not running");
+uint64_t TimerManager::wheel_next_tick() const {
+    // check the first level of the wheel, up to the next cascade
+    const uint64_t next_cascade = (m_current_tick | (WHEEL_NUM_SLOTS -1)) +1;
+    for(uint64_t t = m_current_tick; t < next_cascade; t++){
+        if(m_wheel[0][t & (WHEEL_NUM_SLOTS -1)] != nullptr) return t;
+    }
+    return next_cascade;
+}
 
-    std::promise<void> producer;
-    std::future<void> consumer = producer.get_future();
+void TimerManager::wheel_clear(bool fire){
+    for(int level = 0; level < WHEEL_NUM_LEVELS; level++){
+        for(int slot = 0; slot < WHEEL_NUM_SLOTS; slot++){
+            Gate* gate = m_wheel[level][slot];
+            m_wheel[level][slot] = nullptr;
+            while(gate != nullptr){
+                Gate* next = gate->m_cold->m_timer.m_next;
+                gate->m_cold->m_timer.m_next = gate->m_cold->m_timer.m_prev = nullptr;
+                gate->m_cold->m_timer.m_level = gate->m_cold->m_timer.m_slot = -1;
+                if(fire){ m_expired.push_back(gate); }
+                gate = next;
+            }
+        }
+    }
+    m_num_timers = 0;
+}
 
-    FlushEvent* event_payload = (FlushEvent*) malloc(sizeof(FlushEvent));
-    if(event_payload == nullptr) throw std::bad_alloc{};
+void TimerManager::wheel_discard(Gate* gates, uint64_t num_gates){
+    for(int level = 0; level < WHEEL_NUM_LEVELS; level++){
+        for(int slot = 0; slot < WHEEL_NUM_SLOTS; slot++){
+            Gate* gate = m_wheel[level][slot];
+            while(gate != nullptr){
+                Gate* next = gate->m_cold->m_timer.m_next;
+                if(gate >= gates && gate < gates + num_gates){ wheel_remove(gate); }
+                gate = next;
+            }
+        }
+    }
+}
 
-    struct event* event = event_new(m_queue, /* fd, ignored */ -1, EV_TIMEOUT, TimerManager::callback_flush, event_payload);
-    if(event == nullptr) throw std::bad_alloc{};
-    event_payload->m_event = event;
-    event_payload->m_queue = m_queue;
-    event_payload->m_producer = &producer;
+/*****************************************************************************
+ *                                                                           *
+ *   Worker API                                                              *
+ *                                                                           *
+ *****************************************************************************/
+void TimerManager::delay_rebalance(Gate* gate, chrono::steady_clock::time_point time_last_rebal, std::chrono::microseconds when_to_rebalance){
+    assert(gate != nullptr && "Null pointer");
+    COUT_DEBUG("gate: " << gate->lock_id() << ", delay the rebalance of " << when_to_rebalance.count() << " microseconds");
+    assert(m_background_thread.joinable() && "The service is not running");
 
-    // activate it immediately
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
+    uint64_t expiry = time2tick(chrono::steady_clock::now() + when_to_rebalance) +1; // never fire before the deadline
+    m_queue.push(Command{ Command::Type::Arm, gate, expiry, time_last_rebal, nullptr });
+}
 
-    int rc = event_add(event, &timeout);
-    if(rc != 0) {
-        COUT_DEBUG_FORCE("FATAL: flush, event_add failed");
-        std::abort(); // not sure what we can do here
-    }
+void TimerManager::send_and_wait(Command command){
+    scoped_lock<mutex> lock(m_mutex);
+    if(!m_background_thread.joinable()) return; // the service is not running, there are no timers armed
 
+    std::promise<void> producer;
+    std::future<void> consumer = producer.get_future();
+    command.m_producer = &producer;
+    m_queue.push(command);
     consumer.wait(); // Zzz
+}
+
+void TimerManager::flush(){
+    COUT_DEBUG("Flushing the pending timers");
+    send_and_wait(Command{ Command::Type::Flush, nullptr, 0, chrono::steady_clock::time_point{}, nullptr });
+    COUT_DEBUG("Done");
+}
 
+void TimerManager::discard(Gate* gates, uint64_t num_gates){
+    COUT_DEBUG("Discarding the timers of " << num_gates << " gates");
+    send_and_wait(Command{ Command::Type::Discard, gates, num_gates, chrono::steady_clock::time_point{}, nullptr });
     COUT_DEBUG("Done");
 }
 
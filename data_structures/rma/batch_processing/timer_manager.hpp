@@ -18,50 +18,91 @@
 #pragma once
 
 #include <chrono>
+#include <cinttypes>
 #include <future>
+#include <mutex>
 #include <thread>
+#include <vector>
 
-struct event; // libevent forward decl.
-struct event_base; // libevent forward decl.
+#include "common/mpsc_queue.hpp"
 
 namespace data_structures::rma::batch_processing {
 
-class PackedMemoryArray; // forward declaration
+// forward declarations
+class Gate;
+class PackedMemoryArray;
 
 /**
- * A service thread to create and handle multiple timers. When a timer expires, the service invokes pma->timeout(gate_id, time_last_rebal) to
- * issue a global rebalance of the specified gate_id.
+ * A service thread to create and handle multiple timers. When some timers expire, the service invokes pma->timeout(gates) to
+ * issue a global rebalance of the related gates.
+ *
+ * The timers are embedded in the gates (Gate::m_timer) and are kept in a hierarchical timing wheel, with O(1) insertion and
+ * removal. The wheel is owned by the service thread, the other threads interact with it by sending commands through a
+ * lock-free queue.
  */
 class TimerManager {
+    // The resolution of the timers
+    constexpr static std::chrono::microseconds TICK_DURATION { 100 };
+    constexpr static int WHEEL_LEVEL_BITS = 6; // 64 slots per level
+    constexpr static int WHEEL_NUM_SLOTS = 1 << WHEEL_LEVEL_BITS; // number of slots in each level of the wheel
+    constexpr static int WHEEL_NUM_LEVELS = 4; // with a tick of 100 us, the wheel spans up to ~28 minutes
+
+    // Commands sent to the service thread
+    struct Command {
+        enum class Type { Arm, Flush, Discard, Stop };
+        Type m_type;
+        Gate* m_gate; // Arm: the gate to rebalance; Discard: the first gate to remove
+        uint64_t m_payload; // Arm: the tick when the timer expires; Discard: the number of gates to remove
+        std::chrono::steady_clock::time_point m_time_last_rebal; // Arm: the time the gate was last rebalanced
+        std::promise<void>* m_producer; // Flush & Discard: the thread to notify once the command has been executed
+    };
+
     PackedMemoryArray* m_instance; // pma instance associated to this TimerManager
-    struct event_base* m_queue; // libevent's queue
+    ::common::MPSCQueue<Command> m_queue; // commands for the service thread
     std::thread m_background_thread; // handle to the background thread
-    bool m_eventloop_exec; // true when the service thread is running the event loop
-
-    // The events enqueued
-    struct BaseEvent {  struct event* m_event; }; // base class, every event enqueued must contain a pointer to the libevent's event
-    struct TimeoutEvent : public BaseEvent { // timeout event
-        PackedMemoryArray* m_instance; // the instance owning this queue
-        uint64_t m_gate_id; // the id of the gate to rebalance
-        std::chrono::steady_clock::time_point m_time_last_rebal; // the time the gate was last rebalanced
-    };
-    struct FlushEvent : public BaseEvent { // flush event
-        struct event_base* m_queue; // the libevent's queue handle
-        std::promise<void>* m_producer; // the thread to notify once the flush has been completed
-    };
+    std::mutex m_mutex; // sync start/stop with the threads waiting for the execution of a command
+    const std::chrono::steady_clock::time_point m_time_origin; // the time corresponding to the tick 0
+
+    // The timing wheel. Only accessed by the service thread.
+    Gate* m_wheel[WHEEL_NUM_LEVELS][WHEEL_NUM_SLOTS]; // the heads of the lists of the timers in each slot
+    uint64_t m_current_tick; // the next tick to process
+    uint64_t m_num_timers; // number of timers currently armed
+    std::vector<Gate*> m_expired; // workspace, the timers expired in the last advance of the wheel
 
 protected:
     // Method executed by the background thread, it runs the event loop
     void main_thread();
 
-    // Notify the thread that started the service thread that the event loop is running
-    static void callback_start(int fd, short flags, void* /* TimerManager instance */ event_argument);
+    // Convert a time point in ticks (rounded down, the tick in progress at that time) and vice versa
+    uint64_t time2tick(std::chrono::steady_clock::time_point time) const;
+    std::chrono::steady_clock::time_point tick2time(uint64_t tick) const;
+
+    // Send a command to the service thread and wait for its execution
+    void send_and_wait(Command command);
 
-    // The callback invoked by the libevent event loop, trampoline to `handle_callback'
-    static void callback_invoke(int fd, short flags, void* /* TimerEvent */  event_argument);
+    // Insert the timer of the given gate in the wheel
+    void wheel_insert(Gate* gate);
 
-    // Execute all pending events in the libevent queue
-    static void callback_flush(int fd, short flags, void* /* FlushEvent */ event_argument);
+    // Remove the timer of the given gate from the wheel
+    void wheel_remove(Gate* gate);
+
+    // Process all ticks up to the given one (inclusive), appending the expired timers to m_expired
+    void wheel_advance(uint64_t tick);
+
+    // Move the timers of the given slot to the lower levels of the wheel
+    void wheel_cascade(int level, int slot);
+
+    // Remove all timers from the wheel. Append them to m_expired if `fire' is true
+    void wheel_clear(bool fire);
+
+    // Remove from the wheel the timers of the gates in the range [gates, gates + num_gates)
+    void wheel_discard(Gate* gates, uint64_t num_gates);
+
+    // The tick when the service thread should wake up to process the next timer
+    uint64_t wheel_next_tick() const;
+
+    // Notify the PMA of the timers expired
+    void fire();
 
 public:
     // Constructor
@@ -77,11 +118,15 @@ public:
     // Stop the service / background thread
     void stop();
 
-    // Schedule a new delayed rebalance
-    void delay_rebalance(uint64_t gate_id, std::chrono::steady_clock::time_point time_last_rebal, std::chrono::microseconds when_to_rebalance);
+    // Schedule a new delayed rebalance. The timer is embedded in the gate.
+    // Precondition: the caller holds the lock of the gate
+    void delay_rebalance(Gate* gate, std::chrono::steady_clock::time_point time_last_rebal, std::chrono::microseconds when_to_rebalance);
 
-    // Synchronously flush all events to complete
+    // Synchronously fire all pending timers
     void flush();
+
+    // Synchronously remove the timers of the gates in the range [gates, gates + num_gates), e.g. before the gates are deallocated
+    void discard(Gate* gates, uint64_t num_gates);
 };
 
 
@@ -0,0 +1,90 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "window_snapshot.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "storage.hpp"
+
+using namespace std;
+
+namespace data_structures::rma::batch_processing {
+
+WindowSnapshot::WindowSnapshot(const Storage& storage, int64_t segment_start, int64_t segment_end, int64_t fence_low_key, int64_t fence_high_key, uint64_t gate_end,
+        const vector<pair<int64_t, int64_t>>& pending) :
+        m_fence_low_key(fence_low_key), m_fence_high_key(fence_high_key), m_gate_end(gate_end){
+    assert(segment_start % 2 == 0 && segment_end % 2 == 0 && "The window should be composed by pairs of segments");
+    const int64_t segment_capacity = storage.m_segment_capacity;
+    const bool skip_tombstones = storage.tombstones_enabled();
+
+    uint64_t cardinality = 0;
+    for(int64_t segment_id = segment_start; segment_id < segment_end; segment_id++){ cardinality += storage.m_segment_sizes[segment_id]; }
+    m_keys.reserve(cardinality + pending.size());
+    m_values.reserve(cardinality + pending.size());
+
+    // in a pair of segments, the elements of the even segment are stored at its end and those of the odd segment at its start
+    for(int64_t segment_id = segment_start; segment_id < segment_end; segment_id += 2){
+        int64_t start = (segment_id +1) * segment_capacity - storage.m_segment_sizes[segment_id];
+        int64_t end = (segment_id +1) * segment_capacity + storage.m_segment_sizes[segment_id +1];
+        for(int64_t i = start; i < end; i++){
+            if(skip_tombstones && storage.is_tombstone(i)) continue;
+            m_keys.push_back(storage.m_keys[i]);
+            m_values.push_back(storage.m_values[i]);
+        }
+    }
+
+    // merge the pending elements
+    if(!pending.empty()){
+        assert(is_sorted(begin(pending), end(pending)) && "The pending elements should be sorted");
+        int64_t i = static_cast<int64_t>(m_keys.size()) -1; // last element copied from the storage
+        int64_t j = static_cast<int64_t>(pending.size()) -1; // last pending element
+        m_keys.resize(m_keys.size() + pending.size());
+        m_values.resize(m_values.size() + pending.size());
+        for(int64_t k = static_cast<int64_t>(m_keys.size()) -1; j >= 0; k--){ // from the back, in place
+            if(i >= 0 && m_keys[i] > pending[j].first){
+                m_keys[k] = m_keys[i]; m_values[k] = m_values[i]; i--;
+            } else {
+                m_keys[k] = pending[j].first; m_values[k] = pending[j].second; j--;
+            }
+        }
+    }
+}
+
+int64_t WindowSnapshot::find(int64_t key) const {
+    auto it = lower_bound(begin(m_keys), end(m_keys), key);
+    if(it == end(m_keys) || *it != key) return -1;
+    return m_values[it - begin(m_keys)];
+}
+
+void WindowSnapshot::sum(int64_t min, int64_t max, ::data_structures::Interface::SumResult* __restrict result) const {
+    assert(result != nullptr && "Null pointer");
+    int64_t pos_start = lower_bound(begin(m_keys), end(m_keys), min) - begin(m_keys);
+    int64_t pos_end = upper_bound(begin(m_keys) + pos_start, end(m_keys), max) - begin(m_keys);
+    if(pos_start >= pos_end) return; // no elements in the interval
+
+    for(int64_t i = pos_start; i < pos_end; i++){
+        result->m_sum_keys += m_keys[i];
+        result->m_sum_values += m_values[i];
+    }
+    result->m_first_key = std::min(result->m_first_key, m_keys[pos_start]);
+    result->m_last_key = m_keys[pos_end -1];
+    result->m_num_elements += (pos_end - pos_start);
+}
+
+} // namespace
@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <utility>
+#include <vector>
+
+#include "data_structures/interface.hpp"
+
+namespace data_structures::rma::batch_processing {
+
+struct Storage; // forward declaration
+
+/**
+ * A read-only copy of the elements in a window, taken by the workers before rebalancing it. While the window is being
+ * rebalanced, its gates refer to the snapshot and the readers (find & sum) are served from it rather than waiting for
+ * the rebalance to complete. A snapshot is released through the garbage collector, as readers may still access it
+ * after the gates have been released.
+ */
+class WindowSnapshot {
+    std::vector<int64_t> m_keys; // sorted
+    std::vector<int64_t> m_values;
+
+public:
+    const int64_t m_fence_low_key; // the minimum key of the window (inclusive)
+    const int64_t m_fence_high_key; // the maximum key of the window (inclusive)
+    const uint64_t m_gate_end; // the first gate after the window
+
+    /**
+     * Copy the elements in the segments [segment_start, segment_end) of the given storage, skipping the tombstones, together
+     * with the elements already visible to the readers but not stored in the segments, i.e. those moved by the master from
+     * the delta buffers of the gates to the bulk loading queues. The latter are expected to be sorted by key.
+     */
+    WindowSnapshot(const Storage& storage, int64_t segment_start, int64_t segment_end, int64_t fence_low_key, int64_t fence_high_key, uint64_t gate_end,
+            const std::vector<std::pair<int64_t, int64_t>>& pending = std::vector<std::pair<int64_t, int64_t>>{});
+
+    /**
+     * Check whether the given key belongs to the window of the snapshot
+     */
+    bool contains(int64_t key) const { return m_fence_low_key <= key && key <= m_fence_high_key; }
+
+    /**
+     * Retrieve the value associated to the given key, or -1 if not present
+     */
+    int64_t find(int64_t key) const;
+
+    /**
+     * Add to the partial result the elements in the interval [min, max]
+     */
+    void sum(int64_t min, int64_t max, ::data_structures::Interface::SumResult* __restrict result) const;
+
+    /**
+     * Number of elements in the snapshot
+     */
+    uint64_t size() const { return m_keys.size(); }
+};
+
+} // namespace
@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Kernels to move the elements in bulk during the rebalances. The streaming variant writes the destination with
+ * non-temporal stores, bypassing the caches: it is meant for the large windows of the global rebalances and the
+ * resizes, whose output is not going to be read again by the rebalancer and would otherwise evict from the LLC the
+ * data that the client threads are using. The merge kernel interleaves the elements already in the array with those
+ * being bulk loaded.
+ */
+namespace data_structures::rma::common::copy_kernels {
+
+// How far ahead of the cursor to prefetch the source, in number of elements (= 8 cache lines)
+constexpr static size_t PREFETCH_DISTANCE = 64;
+
+// Below this number of elements, the non-temporal stores are not worth it, as they would only partially fill a
+// write combining buffer
+constexpr static size_t STREAM_MIN_ELEMENTS = 16;
+
+/**
+ * Hint the hardware to load in the caches the cache line containing the given address
+ */
+inline void prefetch(const void* address){
+    __builtin_prefetch(address, /* read */ 0, /* locality */ 0);
+}
+
+/**
+ * Copy `num_elements' from the source to the destination, through the caches
+ */
+inline void copy(int64_t* __restrict destination, const int64_t* __restrict source, size_t num_elements){
+    memcpy(destination, source, num_elements * sizeof(destination[0]));
+}
+
+/**
+ * Copy `num_elements' from the source to the destination, with non-temporal stores. The caller must invoke #fence
+ * before the destination is made visible to other threads.
+ */
+inline void stream(int64_t* __restrict destination, const int64_t* __restrict source, size_t num_elements){
+#if defined(__SSE2__)
+    if(num_elements < STREAM_MIN_ELEMENTS){ copy(destination, source, num_elements); return; }
+
+    size_t i = 0;
+    if(reinterpret_cast<uintptr_t>(destination) % 16 != 0){ // align the destination to 16 bytes
+        destination[0] = source[0];
+        i = 1;
+    }
+    for(const size_t start = i; i + 2 <= num_elements; i += 2){
+        if((i - start) % 8 == 0) prefetch(source + i + PREFETCH_DISTANCE); // once per cache line
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(destination + i), value);
+    }
+    if(i < num_elements){ destination[i] = source[i]; }
+#else
+    copy(destination, source, num_elements);
+#endif
+}
+
+/**
+ * Branch-free merge of the run of elements <input_keys, input_values> with the run of pairs <key, value> to bulk load.
+ * It writes the output from position `output_index' up to `output_end' (excl.) and stops as soon as either input run
+ * is exhausted. For equal keys, the pairs to bulk load come first. The indices are updated with the number of
+ * elements consumed and produced.
+ */
+inline void merge(int64_t* __restrict output_keys, int64_t* __restrict output_values, int64_t& output_index, int64_t output_end,
+        const int64_t* __restrict input_keys, const int64_t* __restrict input_values, int64_t& input_index, int64_t input_end,
+        const std::pair<int64_t, int64_t>* __restrict pairs, int64_t& pairs_index, int64_t pairs_end){
+    int64_t k = output_index, i = input_index, j = pairs_index;
+
+    // each step consumes exactly one element from either run, so that `num_steps' steps can never exceed any of the
+    // bounds and the inner loop only depends on the comparison of the keys, resolved with conditional moves
+    int64_t num_steps = std::min(output_end - k, std::min(input_end - i, pairs_end - j));
+    while(num_steps > 0){
+        for(int64_t s = 0; s < num_steps; s++){
+            const int64_t input_key = input_keys[i];
+            const int64_t pair_key = pairs[j].first;
+            const bool from_input = input_key < pair_key;
+            output_keys[k] = from_input ? input_key : pair_key;
+            output_values[k] = from_input ? input_values[i] : pairs[j].second;
+            i += from_input;
+            j += !from_input;
+            k++;
+        }
+
+        num_steps = std::min(output_end - k, std::min(input_end - i, pairs_end - j));
+    }
+
+    output_index = k;
+    input_index = i;
+    pairs_index = j;
+}
+
+/**
+ * Order the non-temporal stores issued so far with respect to the following stores
+ */
+inline void fence(){
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+}
+
+} // namespace
@@ -35,10 +35,10 @@ namespace data_structures::rma::common {
  * 2 * rho_h < (<=?) theta_h : logic constraint for resizing, since C > theta_h => 2*C > rho_h
  */
 struct DensityBounds {
-    const double rho_0; // lower density at the lowest level of the tree
-    const double rho_h; // lower density at the highest level of the tree
-    const double theta_h; // upper density at the highest level of the tree
-    const double theta_0; // upper density at the lowest level of the tree
+    double rho_0; // lower density at the lowest level of the tree
+    double rho_h; // lower density at the highest level of the tree
+    double theta_h; // upper density at the highest level of the tree
+    double theta_0; // upper density at the lowest level of the tree
 
     /**
      * Automatically fetch the density bounds from the configuration/console params
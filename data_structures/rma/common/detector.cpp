@@ -98,7 +98,7 @@ void Detector::dump() const {
 
 template<int increment>
 void Detector::update(size_t segment_id, int64_t predecessor, int64_t successor){
-    update<increment>(segment_id, predecessor, successor, ++m_counter);
+    update<increment>(segment_id, predecessor, successor, m_counter.fetch_add(1, memory_order_relaxed) +1);
 }
 
 template<int increment>
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cinttypes>
 #include <cstddef>
 #include <iostream>
@@ -32,7 +33,7 @@ private:
     uint64_t m_capacity;
     const uint32_t m_sizeof_entry; // the size of each entry, in terms of uint64_t multiples
     const uint32_t m_modulus; // number of recordings per segment
-    int64_t m_counter =0; // internal counter
+    std::atomic<int64_t> m_counter =0; // internal counter, shared by all writers in the parallel variants
 
     template<int increment>
     void update(size_t segment_id, int64_t predecessor, int64_t successor);
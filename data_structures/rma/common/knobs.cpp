@@ -29,6 +29,7 @@ Knobs::Knobs(){
     m_sequence_threshold = 6;
     m_max_sequence_counter = 8;
     m_max_segment_counter = 10;
+    m_search_strategy = segment_kernels::SearchStrategy::BINARY;
     m_sampling_rate = 1;
     m_sampling_percentage = 100;
     m_thresholds_switch = 64; // there is some (forgotten...) rationale around this value
@@ -45,6 +46,18 @@ void Knobs::set_thresholds_switch(int32_t value){
     m_thresholds_switch = value;
 }
 
+static const char* to_string(segment_kernels::SearchStrategy strategy){
+    using segment_kernels::SearchStrategy;
+    switch(strategy){
+    case SearchStrategy::LINEAR: return "linear";
+    case SearchStrategy::SIMD_LINEAR: return "simd";
+    case SearchStrategy::BINARY: return "binary";
+    case SearchStrategy::INTERPOLATION: return "interpolation";
+    case SearchStrategy::ADAPTIVE: return "adaptive";
+    default: return "unknown";
+    }
+}
+
 ostream& operator<<(ostream& out, const Knobs& settings){
     out << "{APMA/Knobs rank ts: " << settings.get_rank_threshold() << ", " <<
             "segment ts: " << settings.get_segment_threshold() << ", " <<
@@ -52,6 +65,7 @@ ostream& operator<<(ostream& out, const Knobs& settings){
             "segment max count: " << settings.get_max_segment_counter() << ", " <<
             "sequence max count: " << settings.get_max_sequence_counter() << ", " <<
             "sampling rate: " << settings.get_sampling_rate() << ", " <<
+            "search strategy: " << to_string(settings.m_search_strategy) << ", " <<
             "[apma_parallel] thresholds switch: " << settings.get_thresholds_switch() << "}";
 
     return out;
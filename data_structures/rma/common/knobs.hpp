@@ -20,6 +20,8 @@
 #include <cinttypes>
 #include <ostream>
 
+#include "segment_kernels.hpp"
+
 namespace data_structures::rma::common {
 
 struct Knobs {
@@ -29,6 +31,7 @@ public:
     uint8_t m_sequence_threshold; // the minimum value of the counter to infer a contiguous hammered sequence
     uint8_t m_max_sequence_counter; // the maximum value for the counter for the predictor/detector in the bwd/fwd states
     uint8_t m_max_segment_counter; // the maximum value for the counter for for the predictor/detector in the insert/delete states
+    segment_kernels::SearchStrategy m_search_strategy; // how to search a key inside a segment or a gate. Only used in rma_batch
 private:
     double m_sampling_rate; // the sample rate to forward an update to the detector, in [0, 1]
     int32_t m_sampling_percentage; // sample rate in percentage, in [0, 100]
@@ -0,0 +1,327 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "learned_index.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#include "segment_kernels.hpp"
+
+using namespace std;
+
+namespace data_structures::rma::common {
+
+/*****************************************************************************
+ *                                                                           *
+ *   DEBUG                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+//#define DEBUG
+#define COUT_DEBUG_FORCE(msg) std::cout << "[LearnedIndex::" << __FUNCTION__ << "] " << msg << std::endl
+#if defined(DEBUG)
+    #define COUT_DEBUG(msg) COUT_DEBUG_FORCE(msg)
+#else
+    #define COUT_DEBUG(msg)
+#endif
+
+
+/*****************************************************************************
+ *                                                                           *
+ *   Initialisation                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+LearnedIndex::LearnedIndex(uint64_t error_bound, uint64_t num_segments) :
+        m_error_bound(error_bound), m_capacity(0), m_keys(nullptr), m_models(nullptr), m_model_keys(nullptr), m_num_models(0) {
+    if(error_bound == 0){ throw std::invalid_argument("Invalid error bound: 0"); }
+    rebuild(num_segments);
+}
+
+LearnedIndex::~LearnedIndex(){
+    free(m_keys); m_keys = nullptr;
+    free(m_models); m_models = nullptr;
+    free(m_model_keys); m_model_keys = nullptr;
+}
+
+SegmentIndex* LearnedIndex::create(uint64_t num_segments) const {
+    return new LearnedIndex(m_error_bound, num_segments);
+}
+
+void LearnedIndex::rebuild(uint64_t N){
+    if(N == 0) throw std::invalid_argument("Invalid number of keys: 0");
+
+    if(static_cast<int64_t>(N) != m_capacity){
+        free(m_keys); m_keys = nullptr;
+        free(m_models); m_models = nullptr;
+        free(m_model_keys); m_model_keys = nullptr;
+        // in the worst case, there is one model per key
+        int rc = posix_memalign((void**) &m_keys, /* alignment */ 64,  /* size */ N * sizeof(int64_t));
+        if(rc != 0) { throw std::bad_alloc(); }
+        rc = posix_memalign((void**) &m_models, /* alignment */ 64,  /* size */ N * sizeof(Model));
+        if(rc != 0) { throw std::bad_alloc(); }
+        rc = posix_memalign((void**) &m_model_keys, /* alignment */ 64,  /* size */ N * sizeof(int64_t));
+        if(rc != 0) { throw std::bad_alloc(); }
+        m_capacity = N;
+    }
+
+    for(int64_t i = 0; i < m_capacity; i++){ m_keys[i] = numeric_limits<int64_t>::max(); }
+    reset_models();
+
+    COUT_DEBUG("capacity: " << m_capacity);
+}
+
+void LearnedIndex::reset_models(){
+    // the window of the predictions covers the whole index, until the models are trained
+    m_models[0].m_key = numeric_limits<int64_t>::min();
+    m_models[0].m_slope = 0;
+    m_models[0].m_start = 0;
+    m_models[0].m_error = m_capacity;
+    m_model_keys[0] = numeric_limits<int64_t>::min();
+    m_num_models = 1;
+}
+
+int64_t LearnedIndex::error_bound() const noexcept {
+    return m_error_bound;
+}
+
+int64_t LearnedIndex::num_models() const noexcept {
+    return m_num_models;
+}
+
+size_t LearnedIndex::memory_footprint() const {
+    return m_capacity * sizeof(int64_t) + m_num_models * (sizeof(Model) + sizeof(int64_t));
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Training                                                                *
+ *                                                                           *
+ *****************************************************************************/
+
+void LearnedIndex::fit(int64_t start, int64_t end, vector<Model>& output) const {
+    // shrinking cone: keep the range of slopes such that all the keys seen so far are predicted within the error bound
+    const double error_bound = m_error_bound;
+    int64_t first = start;
+    while(first < end){
+        const double x0 = m_keys[first];
+        double slope_min = 0;
+        double slope_max = numeric_limits<double>::infinity();
+
+        int64_t i = first +1;
+        while(i < end){
+            double dx = static_cast<double>(m_keys[i]) - x0;
+            double dy = i - first;
+            if(dx <= 0){ // repeated keys
+                if(dy > error_bound) break;
+            } else {
+                double lower = max(slope_min, (dy - error_bound) / dx);
+                double upper = min(slope_max, (dy + error_bound) / dx);
+                if(lower > upper) break;
+                slope_min = lower;
+                slope_max = upper;
+            }
+            i++;
+        }
+
+        Model model;
+        model.m_key = m_keys[first];
+        model.m_slope = isinf(slope_max) ? slope_min : (slope_min + slope_max) / 2;
+        model.m_start = first;
+        model.m_error = 0;
+
+        // the actual error, including the rounding of #predict
+        for(int64_t j = first; j < i; j++){
+            model.m_error = max<int64_t>(model.m_error, abs(predict(model, m_keys[j]) - j));
+        }
+
+        COUT_DEBUG("model: [" << first << ", " << i << "), key: " << model.m_key << ", slope: " << model.m_slope << ", error: " << model.m_error);
+        output.push_back(model);
+        first = i;
+    }
+}
+
+void LearnedIndex::train(uint64_t num_threads){
+    // segment 0 is only reached when the key is <= than the minimum, there is no need to model it
+    if(m_capacity <= 1){ reset_models(); return; }
+    const int64_t num_keys = m_capacity -1;
+
+    num_threads = max<int64_t>(1, min<int64_t>(num_threads, num_keys / TRAIN_MIN_KEYS_PER_THREAD));
+    vector<vector<Model>> partitions(num_threads);
+    auto train_partition = [this, &partitions, num_keys, num_threads](uint64_t partition_id){
+        int64_t keys_per_thread = num_keys / num_threads;
+        int64_t odd_threads = num_keys % num_threads;
+        int64_t start = 1 + partition_id * keys_per_thread + std::min<int64_t>(partition_id, odd_threads);
+        int64_t end = start + keys_per_thread + (partition_id < static_cast<uint64_t>(odd_threads));
+        fit(start, end, partitions[partition_id]);
+    };
+
+    if(num_threads == 1){
+        train_partition(0);
+    } else {
+        vector<thread> threads;
+        for(uint64_t i = 0; i < num_threads; i++){ threads.emplace_back(train_partition, i); }
+        for(auto& t : threads){ t.join(); }
+    }
+
+    // concatenate the models of all partitions
+    m_num_models = 0;
+    for(auto& partition : partitions){
+        for(auto& model : partition){
+            m_models[m_num_models] = model;
+            m_model_keys[m_num_models] = model.m_key;
+            m_num_models++;
+        }
+    }
+    assert(m_num_models <= num_keys);
+
+    COUT_DEBUG("capacity: " << m_capacity << ", threads: " << num_threads << ", models: " << m_num_models);
+}
+
+int64_t LearnedIndex::predict(const Model& model, int64_t key) const noexcept {
+    double offset = model.m_slope * (static_cast<double>(key) - static_cast<double>(model.m_key));
+    // avoid overflows in the conversion to an integer
+    offset = std::max<double>(-m_capacity, std::min<double>(offset, m_capacity));
+    return std::max<int64_t>(0, std::min<int64_t>(model.m_start + static_cast<int64_t>(offset), m_capacity -1));
+}
+
+LearnedIndex::Model& LearnedIndex::get_model(int64_t position) const noexcept {
+    auto it = upper_bound(m_models, m_models + m_num_models, position, [](int64_t position, const Model& model){
+        return position < model.m_start;
+    });
+    return it == m_models ? m_models[0] : *(it -1);
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Separator keys                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+void LearnedIndex::set_separator_key(uint64_t segment_id, int64_t key){
+    assert(static_cast<int64_t>(segment_id) < m_capacity && "Index out of bounds");
+    m_keys[segment_id] = key;
+
+    // keep the error bound of the model consistent with the new key
+    if(segment_id > 0){
+        Model& model = get_model(segment_id);
+        int64_t error = abs(predict(model, key) - static_cast<int64_t>(segment_id));
+        if(error > model.m_error){ model.m_error = error; }
+    }
+
+    assert(get_separator_key(segment_id) == key);
+}
+
+int64_t LearnedIndex::get_separator_key(uint64_t segment_id) const {
+    assert(static_cast<int64_t>(segment_id) < m_capacity && "Index out of bounds");
+    return m_keys[segment_id];
+}
+
+int64_t LearnedIndex::minimum() const noexcept {
+    return m_keys[0];
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Find                                                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+template<bool inclusive>
+int64_t LearnedIndex::search(int64_t key) const noexcept {
+    assert(m_capacity > 1 && key >= m_keys[0]);
+    auto satisfies = [key](int64_t separator){ return inclusive ? separator <= key : separator < key; };
+
+    // select the model
+    int64_t model_id = 0;
+    if(m_num_models > 1){
+        model_id = segment_kernels::upper_bound(m_model_keys, m_num_models, key, m_num_models);
+        if(model_id > 0) model_id--;
+    }
+    const Model& model = m_models[model_id];
+
+    // candidates around the prediction
+    int64_t position = predict(model, key);
+    int64_t error = model.m_error;
+    int64_t start = std::max<int64_t>(1, position - error);
+    int64_t end = std::min<int64_t>(m_capacity, position + error +1);
+
+    // correction, the candidates may have been invalidated by an update of the separator keys
+    if(start > 1 && !satisfies(m_keys[start -1])) start = 1;
+    if(end < m_capacity && satisfies(m_keys[end])) end = m_capacity;
+
+    size_t length = end - start;
+    return start + (inclusive ?
+            segment_kernels::upper_bound(m_keys + start, length, key, length) :
+            segment_kernels::lower_bound(m_keys + start, length, key, length));
+}
+
+uint64_t LearnedIndex::find(int64_t key) const noexcept {
+    if(key <= m_keys[0] || m_capacity == 1) return 0; // easy!
+    return search</* inclusive ? */ true>(key) -1;
+}
+
+uint64_t LearnedIndex::find_first(int64_t key) const noexcept {
+    if(key <= m_keys[0] || m_capacity == 1) return 0; // easy!
+    return search</* inclusive ? */ false>(key) -1;
+}
+
+uint64_t LearnedIndex::find_last(int64_t key) const noexcept {
+    if(key < m_keys[0] || m_capacity == 1) return 0; // easy!
+    return search</* inclusive ? */ true>(key) -1;
+}
+
+/*****************************************************************************
+ *                                                                           *
+ *   Dump                                                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+void LearnedIndex::dump(std::ostream& out, bool* integrity_check) const {
+    out << "[Index] learned, error bound: " << m_error_bound << ", number of models: " << m_num_models <<
+            ", capacity (number of entries indexed): " << m_capacity << ", minimum: " << minimum() << "\n";
+
+    for(int64_t i = 0; i < m_num_models; i++){
+        const Model& model = m_models[i];
+        int64_t end = (i +1 < m_num_models) ? m_models[i +1].m_start : m_capacity;
+        out << "  [" << i << "] segments: [" << model.m_start << ", " << end << "), key: " << model.m_key << ", slope: " << model.m_slope << ", error: " << model.m_error << "\n";
+    }
+
+    for(int64_t i = 1; i < m_capacity; i++){
+        if(m_keys[i] < m_keys[i -1]){
+            out << " (ERROR: separator keys not sorted, segment " << i << ": " << m_keys[i] << ", previous segment: " << m_keys[i -1] << ")\n";
+            if(integrity_check) *integrity_check = false;
+        }
+    }
+}
+
+void LearnedIndex::dump() const {
+    dump(cout);
+}
+
+std::ostream& operator<<(std::ostream& out, const LearnedIndex& index){
+    index.dump(out);
+    return out;
+}
+
+} // namespace
@@ -0,0 +1,163 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <ostream>
+#include <vector>
+
+#include "segment_index.hpp"
+
+namespace data_structures::rma::common {
+
+/**
+ * A learned index over the separator keys, in the spirit of the PGM index. The positions of the separator keys are
+ * approximated with a sequence of linear models, each fit to a contiguous run of keys such that the maximum error
+ * between the predicted and the actual position of any key in the run does not exceed a given bound. A lookup picks
+ * the model for the key, predicts its position and completes the search among the 2 * error + 1 candidates around
+ * the prediction.
+ *
+ * The models are trained (#train) once all the separator keys of a new index have been set, that is at each resize.
+ * Afterwards, updates to the separator keys (#set_separator_key) only widen the error bound of the model covering the
+ * segment, when needed. Should a concurrent update invalidate the candidates of a lookup, the search is extended to
+ * the whole index.
+ */
+class LearnedIndex final : public SegmentIndex {
+public:
+    // The default bound on the error of the predicted positions
+    constexpr static uint64_t DEFAULT_ERROR_BOUND = 8;
+
+private:
+    // Min number of separator keys to assign to each thread when training the models in parallel
+    constexpr static int64_t TRAIN_MIN_KEYS_PER_THREAD = 16384;
+
+    /**
+     * A linear model, approximating the position of the keys in [m_start, next model->m_start)
+     */
+    struct Model {
+        int64_t m_key; // the first key of the run, when the model has been fit
+        double m_slope; // number of positions per unit of key
+        int64_t m_start; // the position of the first key of the run
+        int64_t m_error; // the max absolute error of the predictions, for the keys in the run
+    };
+
+    const int64_t m_error_bound; // the bound on the error of the predictions, when training the models
+    int64_t m_capacity; // the number of segments/keys in the index
+    int64_t* m_keys; // the separator keys, m_keys[0] is the minimum
+    Model* m_models; // the linear models
+    int64_t* m_model_keys; // the first key of each model, to select the model for a key
+    int64_t m_num_models; // the number of linear models
+
+    // Predict the position of the given key, according to the model
+    int64_t predict(const Model& model, int64_t key) const noexcept;
+
+    // Retrieve the model covering the given position
+    Model& get_model(int64_t position) const noexcept;
+
+    // Fit the linear models for the keys in [start, end)
+    void fit(int64_t start, int64_t end, std::vector<Model>& output) const;
+
+    // Number of keys that are less than (inclusive = false) or less or equal than (inclusive = true) the given key
+    template<bool inclusive>
+    int64_t search(int64_t key) const noexcept;
+
+    // Reset the index to a single model, whose predictions span the whole index
+    void reset_models();
+
+public:
+    /**
+     * Initialise the index with the given bound on the error and capacity
+     */
+    LearnedIndex(uint64_t error_bound = DEFAULT_ERROR_BOUND, uint64_t num_segments = 1);
+
+    /**
+     * Destructor
+     */
+    ~LearnedIndex() override;
+
+    /**
+     * Create a new (empty) index with the same error bound, to contain `num_segments'
+     */
+    SegmentIndex* create(uint64_t num_segments) const override;
+
+    /**
+     * Rebuild the index to contain `num_segments'. The models need to be trained again.
+     */
+    void rebuild(uint64_t num_segments) override;
+
+    /**
+     * Fit the linear models to the current separator keys, splitting the keys among `num_threads'
+     */
+    void train(uint64_t num_threads = 1) override;
+
+    /**
+     * Set the separator key associated to the given segment
+     */
+    void set_separator_key(uint64_t segment_id, int64_t key) override;
+
+    /**
+     * Get the separator key associated to the given segment
+     */
+    int64_t get_separator_key(uint64_t segment_id) const override;
+
+    /**
+     * Return a segment_id that contains the given key. If there are no repetitions in the indexed data structure,
+     * this will be the only candidate segment for the given key.
+     */
+    uint64_t find(int64_t key) const noexcept override;
+
+    /**
+     * Return the first segment id that may contain the given key
+     */
+    uint64_t find_first(int64_t key) const noexcept override;
+
+    /**
+     * Return the last segment id that may contain the given key
+     */
+    uint64_t find_last(int64_t key) const noexcept override;
+
+    /**
+     * Retrieve the minimum stored in the index
+     */
+    int64_t minimum() const noexcept override;
+
+    /**
+     * Retrieve the bound on the error of the predictions
+     */
+    int64_t error_bound() const noexcept;
+
+    /**
+     * Retrieve the number of linear models
+     */
+    int64_t num_models() const noexcept;
+
+    /**
+     * Retrieve the memory footprint of this index, in bytes
+     */
+    size_t memory_footprint() const override;
+
+    /**
+     * Dump the fields of the index
+     */
+    void dump(std::ostream& out, bool* integrity_check = nullptr) const override;
+    void dump() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const LearnedIndex& index);
+
+} // namespace
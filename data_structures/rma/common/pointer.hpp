@@ -51,6 +51,7 @@ public:
     }
 
     uint64_t& timestamp() { return m_timestamp; }
+    uint64_t timestamp() const { return m_timestamp; }
 };
 
 } // namespace
@@ -0,0 +1,104 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <ostream>
+
+namespace data_structures::rma::common {
+
+/**
+ * Route a key to the segment (or the gate) that may contain it, according to the separator keys of the segments.
+ * The separator key of a segment is the minimum stored in that segment, the separator key of the first segment is
+ * the minimum of the whole index.
+ *
+ * Implementations:
+ * - StaticIndex, a B-Tree over the separator keys;
+ * - LearnedIndex, a piecewise linear model over the separator keys, with an error bounded correction.
+ *
+ * The separator keys can be altered by the rebalancer while the client threads are routing their keys: a lookup
+ * never accesses memory outside the index, but its result is only a hint, the callers are expected to check the
+ * fence keys of the returned segment/gate.
+ */
+class SegmentIndex {
+public:
+    /**
+     * Destructor
+     */
+    virtual ~SegmentIndex();
+
+    /**
+     * Create a new index of the same kind, with the same settings, to contain `num_segments'
+     */
+    virtual SegmentIndex* create(uint64_t num_segments) const = 0;
+
+    /**
+     * Rebuild the index to contain `num_segments'
+     */
+    virtual void rebuild(uint64_t num_segments) = 0;
+
+    /**
+     * Invoked once all separator keys of a (re)built index have been set, before it is made visible to the client
+     * threads. It can use up to `num_threads' to refresh the internal structure of the index.
+     */
+    virtual void train(uint64_t num_threads = 1) = 0;
+
+    /**
+     * Set the separator key associated to the given segment
+     */
+    virtual void set_separator_key(uint64_t segment_id, int64_t key) = 0;
+
+    /**
+     * Get the separator key associated to the given segment
+     */
+    virtual int64_t get_separator_key(uint64_t segment_id) const = 0;
+
+    /**
+     * Return a segment_id that contains the given key. If there are no repetitions in the indexed data structure,
+     * this will be the only candidate segment for the given key.
+     */
+    virtual uint64_t find(int64_t key) const noexcept = 0;
+
+    /**
+     * Return the first segment id that may contain the given key
+     */
+    virtual uint64_t find_first(int64_t key) const noexcept = 0;
+
+    /**
+     * Return the last segment id that may contain the given key
+     */
+    virtual uint64_t find_last(int64_t key) const noexcept = 0;
+
+    /**
+     * Retrieve the minimum stored in the index
+     */
+    virtual int64_t minimum() const noexcept = 0;
+
+    /**
+     * Retrieve the memory footprint of this index, in bytes
+     */
+    virtual size_t memory_footprint() const = 0;
+
+    /**
+     * Dump the content of the index
+     */
+    virtual void dump(std::ostream& out, bool* integrity_check = nullptr) const = 0;
+};
+
+} // namespace
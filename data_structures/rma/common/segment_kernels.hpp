@@ -0,0 +1,326 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Kernels to search, insert and remove an element inside a single segment of the PMA. They are shared by all
+ * RMA variants (baseline, one_by_one, batch_processing) and operate on the raw arrays of keys and values:
+ * - even segments store their elements at the end of the segment, in [capacity - size, capacity);
+ * - odd segments store their elements at the start of the segment, in [0, size).
+ *
+ * The search first narrows the window with a branch-free binary search, with a number of steps fixed at compile
+ * time for the most common segment capacities, and then counts the remaining candidates with a vectorised compare.
+ * The elements are shifted with a block move (memmove) rather than an element-at-a-time loop. The same searches
+ * also serve the point lookups and locate the boundaries of the range scans, over a pair of adjacent segments
+ * (even + odd), whose elements are contiguous in memory: in this case the capacity to pass is twice the capacity of
+ * a single segment.
+ *
+ * The strategy of the search can be selected per call (SearchStrategy): the default, BINARY, is the one described
+ * above. INTERPOLATION probes the position of the key from the minimum & maximum of the candidates, and completes
+ * the search with a vectorised linear scan around the probe, reverting to the binary search when the keys turn out
+ * to be skewed. ADAPTIVE picks among them according to the number of candidates and the spread of their keys.
+ */
+namespace data_structures::rma::common::segment_kernels {
+
+// Below this number of candidates, the search only performs a linear (vectorised) count
+constexpr static size_t LINEAR_WINDOW = 16;
+
+// Max number of windows, of LINEAR_WINDOW keys, scanned from the probe of an interpolation search before reverting to
+// the binary search
+constexpr static size_t INTERPOLATION_MAX_WINDOWS = 4;
+
+// With the adaptive strategy, the interpolation search is attempted only with at least this number of candidates ...
+constexpr static size_t INTERPOLATION_MIN_KEYS = 256;
+
+// ... and only if the median of the candidates is within this number of positions from where it would be if the keys
+// were evenly spread, that is, within the reach of the scan from the probe
+constexpr static size_t INTERPOLATION_MAX_SKEW = INTERPOLATION_MAX_WINDOWS * LINEAR_WINDOW;
+
+/**
+ * How to search a key among the elements of a segment
+ */
+enum class SearchStrategy : uint8_t {
+    LINEAR, // scalar scan, from the start of the segment
+    SIMD_LINEAR, // vectorised count of all elements
+    BINARY, // branch-free binary search, completed by a vectorised count
+    INTERPOLATION, // interpolation probe, completed by a vectorised scan around the probe
+    ADAPTIVE, // choose among the above according to the number of candidates and the spread of the keys
+};
+
+namespace details {
+
+/**
+ * Count the number of elements in keys[0, n) that are less than (inclusive = false) or less or equal than
+ * (inclusive = true) the given key. The result is exact only because the keys are sorted.
+ */
+template<bool inclusive>
+inline size_t count(const int64_t* __restrict keys, size_t n, int64_t key){
+    size_t result = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i vkey = _mm256_set1_epi64x(key);
+    for( ; i + 4 <= n; i += 4){
+        __m256i vkeys = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        // inclusive: keys[i] <= key <=> !(keys[i] > key); exclusive: keys[i] < key <=> key > keys[i]
+        __m256i cmp = inclusive ? _mm256_cmpgt_epi64(vkeys, vkey) : _mm256_cmpgt_epi64(vkey, vkeys);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(cmp));
+        result += inclusive ? 4 - __builtin_popcount(mask) : __builtin_popcount(mask);
+    }
+#endif
+    for( ; i < n; i++){ // branch free, the compiler is free to vectorise it
+        result += inclusive ? (keys[i] <= key) : (keys[i] < key);
+    }
+    return result;
+}
+
+/**
+ * Branch-free binary search over keys[0, n), reducing the candidates to at most LINEAR_WINDOW elements in
+ * `num_steps' iterations. When num_steps is a constant, the compiler fully unrolls the loop.
+ */
+template<bool inclusive>
+inline size_t search(const int64_t* __restrict keys, size_t n, int64_t key, int num_steps){
+    if(n <= LINEAR_WINDOW) return count<inclusive>(keys, n, key);
+
+    const int64_t* base = keys;
+    size_t length = n;
+    for(int i = 0; i < num_steps; i++){
+        size_t half = length / 2;
+        bool move_right = inclusive ? (base[half] <= key) : (base[half] < key);
+        base = move_right ? base + half : base;
+        length -= half;
+    }
+    assert(length <= LINEAR_WINDOW && "Not enough steps to narrow the window");
+
+    return (base - keys) + count<inclusive>(base, length, key);
+}
+
+// Number of halving steps to reduce `capacity' candidates to at most LINEAR_WINDOW
+constexpr int num_steps(size_t capacity){
+    int steps = 0;
+    while(capacity > LINEAR_WINDOW){ capacity = capacity - capacity / 2; steps++; }
+    return steps;
+}
+
+/**
+ * Specialisation for a given segment capacity, where the number of steps of the binary search is known at
+ * compile time
+ */
+template<size_t capacity>
+struct Search {
+    template<bool inclusive>
+    static size_t run(const int64_t* __restrict keys, size_t n, int64_t key){
+        assert(n <= capacity);
+        return search<inclusive>(keys, n, key, num_steps(capacity));
+    }
+};
+
+// Dispatch to the specialised search according to the capacity of the segment
+template<bool inclusive>
+inline size_t dispatch(const int64_t* __restrict keys, size_t n, int64_t key, size_t capacity){
+    switch(capacity){
+    case 32: return Search<32>::run<inclusive>(keys, n, key);
+    case 64: return Search<64>::run<inclusive>(keys, n, key);
+    case 128: return Search<128>::run<inclusive>(keys, n, key);
+    case 256: return Search<256>::run<inclusive>(keys, n, key);
+    case 512: return Search<512>::run<inclusive>(keys, n, key);
+    case 1024: return Search<1024>::run<inclusive>(keys, n, key);
+    default: return search<inclusive>(keys, n, key, num_steps(capacity));
+    }
+}
+
+/**
+ * Scalar scan from the start of the keys, stopping at the first element greater or equal than (inclusive = false) or
+ * greater than (inclusive = true) the given key
+ */
+template<bool inclusive>
+inline size_t linear(const int64_t* __restrict keys, size_t n, int64_t key){
+    size_t i = 0;
+    while(i < n && (inclusive ? keys[i] <= key : keys[i] < key)) i++;
+    return i;
+}
+
+/**
+ * Interpolation search: probe the position of the key assuming the keys are evenly spread between keys[0] and
+ * keys[n -1], then scan the windows of LINEAR_WINDOW keys next to the probe, towards the key. After
+ * INTERPOLATION_MAX_WINDOWS windows, the keys are not evenly spread, complete with a binary search.
+ */
+template<bool inclusive>
+inline size_t interpolation(const int64_t* __restrict keys, size_t n, int64_t key){
+    if(n <= LINEAR_WINDOW) return count<inclusive>(keys, n, key);
+    auto satisfies = [key](int64_t k){ return inclusive ? k <= key : k < key; };
+
+    const int64_t key_min = keys[0];
+    const int64_t key_max = keys[n -1];
+    if(!satisfies(key_min)) return 0;
+    if(satisfies(key_max)) return n;
+    assert(key_min < key_max);
+
+    // in double precision, to avoid overflows with the spread of the keys
+    double fraction = (static_cast<double>(key) - static_cast<double>(key_min)) / (static_cast<double>(key_max) - static_cast<double>(key_min));
+    size_t probe = std::min<size_t>(static_cast<size_t>(fraction * (n -1)), n -1);
+
+    if(satisfies(keys[probe])){ // move right, the result is in (probe, n)
+        size_t start = probe +1;
+        for(size_t i = 0; i < INTERPOLATION_MAX_WINDOWS; i++){
+            size_t end = std::min(start + LINEAR_WINDOW, n);
+            if(end == n || !satisfies(keys[end -1])) return start + count<inclusive>(keys + start, end - start, key);
+            start = end;
+        }
+        return start + search<inclusive>(keys + start, n - start, key, num_steps(n - start));
+    } else { // move left, the result is in [0, probe]
+        size_t end = probe;
+        for(size_t i = 0; i < INTERPOLATION_MAX_WINDOWS; i++){
+            size_t start = end > LINEAR_WINDOW ? end - LINEAR_WINDOW : 0;
+            if(start == 0 || satisfies(keys[start -1])) return start + count<inclusive>(keys + start, end - start, key);
+            end = start;
+        }
+        return search<inclusive>(keys, end, key, num_steps(end));
+    }
+}
+
+/**
+ * Whether the keys are evenly spread between keys[0] and keys[n -1], checking where the median lies
+ */
+inline bool is_evenly_spread(const int64_t* __restrict keys, size_t n){
+    const double key_min = keys[0];
+    const double key_max = keys[n -1];
+    if(key_min >= key_max) return false;
+    double position = (static_cast<double>(keys[n /2]) - key_min) / (key_max - key_min) * (n -1);
+    return std::abs(position - static_cast<double>(n /2)) <= INTERPOLATION_MAX_SKEW;
+}
+
+// Perform the search with the given strategy
+template<bool inclusive>
+inline size_t search(SearchStrategy strategy, const int64_t* __restrict keys, size_t n, int64_t key, size_t capacity){
+    switch(strategy){
+    case SearchStrategy::LINEAR:
+        return linear<inclusive>(keys, n, key);
+    case SearchStrategy::SIMD_LINEAR:
+        return count<inclusive>(keys, n, key);
+    case SearchStrategy::INTERPOLATION:
+        return interpolation<inclusive>(keys, n, key);
+    case SearchStrategy::ADAPTIVE:
+        if(n >= INTERPOLATION_MIN_KEYS && is_evenly_spread(keys, n)) return interpolation<inclusive>(keys, n, key);
+        return dispatch<inclusive>(keys, n, key, capacity);
+    default: // BINARY
+        return dispatch<inclusive>(keys, n, key, capacity);
+    }
+}
+
+} // namespace details
+
+/**
+ * Whether the kernels have been specialised at compile time for the given segment capacity. Other capacities are
+ * still supported, with a number of search steps computed at runtime.
+ */
+constexpr bool is_specialised(size_t capacity){
+    return capacity == 32 || capacity == 64 || capacity == 128 || capacity == 256 || capacity == 512 || capacity == 1024;
+}
+
+/**
+ * Position of the first element in keys[0, n) that is not less than the given key
+ */
+inline size_t lower_bound(const int64_t* __restrict keys, size_t n, int64_t key, size_t capacity, SearchStrategy strategy = SearchStrategy::BINARY){
+    return details::search</* inclusive ? */ false>(strategy, keys, n, key, capacity);
+}
+
+/**
+ * Position of the first element in keys[0, n) that is greater than the given key
+ */
+inline size_t upper_bound(const int64_t* __restrict keys, size_t n, int64_t key, size_t capacity, SearchStrategy strategy = SearchStrategy::BINARY){
+    return details::search</* inclusive ? */ true>(strategy, keys, n, key, capacity);
+}
+
+/**
+ * Insert the pair <key, value> in an even segment, whose elements are in [capacity - size, capacity). The
+ * elements less than the key are shifted one position to the left. Duplicates are inserted before the existing
+ * occurrences of the same key.
+ * @return the position of the inserted key, relative to the start of the segment
+ */
+inline size_t insert_even(int64_t* __restrict keys, int64_t* __restrict values, size_t capacity, size_t size, int64_t key, int64_t value, SearchStrategy strategy = SearchStrategy::BINARY){
+    assert(size < capacity && "The segment is full");
+    const size_t start = capacity - size -1; // first free slot
+    const size_t num_shifts = lower_bound(keys + start +1, size, key, capacity, strategy);
+    memmove(keys + start, keys + start +1, num_shifts * sizeof(keys[0]));
+    memmove(values + start, values + start +1, num_shifts * sizeof(values[0]));
+    const size_t position = start + num_shifts;
+    keys[position] = key;
+    values[position] = value;
+    return position;
+}
+
+/**
+ * Insert the pair <key, value> in an odd segment, whose elements are in [0, size). The elements greater than the
+ * key are shifted one position to the right. Duplicates are inserted after the existing occurrences of the same key.
+ * @return the position of the inserted key, relative to the start of the segment
+ */
+inline size_t insert_odd(int64_t* __restrict keys, int64_t* __restrict values, size_t capacity, size_t size, int64_t key, int64_t value, SearchStrategy strategy = SearchStrategy::BINARY){
+    assert(size < capacity && "The segment is full");
+    const size_t position = upper_bound(keys, size, key, capacity, strategy);
+    const size_t num_shifts = size - position;
+    memmove(keys + position +1, keys + position, num_shifts * sizeof(keys[0]));
+    memmove(values + position +1, values + position, num_shifts * sizeof(values[0]));
+    keys[position] = key;
+    values[position] = value;
+    return position;
+}
+
+/**
+ * Find the first occurrence of the given key in a segment
+ * @return the position of the key, relative to the start of the segment, or `capacity' if it is not present
+ */
+inline size_t find(const int64_t* __restrict keys, size_t capacity, size_t size, bool is_even, int64_t key, SearchStrategy strategy = SearchStrategy::BINARY){
+    const size_t start = is_even ? capacity - size : 0;
+    const size_t position = start + lower_bound(keys + start, size, key, capacity, strategy);
+    return (position < start + size && keys[position] == key) ? position : capacity;
+}
+
+/**
+ * Remove the element at the given position from an even segment, whose elements are in [capacity - size, capacity).
+ * The elements before the position are shifted one position to the right.
+ */
+inline void remove_even(int64_t* __restrict keys, int64_t* __restrict values, size_t capacity, size_t size, size_t position){
+    assert(size > 0 && position >= capacity - size && position < capacity && "Invalid position");
+    const size_t start = capacity - size;
+    const size_t num_shifts = position - start;
+    memmove(keys + start +1, keys + start, num_shifts * sizeof(keys[0]));
+    memmove(values + start +1, values + start, num_shifts * sizeof(values[0]));
+}
+
+/**
+ * Remove the element at the given position from an odd segment, whose elements are in [0, size). The elements
+ * after the position are shifted one position to the left.
+ */
+inline void remove_odd(int64_t* __restrict keys, int64_t* __restrict values, size_t size, size_t position){
+    assert(position < size && "Invalid position");
+    const size_t num_shifts = size - position -1;
+    memmove(keys + position, keys + position +1, num_shifts * sizeof(keys[0]));
+    memmove(values + position, values + position +1, num_shifts * sizeof(values[0]));
+}
+
+} // namespace
@@ -49,6 +49,14 @@ namespace data_structures::rma::common {
  *                                                                           *
  *****************************************************************************/
 
+// The min height h such that node_size^h >= N. Computed with integers, as with floating points the ratio
+// log2(N) / log2(node_size) can be slightly greater than h when N is a power of node_size, e.g. 17^3
+static int tree_height(uint64_t N, uint64_t node_size){
+    int height = 0;
+    for(uint64_t capacity = 1; capacity < N; capacity *= node_size){ height++; }
+    return height;
+}
+
 StaticIndex::StaticIndex(uint64_t node_size, uint64_t num_segments) :
         m_node_size(node_size), m_height(0), m_capacity(0), m_keys(nullptr), m_key_minimum(numeric_limits<int64_t>::max()) {
     if(node_size > (uint64_t) numeric_limits<uint16_t>::max()){ throw std::invalid_argument("Invalid node size: too big"); }
@@ -64,9 +72,17 @@ int64_t StaticIndex::node_size() const noexcept {
     return m_node_size;
 }
 
+SegmentIndex* StaticIndex::create(uint64_t num_segments) const {
+    return new StaticIndex(node_size(), num_segments);
+}
+
+void StaticIndex::train(uint64_t num_threads){
+    // nop
+}
+
 void StaticIndex::rebuild(uint64_t N){
     if(N == 0) throw std::invalid_argument("Invalid number of keys: 0");
-    int height = ceil( log2(N) / log2(node_size()) );
+    int height = tree_height(N, node_size());
     if(height > m_rightmost_sz){ throw std::invalid_argument("Invalid number of keys/segments: too big"); }
     uint64_t tree_sz = pow(node_size(), height) -1; // don't store the minimum, segment 0
 
@@ -89,7 +105,7 @@ void StaticIndex::rebuild(uint64_t N){
         int rightmost_subtree_height = 0;
         if(rightmost_subtree_sz > 0){
             rightmost_subtree_sz += 1; // with B-1 keys we index B entries
-            rightmost_subtree_height = ceil(log2(rightmost_subtree_sz) / log2(m_node_size));
+            rightmost_subtree_height = tree_height(rightmost_subtree_sz, m_node_size);
         }
         m_rightmost[height -1].m_right_height = rightmost_subtree_height;
 
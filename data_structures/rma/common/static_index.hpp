@@ -20,6 +20,8 @@
 #include <cinttypes>
 #include <ostream>
 
+#include "segment_index.hpp"
+
 namespace data_structures::rma::common {
 
 /**
@@ -30,7 +32,7 @@ namespace data_structures::rma::common {
  * in terms of space, so it is recommended to set B to a power of 2 + 1 (e.g. 65) to fully
  * exploit aligned accesses to the cache.
  */
-class StaticIndex {
+class StaticIndex final : public SegmentIndex {
     const uint16_t m_node_size; // number of keys per node
     int16_t m_height; // the height of this tree
     int32_t m_capacity; // the number of segments/keys in the tree
@@ -63,44 +65,54 @@ public:
     /**
      * Destructor
      */
-    ~StaticIndex();
+    ~StaticIndex() override;
+
+    /**
+     * Create a new (empty) tree with the same node size, to contain `num_segments'
+     */
+    SegmentIndex* create(uint64_t num_segments) const override;
 
     /**
      * Rebuild the tree to contain `num_segments'
      */
-    void rebuild(uint64_t num_segments);
+    void rebuild(uint64_t num_segments) override;
+
+    /**
+     * Nop, the tree is always up to date with its separator keys
+     */
+    void train(uint64_t num_threads = 1) override;
 
     /**
      * Set the separator key associated to the given segment
      */
-    void set_separator_key(uint64_t segment_id, int64_t key);
+    void set_separator_key(uint64_t segment_id, int64_t key) override;
 
     /**
      * Get the separator key associated to the given segment.
      * Used only for the debugging purposes.
      */
-    int64_t get_separator_key(uint64_t segment_id) const;
+    int64_t get_separator_key(uint64_t segment_id) const override;
 
     /**
      * Return a segment_id that contains the given key. If there are no repetitions in the indexed data structure,
      * this will be the only candidate segment for the given key.
      */
-    uint64_t find(int64_t key) const noexcept;
+    uint64_t find(int64_t key) const noexcept override;
 
     /**
      * Return the first segment id that may contain the given key
      */
-    uint64_t find_first(int64_t key) const noexcept;
+    uint64_t find_first(int64_t key) const noexcept override;
 
     /**
      * Return the last segment id that may contain the given key
      */
-    uint64_t find_last(int64_t key) const noexcept;
+    uint64_t find_last(int64_t key) const noexcept override;
 
     /**
      * Retrieve the minimum stored in the tree
      */
-    int64_t minimum() const noexcept;
+    int64_t minimum() const noexcept override;
 
     /**
      * Retrieve the height of the current static tree
@@ -115,12 +127,12 @@ public:
     /**
      * Retrieve the memory footprint of this index, in bytes
      */
-    size_t memory_footprint() const;
+    size_t memory_footprint() const override;
 
     /**
      * Dump the fields of the index
      */
-    void dump(std::ostream& out, bool* integrity_check = nullptr) const;
+    void dump(std::ostream& out, bool* integrity_check = nullptr) const override;
     void dump() const;
 };
 
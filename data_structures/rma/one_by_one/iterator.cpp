@@ -25,11 +25,13 @@
 
 #include "data_structures/parallel.hpp"
 #include "rma/common/abort.hpp"
+#include "rma/common/segment_kernels.hpp"
 #include "gate.hpp"
 #include "packed_memory_array.hpp"
 #include "rebalancing_master.hpp"
 #include "thread_context.hpp"
 
+using namespace data_structures::rma::common;
 using namespace std;
 
 namespace data_structures::rma::one_by_one {
@@ -194,13 +196,12 @@ void Iterator::set_offset(uint64_t segment_id){
     m_stop = stop_segment_id * m_pma->m_storage.m_segment_capacity + m_pma->m_storage.m_segment_sizes[stop_segment_id] -1; // inclusive
 
     int64_t* __restrict keys = m_pma->m_storage.m_keys;
-    while(m_offset <= m_stop && keys[m_offset] < m_min){
-        m_offset++;
+    const size_t window_capacity = 2 * m_pma->m_storage.m_segment_capacity; // the pair of segments
+    if(m_offset <= m_stop){
+        m_offset += segment_kernels::lower_bound(keys + m_offset, m_stop - m_offset +1, m_min, window_capacity);
     }
-    if(m_last){
-        while(m_offset <= m_stop && keys[m_stop] > m_max){
-            m_stop--;
-        }
+    if(m_last && m_offset <= m_stop){
+        m_stop = m_offset + segment_kernels::upper_bound(keys + m_offset, m_stop - m_offset +1, m_max, window_capacity) -1;
     }
 }
 
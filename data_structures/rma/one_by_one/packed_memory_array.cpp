@@ -28,6 +28,7 @@
 #include "rma/common/abort.hpp"
 #include "rma/common/buffered_rewired_memory.hpp"
 #include "rma/common/move_detector_info.hpp"
+#include "rma/common/segment_kernels.hpp"
 #include "adaptive_rebalancing.hpp"
 #include "garbage_collector.hpp"
 #include "gate.hpp"
@@ -37,6 +38,7 @@
 #include "weights.hpp"
 
 using namespace common;
+using namespace data_structures::rma::common;
 using namespace std;
 
 namespace data_structures::rma::one_by_one {
@@ -71,7 +73,8 @@ PackedMemoryArray::PackedMemoryArray(size_t btree_block_size, size_t pma_segment
         m_density_bounds1(0, 0.75, 0.75, 1), /* there is rationale for these hardwired thresholds */
         m_rebalancer(new RebalancingMaster{ this, num_worker_threads } ),
         m_garbage_collector( new GarbageCollector(this) ),
-        m_segments_per_lock(segments_per_lock){
+        m_segments_per_lock(segments_per_lock),
+        m_update_mode(UpdateMode::ASYNC){
     if(!is_power_of_2(segments_per_lock)) throw std::invalid_argument("[PackedMemoryArray::ctor] Invalid value for the `segments_per_lock', it is not a power of 2");
     if(segments_per_lock < 2) throw std::invalid_argument("[PackedMemoryArray::ctor] Invalid value for the `segments_per_lock', it must be >= 2");
     if(m_storage.get_segments_per_extent() % segments_per_lock != 0) throw std::invalid_argument("[PackedMemoryArray::ctor] The parameter `segments_per_extent' must be a multiple of `segments_per_lock'");
@@ -109,6 +112,14 @@ PackedMemoryArray::~PackedMemoryArray() {
  *   ThreadContext                                                           *
  *                                                                           *
  *****************************************************************************/
+void PackedMemoryArray::set_update_mode(UpdateMode mode){
+    m_update_mode = mode;
+}
+
+PackedMemoryArray::UpdateMode PackedMemoryArray::get_update_mode() const noexcept {
+    return m_update_mode;
+}
+
 void PackedMemoryArray::set_max_number_workers(size_t num_workers){
     m_thread_contexts.resize(num_workers);
 }
@@ -197,6 +208,7 @@ void PackedMemoryArray::writer_main(){
                         gate = nullptr; // restart
                     } else {
                         num_insertions++;
+                        context->update_done();
 //                        COUT_DEBUG_FORCE("gate: " << gate->lock_id() << ", key inserted: " << update.m_key << ", num_insertions: " << num_insertions);
                         context->fetch_local_queue();
 
@@ -210,6 +222,7 @@ void PackedMemoryArray::writer_main(){
                     bool need_global_rebalance = do_remove(gate, update.m_key, /* ignored */ &update.m_value);
 
                     if( update.m_value != -1 ) num_deletions++; // did it actually remove a value ?
+                    context->update_done();
                     context->fetch_local_queue(); // next item to handle
 
                     if(need_global_rebalance || !context->has_update() || gate->check_fence_keys(context->get_update().m_key) != Gate::Direction::GO_AHEAD){
@@ -239,9 +252,9 @@ Gate* PackedMemoryArray::writer_on_entry() {
         unique_lock<Gate> lock(gate);
         // is this the right gate ?
         if(check_fence_keys(gate, /* in/out */ gate_id, key)){
-            if (gate.m_writer != nullptr && gate.m_writer != context){ // this gate is likely busy, but a writer is already operating here
+            if (m_update_mode != UpdateMode::SYNC && gate.m_writer != nullptr && gate.m_writer != context){ // this gate is likely busy, but a writer is already operating here
                 // forward the update to the existing worker && return
-                gate.m_writer->enqueue(context->get_update());
+                context->forward(gate.m_writer, /* read your writes ? */ m_update_mode == UpdateMode::ASYNC_READ_YOUR_WRITES);
                 if(gate.m_state == Gate::State::FREE) gate.wake_next(context); // edge case, we detected multiple writers on this gate
                 lock.unlock();
 
@@ -264,7 +277,9 @@ Gate* PackedMemoryArray::writer_on_entry() {
                 std::future<void> consumer = producer.get_future();
 
                 gate.m_queue.append({ Gate::State::WRITE, &producer } );
-                if(gate.m_state != Gate::State::REBAL) gate.m_writer = context;
+                // register as the writer of this gate, the next writers will forward their updates to us rather than waiting
+                // as well. When the gate is being rebalanced, the master resets the writer once it releases the gate.
+                if(m_update_mode != UpdateMode::SYNC) gate.m_writer = context;
                 lock.unlock();
                 consumer.wait();
 
@@ -303,7 +318,7 @@ Gate* PackedMemoryArray::writer_check_gate(Gate* gate, int64_t cardinality_chang
         }
 
         // gain control of the lock's writer queue
-        if(gate->m_writer == nullptr) gate->m_writer = context;
+        if(gate->m_writer == nullptr && m_update_mode != UpdateMode::SYNC) gate->m_writer = context;
 
         break;
     case Gate::State::REBAL:
@@ -608,8 +623,10 @@ void PackedMemoryArray::set_separator_key(uint64_t segment_id, int64_t key) {
  *                                                                           *
  *****************************************************************************/
 void PackedMemoryArray::insert(int64_t key, int64_t value){
-    get_context()->set_update(/* insert ? */ true, key, value);
+    ThreadContext* context = get_context();
+    context->set_update(/* insert ? */ true, key, value);
     writer_main(); // update loop
+    if(m_update_mode == UpdateMode::ASYNC_READ_YOUR_WRITES) context->wait_forwarded_updates();
 }
 
 //Gate* PackedMemoryArray::insert_on_entry(int64_t key, int64_t value){
@@ -676,43 +693,19 @@ bool PackedMemoryArray::storage_insert_unsafe(size_t segment_id, int64_t key, in
     if(segment_id % 2 == 0){ // for even segment ids (0, 2, ...), insert at the end of the segment
         size_t stop = m_storage.m_segment_capacity -1;
         size_t start = m_storage.m_segment_capacity - sz -1;
-        size_t i = start;
-
-        while(i < stop && keys[i+1] < key){
-            keys[i] = keys[i+1];
-            i++;
-        }
+        size_t i = segment_kernels::insert_even(keys, values, m_storage.m_segment_capacity, sz, key, value);
 
 //        COUT_DEBUG("(even) segment_id: " << segment_id << ", start: " << start << ", stop: " << stop << ", key: " << key << ", value: " << value << ", position: " << i);
-        keys[i] = key;
-
-        for(size_t j = start; j < i; j++){
-            values[j] = values[j+1];
-        }
-        values[i] = value;
-
         minimum = (i == start);
         bool maximum = (i == stop);
 
         // update the detector
         predecessor = minimum ? std::numeric_limits<int64_t>::min() : keys[i -1];
         successor = maximum ? std::numeric_limits<int64_t>::max() : keys[i +1];
-
     } else { // for odd segment ids (1, 3, ...), insert at the front of the segment
-        size_t i = sz;
-        while(i > 0 && keys[i-1] > key){
-            keys[i] = keys[i-1];
-            i--;
-        }
+        size_t i = segment_kernels::insert_odd(keys, values, m_storage.m_segment_capacity, sz, key, value);
 
 //        COUT_DEBUG("(odd) segment_id: " << segment_id << ", key: " << key << ", value: " << value << ", position: " << i);
-        keys[i] = key;
-
-        for(size_t j = sz; j > i; j--){
-            values[j] = values[j-1];
-        }
-        values[i] = value;
-
         minimum = (i == 0);
         bool maximum = (i == sz);
 
@@ -736,11 +729,21 @@ bool PackedMemoryArray::storage_insert_unsafe(size_t segment_id, int64_t key, in
  *                                                                           *
  *****************************************************************************/
 int64_t PackedMemoryArray::remove(int64_t key){
-    get_context()->set_update(/* insert ? */ false, key, /* ignored */ -1);
+    ThreadContext* context = get_context();
+    context->set_update(/* insert ? */ false, key, /* ignored */ -1);
     writer_main(); // update loop
 
-    // in this implementation we don't report the value removed, as the operation can be asynchronously processed by a different worker
-    return -1;
+    switch(m_update_mode){
+    case UpdateMode::SYNC:
+        // the deletion has been performed by this thread, with an empty local queue the last update is still the current one
+        return context->get_update().m_value;
+    case UpdateMode::ASYNC_READ_YOUR_WRITES:
+        context->wait_forwarded_updates();
+        return -1;
+    default:
+        // in this mode we don't report the value removed, as the operation can be asynchronously processed by a different worker
+        return -1;
+    }
 }
 
 bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
@@ -763,8 +766,8 @@ bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
     int64_t successor = numeric_limits<int64_t>::max(); // to forward to the detector/predictor
 
     if (segment_id % 2 == 0) { // even
-        size_t imin = m_storage.m_segment_capacity - sz, i;
-        for(i = imin; i < m_storage.m_segment_capacity; i++){ if(keys[i] == key) break; }
+        size_t imin = m_storage.m_segment_capacity - sz;
+        size_t i = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, /* even ? */ true, key);
         if(i < m_storage.m_segment_capacity){ // found ?
             // to update the predictor/detector
             if(i > imin) predecessor = keys[i-1];
@@ -772,10 +775,7 @@ bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
 
             value = values[i];
             // shift the rest of the elements by 1
-            for(size_t j = i; j > imin; j--){
-                keys[j] = keys[j -1];
-                values[j] = values[j-1];
-            }
+            segment_kernels::remove_even(keys, values, m_storage.m_segment_capacity, sz, i);
 
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
@@ -791,8 +791,7 @@ bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
         } // end if (found)
     } else { // odd
         // find the key in the segment
-        size_t i = 0;
-        for( ; i < sz; i++){ if(keys[i] == key) break; }
+        size_t i = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, /* even ? */ false, key);
         if(i < sz){ // found?
             // to update the predictor/detector
             if(i > 0) predecessor = keys[i-1];
@@ -800,10 +799,7 @@ bool PackedMemoryArray::do_remove(Gate* gate, int64_t key, int64_t* out_value){
 
             value = values[i];
             // shift the rest of the elements by 1
-            for(size_t j = i; j < sz - 1; j++){
-                keys[j] = keys[j+1];
-                values[j] = values[j+1];
-            }
+            segment_kernels::remove_odd(keys, values, sz, i);
 
             sz--;
             m_storage.m_segment_sizes[segment_id] = sz;
@@ -1525,22 +1521,9 @@ int64_t PackedMemoryArray::do_find(Gate* gate, int64_t key) const{
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
     size_t sz = m_storage.m_segment_sizes[segment_id];
 
-    size_t start, stop;
-    if(segment_id % 2 == 0){ // even
-        stop = m_storage.m_segment_capacity;
-        start = stop - sz;
-    } else { // odd
-        start = 0;
-        stop = sz;
-    }
-
-    for(size_t i = start; i < stop; i++){
-        if(keys[i] == key){
-            return *(m_storage.m_values + segment_id * m_storage.m_segment_capacity + i);
-        }
-    }
-
-    return -1;
+    size_t i = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, /* even ? */ segment_id % 2 == 0, key);
+    if(i == m_storage.m_segment_capacity) return -1; // not found
+    return *(m_storage.m_values + segment_id * m_storage.m_segment_capacity + i);
 }
 
 Gate* PackedMemoryArray::find_on_entry(int64_t key) const {
@@ -1559,23 +1542,13 @@ int PackedMemoryArray::find_position(size_t segment_id, int64_t key) const noexc
     sz = min<size_t>(sz, m_storage.m_segment_capacity); // avoid overflow
 
     int64_t* __restrict keys = m_storage.m_keys + segment_id * m_storage.m_segment_capacity;
-    int start, stop;
-
-    if(segment_id % 2 == 0){ // for even segment ids (0, 2, ...), the keys are at the end
-        start = m_storage.m_segment_capacity - sz;
-        stop = m_storage.m_segment_capacity;
-    } else { // odd segment ids (1, 3, ...), the keys are at the start of the segment
-        start = 0;
-        stop = sz;
-    }
-
-    for(int i = start; i < stop; i++){
-        if(keys[i] == key){
-            return i -start;
-        }
-    }
+    // for even segment ids (0, 2, ...), the keys are at the end; odd segment ids (1, 3, ...), the keys are at the start of the segment
+    const bool is_even = segment_id % 2 == 0;
+    const size_t start = is_even ? m_storage.m_segment_capacity - sz : 0;
 
-    return -1; // not found
+    size_t position = segment_kernels::find(keys, m_storage.m_segment_capacity, sz, is_even, key);
+    if(position == m_storage.m_segment_capacity) return -1; // not found
+    return static_cast<int>(position - start);
 }
 
 /*****************************************************************************
@@ -1677,7 +1650,7 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
 
             // find the starting offset
             while(min_notfound && segment_begin < window_end){
-                while(start < stop && keys[start] < next_min){ start++; }
+                start += segment_kernels::lower_bound(keys + start, stop - start, next_min, 2 * m_storage.m_segment_capacity);
 
                 min_notfound = (start == stop);
                 if(min_notfound){
@@ -1710,7 +1683,7 @@ void PackedMemoryArray::do_sum(uint64_t gate_id, int64_t& next_min, int64_t max,
                     int64_t index = end -1;
 
                     while(max_notfound && segment_end >= segment_begin){
-                        while(index >= stop && keys[index] > max) index--;
+                        if(index >= stop) index = stop + segment_kernels::upper_bound(keys + stop, index - stop +1, max, 2 * m_storage.m_segment_capacity) -1;
                         max_notfound = (index < stop);
                         if(max_notfound){
                             segment_end -= 2;
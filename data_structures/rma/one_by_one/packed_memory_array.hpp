@@ -61,6 +61,14 @@ using CachedDensityBounds = data_structures::rma::common::CachedDensityBounds;
 using Knobs = data_structures::rma::common::Knobs;
 using StaticIndex = data_structures::rma::common::StaticIndex;
 
+public:
+    // How to handle an update when its gate is busy
+    enum class UpdateMode {
+        SYNC, // always wait for the gate and apply the update before returning
+        ASYNC, // forward the update to the writer already operating or waiting on the gate and return immediately
+        ASYNC_READ_YOUR_WRITES, // as ASYNC, but before returning wait for the forwarded update to be applied
+    };
+
 protected:
     std::atomic<int64_t> m_cardinality = 0; // the number of elements contained in the data structure
     Storage m_storage; // actual content. There is no need to further protect its access, workers/rebalancers need to hold a lock to the related extent to alter it
@@ -76,6 +84,7 @@ protected:
     GarbageCollector* m_garbage_collector; // garbage collector
     ThreadContextList m_thread_contexts; // the list of thread contexts, to keep track of the thread epochs
     const uint64_t m_segments_per_lock; // number of contiguous segments per lock
+    UpdateMode m_update_mode; // whether updates can be forwarded to the other writers
 
     // Check this is the correct lock
     bool check_fence_keys(Gate& gate, uint64_t& gate_id, int64_t key) const;
@@ -200,6 +209,7 @@ public:
 
     /**
      * Remove the given key from the data structure. Returns its value if found, otherwise -1.
+     * With asynchronous updates the value removed is not reported and the method always returns -1.
      */
     int64_t remove(int64_t key) override;
 
@@ -279,6 +289,17 @@ public:
      */
     size_t get_number_locks() const noexcept;
 
+    /**
+     * Set how the updates are handled when their gate is busy. By default, updates are asynchronous.
+     * This method is not thread safe, it should be invoked before the client threads start.
+     */
+    void set_update_mode(UpdateMode mode);
+
+    /**
+     * Retrieve how the updates are handled when their gate is busy
+     */
+    UpdateMode get_update_mode() const noexcept;
+
     /**
      * Set the maximum number of worker threads
      */
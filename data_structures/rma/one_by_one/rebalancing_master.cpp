@@ -316,9 +316,8 @@ void RebalancingMaster::wait_to_complete_remove(RebalancingTask* task, uint64_t
         int64_t cardinality_new = gate.m_cardinality;
         task->m_plan.m_cardinality_after += (cardinality_new - cardinality_old);
 
-        // we can safely set gate.m_writer = nullptr here as well, still the protocol is that a worker
-        // unsets this field before invoking the rebalancer
-        assert(gate.m_writer == nullptr && "The write queue should have been unset by the writer invoking the rebalancer");
+        // the writer invoking the rebalancer unsets gate.m_writer, but with asynchronous updates another writer waiting
+        // for the rebalance to complete may have already registered itself in the meanwhile
     }
 
     // remove the lock from the waiting list
@@ -636,10 +635,13 @@ void RebalancingMaster::release_lock(uint64_t lock_id, WakeList& worker_list){
     gate->lock();
     assert(gate->m_state == Gate::State::REBAL && "This gate was supposed to be acquired previously");
     assert(gate->m_num_active_threads == 0 && "This gate should be closed for rebalancing");
-    assert(gate->m_writer == nullptr && "Lock not released when it was acquired");
 
     gate->m_state = Gate::State::FREE;
 
+    // The writer waiting on this gate, if any, is going to be woken up together with the other threads and it may need to
+    // move to another gate, as the fence keys may have changed. Unregister it, so that the updates are not forwarded anymore.
+    gate->m_writer = nullptr;
+
     // Use #wake_all rather than #wake_next! Potentially the fence keys have been changed, to threads
     // upon wake up might move to other gates. If other threads are in the wait list, they
     // might potentially end up blocked forever.
@@ -653,7 +655,7 @@ void RebalancingMaster::release_lock(uint64_t lock_id, WakeList& worker_list){
 
 void RebalancingMaster::cleanup_lock(Gate& gate, WakeList& worker_list){
     gate.lock();
-    assert(gate.m_writer == nullptr && "Lock not released when it was acquired");
+    gate.m_writer = nullptr; // as #release_lock
 
     gate.m_fence_low_key = gate.m_fence_high_key = numeric_limits<int64_t>::min();
     gate.wake_all(/* out */ worker_list);
@@ -101,7 +101,7 @@ uint64_t ThreadContextList::min_epoch() const {
  *                                                                           *
  *****************************************************************************/
 
-ThreadContext::ThreadContext() : m_timestamp(numeric_limits<uint64_t>::max()), m_hosted(false), m_has_update(false), m_queue_next(16) {
+ThreadContext::ThreadContext() : m_timestamp(numeric_limits<uint64_t>::max()), m_hosted(false), m_has_update(false), m_queue_next(16), m_num_forwarded(0) {
 
 }
 
@@ -161,6 +161,29 @@ bool ThreadContext::enqueue(const ThreadContext::Update& update){
 //    }
 }
 
+void ThreadContext::forward(ThreadContext* writer, bool read_your_writes){
+    assert(writer != nullptr && writer != this && "Invalid writer");
+    assert(m_has_update && "No update to forward");
+    if(read_your_writes && m_current_update.m_issuer == nullptr){ // otherwise it was already forwarded to us by another thread
+        m_current_update.m_issuer = this;
+        m_num_forwarded++;
+    }
+    writer->enqueue(m_current_update);
+}
+
+void ThreadContext::update_done() noexcept {
+    ThreadContext* issuer = m_current_update.m_issuer;
+    if(issuer != nullptr){
+        m_current_update.m_issuer = nullptr;
+        issuer->m_num_forwarded.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void ThreadContext::wait_forwarded_updates() const noexcept {
+    // the writer applying our updates may be waiting for a rebalance to complete, do not hog the CPU meanwhile
+    while(m_num_forwarded.load(std::memory_order_acquire) > 0){ this_thread::yield(); }
+}
+
 void ThreadContext::fetch_local_queue() noexcept {
     scoped_lock<SpinLock> lock(m_queue_mutex);
     fetch_local_queue_unsafe();
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cinttypes>
 #include <iostream>
 #include <mutex>
@@ -48,6 +49,7 @@ public:
         bool m_is_insert; // true => insertion, false => deletion
         int64_t m_key; // the key to insert
         int64_t m_value; // if insertion, the value to insert, if deletion it's ignored
+        ThreadContext* m_issuer = nullptr; // the thread waiting for this update to be applied, only set for updates forwarded in read-your-writes mode
     };
     WakeList m_wakelist; // cached list
 private:
@@ -55,6 +57,7 @@ private:
     Update m_current_update; // current update to perform
     ::common::CircularArray<Update> m_queue_next; // items to insert/delete (supposedly) in the same segment
     mutable ::common::SpinLock m_queue_mutex; // spin lock to protect the access to m_queue
+    std::atomic<int64_t> m_num_forwarded; // number of updates forwarded to other writers and not applied yet, only in read-your-writes mode
 
 public:
     /**
@@ -109,6 +112,22 @@ public:
      */
     bool enqueue(const Update& update);
 
+    /**
+     * Forward the current update to the queue of the given writer. With `read_your_writes', keep track of the update
+     * in this context, so that the current thread can wait for the writer to apply it.
+     */
+    void forward(ThreadContext* writer, bool read_your_writes);
+
+    /**
+     * Notify the thread that issued the current update, in read-your-writes mode, that the update has been applied
+     */
+    void update_done() noexcept;
+
+    /**
+     * Wait for all updates forwarded by this context, in read-your-writes mode, to be applied by the other writers
+     */
+    void wait_forwarded_updates() const noexcept;
+
     /**
      * Check whether there is an operation scheduled for the current worker
      */
@@ -0,0 +1,214 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "gate_contention.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "common/circular_array.hpp"
+#include "common/configuration.hpp"
+#include "common/database.hpp"
+#include "common/errorhandling.hpp"
+#include "common/spin_lock.hpp"
+#include "common/timer.hpp"
+#include "rma/batch_processing/gate.hpp"
+
+using namespace common;
+using namespace data_structures::rma::batch_processing;
+using namespace std;
+
+namespace experiments {
+
+namespace {
+
+constexpr uint64_t SEGMENTS_PER_GATE = 4; // number of segments covered by each gate
+constexpr int64_t KEYS_PER_GATE = 1024; // the interval of keys covered by each gate
+
+/**
+ * Replica of the gates before the split in hot & cold fields: all fields are stored back to back in a single record,
+ * and the records are allocated contiguously, without any alignment to the cache lines.
+ */
+struct UnsplitGate {
+    uint32_t m_window_start;
+    uint32_t m_window_length;
+    Gate::State m_state = Gate::State::FREE;
+    SpinLock m_spin_lock;
+    int32_t m_num_active_threads = 0;
+    uint32_t m_cardinality = 0;
+    int64_t m_fence_low_key;
+    int64_t m_fence_high_key;
+    void* m_async_queue = nullptr;
+    const void* m_snapshot = nullptr;
+    void* m_delta_buffer = nullptr;
+    uint32_t m_version = 0;
+    chrono::steady_clock::time_point m_time_last_rebal;
+    uint32_t m_num_updates = 0;
+    chrono::microseconds m_rebalance_delay {0};
+    CircularArray<Gate::SleepingBeauty> m_queue { /* initial capacity */ 2 };
+    Gate::Timer m_timer;
+    int64_t* m_separator_keys;
+};
+
+bool queue_empty(const Gate& gate){ return gate.m_cold->m_queue.empty(); }
+bool queue_empty(const UnsplitGate& gate){ return gate.m_queue.empty(); }
+
+/**
+ * Enter the gate as a reader, search the segment for the given key and leave the gate, following the same steps of
+ * PackedMemoryArray::reader_on_entry, Gate::find and PackedMemoryArray::reader_on_exit
+ */
+template<typename G>
+uint64_t read_gate(G& gate, int64_t key){
+    uint64_t segment_id = numeric_limits<uint64_t>::max();
+
+    gate.m_spin_lock.lock();
+    if(gate.m_fence_low_key <= key && key <= gate.m_fence_high_key){
+        if(gate.m_state == Gate::State::FREE || (gate.m_state == Gate::State::READ && queue_empty(gate))){
+            gate.m_state = Gate::State::READ;
+            gate.m_num_active_threads++;
+            segment_id = 0; // acquired
+        }
+    }
+    gate.m_spin_lock.unlock();
+    if(segment_id != 0) return segment_id; // the gate has not been acquired
+
+    segment_id = gate.m_window_start + (upper_bound(gate.m_separator_keys, gate.m_separator_keys + gate.m_window_length -1, key) - gate.m_separator_keys);
+
+    gate.m_spin_lock.lock();
+    gate.m_num_active_threads--;
+    if(gate.m_num_active_threads == 0){
+        gate.m_state = Gate::State::FREE;
+        if(!queue_empty(gate)){ RAISE_EXCEPTION(ExperimentError, "There should not be any thread waiting on the gate"); }
+    }
+    gate.m_spin_lock.unlock();
+
+    return segment_id;
+}
+
+// Set the fence & separator keys of the gate at the given position
+template<typename G>
+void init_gate(G& gate, int64_t* separator_keys, uint64_t gate_id){
+    gate.m_fence_low_key = gate_id * KEYS_PER_GATE;
+    gate.m_fence_high_key = (gate_id +1) * KEYS_PER_GATE -1;
+    gate.m_separator_keys = separator_keys;
+    for(uint64_t i = 1; i < SEGMENTS_PER_GATE; i++){
+        separator_keys[i -1] = gate.m_fence_low_key + i * (KEYS_PER_GATE / SEGMENTS_PER_GATE);
+    }
+}
+
+} // anonymous namespace
+
+GateContention::GateContention(uint64_t num_threads, uint64_t num_operations) : m_num_threads(num_threads), m_num_operations(num_operations) {
+    if(num_threads == 0) RAISE_EXCEPTION(ExperimentError, "The number of threads must be > 0");
+    if(num_operations == 0) RAISE_EXCEPTION(ExperimentError, "The number of operations must be > 0");
+}
+
+GateContention::~GateContention() {
+
+}
+
+template<typename GateArray>
+void GateContention::run_layout(const string& layout, GateArray& gates){
+    atomic<uint64_t> num_threads_ready = 0;
+    atomic<bool> start = false;
+    atomic<uint64_t> checksum = 0;
+
+    vector<thread> threads;
+    for(uint64_t thread_id = 0; thread_id < m_num_threads; thread_id++){
+        threads.emplace_back([&](uint64_t gate_id){
+            auto& gate = gates[gate_id];
+            uint64_t local_checksum = 0;
+            num_threads_ready++;
+            while(!start){ /* spin */ }
+
+            for(uint64_t i = 0; i < m_num_operations; i++){
+                int64_t key = gate_id * KEYS_PER_GATE + (i % KEYS_PER_GATE);
+                local_checksum += read_gate(gate, key);
+            }
+
+            checksum += local_checksum;
+        }, thread_id);
+    }
+    while(num_threads_ready < m_num_threads){ this_thread::yield(); }
+
+    Timer timer { true };
+    start = true;
+    for(auto& t : threads) t.join();
+    timer.stop();
+
+    // each key maps to one of the segments of its gate
+    uint64_t expected_checksum = 0;
+    for(uint64_t gate_id = 0; gate_id < m_num_threads; gate_id++){
+        for(uint64_t i = 0; i < m_num_operations; i++){
+            expected_checksum += gate_id * SEGMENTS_PER_GATE + (i % KEYS_PER_GATE) / (KEYS_PER_GATE / SEGMENTS_PER_GATE);
+        }
+    }
+    if(checksum != expected_checksum){ RAISE_EXCEPTION(ExperimentError, "[" << layout << "] Checksum mismatch: " << checksum << ", expected: " << expected_checksum); }
+
+    uint64_t num_operations = m_num_threads * m_num_operations;
+    LOG_VERBOSE("[" << layout << "] threads: " << m_num_threads << ", elapsed time: " << timer.milliseconds() << " millisecs, "
+            "throughput: " << static_cast<uint64_t>(num_operations / max<double>(timer.seconds<double>(), 1e-9)) << " ops/sec");
+
+    config().db()->add("gate_contention")
+                ("layout", layout)
+                ("num_threads", (int64_t) m_num_threads)
+                ("num_operations", (int64_t) num_operations)
+                ("time_usecs", (int64_t) timer.microseconds());
+}
+
+void GateContention::run() {
+    { // the gates of the rma_batch, hot fields aligned to a cache line & cold fields in a parallel array
+        Gate* gates = Gate::allocate(m_num_threads, SEGMENTS_PER_GATE);
+        for(uint64_t i = 0; i < m_num_threads; i++){ init_gate(gates[i], gates[i].m_separator_keys, i); }
+        try {
+            run_layout("split", gates);
+        } catch(...){
+            Gate::deallocate(gates, m_num_threads);
+            throw;
+        }
+        Gate::deallocate(gates, m_num_threads);
+    }
+
+    { // all fields back to back, as Gate::allocate did before the split
+        size_t space_per_gate = sizeof(UnsplitGate) + (SEGMENTS_PER_GATE -1) * sizeof(int64_t);
+        UnsplitGate* gates = (UnsplitGate*) malloc(space_per_gate * m_num_threads);
+        if(gates == nullptr) throw std::bad_alloc();
+        int64_t* separator_keys = reinterpret_cast<int64_t*>(gates + m_num_threads);
+        for(uint64_t i = 0; i < m_num_threads; i++){
+            new (gates + i) UnsplitGate{ static_cast<uint32_t>(i * SEGMENTS_PER_GATE), static_cast<uint32_t>(SEGMENTS_PER_GATE) };
+            init_gate(gates[i], separator_keys + i * (SEGMENTS_PER_GATE -1), i);
+        }
+        try {
+            run_layout("unsplit", gates);
+        } catch(...){
+            for(uint64_t i = 0; i < m_num_threads; i++){ gates[i].~UnsplitGate(); }
+            free(gates);
+            throw;
+        }
+        for(uint64_t i = 0; i < m_num_threads; i++){ gates[i].~UnsplitGate(); }
+        free(gates);
+    }
+}
+
+} // namespace experiments
@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cinttypes>
+#include <string>
+
+#include "interface.hpp"
+
+namespace experiments {
+
+/**
+ * Measure the false sharing among the gates of the rma_batch. Each thread repeatedly acquires & releases its own gate
+ * as a reader would, with adjacent threads operating on adjacent gates. The experiment compares the gates of the
+ * rma_batch, where the hot fields are aligned to a cache line and the cold fields are moved to a parallel array,
+ * against a replica of the previous layout, where all the fields of a gate were stored back to back.
+ */
+class GateContention : public Interface {
+    const uint64_t m_num_threads; // number of threads, each operating on a distinct gate
+    const uint64_t m_num_operations; // number of acquisitions & releases performed by each thread
+
+    // Run the threads over the given array of gates, record the results in the database
+    template<typename GateArray>
+    void run_layout(const std::string& layout, GateArray& gates);
+
+protected:
+    void run() override;
+
+public:
+    GateContention(uint64_t num_threads, uint64_t num_operations);
+
+    virtual ~GateContention();
+};
+
+} /* namespace experiments */
@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "index_routing.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <random>
+
+#include "common/configuration.hpp"
+#include "common/console_arguments.hpp"
+#include "common/database.hpp"
+#include "common/errorhandling.hpp"
+#include "common/timer.hpp"
+#include "rma/common/learned_index.hpp"
+#include "rma/common/static_index.hpp"
+#include "distributions/factory.hpp"
+#include "distributions/interface.hpp"
+
+using namespace common;
+using namespace data_structures::rma::common;
+using namespace std;
+
+namespace experiments {
+
+IndexRouting::IndexRouting(uint64_t num_segments, uint64_t num_lookups, uint64_t node_size, uint64_t error_bound, uint64_t num_threads) :
+        m_num_segments(num_segments), m_num_lookups(num_lookups), m_node_size(node_size), m_error_bound(error_bound), m_num_threads(num_threads) {
+    if(num_segments == 0) RAISE_EXCEPTION(ExperimentError, "The number of segments must be > 0");
+    if(num_lookups == 0) RAISE_EXCEPTION(ExperimentError, "The number of lookups must be > 0");
+}
+
+IndexRouting::~IndexRouting() {
+
+}
+
+void IndexRouting::run_index(const string& distribution, const string& index_name, SegmentIndex* index, const vector<int64_t>& separator_keys, const vector<int64_t>& lookups, vector<uint64_t>& results){
+    Timer timer_build { true };
+    for(uint64_t i = 0; i < separator_keys.size(); i++){ index->set_separator_key(i, separator_keys[i]); }
+    index->train(m_num_threads);
+    timer_build.stop();
+
+    Timer timer_lookups { true };
+    for(uint64_t i = 0; i < lookups.size(); i++){ results[i] = index->find(lookups[i]); }
+    timer_lookups.stop();
+
+    LearnedIndex* learned_index = dynamic_cast<LearnedIndex*>(index);
+    LOG_VERBOSE("[" << distribution << "] " << index_name << ", build time: " << timer_build.microseconds() << " microsecs, "
+            "lookup time: " << timer_lookups.nanoseconds() / lookups.size() << " nanosecs/key, memory footprint: " << index->memory_footprint() << " bytes" <<
+            (learned_index != nullptr ? ", number of models: " + to_string(learned_index->num_models()) : string("")));
+
+    config().db()->add("index_routing")
+                ("distribution", distribution)
+                ("index", index_name)
+                ("num_segments", (int64_t) m_num_segments)
+                ("num_lookups", (int64_t) lookups.size())
+                ("build_time_usecs", (int64_t) timer_build.microseconds())
+                ("lookup_time_nsecs", (int64_t) timer_lookups.nanoseconds())
+                ("memory_footprint", (int64_t) index->memory_footprint())
+                ("num_models", (int64_t) (learned_index != nullptr ? learned_index->num_models() : 0));
+}
+
+void IndexRouting::run() {
+    mt19937_64 random_generator { ARGREF(uint64_t, "seed_random_permutation").get() };
+
+    for(auto& item : distributions::factory().list()){
+        const string& name = item->name();
+
+        // not all distributions are valid with the current parameters (alpha, beta), skip them
+        unique_ptr<distributions::Interface> distribution;
+        try {
+            distribution = item->make();
+        } catch (std::exception& e){
+            LOG_VERBOSE("[" << name << "] skipped, " << e.what());
+            continue;
+        }
+        if(distribution->size() == 0) continue;
+
+        vector<int64_t> keys(distribution->size());
+        for(uint64_t i = 0; i < keys.size(); i++){ keys[i] = distribution->key(i); }
+        distribution.reset();
+        sort(begin(keys), end(keys));
+
+        // the minima of equal partitions of the keys, as in a rebalanced array
+        const uint64_t num_segments = min<uint64_t>(m_num_segments, keys.size());
+        vector<int64_t> separator_keys(num_segments);
+        for(uint64_t i = 0; i < num_segments; i++){ separator_keys[i] = keys[i * keys.size() / num_segments]; }
+
+        vector<int64_t> lookups(m_num_lookups);
+        uniform_int_distribution<uint64_t> sampler(0, keys.size() -1);
+        for(uint64_t i = 0; i < m_num_lookups; i++){ lookups[i] = keys[sampler(random_generator)]; }
+        keys.clear(); keys.shrink_to_fit();
+
+        vector<uint64_t> results_static(m_num_lookups), results_learned(m_num_lookups);
+        { // static index
+            StaticIndex index { m_node_size, num_segments };
+            run_index(name, "static", &index, separator_keys, lookups, results_static);
+        }
+        { // learned index
+            LearnedIndex index { m_error_bound, num_segments };
+            run_index(name, "learned", &index, separator_keys, lookups, results_learned);
+        }
+
+        // both indices must route the keys to the same segments
+        for(uint64_t i = 0; i < m_num_lookups; i++){
+            if(results_static[i] != results_learned[i]){
+                RAISE_EXCEPTION(ExperimentError, "[" << name << "] Mismatch for the key " << lookups[i] << ", static index: " << results_static[i] << ", learned index: " << results_learned[i]);
+            }
+        }
+    }
+}
+
+} // namespace experiments
@@ -0,0 +1,55 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+#include "interface.hpp"
+
+namespace data_structures::rma::common { class SegmentIndex; } // forward declaration
+
+namespace experiments {
+
+/**
+ * Compare the StaticIndex and the LearnedIndex of the RMA, as the router of the keys to the segments. For each
+ * registered distribution, the separator keys are the minima of `num_segments' equal partitions of the generated
+ * keys, and the lookups are keys sampled from the same distribution.
+ */
+class IndexRouting : public Interface {
+    const uint64_t m_num_segments; // number of separator keys in the index
+    const uint64_t m_num_lookups; // number of keys to route, for each index
+    const uint64_t m_node_size; // the node size of the static index
+    const uint64_t m_error_bound; // the error bound of the learned index
+    const uint64_t m_num_threads; // number of threads to train the learned index
+
+    // Build the index and route the lookups, record the results in the database
+    void run_index(const std::string& distribution, const std::string& index_name, data_structures::rma::common::SegmentIndex* index,
+            const std::vector<int64_t>& separator_keys, const std::vector<int64_t>& lookups, std::vector<uint64_t>& results);
+
+protected:
+    void run() override;
+
+public:
+    IndexRouting(uint64_t num_segments, uint64_t num_lookups, uint64_t node_size, uint64_t error_bound, uint64_t num_threads);
+
+    virtual ~IndexRouting();
+};
+
+} /* namespace experiments */
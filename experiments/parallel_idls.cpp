@@ -21,12 +21,14 @@
 #include <condition_variable>
 #include <mutex>
 #include <iostream>
+#include <memory>
 #include <thread>
 
 
 #include "common/configuration.hpp"
 #include "common/database.hpp"
 #include "common/miscellaneous.hpp" // pin_thread_to_cpu(), unpin_thread()
+#include "common/profiler.hpp"
 #include "common/spin_lock.hpp"
 #include "data_structures/interface.hpp"
 #include "data_structures/parallel.hpp"
@@ -97,10 +99,14 @@ struct Task {
 } // anononymous namespce
 
 static Task* _task_stop = reinterpret_cast<Task*>(0x01);
+#if defined(HAVE_LIBPAPI)
+static mutex _profiler_mutex; // the initialisation of the PAPI library is not thread safe
+#endif
 
 class ExperimentParallelIDLSThread {
 public:
     uint64_t m_scan_elements = 0;
+    CachesSnapshot m_scan_caches; // cache faults of the scans, to observe the interference of the rebalances on the readers
 private:
     thread m_handle;
     data_structures::Interface* m_interface;
@@ -173,10 +179,18 @@ private:
             }
         } break;
         case Task::Type::SCAN_ALL: {
+#if defined(HAVE_LIBPAPI)
+            unique_ptr<CachesProfiler> profiler;
+            { scoped_lock<mutex> lock(_profiler_mutex); profiler.reset(new CachesProfiler()); }
+            profiler->start();
+#endif
             while(::data_structures::global_parallel_scan_enabled){
                 auto scan = m_interface->sum(0, numeric_limits<int64_t>::max());
                 m_scan_elements += scan.m_num_elements;
             }
+#if defined(HAVE_LIBPAPI)
+            m_scan_caches += profiler->stop();
+#endif
         } break;
         default:
             assert(0 && "Invalid task");
@@ -331,7 +345,11 @@ void ParallelIDLS::run() {
     t_initial_inserts.stop();
     m_keys_experiment.unset_preparation_step(); // release some memory
     uint64_t num_initial_scan_elts = 0;
-    for(auto scanner : m_scan_threads){ num_initial_scan_elts += scanner->m_scan_elements; scanner->m_scan_elements = 0;/* reset */ }
+    CachesSnapshot initial_scan_caches;
+    for(auto scanner : m_scan_threads){
+        num_initial_scan_elts += scanner->m_scan_elements; scanner->m_scan_elements = 0;/* reset */
+        initial_scan_caches += scanner->m_scan_caches; scanner->m_scan_caches = CachesSnapshot{}; /* reset */
+    }
 
     double seconds = t_initial_inserts.microseconds() * 1000 * 1000;
     LOG_VERBOSE("Initial step: " << N_initial_inserts << " insertions. Elapsed time: " << seconds << " seconds, "
@@ -344,19 +362,30 @@ void ParallelIDLS::run() {
     t_updates.stop();
     m_keys_experiment.unset_insdel_step(); // release some additional memory
     uint64_t num_bulk_scan_elts = 0;
-    for(auto scanner : m_scan_threads){ num_bulk_scan_elts += scanner->m_scan_elements; scanner->m_scan_elements = 0;/* reset */ }
+    CachesSnapshot bulk_scan_caches;
+    for(auto scanner : m_scan_threads){
+        num_bulk_scan_elts += scanner->m_scan_elements; scanner->m_scan_elements = 0;/* reset */
+        bulk_scan_caches += scanner->m_scan_caches; scanner->m_scan_caches = CachesSnapshot{}; /* reset */
+    }
     LOG_VERBOSE("Update step: " << N_insdel << " updates in sequences of " << N_consecutive_operations << " operations. Elapsed time: " << seconds << " seconds, "
             "insertion throughput (" << m_insert_threads.size() << " threads): " << N_insdel / seconds << ", "
             "scan throughput (" << m_scan_threads.size() << " threads): " << num_initial_scan_elts / seconds );
+    if(!m_scan_threads.empty()){ LOG_VERBOSE("Scans during the update step, " << bulk_scan_caches); }
 
 
     config().db()->add("parallel_idls")
                     ("initial_size", N_initial_inserts)
                     ("t_init_millisecs", t_initial_inserts.milliseconds<uint64_t>())
                     ("scan_init", num_initial_scan_elts)
+                    ("scan_init_l1_misses", initial_scan_caches.m_cache_l1_misses)
+                    ("scan_init_llc_misses", initial_scan_caches.m_cache_llc_misses)
+                    ("scan_init_tlb_misses", initial_scan_caches.m_cache_tlb_misses)
                     ("updates", N_insdel)
                     ("t_updates_millisecs", t_updates.milliseconds<uint64_t>())
                     ("scan_updates", num_bulk_scan_elts)
+                    ("scan_updates_l1_misses", bulk_scan_caches.m_cache_l1_misses)
+                    ("scan_updates_llc_misses", bulk_scan_caches.m_cache_llc_misses)
+                    ("scan_updates_tlb_misses", bulk_scan_caches.m_cache_tlb_misses)
                     ;
 
 
@@ -0,0 +1,132 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include "third-party/catch/catch.hpp"
+
+#include "rma/common/learned_index.hpp"
+#include "rma/common/static_index.hpp"
+
+using namespace data_structures::rma::common;
+using namespace std;
+
+// compare the learned index with the static index, for the given separator keys
+static void validate(LearnedIndex& learned, const vector<int64_t>& keys){
+    StaticIndex expected(/* node size */ 9, keys.size());
+    for(size_t i = 0; i < keys.size(); i++){ expected.set_separator_key(i, keys[i]); }
+
+    REQUIRE(learned.minimum() == expected.minimum());
+    for(size_t i = 0; i < keys.size(); i++){
+        REQUIRE(learned.get_separator_key(i) == keys[i]);
+        for(int64_t key = std::max(keys[i], numeric_limits<int64_t>::min() +1) -1; key <= keys[i] +1; key++){
+            REQUIRE(learned.find(key) == expected.find(key));
+            REQUIRE(learned.find_first(key) == expected.find_first(key));
+            REQUIRE(learned.find_last(key) == expected.find_last(key));
+        }
+    }
+}
+
+TEST_CASE("only_root"){
+    LearnedIndex index(/* error bound */ 1, /* number of keys */ 3);
+    index.set_separator_key(0, 10);
+    index.set_separator_key(1, 20);
+    index.set_separator_key(2, 30);
+
+    // before and after the models are trained
+    for(int i = 0; i < 2; i++){
+        REQUIRE(index.find(5) == 0);
+        REQUIRE(index.find(10) == 0);
+        REQUIRE(index.find(15) == 0);
+        REQUIRE(index.find(20) == 1);
+        REQUIRE(index.find(25) == 1);
+        REQUIRE(index.find(30) == 2);
+        REQUIRE(index.find(35) == 2);
+
+        REQUIRE(index.find_first(20) == 0);
+        REQUIRE(index.find_first(25) == 1);
+        REQUIRE(index.find_last(20) == 1);
+        REQUIRE(index.find_last(35) == 2);
+
+        index.train();
+    }
+
+    index.dump();
+}
+
+TEST_CASE("linear"){
+    constexpr size_t num_keys = 4000;
+    LearnedIndex index(/* error bound */ 4, num_keys);
+    vector<int64_t> keys(num_keys);
+    for(size_t i = 0; i < num_keys; i++){ keys[i] = (i+1) * 10; index.set_separator_key(i, keys[i]); }
+    index.train();
+    REQUIRE(index.num_models() == 1); // a perfect fit
+    validate(index, keys);
+}
+
+TEST_CASE("piecewise"){
+    mt19937_64 random_generator(42);
+
+    for(size_t num_keys : { 2, 17, 1000, 100000 }){
+        // a few runs of keys with different density, and duplicates
+        vector<int64_t> keys(num_keys);
+        for(size_t i = 0; i < num_keys; i++){
+            keys[i] = (i % 1000 < 500) ? random_generator() % 1000000 : random_generator() % 1000000000;
+        }
+        sort(begin(keys), end(keys));
+        keys[0] = numeric_limits<int64_t>::min(); // as in the RMA
+
+        for(uint64_t num_threads : { 1, 8 }){
+            LearnedIndex index(LearnedIndex::DEFAULT_ERROR_BOUND, num_keys);
+            for(size_t i = 0; i < num_keys; i++){ index.set_separator_key(i, keys[i]); }
+            index.train(num_threads);
+            validate(index, keys);
+        }
+    }
+}
+
+TEST_CASE("update"){
+    mt19937_64 random_generator(42);
+    constexpr size_t num_keys = 10000;
+
+    vector<int64_t> keys(num_keys);
+    LearnedIndex index(/* error bound */ 2, num_keys);
+    for(size_t i = 0; i < num_keys; i++){ keys[i] = (i+1) * 100; index.set_separator_key(i, keys[i]); }
+    index.train();
+
+    // move the separator keys without retraining the models, as in a rebalance
+    for(int round = 0; round < 1000; round++){
+        size_t i = 1 + random_generator() % (num_keys -1);
+        int64_t min = keys[i -1] +1;
+        int64_t max = (i +1 < num_keys) ? keys[i +1] : keys[i] + 10000;
+        keys[i] = min + random_generator() % (max - min +1);
+        index.set_separator_key(i, keys[i]);
+    }
+    validate(index, keys);
+
+    // shift a whole range of keys, beyond the error bound of the model
+    for(size_t i = num_keys / 2; i < num_keys; i++){ keys[i] += 1000000; index.set_separator_key(i, keys[i]); }
+    validate(index, keys);
+
+    index.train();
+    validate(index, keys);
+}
@@ -0,0 +1,212 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <thread>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include "third-party/catch/catch.hpp"
+
+#include "common/mpsc_queue.hpp"
+
+using namespace common;
+using namespace std;
+
+TEST_CASE("sanity"){
+    MPSCQueue<int64_t> Q{/* capacity = */ 4};
+    int64_t buffer[16];
+    REQUIRE(Q.empty());
+    REQUIRE(Q.pop(buffer, 16) == 0);
+
+    Q.push(1);
+    Q.push(2);
+    Q.push(3);
+    REQUIRE(!Q.empty());
+    REQUIRE(Q.pop(buffer, 2) == 2);
+    REQUIRE(buffer[0] == 1);
+    REQUIRE(buffer[1] == 2);
+
+    // wrap around the ring buffer
+    Q.push(4);
+    Q.push(5);
+    Q.push(6);
+    REQUIRE(Q.pop(buffer, 16) == 4);
+    for(int64_t i = 0; i < 4; i++){ REQUIRE(buffer[i] == i + 3); }
+    REQUIRE(Q.empty());
+}
+
+TEST_CASE("overflow"){
+    MPSCQueue<int64_t> Q{/* capacity = */ 4};
+    int64_t buffer[16];
+
+    // the last items do not fit the ring buffer
+    for(int64_t i = 1; i <= 10; i++){ Q.push(i); }
+    REQUIRE(Q.pop(buffer, 3) == 3);
+    for(int64_t i = 0; i < 3; i++){ REQUIRE(buffer[i] == i + 1); }
+
+    // as long as the overflow list is not empty, the order must be preserved
+    Q.push(11);
+    REQUIRE(Q.pop(buffer, 16) == 8);
+    for(int64_t i = 0; i < 8; i++){ REQUIRE(buffer[i] == i + 4); }
+    REQUIRE(Q.empty());
+}
+
+TEST_CASE("timed_wait"){
+    MPSCQueue<int64_t> Q{/* capacity = */ 4};
+    int64_t buffer[16];
+
+    // nothing to fetch, the call must return once the timeout expires
+    auto t0 = chrono::steady_clock::now();
+    REQUIRE(Q.wait_and_pop(buffer, 16, chrono::milliseconds(20)) == 0);
+    REQUIRE(chrono::steady_clock::now() - t0 >= chrono::milliseconds(20));
+
+    // woken up by a producer before the timeout expires
+    thread producer{ [&Q](){ this_thread::sleep_for(chrono::milliseconds(10)); Q.push(42); } };
+    REQUIRE(Q.wait_and_pop(buffer, 16, chrono::seconds(60)) == 1);
+    REQUIRE(buffer[0] == 42);
+    producer.join();
+    REQUIRE(Q.empty());
+}
+
+TEST_CASE("multiple_producers"){
+    constexpr int num_producers = 8;
+    constexpr int64_t num_items = 100000; // per producer
+    MPSCQueue<int64_t> Q{/* capacity = */ 64};
+
+    vector<thread> producers;
+    for(int producer_id = 0; producer_id < num_producers; producer_id++){
+        producers.emplace_back([&Q](int64_t producer_id){
+            for(int64_t i = 0; i < num_items; i++){
+                Q.push(producer_id * num_items + i);
+            }
+        }, producer_id);
+    }
+
+    // the items sent by the same producer must be received in order
+    vector<int64_t> next_expected(num_producers, 0);
+    int64_t buffer[32];
+    int64_t num_received = 0;
+    while(num_received < num_producers * num_items){
+        uint64_t sz = Q.wait_and_pop(buffer, 32);
+        REQUIRE(sz > 0);
+        for(uint64_t i = 0; i < sz; i++){
+            int64_t producer_id = buffer[i] / num_items;
+            int64_t sequence = buffer[i] % num_items;
+            REQUIRE(sequence == next_expected[producer_id]);
+            next_expected[producer_id]++;
+        }
+        num_received += sz;
+    }
+
+    for(auto& t : producers) t.join();
+    REQUIRE(Q.empty());
+}
+
+/**
+ * An item that keeps the producer busy while it's being copied into the cell of the ring buffer, that is, after
+ * the producer reserved the cell but before it published the item.
+ */
+namespace {
+atomic<bool> g_release_items { true }; // when false, the items with m_hold = -1 block until it's set back to true
+atomic<int> g_items_blocked { 0 }; // number of producers currently blocked by g_release_items
+struct SlowItem {
+    int64_t m_value = 0;
+    int64_t m_hold = 0; // number of times to yield the processor while copying the item, -1 => wait for g_release_items
+
+    SlowItem() { }
+    SlowItem(int64_t value, int64_t hold) : m_value(value), m_hold(hold) { }
+    SlowItem(const SlowItem&) = default;
+    SlowItem& operator=(const SlowItem& other){
+        m_value = other.m_value;
+        m_hold = other.m_hold;
+        if(m_hold < 0 && !g_release_items){
+            g_items_blocked++;
+            while(!g_release_items) this_thread::yield();
+            g_items_blocked--;
+        }
+        for(int64_t i = 0; i < m_hold; i++) this_thread::yield();
+        return *this;
+    }
+};
+} // anonymous namespace
+
+TEST_CASE("overflow_reserved_cell"){
+    MPSCQueue<SlowItem> Q{/* capacity = */ 2};
+    SlowItem buffer[16];
+
+    // the first producer reserves the first cell, but it does not publish its item yet
+    g_release_items = false;
+    thread producer{ [&Q](){ Q.push(SlowItem{100, -1}); } };
+    while(g_items_blocked == 0) this_thread::yield();
+
+    // the second producer fills the ring buffer, its second item goes to the overflow list
+    Q.push(SlowItem{1, 0});
+    Q.push(SlowItem{2, 0});
+    REQUIRE(!Q.empty());
+
+    // the overflow list cannot be drained before the items in the ring buffer, otherwise 2 would be received before 1
+    REQUIRE(Q.pop(buffer, 16) == 0);
+
+    g_release_items = true;
+    producer.join();
+    REQUIRE(Q.pop(buffer, 16) == 3);
+    REQUIRE(buffer[0].m_value == 100);
+    REQUIRE(buffer[1].m_value == 1);
+    REQUIRE(buffer[2].m_value == 2);
+    REQUIRE(Q.empty());
+}
+
+TEST_CASE("overflow_reserved_cells"){
+    // a tiny ring buffer, where the producers hold their reserved cells for a while, giving the time to the other
+    // producers to append their items to the overflow list
+    constexpr int num_producers = 8;
+    constexpr int64_t num_items = 20000; // per producer
+    MPSCQueue<SlowItem> Q{/* capacity = */ 2};
+
+    vector<thread> producers;
+    for(int producer_id = 0; producer_id < num_producers; producer_id++){
+        producers.emplace_back([&Q](int64_t producer_id){
+            for(int64_t i = 0; i < num_items; i++){
+                Q.push(SlowItem{producer_id * num_items + i, /* hold */ (i % 4 == producer_id % 4) ? 2 : 0});
+            }
+        }, producer_id);
+    }
+
+    // fetch a few items at the time, the items sent by the same producer must be received in order and none can be lost
+    vector<int64_t> next_expected(num_producers, 0);
+    SlowItem buffer[3];
+    int64_t num_received = 0;
+    while(num_received < num_producers * num_items){
+        uint64_t sz = Q.wait_and_pop(buffer, 3);
+        REQUIRE(sz > 0);
+        for(uint64_t i = 0; i < sz; i++){
+            int64_t producer_id = buffer[i].m_value / num_items;
+            int64_t sequence = buffer[i].m_value % num_items;
+            REQUIRE(sequence == next_expected[producer_id]);
+            next_expected[producer_id]++;
+        }
+        num_received += sz;
+    }
+
+    for(auto& t : producers) t.join();
+    for(int producer_id = 0; producer_id < num_producers; producer_id++){ REQUIRE(next_expected[producer_id] == num_items); }
+    REQUIRE(Q.empty());
+    REQUIRE(Q.pop(buffer, 3) == 0);
+}
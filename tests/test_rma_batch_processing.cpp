@@ -18,14 +18,25 @@
 #define CATCH_CONFIG_MAIN
 #include "third-party/catch/catch.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <random>
 #include <thread>
 #include <vector>
 
 #include "common/miscellaneous.hpp"
 #include "distributions/random_permutation.hpp"
+#include "rma/batch_processing/delay_controller.hpp"
+#include "rma/batch_processing/density_tuner.hpp"
+#include "rma/batch_processing/gate.hpp"
 #include "rma/batch_processing/packed_memory_array.hpp"
+#include "rma/batch_processing/read_cache.hpp"
+#include "rma/batch_processing/rebalancing_task.hpp"
+#include "rma/batch_processing/task_scheduler.hpp"
 #include "driver.hpp"
 #include "parallel.hpp"
 
@@ -297,6 +308,1310 @@ TEST_CASE("multi_thread_global_rebal"){
     REQUIRE(pma.empty());
 }
 
+TEST_CASE("multi_thread_sharded_master"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr size_t num_elts = 200000;
+
+    Options options;
+    options.m_num_master_shards = 4;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_threads);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 11 };
+    int threads_started = 0;
+    condition_variable _cvar;
+    mutex _mutex;
+
+    auto run_workers = [&](auto&& fn){
+        vector<thread> threads;
+        const int64_t num_keys_per_thread = num_elts / num_threads;
+        const int64_t num_keys_leftover = num_elts % num_threads;
+        int64_t start_position = 0;
+        threads_started = 0;
+        for(int i = 0; i < num_threads; i++){
+            int64_t num_keys_to_process = num_keys_per_thread + (i < num_keys_leftover);
+            threads.emplace_back([&](int64_t pos_start, int64_t num_keys){
+                { // wait for all threads to start
+                    unique_lock<mutex> lock(_mutex);
+                    pma.register_thread(threads_started);
+                    threads_started++;
+                    _cvar.notify_all();
+                    if(threads_started < num_threads) { _cvar.wait(lock, [&](){ return threads_started == num_threads; }); }
+                }
+
+                for(int64_t pos = pos_start, end = pos_start + num_keys; pos < end; pos++){
+                    fn(sampler.get_raw_key(pos) +1);
+                }
+
+                pma.unregister_thread();
+            }, start_position, num_keys_to_process);
+            start_position += num_keys_to_process;
+        }
+        for(auto& t : threads) t.join(); // Zzz
+        pma.on_complete(); // wait for the shards & the coordinator to become idle
+    };
+
+    // insert the keys, the array is resized multiple times through the coordinator
+    run_workers([&](int64_t key){ pma.insert(key, key * 10); });
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(size_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    pma.unregister_thread();
+
+    // remove them
+    run_workers([&](int64_t key){ pma.remove(key); });
+
+    REQUIRE(pma.size() == 0);
+    REQUIRE(pma.empty());
+}
+
+TEST_CASE("multi_thread_delayed_sharded"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 200000;
+
+    // a short delay, to arm & fire many timers, expiring in batches, while the array is resized
+    Options options;
+    options.m_num_master_shards = 4;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 1ms, options };
+    pma.set_max_number_workers(num_threads);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 13 };
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_threads){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                pma.insert(key, key * 10);
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join(); // Zzz
+    pma.on_complete(); // fire the pending timers & wait for the rebalancer to become idle
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("multi_thread_adaptive_delay"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 200000;
+
+    // the delay of each gate is tuned at runtime, up to 20ms
+    Options options;
+    options.m_adaptive_delay = true;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* max delay */ 20ms, options };
+    pma.set_max_number_workers(num_threads);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 17 };
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_threads){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                pma.insert(key, key * 10);
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join(); // Zzz
+    pma.on_complete();
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("delay_controller"){
+    constexpr uint64_t backlog_capacity = 64;
+    DelayController controller { /* max delay */ 5ms, backlog_capacity };
+    REQUIRE(controller.max_delay() == 5ms);
+
+    // moving average of the cost of the rebalances
+    REQUIRE(controller.rebalance_cost() == 0us);
+    controller.record_rebalance(1000us);
+    REQUIRE(controller.rebalance_cost() == 1000us);
+    controller.record_rebalance(9000us); // 1000 + (9000 - 1000) / 8
+    REQUIRE(controller.rebalance_cost() == 2000us);
+
+    constexpr int64_t num_gates = 5;
+    Gate* gates = Gate::allocate(num_gates, /* segments per lock */ 2);
+    const auto now = chrono::steady_clock::now();
+    auto set_arrivals = [&](int64_t gate_id, uint32_t num_updates, chrono::microseconds interval){
+        gates[gate_id].m_cold->m_num_updates = num_updates;
+        gates[gate_id].m_cold->m_time_last_rebal = now - interval;
+    };
+    auto deadline = [&](DelayController& controller, int64_t gate_id){
+        Gate& gate = gates[gate_id];
+        gate.lock();
+        auto result = controller.deadline(&gate, now);
+        gate.unlock();
+        REQUIRE(result == gate.m_cold->m_time_last_rebal + gate.m_cold->m_rebalance_delay);
+        return gate.m_cold->m_rebalance_delay;
+    };
+
+    // no updates, the delay is set by the cost of the rebalances (10 x 2 ms), smoothed (/2) and capped at 5 ms
+    set_arrivals(0, 0, 1024us);
+    REQUIRE(deadline(controller, 0) == 5ms);
+    REQUIRE(deadline(controller, 0) == 5ms);
+
+    // 128 updates in 1024 us, the backlog is filled in 512 us: target = 1024 + 512 us, smoothed over the successive requests
+    set_arrivals(1, 128, 1024us);
+    REQUIRE(deadline(controller, 1) == 768us);
+    REQUIRE(deadline(controller, 1) == 1152us); // (768 + 1536) / 2
+
+    // as above, with three clients waiting on the gate: target = 1536 us / 4
+    set_arrivals(2, 128, 1024us);
+    for(int i = 0; i < 3; i++){ gates[2].m_cold->m_queue.append({ Gate::State::WRITE, nullptr }); }
+    REQUIRE(deadline(controller, 2) == 192us);
+
+    // a higher arrival rate, 1024 updates in 1024 us, the backlog is filled in 64 us: target = 1024 + 64 us
+    set_arrivals(3, 1024, 1024us);
+    REQUIRE(deadline(controller, 3) == 544us);
+
+    // cheaper rebalances, the delay for the gate without updates is below the cap: target = 10 x 200 us
+    DelayController cheap_rebalances { /* max delay */ 5ms, backlog_capacity };
+    cheap_rebalances.record_rebalance(200us);
+    set_arrivals(4, 0, 1024us);
+    REQUIRE(deadline(cheap_rebalances, 4) == 1000us);
+
+    Gate::deallocate(gates, num_gates);
+}
+
+TEST_CASE("multi_thread_apma"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 200000;
+    constexpr int64_t elts_per_thread = num_elts / num_threads;
+
+    // each thread inserts a run of consecutive keys, the detector should mark the tail of each run as hammered and
+    // the rebalances should leave more room to those segments
+    auto run = [&](bool adaptive_rebalancing){
+        Options options;
+        options.m_adaptive_rebalancing = adaptive_rebalancing;
+        PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+            /* delay */ 0ms, options };
+        pma.set_max_number_workers(num_threads);
+        REQUIRE(pma.knobs().get_sampling_rate() > 0);
+
+        vector<thread> threads;
+        for(int worker_id = 0; worker_id < num_threads; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                for(int64_t i = 0; i < elts_per_thread; i++){
+                    int64_t key = thread_id * elts_per_thread + i +1;
+                    pma.insert(key, key * 10);
+                }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(auto& t : threads) t.join(); // Zzz
+        pma.on_complete();
+
+        pma.register_thread(0);
+        REQUIRE(pma.size() == num_elts);
+        for(int64_t i = 1; i <= num_elts; i++){
+            REQUIRE(pma.find(i) == i * 10);
+        }
+        pma.unregister_thread();
+
+        return pma.get_number_skewed_rebalances();
+    };
+
+    // the adaptive rebalancing is opt-in
+    REQUIRE(run(/* adaptive rebalancing ? */ false) == 0);
+    REQUIRE(run(/* adaptive rebalancing ? */ true) > 0);
+}
+
+TEST_CASE("multi_thread_parallel_sort"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 400000;
+
+    // a long delay, so that the gates accumulate large bulk loading queues, to be sorted by multiple workers
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 200ms };
+    pma.set_max_number_workers(num_threads);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 17 };
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_threads){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                pma.insert(key, key * 10);
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join(); // Zzz
+    pma.on_complete();
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("parallel_sort_runs"){
+    using insertion_t = RebalancingTask::insertion_t;
+    using BlkLoadSortJob = RebalancingTask::BlkLoadSortJob;
+
+    // split the vector in runs, sort each run, then merge the runs with the jobs of the second phase, in any order
+    auto parallel_sort = [](vector<insertion_t>& vect, size_t num_runs){
+        vector<BlkLoadSortJob> sort_jobs = BlkLoadSortJob::split(vect, num_runs);
+        REQUIRE(sort_jobs.size() <= num_runs);
+        vector<BlkLoadSortJob::run_t> runs;
+        const insertion_t* next = vect.data();
+        for(auto& job : sort_jobs){
+            REQUIRE(job.m_runs.empty());
+            REQUIRE(job.m_output == next); // the runs are contiguous & cover the whole vector
+            next += job.m_length;
+            job.execute();
+            REQUIRE(is_sorted(job.m_output, job.m_output + job.m_length));
+            runs.emplace_back(job.m_output, job.m_output + job.m_length);
+        }
+        REQUIRE(next == vect.data() + vect.size());
+
+        vector<insertion_t> output(vect.size());
+        vector<BlkLoadSortJob> merge_jobs = BlkLoadSortJob::merge(runs, output.data());
+        REQUIRE(merge_jobs.size() <= runs.size());
+        insertion_t* slice = output.data();
+        for(auto& job : merge_jobs){
+            REQUIRE(job.m_output == slice); // each job writes its own slice of the output
+            slice += job.m_length;
+        }
+        REQUIRE(slice == output.data() + output.size());
+        for(auto it = merge_jobs.rbegin(); it != merge_jobs.rend(); it++){ it->execute(); }
+
+        // the key ranges of the jobs are disjoint, the copies of the same element are merged by the same job
+        for(size_t i = 1; i < merge_jobs.size(); i++){
+            REQUIRE(*(merge_jobs[i].m_output -1) < *(merge_jobs[i].m_output));
+        }
+        return make_pair(output, merge_jobs.size());
+    };
+
+    mt19937_64 random_generator(42);
+    uniform_int_distribution<int64_t> distribution_keys(1, 1000), distribution_values(0, 3);
+
+    SECTION("duplicates across runs"){
+        vector<insertion_t> input;
+        for(int i = 0; i < 50000; i++){
+            int64_t key = distribution_keys(random_generator);
+            input.emplace_back(key, key * 10 + distribution_values(random_generator));
+        }
+        vector<insertion_t> expected = input;
+        sort(begin(expected), end(expected));
+
+        for(size_t num_runs : { 2, 3, 7, 16 }){
+            vector<insertion_t> vect = input;
+            auto result = parallel_sort(vect, num_runs);
+            REQUIRE(result.first == expected);
+            REQUIRE(result.second > 1);
+        }
+    }
+
+    SECTION("all elements equal"){
+        vector<insertion_t> vect(1000, insertion_t{ 7, 70 });
+        auto result = parallel_sort(vect, 4);
+        REQUIRE(result.first == vect);
+        REQUIRE(result.second == 1); // a single key range
+    }
+
+    SECTION("fewer elements than runs"){
+        vector<insertion_t> vect { {3, 30}, {1, 10}, {2, 20} };
+        auto result = parallel_sort(vect, 8);
+        REQUIRE((result.first == vector<insertion_t>{ {1, 10}, {2, 20}, {3, 30} }));
+    }
+}
+
+TEST_CASE("multi_thread_lazy_deletes"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 100000;
+
+    // deletions only mark the elements with a tombstone, removed by the next insertion or rebalance
+    Options options;
+    options.m_lazy_deletes = true;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_threads);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 23 };
+    auto run_workers = [&](auto fn){
+        vector<thread> threads;
+        for(int worker_id = 0; worker_id < num_threads; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                for(int64_t pos = thread_id; pos < num_elts; pos += num_threads){ fn(sampler.get_raw_key(pos) +1); }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(auto& t : threads) t.join(); // Zzz
+        pma.on_complete();
+    };
+    auto is_deleted = [](int64_t key){ return key % 3 == 0; };
+
+    // insert all keys, then remove the multiples of 3
+    run_workers([&](int64_t key){ pma.insert(key, key * 10); });
+    run_workers([&](int64_t key){ if(is_deleted(key)) pma.remove(key); });
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts - num_elts / 3);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == (is_deleted(i) ? -1 : i * 10));
+    }
+
+    // scans
+    int64_t expected_key = 1;
+    auto it = pma.iterator();
+    while(it->hasNext()){
+        while(is_deleted(expected_key)) expected_key++;
+        auto p = it->next();
+        REQUIRE(p.first == expected_key);
+        REQUIRE(p.second == expected_key * 10);
+        expected_key++;
+    }
+    while(is_deleted(expected_key)) expected_key++;
+    REQUIRE(expected_key == num_elts +1);
+    it.reset();
+
+    for(int64_t min = 1; min <= num_elts; min += 4999){
+        int64_t max = std::min<int64_t>(num_elts, min + 3 * min / 2);
+        auto sum = pma.sum(min, max);
+        int64_t first_key = min; while(is_deleted(first_key)) first_key++;
+        int64_t last_key = max; while(is_deleted(last_key)) last_key--;
+        int64_t expected_count = 0, expected_sum = 0;
+        for(int64_t key = min; key <= max; key++){
+            if(!is_deleted(key)){ expected_count++; expected_sum += key; }
+        }
+        REQUIRE(sum.m_first_key == first_key);
+        REQUIRE(sum.m_last_key == last_key);
+        REQUIRE(sum.m_num_elements == expected_count);
+        REQUIRE(sum.m_sum_keys == expected_sum);
+        REQUIRE(sum.m_sum_values == expected_sum * 10);
+    }
+    pma.unregister_thread();
+
+    // insert back the deleted keys, with a different value
+    run_workers([&](int64_t key){ if(is_deleted(key)) pma.insert(key, key * 20); });
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == (is_deleted(i) ? i * 20 : i * 10));
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("task_scheduler"){
+    data_structures::initialise();
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 2, /* segments per lock */ 2 };
+    pma.register_thread(0);
+    for(int64_t i = 1; i <= 1000; i++){ pma.insert(i, i * 10); } // the tasks read the thresholds of their windows from the calibrator tree
+    constexpr int64_t num_gates = 512;
+    Gate* gates = Gate::allocate(num_gates, pma.get_segments_per_lock());
+    auto add_waiters = [gates](int64_t gate_id, int num_waiters){
+        for(int i = 0; i < num_waiters; i++){ gates[gate_id].m_cold->m_queue.append({ Gate::State::WRITE, nullptr }); }
+    };
+
+    const auto t0 = chrono::steady_clock::now();
+    vector<unique_ptr<RebalancingTask>> instances;
+    auto create_task = [&](int64_t lock_start, int64_t lock_length, chrono::microseconds time_created){
+        instances.push_back(make_unique<RebalancingTask>(&pma, /* master */ nullptr, gates + lock_start));
+        RebalancingTask* task = instances.back().get();
+        task->set_lock_window(lock_start, lock_length);
+        task->m_time_created = t0 + time_created;
+        return task;
+    };
+
+    RebalancingTask* A = create_task(/* lock start */ 0, /* lock length */ 1, /* created */ 1000us);
+    RebalancingTask* B = create_task(128, 128, 0us); // large window, waiters are ignored
+    add_waiters(130, 8);
+    RebalancingTask* C = create_task(256, 256, -2000us); // large window, but aged
+    RebalancingTask* D = create_task(8, 8, 0us);
+    RebalancingTask* E = create_task(16, 4, 1500us); // boosted
+    add_waiters(16, 2); add_waiters(19, 2);
+    RebalancingTask* F = create_task(0, 1, 0us); // resize
+    F->m_plan.m_operation = RebalanceOperation::RESIZE;
+    RebalancingTask* G = create_task(32, 4, 1500us); // not enough waiters for a boost
+    add_waiters(33, TaskScheduler::WAITERS -1);
+
+    REQUIRE(TaskScheduler::deadline(A, gates, num_gates) == A->m_time_created);
+    REQUIRE(TaskScheduler::deadline(B, gates, num_gates) == B->m_time_created + 7 * TaskScheduler::SLICE);
+    REQUIRE(TaskScheduler::deadline(E, gates, num_gates) == E->m_time_created + 2 * TaskScheduler::SLICE - TaskScheduler::BOOST);
+    REQUIRE(TaskScheduler::deadline(F, gates, num_gates) == F->m_time_created + 9 * TaskScheduler::SLICE); // the whole array
+    REQUIRE(TaskScheduler::deadline(G, gates, num_gates) == G->m_time_created + 2 * TaskScheduler::SLICE);
+
+    vector<RebalancingTask*> tasks { A, B, C, D, E, F, G };
+    TaskScheduler::sort(tasks, gates, num_gates);
+    REQUIRE((tasks == vector<RebalancingTask*>{ E, A, D, C, G, B, F }));
+
+    // launch the rebalances in order, as the master does when enough workers are available
+    auto num_large_tasks = [](const vector<const RebalancingTask*>& executing){
+        return count_if(begin(executing), end(executing), [](const RebalancingTask* task){ return task->get_lock_length() > TaskScheduler::LARGE_WINDOW; });
+    };
+    vector<const RebalancingTask*> executing;
+    vector<RebalancingTask*> postponed;
+    for(auto task : tasks){
+        if(task == F) continue;
+        if(TaskScheduler::is_rate_limited(task, executing)){
+            postponed.push_back(task);
+        } else {
+            executing.push_back(task);
+        }
+        REQUIRE(static_cast<uint64_t>(num_large_tasks(executing)) <= TaskScheduler::MAX_LARGE_TASKS);
+    }
+    REQUIRE((executing == vector<const RebalancingTask*>{ E, A, D, C, G }));
+    REQUIRE((postponed == vector<RebalancingTask*>{ B }));
+    REQUIRE(!TaskScheduler::is_rate_limited(F, executing)); // resizes are never rate limited
+
+    // once the large window has been completed, the postponed task can be launched
+    executing.erase(find(begin(executing), end(executing), C));
+    REQUIRE(!TaskScheduler::is_rate_limited(B, executing));
+
+    instances.clear();
+    Gate::deallocate(gates, num_gates);
+    pma.unregister_thread();
+}
+
+TEST_CASE("density_tuner"){
+    DensityTuner tuner { /* segment capacity */ 32 };
+
+    // nothing happened, keep the current density
+    REQUIRE(tuner.tune(0.75) == 0.75);
+
+    // scans only, the density should move towards the upper bound
+    double density = 0.75;
+    for(int i = 0; i < 10; i++){
+        tuner.record_update();
+        tuner.record_scan(32 * 1000);
+        double next = tuner.tune(density);
+        REQUIRE(next >= density);
+        REQUIRE(next <= tuner.density_max());
+        density = next;
+    }
+    REQUIRE(density > 0.85);
+
+    // updates only, with expensive rebalances, the density should drop to the lower bound
+    for(int i = 0; i < 10; i++){
+        for(int j = 0; j < 100; j++){ tuner.record_update(); }
+        tuner.record_rebalance(100 * 1000);
+        double next = tuner.tune(density);
+        REQUIRE(next <= density);
+        REQUIRE(next >= tuner.density_min());
+        density = next;
+    }
+    REQUIRE(density == tuner.density_min());
+}
+
+TEST_CASE("multi_thread_density_tuner"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 100000;
+
+    // the primary density is revised at each resize
+    Options options;
+    options.m_adaptive_densities = true;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_threads);
+    REQUIRE(pma.get_primary_density() == 0.75);
+
+    // insert all keys, the first thread also scans a range from time to time
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 29 };
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_threads){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                pma.insert(key, key * 10);
+                if(thread_id == 0 && pos % 1000 == 0){ pma.sum(key, key + 100); }
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join(); // Zzz
+    pma.on_complete();
+
+    // an update intensive workload should have lowered the density
+    REQUIRE(pma.get_primary_density() < 0.75);
+    REQUIRE(pma.get_primary_density() >= 0.6);
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    for(int64_t min = 1; min <= num_elts; min += 4999){
+        int64_t max = std::min<int64_t>(num_elts, min + 3 * min / 2);
+        auto sum = pma.sum(min, max);
+        REQUIRE(sum.m_first_key == min);
+        REQUIRE(sum.m_last_key == max);
+        REQUIRE(sum.m_num_elements == max - min +1);
+        REQUIRE(sum.m_sum_keys == (min + max) * (max - min +1) / 2);
+        REQUIRE(sum.m_sum_values == (min + max) * (max - min +1) / 2 * 10);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("multi_thread_online_resize"){
+    data_structures::initialise();
+    constexpr int num_writers = 6;
+    constexpr int num_readers = 2;
+    constexpr int64_t num_elts = 100000;
+
+    // while the array is resized, the readers keep accessing the old storage and the writers defer their updates
+    Options options;
+    options.m_online_resize = true;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_writers + num_readers);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 31 };
+    auto is_deleted = [](int64_t key){ return key % 3 == 0; };
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+    auto run_workers = [&](auto fn){
+        atomic<bool> writers_done = false;
+        vector<thread> threads;
+        for(int worker_id = 0; worker_id < num_writers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                for(int64_t pos = thread_id; pos < num_elts; pos += num_writers){ fn(sampler.get_raw_key(pos) +1); }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int worker_id = num_writers; worker_id < num_writers + num_readers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                int64_t key = thread_id;
+                while(!writers_done){
+                    key = (key * 7919) % num_elts +1;
+                    int64_t value = pma.find(key);
+                    if(value != -1 && value != key * 10){ num_errors++; } // the update may be still pending
+                    auto sum = pma.sum(key, key + 100);
+                    if(sum.m_num_elements > 101){ num_errors++; }
+                }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int i = 0; i < num_writers; i++) threads[i].join();
+        writers_done = true;
+        for(int i = num_writers; i < num_writers + num_readers; i++) threads[i].join();
+        pma.on_complete(); // wait for the deferred updates to be loaded
+        REQUIRE(num_errors == 0);
+    };
+
+    // upsizes
+    run_workers([&](int64_t key){ pma.insert(key, key * 10); });
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    pma.unregister_thread();
+
+    // downsizes
+    run_workers([&](int64_t key){ if(!is_deleted(key)) pma.remove(key); });
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts / 3);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == (is_deleted(i) ? i * 10 : -1));
+    }
+    for(int64_t min = 1; min <= num_elts; min += 4999){
+        int64_t max = std::min<int64_t>(num_elts, min + 3 * min / 2);
+        auto sum = pma.sum(min, max);
+        int64_t expected_count = 0, expected_sum = 0;
+        for(int64_t key = min; key <= max; key++){
+            if(is_deleted(key)){ expected_count++; expected_sum += key; }
+        }
+        REQUIRE(sum.m_num_elements == expected_count);
+        REQUIRE(sum.m_sum_keys == expected_sum);
+        REQUIRE(sum.m_sum_values == expected_sum * 10);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("multi_thread_rebalance_snapshots"){
+    data_structures::initialise();
+    constexpr int num_writers = 6;
+    constexpr int num_readers = 2;
+    constexpr int64_t num_elts = 100000;
+
+    // the point lookups & the sums on a window being rebalanced are served from a copy of the window
+    Options options;
+    options.m_rebalance_snapshots = true;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_writers + num_readers);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 37 };
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+    atomic<bool> writers_done = false;
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_writers; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_writers){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                pma.insert(key, key * 10);
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(int worker_id = num_writers; worker_id < num_writers + num_readers; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            int64_t key = thread_id;
+            while(!writers_done){
+                key = (key * 7919) % num_elts +1;
+                int64_t value = pma.find(key);
+                if(value != -1 && value != key * 10){ num_errors++; }
+                auto sum = pma.sum(key, key + 1000);
+                if(sum.m_num_elements > 1001 || sum.m_sum_values != sum.m_sum_keys * 10){ num_errors++; }
+                if(sum.m_num_elements > 0 && (sum.m_first_key < key || sum.m_last_key > key + 1000 || sum.m_first_key > sum.m_last_key)){ num_errors++; }
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(int i = 0; i < num_writers; i++) threads[i].join();
+    writers_done = true;
+    for(int i = num_writers; i < num_writers + num_readers; i++) threads[i].join();
+    pma.on_complete();
+    REQUIRE(num_errors == 0);
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    for(int64_t min = 1; min <= num_elts; min += 4999){
+        int64_t max = std::min<int64_t>(num_elts, min + 3 * min / 2);
+        auto sum = pma.sum(min, max);
+        REQUIRE(sum.m_first_key == min);
+        REQUIRE(sum.m_last_key == max);
+        REQUIRE(sum.m_num_elements == max - min +1);
+        REQUIRE(sum.m_sum_keys == (min + max) * (max - min +1) / 2);
+        REQUIRE(sum.m_sum_values == (min + max) * (max - min +1) / 2 * 10);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("multi_thread_append"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 200000;
+
+    // the writers insert interleaved runs of increasing keys, staged in their buffers and appended in batches
+    Options options;
+    options.m_append_fastpath = true;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_threads);
+
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t key = thread_id +1; key <= num_elts; key += num_threads){
+                pma.insert(key, key * 10);
+                if(key % 1000 == 0 && pma.find(key) != key * 10){ num_errors++; } // a thread observes its own staged insertions
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join();
+    pma.on_complete();
+    REQUIRE(num_errors == 0);
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    for(int64_t min = 1; min <= num_elts; min += 4999){
+        int64_t max = std::min<int64_t>(num_elts, min + 3 * min / 2);
+        auto sum = pma.sum(min, max);
+        REQUIRE(sum.m_first_key == min);
+        REQUIRE(sum.m_last_key == max);
+        REQUIRE(sum.m_num_elements == max - min +1);
+        REQUIRE(sum.m_sum_keys == (min + max) * (max - min +1) / 2);
+        REQUIRE(sum.m_sum_values == (min + max) * (max - min +1) / 2 * 10);
+    }
+
+    // a run interrupted by a key out of order & by a deletion
+    for(int64_t key = num_elts +1; key <= num_elts + 100; key++){ pma.insert(key, key * 10); }
+    pma.insert(-1, -10);
+    for(int64_t key = num_elts + 101; key <= num_elts + 200; key++){ pma.insert(key, key * 10); }
+    pma.remove(num_elts + 200);
+    pma.on_complete();
+    REQUIRE(pma.size() == num_elts + 200);
+    REQUIRE(pma.find(-1) == -10);
+    REQUIRE(pma.find(num_elts + 199) == (num_elts + 199) * 10);
+    REQUIRE(pma.find(num_elts + 200) == -1);
+    { // scope for the iterator, it must be released before unregistering the thread
+        int64_t previous = numeric_limits<int64_t>::min();
+        int64_t count = 0;
+        auto it = pma.iterator();
+        while(it->hasNext()){
+            auto p = it->next();
+            REQUIRE(p.first > previous);
+            REQUIRE(p.second == p.first * 10);
+            previous = p.first;
+            count++;
+        }
+        REQUIRE(count == num_elts + 200);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("multi_thread_finger"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 200000;
+    constexpr int64_t elts_per_thread = num_elts / num_threads;
+
+    // range partitioned clients, the consecutive operations of a thread mostly hit the same or a neighbouring gate,
+    // while the array of gates is replaced by the resizes
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4 };
+    pma.set_max_number_workers(num_threads);
+
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            const int64_t start = thread_id * elts_per_thread +1;
+            const int64_t end = start + elts_per_thread; // exclusive
+            for(int64_t i = 0; i < elts_per_thread; i++){
+                int64_t key = start + (i * 7919) % elts_per_thread; // permutation of the range
+                pma.insert(key, key * 10);
+                int64_t value = pma.find(key);
+                if(value != -1 && value != key * 10){ num_errors++; } // the insertion may be still pending
+                int64_t key_next = end + i % 100; // the range of the next thread
+                value = pma.find(key_next);
+                if(value != -1 && value != key_next * 10){ num_errors++; }
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join();
+    pma.on_complete();
+    REQUIRE(num_errors == 0);
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    for(int64_t min = 1; min <= num_elts; min += 4999){
+        int64_t max = std::min<int64_t>(num_elts, min + 3 * min / 2);
+        auto sum = pma.sum(min, max);
+        REQUIRE(sum.m_num_elements == max - min +1);
+        REQUIRE(sum.m_sum_keys == (min + max) * (max - min +1) / 2);
+
+        // start the iterator from the middle of the array
+        auto it = pma.find(min, max);
+        int64_t expected = min;
+        while(it->hasNext()){
+            auto p = it->next();
+            REQUIRE(p.first == expected);
+            REQUIRE(p.second == expected * 10);
+            expected++;
+        }
+        REQUIRE(expected == max +1);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("multi_thread_learned_index"){
+    data_structures::initialise();
+    constexpr int num_writers = 6;
+    constexpr int num_readers = 2;
+    constexpr int64_t num_elts = 100000;
+
+    // the keys are routed to the gates by the learned index, retrained at each resize
+    Options options;
+    options.m_learned_index = true;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_writers + num_readers);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 41 };
+    auto is_deleted = [](int64_t key){ return key % 3 == 0; };
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+    auto run_workers = [&](auto fn){
+        atomic<bool> writers_done = false;
+        vector<thread> threads;
+        for(int worker_id = 0; worker_id < num_writers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                for(int64_t pos = thread_id; pos < num_elts; pos += num_writers){ fn(sampler.get_raw_key(pos) +1); }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int worker_id = num_writers; worker_id < num_writers + num_readers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                int64_t key = thread_id;
+                while(!writers_done){
+                    key = (key * 7919) % num_elts +1;
+                    int64_t value = pma.find(key);
+                    if(value != -1 && value != key * 10){ num_errors++; }
+                    auto sum = pma.sum(key, key + 100);
+                    if(sum.m_num_elements > 101 || sum.m_sum_values != sum.m_sum_keys * 10){ num_errors++; }
+                }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int i = 0; i < num_writers; i++) threads[i].join();
+        writers_done = true;
+        for(int i = num_writers; i < num_writers + num_readers; i++) threads[i].join();
+        pma.on_complete();
+        REQUIRE(num_errors == 0);
+    };
+
+    // upsizes
+    run_workers([&](int64_t key){ pma.insert(key, key * 10); });
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    pma.unregister_thread();
+
+    // downsizes
+    run_workers([&](int64_t key){ if(!is_deleted(key)) pma.remove(key); });
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts / 3);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == (is_deleted(i) ? i * 10 : -1));
+    }
+    for(int64_t min = 1; min <= num_elts; min += 4999){
+        int64_t max = std::min<int64_t>(num_elts, min + 3 * min / 2);
+        auto sum = pma.sum(min, max);
+        int64_t expected_count = max / 3 - (min -1) / 3;
+        REQUIRE(sum.m_num_elements == expected_count);
+    }
+    pma.unregister_thread();
+}
+
+TEST_CASE("multi_thread_delta_buffers"){
+    data_structures::initialise();
+    constexpr int num_writers = 6;
+    constexpr int num_readers = 2;
+    constexpr int64_t num_elts = 100000;
+
+    // the insertions are absorbed by a buffer of 32 elements per gate, merged with the segments by the readers
+    Options options;
+    options.m_delta_buffer_capacity = 32;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_writers + num_readers);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 43 };
+    auto is_deleted = [](int64_t key){ return key % 3 == 0; };
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+    auto run_workers = [&](auto fn){
+        atomic<bool> writers_done = false;
+        vector<thread> threads;
+        for(int worker_id = 0; worker_id < num_writers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                for(int64_t pos = thread_id; pos < num_elts; pos += num_writers){ fn(sampler.get_raw_key(pos) +1); }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int worker_id = num_writers; worker_id < num_writers + num_readers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                int64_t key = thread_id;
+                while(!writers_done){
+                    key = (key * 7919) % num_elts +1;
+                    int64_t value = pma.find(key);
+                    if(value != -1 && value != key * 10){ num_errors++; }
+                    auto sum = pma.sum(key, key + 100);
+                    if(sum.m_num_elements > 101 || sum.m_sum_values != sum.m_sum_keys * 10){ num_errors++; }
+                    int64_t previous = key -1;
+                    auto it = pma.find(key, key + 100);
+                    while(it->hasNext()){
+                        auto e = it->next();
+                        if(e.first <= previous || e.first > key + 100 || e.second != e.first * 10){ num_errors++; }
+                        previous = e.first;
+                    }
+                }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int i = 0; i < num_writers; i++) threads[i].join();
+        writers_done = true;
+        for(int i = num_writers; i < num_writers + num_readers; i++) threads[i].join();
+        pma.on_complete();
+        REQUIRE(num_errors == 0);
+    };
+    auto validate = [&](auto is_present){
+        pma.register_thread(0);
+        int64_t expected_count = 0;
+        for(int64_t i = 1; i <= num_elts; i++){
+            REQUIRE(pma.find(i) == (is_present(i) ? i * 10 : -1));
+            expected_count += is_present(i);
+        }
+        REQUIRE(pma.size() == expected_count);
+        auto sum = pma.sum(1, num_elts);
+        REQUIRE(sum.m_num_elements == expected_count);
+        REQUIRE(sum.m_sum_values == sum.m_sum_keys * 10);
+        for(int64_t min = 1; min <= num_elts; min += 4999){
+            int64_t max = std::min<int64_t>(num_elts, min + 3 * min / 2);
+            int64_t expected_key = min;
+            auto it = pma.find(min, max);
+            while(it->hasNext()){
+                while(!is_present(expected_key)) expected_key++;
+                auto e = it->next();
+                REQUIRE(e.first == expected_key);
+                REQUIRE(e.second == expected_key * 10);
+                expected_key++;
+            }
+            while(expected_key <= max && !is_present(expected_key)) expected_key++;
+            REQUIRE(expected_key > max);
+        }
+        pma.unregister_thread();
+    };
+
+    // upsizes
+    run_workers([&](int64_t key){ pma.insert(key, key * 10); });
+    validate([](int64_t){ return true; });
+
+    // downsizes
+    run_workers([&](int64_t key){ if(!is_deleted(key)) pma.remove(key); });
+    validate(is_deleted);
+}
+
+TEST_CASE("multi_thread_delta_buffers_snapshots"){
+    data_structures::initialise();
+    constexpr int num_writers = 4;
+    constexpr int num_readers = 4;
+    constexpr int64_t num_elts = 200000;
+
+    // the elements moved from the delta buffers to the bulk loading queues must still be visible through the snapshots
+    Options options;
+    options.m_rebalance_snapshots = true;
+    options.m_delta_buffer_capacity = 8;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_writers + num_readers);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 53 };
+    constexpr int64_t history_length = 64;
+    vector<atomic<int64_t>> published(num_writers * history_length); // the last keys inserted & confirmed by each writer
+    for(auto& key : published) key = 0;
+    atomic<bool> writers_done = false;
+    atomic<int64_t> num_lookups = 0;
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_writers; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            int64_t num_published = 0;
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_writers){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                pma.insert(key, key * 10);
+                if(pma.find(key) == key * 10){ // once observed, a key must remain visible
+                    published[thread_id * history_length + (num_published++ % history_length)] = key;
+                }
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(int worker_id = num_writers; worker_id < num_writers + num_readers; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            uint64_t i = thread_id;
+            while(!writers_done){
+                int64_t key = published[i++ % published.size()];
+                if(key == 0) continue;
+                if(pma.find(key) != key * 10){ num_errors++; }
+                auto sum = pma.sum(key, key);
+                if(sum.m_num_elements != 1 || sum.m_sum_values != key * 10){ num_errors++; }
+                num_lookups++;
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(int i = 0; i < num_writers; i++) threads[i].join();
+    writers_done = true;
+    for(int i = num_writers; i < num_writers + num_readers; i++) threads[i].join();
+    pma.on_complete();
+    REQUIRE(num_lookups > 0);
+    REQUIRE(num_errors == 0);
+
+    pma.register_thread(0);
+    for(int64_t key = 1; key <= num_elts; key++){ REQUIRE(pma.find(key) == key * 10); }
+    REQUIRE(pma.size() == num_elts);
+    auto sum = pma.sum(1, num_elts);
+    REQUIRE(sum.m_num_elements == num_elts);
+    REQUIRE(sum.m_sum_values == sum.m_sum_keys * 10);
+    pma.unregister_thread();
+}
+
+TEST_CASE("delta_buffers_empty_storage"){
+    data_structures::initialise();
+    Options options;
+    options.m_delta_buffer_capacity = 8;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 2, /* segments per lock */ 2,
+        /* delay */ 0ms, options };
+    pma.register_thread(0);
+    REQUIRE(pma.empty());
+
+    // the first element goes into the storage, the second one into the delta buffer of the gate
+    pma.insert(10, 100);
+    pma.insert(20, 200);
+    REQUIRE(pma.size() == 2);
+
+    // the storage is now empty, but the container is not
+    pma.remove(10);
+    REQUIRE(!pma.empty());
+    REQUIRE(pma.size() == 1);
+    REQUIRE(pma.find(20) == 200);
+
+    // the next insertion goes through the segments of the gate, next to the buffered element
+    pma.insert(30, 300);
+    REQUIRE(pma.size() == 2);
+    REQUIRE(pma.find(10) == -1);
+    REQUIRE(pma.find(20) == 200);
+    REQUIRE(pma.find(30) == 300);
+    auto sum = pma.sum(0, 100);
+    REQUIRE(sum.m_num_elements == 2);
+    REQUIRE(sum.m_sum_keys == 50);
+
+    pma.remove(20);
+    pma.remove(30);
+    REQUIRE(pma.empty());
+    REQUIRE(pma.find(20) == -1);
+    REQUIRE(pma.find(30) == -1);
+
+    pma.unregister_thread();
+}
+
+TEST_CASE("multi_thread_lookup_filters"){
+    data_structures::initialise();
+    constexpr int num_writers = 6;
+    constexpr int num_readers = 2;
+    constexpr int64_t num_elts = 100000;
+
+    // only the even keys are inserted, the lookups for the odd keys should be answered by the filters
+    Options options;
+    options.m_lazy_deletes = true;
+    options.m_filter_bits_per_key = 8;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_writers + num_readers);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 47 };
+    auto is_deleted = [](int64_t key){ return key % 3 == 0; };
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+    auto run_workers = [&](auto fn){
+        atomic<bool> writers_done = false;
+        vector<thread> threads;
+        for(int worker_id = 0; worker_id < num_writers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                for(int64_t pos = thread_id; pos < num_elts; pos += num_writers){ fn((sampler.get_raw_key(pos) +1) * 2); }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int worker_id = num_writers; worker_id < num_writers + num_readers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                int64_t key = thread_id;
+                while(!writers_done){
+                    key = (key * 7919) % (2 * num_elts) +1;
+                    int64_t value = pma.find(key);
+                    if((value != -1 && value != key * 10) || (key % 2 == 1 && value != -1)){ num_errors++; }
+                }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int i = 0; i < num_writers; i++) threads[i].join();
+        writers_done = true;
+        for(int i = num_writers; i < num_writers + num_readers; i++) threads[i].join();
+        pma.on_complete();
+        REQUIRE(num_errors == 0);
+    };
+    auto validate = [&](auto is_present){
+        pma.register_thread(0);
+        int64_t expected_count = 0;
+        for(int64_t i = 1; i <= 2 * num_elts +1; i++){
+            bool present = i % 2 == 0 && i <= 2 * num_elts && is_present(i / 2);
+            REQUIRE(pma.find(i) == (present ? i * 10 : -1));
+            expected_count += present;
+        }
+        REQUIRE(pma.size() == expected_count);
+        pma.unregister_thread();
+    };
+
+    // upsizes
+    run_workers([&](int64_t key){ pma.insert(key, key * 10); });
+    validate([](int64_t){ return true; });
+
+    // downsizes, the removed keys may linger in the filters until the segments are rebuilt
+    run_workers([&](int64_t key){ if(!is_deleted(key / 2)) pma.remove(key); });
+    validate(is_deleted);
+}
+
+TEST_CASE("multi_thread_read_cache"){
+    data_structures::initialise();
+    constexpr int num_writers = 4;
+    constexpr int num_readers = 4;
+    constexpr int64_t num_elts = 100000;
+    constexpr int64_t num_hot_keys = 256; // the keys [1, num_hot_keys] are the target of most lookups
+
+    Options options;
+    options.m_lazy_deletes = true;
+    options.m_read_cache_capacity = 1024;
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 4, /* segments per lock */ 4,
+        /* delay */ 0ms, options };
+    pma.set_max_number_workers(num_writers + num_readers);
+    REQUIRE(pma.read_cache() != nullptr);
+
+    // the readers check that the values observed for a key only move forwards, `stage' maps a value to its position or -1 if invalid
+    atomic<int64_t> num_errors = 0; // Catch's assertions are not thread safe
+    auto run_workers = [&](auto writer_fn, auto stage){
+        atomic<bool> writers_done = false;
+        vector<thread> threads;
+        for(int worker_id = 0; worker_id < num_writers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                writer_fn(thread_id);
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int worker_id = num_writers; worker_id < num_writers + num_readers; worker_id++){
+            threads.emplace_back([&](int thread_id){
+                pma.register_thread(thread_id);
+                vector<int> last_stage(num_hot_keys +1, 0); // the last stage observed for each hot key
+                int64_t key = thread_id;
+                while(!writers_done){
+                    key = (key * 7919) % num_hot_keys +1;
+                    int current_stage = stage(key, pma.find(key));
+                    if(current_stage < last_stage[key]){ num_errors++; } // -1 if invalid
+                    last_stage[key] = max(last_stage[key], current_stage);
+                }
+                pma.unregister_thread();
+            }, worker_id);
+        }
+        for(int i = 0; i < num_writers; i++) threads[i].join();
+        writers_done = true;
+        for(int i = num_writers; i < num_writers + num_readers; i++) threads[i].join();
+        pma.on_complete();
+        REQUIRE(num_errors == 0);
+    };
+
+    // load the keys, while the readers repeatedly look up the hot keys
+    run_workers([&](int thread_id){
+        for(int64_t key = num_elts - thread_id; key > 0; key -= num_writers){ pma.insert(key, key * 10); }
+    }, [](int64_t key, int64_t value){ return value == -1 ? 0 : value == key * 10 ? 1 : -1; });
+    REQUIRE(pma.read_cache()->num_hits() > 0);
+
+    // update the hot keys, the readers should never observe a value invalidated by the writers
+    run_workers([&](int thread_id){
+        for(int64_t key = thread_id +1; key <= num_hot_keys; key += num_writers){
+            pma.remove(key);
+            pma.insert(key, key * 100);
+        }
+    }, [](int64_t key, int64_t value){ return value == key * 10 ? 0 : value == -1 ? 1 : value == key * 100 ? 2 : -1; });
+
+    pma.register_thread(0);
+    for(int64_t key = 1; key <= num_elts; key++){
+        REQUIRE(pma.find(key) == (key <= num_hot_keys ? key * 100 : key * 10));
+    }
+
+    // a removal must invalidate the entry for the key just cached
+    for(int64_t key = 1; key <= num_hot_keys; key += 2){
+        REQUIRE(pma.find(key) == key * 100);
+        REQUIRE(pma.find(key) == key * 100); // served by the cache
+        pma.remove(key);
+        REQUIRE(pma.find(key) == -1);
+    }
+
+    // downsize the array, the cache is cleared when the new gates are installed
+    for(int64_t key = num_hot_keys +1; key <= num_elts; key++){
+        if(key % 8 != 0){ pma.remove(key); }
+    }
+    pma.on_complete();
+    for(int64_t key = 1; key <= num_elts; key++){
+        bool present = key <= num_hot_keys ? key % 2 == 0 : key % 8 == 0;
+        int64_t expected_value = !present ? -1 : key <= num_hot_keys ? key * 100 : key * 10;
+        REQUIRE(pma.find(key) == expected_value);
+    }
+    REQUIRE(pma.size() == num_hot_keys / 2 + (num_elts - num_hot_keys) / 8);
+    pma.unregister_thread();
+}
+
+TEST_CASE("search_strategies"){
+    data_structures::initialise();
+    using SearchStrategy = data_structures::rma::common::segment_kernels::SearchStrategy;
+    constexpr int64_t num_elts = 20000;
+
+    for(auto strategy : { SearchStrategy::LINEAR, SearchStrategy::SIMD_LINEAR, SearchStrategy::BINARY, SearchStrategy::INTERPOLATION, SearchStrategy::ADAPTIVE }){
+        // large segments, to also take the interpolation search in the adaptive strategy
+        PackedMemoryArray pma { /* block size */ 17, /* segment size */ 256, /* pages per extent */ 8, /* worker threads */ 2, /* segments per lock */ 4 };
+        pma.knobs().m_search_strategy = strategy;
+        pma.register_thread(0);
+
+        // keys in (0, 3 * num_elts], with gaps
+        distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 23 };
+        for(int64_t pos = 0; pos < num_elts; pos++){
+            int64_t key = (sampler.get_raw_key(pos) +1) * 3;
+            pma.insert(key, key * 10);
+        }
+        pma.on_complete();
+        REQUIRE(pma.size() == num_elts);
+        for(int64_t key = 1; key <= 3 * num_elts; key++){
+            REQUIRE(pma.find(key) == (key % 3 == 0 ? key * 10 : -1));
+        }
+
+        // remove the odd keys
+        for(int64_t key = 3; key <= 3 * num_elts; key += 6){ pma.remove(key); }
+        pma.on_complete();
+        REQUIRE(pma.size() == num_elts / 2);
+        for(int64_t key = 3; key <= 3 * num_elts; key += 3){
+            REQUIRE(pma.find(key) == (key % 6 == 0 ? key * 10 : -1));
+        }
+        for(int64_t min = 1; min <= 3 * num_elts; min += 4999){
+            int64_t max = std::min<int64_t>(3 * num_elts, min + 3 * min / 2);
+            auto sum = pma.sum(min, max);
+            REQUIRE(sum.m_num_elements == max / 6 - (min -1) / 6);
+            REQUIRE(sum.m_sum_values == sum.m_sum_keys * 10);
+        }
+
+        pma.unregister_thread();
+    }
+}
+
 TEST_CASE("multi_thread_sequential"){
     data_structures::initialise();
     constexpr int num_threads = 8;
@@ -282,6 +282,81 @@ TEST_CASE("multi_thread_global_rebal"){
     REQUIRE(pma.empty());
 }
 
+TEST_CASE("multi_thread_sync_updates"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 200000;
+
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 2, /* segments per lock */ 4 };
+    pma.set_update_mode(PackedMemoryArray::UpdateMode::SYNC);
+    pma.set_max_number_workers(num_threads);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 11 };
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_threads){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                pma.insert(key, key * 10);
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join(); // Zzz
+    REQUIRE(pma.size() == num_elts);
+
+    // with synchronous updates, each writer reports the value removed
+    threads.resize(0);
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_threads){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                int64_t value = pma.remove(key);
+                REQUIRE(value == key * 10);
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join(); // Zzz
+
+    REQUIRE(pma.size() == 0);
+    REQUIRE(pma.empty());
+}
+
+TEST_CASE("multi_thread_read_your_writes"){
+    data_structures::initialise();
+    constexpr int num_threads = 8;
+    constexpr int64_t num_elts = 200000;
+
+    PackedMemoryArray pma { /* block size */ 17, /* segment size */ 32, /* pages per extent */ 1, /* worker threads */ 2, /* segments per lock */ 4 };
+    pma.set_update_mode(PackedMemoryArray::UpdateMode::ASYNC_READ_YOUR_WRITES);
+    pma.set_max_number_workers(num_threads);
+
+    distributions::RandomPermutationParallel sampler{ num_elts, /* seed */ 13 };
+    vector<thread> threads;
+    for(int worker_id = 0; worker_id < num_threads; worker_id++){
+        threads.emplace_back([&](int thread_id){
+            pma.register_thread(thread_id);
+            for(int64_t pos = thread_id; pos < num_elts; pos += num_threads){
+                int64_t key = sampler.get_raw_key(pos) +1;
+                pma.insert(key, key * 10);
+                REQUIRE(pma.find(key) == key * 10); // the update may have been forwarded, but it must be already visible
+            }
+            pma.unregister_thread();
+        }, worker_id);
+    }
+    for(auto& t : threads) t.join(); // Zzz
+
+    pma.register_thread(0);
+    REQUIRE(pma.size() == num_elts);
+    for(int64_t i = 1; i <= num_elts; i++){
+        REQUIRE(pma.find(i) == i * 10);
+    }
+    pma.unregister_thread();
+}
+
 TEST_CASE("multi_thread_sequential"){
     data_structures::initialise();
     constexpr int num_threads = 8;
@@ -0,0 +1,194 @@
+/**
+ * Copyright (C) 2018 Dean De Leo, email: dleo[at]cwi.nl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#define CATCH_CONFIG_MAIN
+#include "third-party/catch/catch.hpp"
+
+#include "rma/common/segment_kernels.hpp"
+
+using namespace data_structures::rma::common;
+using namespace std;
+
+// capacities with a specialised kernel (32 ... 1024) and a few without
+static const size_t capacities[] = { 8, 17, 32, 48, 64, 128, 256, 512, 1024 };
+
+TEST_CASE("search"){
+    mt19937_64 random_generator(42);
+
+    for(size_t capacity : capacities){
+        for(size_t n = 0; n <= capacity; n++){
+            // keys with duplicates
+            vector<int64_t> keys(n);
+            for(size_t i = 0; i < n; i++) keys[i] = random_generator() % (capacity +1);
+            sort(begin(keys), end(keys));
+
+            for(int64_t key = -1; key <= static_cast<int64_t>(capacity) +1; key++){
+                size_t expected_lb = lower_bound(begin(keys), end(keys), key) - begin(keys);
+                size_t expected_ub = upper_bound(begin(keys), end(keys), key) - begin(keys);
+                REQUIRE(segment_kernels::lower_bound(keys.data(), n, key, capacity) == expected_lb);
+                REQUIRE(segment_kernels::upper_bound(keys.data(), n, key, capacity) == expected_ub);
+            }
+        }
+    }
+}
+
+static const segment_kernels::SearchStrategy strategies[] = {
+        segment_kernels::SearchStrategy::LINEAR, segment_kernels::SearchStrategy::SIMD_LINEAR, segment_kernels::SearchStrategy::BINARY,
+        segment_kernels::SearchStrategy::INTERPOLATION, segment_kernels::SearchStrategy::ADAPTIVE };
+static const char* strategy_names[] = { "linear", "simd", "binary", "interpolation", "adaptive" };
+
+// sorted keys: 0 = dense sequence, 1 = uniform, 2 = skewed (clustered at the start), 3 = spread over the whole domain
+static vector<int64_t> generate_keys(mt19937_64& random_generator, size_t n, int distribution){
+    vector<int64_t> keys(n);
+    for(size_t i = 0; i < n; i++){
+        switch(distribution){
+        case 0: keys[i] = static_cast<int64_t>(i) * 2; break;
+        case 1: keys[i] = random_generator() % (n * 16 +1); break;
+        case 2: keys[i] = static_cast<int64_t>(pow(static_cast<double>(random_generator() % 1000000) / 1000000, 8) * n * 1000); break;
+        default: keys[i] = static_cast<int64_t>(random_generator()); break;
+        }
+    }
+    if(distribution == 3 && n >= 2){ keys[0] = numeric_limits<int64_t>::min(); keys[1] = numeric_limits<int64_t>::max(); }
+    sort(begin(keys), end(keys));
+    return keys;
+}
+
+TEST_CASE("search_strategies"){
+    mt19937_64 random_generator(42);
+
+    for(auto strategy : strategies){
+        for(size_t capacity : capacities){
+            for(int distribution = 0; distribution < 4; distribution++){
+                for(size_t n = 0; n <= capacity; n += (n < 64) ? 1 : 7){
+                    auto keys = generate_keys(random_generator, n, distribution);
+
+                    // the keys in the segment, their neighbours & a few random keys
+                    vector<int64_t> probes { numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max(), -1, 0 };
+                    for(auto k : keys){
+                        probes.push_back(k);
+                        if(k > numeric_limits<int64_t>::min()) probes.push_back(k -1);
+                        if(k < numeric_limits<int64_t>::max()) probes.push_back(k +1);
+                    }
+                    for(int i = 0; i < 16; i++) probes.push_back(n > 0 ? keys[0] + random_generator() % (n * 16 +1) : 0);
+
+                    for(auto key : probes){
+                        size_t expected_lb = lower_bound(begin(keys), end(keys), key) - begin(keys);
+                        size_t expected_ub = upper_bound(begin(keys), end(keys), key) - begin(keys);
+                        REQUIRE(segment_kernels::lower_bound(keys.data(), n, key, capacity, strategy) == expected_lb);
+                        REQUIRE(segment_kernels::upper_bound(keys.data(), n, key, capacity, strategy) == expected_ub);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Microbenchmark, not run by default. Execute it with `tests/test_segment_kernels "[.benchmark]"'
+ * Time of a point lookup in a segment, for each search strategy, segment size & distribution of the keys.
+ */
+TEST_CASE("benchmark_search_strategies", "[.benchmark]"){
+    const size_t num_segments = 1024; // to not measure the search in the same cache lines over and over
+    const size_t num_lookups = 1ull << 20;
+    const char* distribution_names[] = { "dense", "uniform", "skewed", "sparse" };
+    mt19937_64 random_generator(42);
+
+    cout << setw(10) << "capacity" << setw(10) << "keys" << setw(16) << "strategy" << setw(14) << "ns/lookup" << "\n";
+    for(size_t capacity : { 32, 64, 128, 256, 512, 1024, 2048, 4096 }){
+        for(int distribution = 0; distribution < 4; distribution++){
+            vector<int64_t> keys;
+            keys.reserve(num_segments * capacity);
+            for(size_t i = 0; i < num_segments; i++){
+                auto segment = generate_keys(random_generator, capacity, distribution);
+                keys.insert(end(keys), begin(segment), end(segment));
+            }
+            vector<int64_t> lookups(num_lookups);
+            for(auto& lookup : lookups) lookup = random_generator() % (num_segments * capacity);
+
+            for(size_t j = 0; j < sizeof(strategies) / sizeof(strategies[0]); j++){
+                size_t checksum = 0;
+                auto t0 = chrono::steady_clock::now();
+                for(auto lookup : lookups){
+                    const int64_t* segment = keys.data() + (lookup / capacity) * capacity;
+                    checksum += segment_kernels::lower_bound(segment, capacity, segment[lookup % capacity], capacity, strategies[j]);
+                }
+                auto t1 = chrono::steady_clock::now();
+                REQUIRE(checksum <= num_lookups * capacity);
+                cout << setw(10) << capacity << setw(10) << distribution_names[distribution] << setw(16) << strategy_names[j] << setw(14) <<
+                        fixed << setprecision(2) << static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count()) / num_lookups << "\n";
+            }
+        }
+    }
+}
+
+TEST_CASE("insert_remove"){
+    mt19937_64 random_generator(42);
+
+    for(size_t capacity : capacities){
+        for(bool is_even : { true, false }){
+            vector<int64_t> keys(capacity), values(capacity);
+            vector<int64_t> expected; // sorted content of the segment
+
+            // fill the segment
+            for(size_t sz = 0; sz < capacity; sz++){
+                int64_t key = random_generator() % capacity;
+                size_t position = is_even ?
+                        segment_kernels::insert_even(keys.data(), values.data(), capacity, sz, key, key * 10) :
+                        segment_kernels::insert_odd(keys.data(), values.data(), capacity, sz, key, key * 10);
+                REQUIRE(keys[position] == key);
+                expected.insert(upper_bound(begin(expected), end(expected), key), key);
+
+                size_t start = is_even ? capacity - sz -1 : 0;
+                for(size_t i = 0; i <= sz; i++){
+                    REQUIRE(keys[start + i] == expected[i]);
+                    REQUIRE(values[start + i] == expected[i] * 10);
+                }
+            }
+
+            // empty the segment
+            for(size_t sz = capacity; sz > 0; sz--){
+                int64_t key = expected[random_generator() % sz];
+                REQUIRE(segment_kernels::find(keys.data(), capacity, sz, is_even, capacity +1) == capacity); // not present
+                size_t position = segment_kernels::find(keys.data(), capacity, sz, is_even, key);
+                REQUIRE(position < capacity);
+                REQUIRE(keys[position] == key);
+                REQUIRE(values[position] == key * 10);
+                if(is_even){
+                    segment_kernels::remove_even(keys.data(), values.data(), capacity, sz, position);
+                } else {
+                    segment_kernels::remove_odd(keys.data(), values.data(), sz, position);
+                }
+                expected.erase(lower_bound(begin(expected), end(expected), key));
+
+                size_t start = is_even ? capacity - sz +1 : 0;
+                for(size_t i = 0; i < sz -1; i++){
+                    REQUIRE(keys[start + i] == expected[i]);
+                    REQUIRE(values[start + i] == expected[i] * 10);
+                }
+            }
+        }
+    }
+}
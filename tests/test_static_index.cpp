@@ -153,3 +153,25 @@ TEST_CASE("height6"){
         REQUIRE(index.find((i+1) * 10 +1) == i);
     }
 }
+
+TEST_CASE("power_of_node_size"){
+    // 17^3 keys, both as the whole tree and as the rightmost subtree of a larger tree
+    for(size_t num_keys : { 4913, 4 * 4913 }){
+        StaticIndex index(/* node size */ 17, /* number of keys */ num_keys);
+        REQUIRE(index.height() == (num_keys == 4913 ? 3 : 4));
+        for(int i = 0; i < num_keys; i++){
+            index.set_separator_key(i, (i+1) * 10);
+        } // 10, 20, 30, 40, 50, 60, 70, etc.
+
+        for(int i = 0; i < num_keys; i++) {
+            REQUIRE(index.get_separator_key(i) == (i+1) * 10);
+        }
+
+        // check
+        for(int i = 0; i < num_keys; i++){
+            REQUIRE(index.find((i+1) * 10 -1) == max(i -1, 0));
+            REQUIRE(index.find((i+1) * 10) == i);
+            REQUIRE(index.find((i+1) * 10 +1) == i);
+        }
+    }
+}
@@ -42,6 +42,17 @@ SELECT
 	CASE WHEN pUpdateThreads.value IS NULL THEN 0 ELSE CAST(pUpdateThreads.value AS INT) END AS parallelism_updates,
 	CASE WHEN pScanThreads.value IS NULL THEN 0 ELSE CAST(pScanThreads.value AS INT) END AS parallelism_scans,
 	CASE WHEN pDelay.value IS NULL THEN 0 ELSE CAST(pDelay.value AS INT) END AS delay_millisecs,
+	CASE
+		WHEN pDelayAdaptive.value IS NULL THEN 0
+		WHEN pDelayAdaptive.value = '1' OR pDelayAdaptive.value = 'true' THEN 1
+		ELSE 0
+	END AS delay_adaptive,
+	CASE WHEN pDensity.value IS NULL THEN 0.75 ELSE CAST(pDensity.value AS real) END AS primary_density,
+	CASE
+		WHEN pDensityTuner.value IS NULL THEN 0
+		WHEN pDensityTuner.value = '1' OR pDensityTuner.value = 'true' THEN 1
+		ELSE 0
+	END AS density_tuner,
 	timeStart AS timeStart,
 	timeEnd AS timeEnd
 FROM executions e
@@ -73,6 +84,10 @@ FROM executions e
 	LEFT JOIN parameters pUpdateThreads ON (e.id = pUpdateThreads.exec_id AND pUpdateThreads.name = 'thread_inserts')
 	LEFT JOIN parameters pScanThreads ON (e.id = pScanThreads.exec_id AND pScanThreads.name = 'thread_scans')
 	LEFT JOIN parameters pDelay ON (e.id = pDelay.exec_id AND pDelay.name = 'delay')
+	LEFT JOIN parameters pDelayAdaptive ON (e.id = pDelayAdaptive.exec_id AND pDelayAdaptive.name = 'delay_adaptive')
+	 /* The upper density of the primary thresholds in rma_batch, fixed or tuned at runtime */
+	LEFT JOIN parameters pDensity ON (e.id = pDensity.exec_id AND pDensity.name = 'apma_density')
+	LEFT JOIN parameters pDensityTuner ON (e.id = pDensityTuner.exec_id AND pDensityTuner.name = 'apma_density_tuner')
 ;
   
 /**
@@ -97,6 +112,9 @@ SELECT
 	e.parallelism_scans,
 	(e.parallelism_updates + e.parallelism_scans) AS parallelism_degree,
 	e.delay_millisecs,
+	e.delay_adaptive,
+	e.primary_density,
+	e.density_tuner,
 	t.time_insert AS completion_time_microsecs,
 	(CAST(e.num_insertions AS REAL) / t.time_insert) * 1000 * 1000 AS insert_throughput,
 	(CAST(t.num_elements_scan AS REAL) / t.time_insert) * 1000 * 1000 AS scan_throughput
@@ -127,6 +145,9 @@ SELECT
 	e.parallelism_scans,
 	(e.parallelism_updates + e.parallelism_scans) AS parallelism_degree,
 	e.delay_millisecs,
+	e.delay_adaptive,
+	e.primary_density,
+	e.density_tuner,
 	t.updates AS num_updates,
 	t.t_updates_millisecs AS updates_completion_time_millisecs,
 	(CAST(t.updates AS REAL) / t.t_updates_millisecs) * 1000 AS updates_throughput,
@@ -134,4 +155,78 @@ SELECT
 	(CAST(t.scan_updates AS REAL) / t.t_updates_millisecs) * 1000 AS scan_throughput
 FROM parallel_idls t
 JOIN view_executions e ON (t.exec_id = e.exec_id)
-;
\ No newline at end of file
+;
+
+/**
+ * Adaptive vs fixed delays for the rebalances in rma_batch, experiment 'parallel_insert'. Execute the same
+ * configuration with a sweep of --delay=N and with --delay_adaptive, then compare the average throughput of
+ * the adaptive controller with the best and the worst fixed delay.
+ * -- It depends on the view `view_parallel_insert'
+ */
+CREATE VIEW view_delay_comparison AS
+WITH
+	runs AS (
+		SELECT algorithm, size, distribution, alpha, beta, extent_size, parallelism_updates, parallelism_scans, delay_millisecs, delay_adaptive,
+			AVG(insert_throughput) AS insert_throughput, COUNT(*) AS num_runs
+		FROM view_parallel_insert
+		WHERE algorithm = 'rma_batch'
+		GROUP BY algorithm, size, distribution, alpha, beta, extent_size, parallelism_updates, parallelism_scans, delay_millisecs, delay_adaptive
+	),
+	fixed AS (
+		SELECT size, distribution, alpha, beta, extent_size, parallelism_updates, parallelism_scans,
+			MAX(insert_throughput) AS best_throughput, MIN(insert_throughput) AS worst_throughput, COUNT(*) AS num_delays
+		FROM runs
+		WHERE delay_adaptive = 0
+		GROUP BY size, distribution, alpha, beta, extent_size, parallelism_updates, parallelism_scans
+	)
+SELECT
+	a.size, a.distribution, a.alpha, a.beta, a.extent_size, a.parallelism_updates, a.parallelism_scans,
+	a.delay_millisecs AS adaptive_max_delay_millisecs,
+	a.insert_throughput AS adaptive_throughput,
+	f.best_throughput AS best_fixed_throughput,
+	f.worst_throughput AS worst_fixed_throughput,
+	f.num_delays AS num_fixed_delays,
+	a.insert_throughput / f.best_throughput AS speedup_vs_best_fixed
+FROM runs a
+JOIN fixed f ON (a.size = f.size AND a.distribution = f.distribution AND a.alpha = f.alpha AND a.beta = f.beta AND a.extent_size = f.extent_size
+	AND a.parallelism_updates = f.parallelism_updates AND a.parallelism_scans = f.parallelism_scans)
+WHERE a.delay_adaptive = 1
+;
+
+/**
+ * Density tuner vs static primary densities in rma_batch, experiment 'parallel_insert' with concurrent scans. Execute the
+ * same configuration with a sweep of --apma_density=N and with --apma_density_tuner, then compare the insert & scan
+ * throughput of the tuner with the best static density for each metric.
+ * -- It depends on the view `view_parallel_insert'
+ */
+CREATE VIEW view_density_comparison AS
+WITH
+	runs AS (
+		SELECT algorithm, size, distribution, alpha, beta, extent_size, parallelism_updates, parallelism_scans, primary_density, density_tuner,
+			AVG(insert_throughput) AS insert_throughput, AVG(scan_throughput) AS scan_throughput, COUNT(*) AS num_runs
+		FROM view_parallel_insert
+		WHERE algorithm = 'rma_batch'
+		GROUP BY algorithm, size, distribution, alpha, beta, extent_size, parallelism_updates, parallelism_scans, primary_density, density_tuner
+	),
+	static AS (
+		SELECT size, distribution, alpha, beta, extent_size, parallelism_updates, parallelism_scans,
+			MAX(insert_throughput) AS best_insert_throughput, MAX(scan_throughput) AS best_scan_throughput, COUNT(*) AS num_densities
+		FROM runs
+		WHERE density_tuner = 0
+		GROUP BY size, distribution, alpha, beta, extent_size, parallelism_updates, parallelism_scans
+	)
+SELECT
+	a.size, a.distribution, a.alpha, a.beta, a.extent_size, a.parallelism_updates, a.parallelism_scans,
+	a.primary_density AS tuner_initial_density,
+	a.insert_throughput AS tuner_insert_throughput,
+	a.scan_throughput AS tuner_scan_throughput,
+	s.best_insert_throughput AS best_static_insert_throughput,
+	s.best_scan_throughput AS best_static_scan_throughput,
+	s.num_densities AS num_static_densities,
+	a.insert_throughput / s.best_insert_throughput AS insert_ratio_vs_best_static,
+	a.scan_throughput / s.best_scan_throughput AS scan_ratio_vs_best_static
+FROM runs a
+JOIN static s ON (a.size = s.size AND a.distribution = s.distribution AND a.alpha = s.alpha AND a.beta = s.beta AND a.extent_size = s.extent_size
+	AND a.parallelism_updates = s.parallelism_updates AND a.parallelism_scans = s.parallelism_scans)
+WHERE a.density_tuner = 1
+;